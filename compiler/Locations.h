@@ -0,0 +1 @@
+#define PACKAGE_CONF_STRING "/root/repo/libraries/package.conf"
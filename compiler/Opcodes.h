@@ -0,0 +1,130 @@
+#ifndef _LAMBDACHINE_OPCODES_H
+#define _LAMBDACHINE_OPCODES_H
+
+/* DO NOT EDIT.  This is an auto-generated file. */
+/* See utils/genopcodes.cc */
+
+#define branch_BIAS 0x8000
+#define cMAX_CALL_ARGS 13
+
+#define opc_ISLT 0
+#define opc_ISGE 1
+#define opc_ISLE 2
+#define opc_ISGT 3
+#define opc_ISEQ 4
+#define opc_ISNE 5
+#define opc_ISLTU 6
+#define opc_ISGEU 7
+#define opc_ISLEU 8
+#define opc_ISGTU 9
+#define opc_NEG 10
+#define opc_MOV 11
+#define opc_MOV_RES 12
+#define opc_UPDATE 13
+#define opc_LOADF 14
+#define opc_LOADFV 15
+#define opc_LOADBH 16
+#define opc_LOADSLF 17
+#define opc_INITF 18
+#define opc_ADDRR 19
+#define opc_SUBRR 20
+#define opc_MULRR 21
+#define opc_DIVRR 22
+#define opc_REMRR 23
+#define opc_CMPLT 24
+#define opc_CMPGE 25
+#define opc_CMPLE 26
+#define opc_CMPGT 27
+#define opc_CMPEQ 28
+#define opc_CMPNE 29
+#define opc_CMPLTU 30
+#define opc_CMPGEU 31
+#define opc_CMPLEU 32
+#define opc_CMPGTU 33
+#define opc_BNOT 34
+#define opc_BAND 35
+#define opc_BOR 36
+#define opc_BXOR 37
+#define opc_BSHL 38
+#define opc_BSHR 39
+#define opc_BSAR 40
+#define opc_BROL 41
+#define opc_BROR 42
+#define opc_PTROFSC 43
+#define opc_GETTAG 44
+#define opc_LOADK 45
+#define opc_KINT 46
+#define opc_NEW_INT 47
+#define opc_ALLOC1 48
+#define opc_ALLOC 49
+#define opc_ALLOCAP 50
+#define opc_CALL 51
+#define opc_CALLT 52
+#define opc_RET1 53
+#define opc_RETN 54
+#define opc_JMP 55
+#define opc_EVAL 56
+#define opc_CASE 57
+#define opc_CASE_S 58
+#define opc_RAISE 59
+#define opc_NEWBYTEA 60
+#define opc_GETA1 61
+#define opc_GETA2 62
+#define opc_GETA4 63
+#define opc_GETA8 64
+#define opc_SETA1 65
+#define opc_SETA2 66
+#define opc_SETA4 67
+#define opc_SETA8 68
+#define opc_FUNC 69
+#define opc_IFUNC 70
+#define opc_JFUNC 71
+#define opc_FUNCPAP 72
+#define opc_JRET 73
+#define opc_IRET 74
+#define opc_SYNC 75
+#define opc_STOP 76
+#define opc_ISLTD 77
+#define opc_ISGED 78
+#define opc_ISLED 79
+#define opc_ISGTD 80
+#define opc_ISEQD 81
+#define opc_ISNED 82
+#define opc_NEGD 83
+#define opc_SQRTD 84
+#define opc_I2D 85
+#define opc_D2I 86
+#define opc_ADDD 87
+#define opc_SUBD 88
+#define opc_MULD 89
+#define opc_DIVD 90
+#define opc_CMPLTD 91
+#define opc_CMPGED 92
+#define opc_CMPLED 93
+#define opc_CMPGTD 94
+#define opc_CMPEQD 95
+#define opc_CMPNED 96
+
+#define littype_INT 0
+#define littype_WORD 3
+#define littype_CHAR 2
+#define littype_FLOAT 4
+#define littype_DOUBLE 8
+#define littype_STRING 1
+#define littype_CLOSURE 5
+#define littype_INFO 6
+
+#define cltype_INVALID_OBJECT 0
+#define cltype_CONSTR 1
+#define cltype_FUN 2
+#define cltype_THUNK 3
+#define cltype_IND 4
+#define cltype_CAF 5
+#define cltype_PAP 6
+#define cltype_LARGE 7
+#define cltype_AP_CONT 8
+#define cltype_STATIC_IND 9
+#define cltype_UPDATE_FRAME 10
+#define cltype_BLACKHOLE 11
+
+#endif
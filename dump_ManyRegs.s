@@ -0,0 +1,146 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x89
+	.byte 0x44
+	.byte 0x24
+	.byte 0x30
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x75
+	.byte 0x8
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x7d
+	.byte 0x10
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x6d
+	.byte 0x18
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xd8
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xde
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xd0
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xd7
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xc8
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xcd
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xc6
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xc7
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xfe
+	.byte 0x49
+	.byte 0x3
+	.byte 0xfd
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xf7
+	.byte 0x49
+	.byte 0x3
+	.byte 0xf5
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xd8
+	.byte 0x49
+	.byte 0x3
+	.byte 0xdb
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xd0
+	.byte 0x49
+	.byte 0x3
+	.byte 0xd2
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xc8
+	.byte 0x49
+	.byte 0x3
+	.byte 0xc9
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc7
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x6d
+	.byte 0x78
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x6c
+	.byte 0x24
+	.byte 0x30
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x7d
+	.byte 0x70
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x75
+	.byte 0x68
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x6d
+	.byte 0x60
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x48
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x55
+	.byte 0x40
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x38
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x45
+	.byte 0x30
+	.byte 0x48
+	.byte 0x89
+	.byte 0x7d
+	.byte 0x28
+	.byte 0x48
+	.byte 0x89
+	.byte 0x75
+	.byte 0x20
+	.byte 0x48
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x18
+	.byte 0x48
+	.byte 0x89
+	.byte 0x55
+	.byte 0x10
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x0
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
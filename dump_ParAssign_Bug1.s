@@ -0,0 +1,27 @@
+.text
+dump:
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xf3
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xdd
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xee
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x44
+	.byte 0x24
+	.byte 0x40
+	.byte 0x48
+	.byte 0x89
+	.byte 0x7c
+	.byte 0x24
+	.byte 0x38
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x30
+	.byte 0xc3
@@ -0,0 +1,12 @@
+.text
+dump:
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xfb
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xd8
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xc7
+	.byte 0xc3
@@ -0,0 +1,6 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xc7
+	.byte 0xc3
@@ -0,0 +1,37 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x81
+	.byte 0xc0
+	.byte 0xd2
+	.byte 0x4
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x81
+	.byte 0xc0
+	.byte 0xd2
+	.byte 0x4
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0xc7
+	.byte 0x45
+	.byte 0x8
+	.byte 0xd2
+	.byte 0x4
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x0
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
@@ -0,0 +1,35 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0xb9
+	.byte 0x34
+	.byte 0x12
+	.byte 0x0
+	.byte 0x0
+	.byte 0x5
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc1
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc1
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x0
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
@@ -0,0 +1,78 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0xb9
+	.byte 0x83
+	.byte 0x67
+	.byte 0x45
+	.byte 0x23
+	.byte 0x1
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0xb8
+	.byte 0xd2
+	.byte 0x8c
+	.byte 0x52
+	.byte 0x6a
+	.byte 0x74
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x4d
+	.byte 0x8d
+	.byte 0x64
+	.byte 0x24
+	.byte 0x18
+	.byte 0x4c
+	.byte 0x3b
+	.byte 0x24
+	.byte 0x24
+	.byte 0xf
+	.byte 0x87
+	.byte 0x29
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x49
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0xe8
+	.byte 0x49
+	.byte 0xc7
+	.byte 0x44
+	.byte 0x24
+	.byte 0xf0
+	.byte 0x5
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x49
+	.byte 0x89
+	.byte 0x44
+	.byte 0x24
+	.byte 0xf8
+	.byte 0x49
+	.byte 0x8d
+	.byte 0x44
+	.byte 0x24
+	.byte 0xe8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x8
+	.byte 0x48
+	.byte 0xc7
+	.byte 0x45
+	.byte 0x0
+	.byte 0x22
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x4
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
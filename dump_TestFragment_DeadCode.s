@@ -0,0 +1,19 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x83
+	.byte 0xc0
+	.byte 0xfb
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x0
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
@@ -0,0 +1,99 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x89
+	.byte 0x44
+	.byte 0x24
+	.byte 0x40
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x38
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x5d
+	.byte 0x10
+	.byte 0x48
+	.byte 0x99
+	.byte 0x48
+	.byte 0xf7
+	.byte 0xf9
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xf8
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x44
+	.byte 0x24
+	.byte 0x40
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x7c
+	.byte 0x24
+	.byte 0x30
+	.byte 0x48
+	.byte 0x99
+	.byte 0x48
+	.byte 0xf7
+	.byte 0xf9
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xca
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x44
+	.byte 0x24
+	.byte 0x38
+	.byte 0x48
+	.byte 0x99
+	.byte 0x48
+	.byte 0xf7
+	.byte 0xfb
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xda
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x54
+	.byte 0x24
+	.byte 0x30
+	.byte 0x48
+	.byte 0xb8
+	.byte 0xf3
+	.byte 0x68
+	.byte 0x54
+	.byte 0x6a
+	.byte 0x74
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x18
+	.byte 0x48
+	.byte 0x89
+	.byte 0x55
+	.byte 0x10
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x0
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
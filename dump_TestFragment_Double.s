@@ -0,0 +1,112 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0xb9
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0xe0
+	.byte 0x3f
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x10
+	.byte 0x55
+	.byte 0x0
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x10
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x10
+	.byte 0xf
+	.byte 0x28
+	.byte 0xc2
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x58
+	.byte 0xc1
+	.byte 0x66
+	.byte 0xf
+	.byte 0x2e
+	.byte 0xca
+	.byte 0xf
+	.byte 0x86
+	.byte 0x45
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x66
+	.byte 0xf
+	.byte 0x2e
+	.byte 0xd1
+	.byte 0x7a
+	.byte 0x6
+	.byte 0xf
+	.byte 0x84
+	.byte 0x3d
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x59
+	.byte 0xc2
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x5e
+	.byte 0xc1
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x51
+	.byte 0xc0
+	.byte 0xf
+	.byte 0x57
+	.byte 0xc9
+	.byte 0xf2
+	.byte 0x48
+	.byte 0xf
+	.byte 0x2a
+	.byte 0xc8
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x5c
+	.byte 0xc1
+	.byte 0xf2
+	.byte 0x48
+	.byte 0xf
+	.byte 0x2c
+	.byte 0xc0
+	.byte 0x66
+	.byte 0x48
+	.byte 0xf
+	.byte 0x6e
+	.byte 0xd1
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x59
+	.byte 0xc2
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x11
+	.byte 0x4d
+	.byte 0x10
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x8
+	.byte 0xf2
+	.byte 0xf
+	.byte 0x11
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x8
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
@@ -0,0 +1,55 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0xb9
+	.byte 0xd2
+	.byte 0x8c
+	.byte 0x52
+	.byte 0x6a
+	.byte 0x74
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x55
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x8
+	.byte 0x48
+	.byte 0x81
+	.byte 0x3a
+	.byte 0xd2
+	.byte 0x4
+	.byte 0x0
+	.byte 0x0
+	.byte 0xf
+	.byte 0x85
+	.byte 0x16
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x3b
+	.byte 0x8
+	.byte 0xf
+	.byte 0x85
+	.byte 0x11
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0xc7
+	.byte 0x45
+	.byte 0x0
+	.byte 0x19
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x8
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
@@ -0,0 +1,94 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x5d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x4d
+	.byte 0x10
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x30
+	.byte 0x48
+	.byte 0x83
+	.byte 0xfb
+	.byte 0x0
+	.byte 0xf
+	.byte 0x8e
+	.byte 0x41
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x83
+	.byte 0xf9
+	.byte 0x0
+	.byte 0xf
+	.byte 0x8e
+	.byte 0x3b
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xf1
+	.byte 0x48
+	.byte 0x3
+	.byte 0xf0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xfb
+	.byte 0x48
+	.byte 0x83
+	.byte 0xc7
+	.byte 0xff
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x30
+	.byte 0x48
+	.byte 0x83
+	.byte 0xff
+	.byte 0x0
+	.byte 0xf
+	.byte 0x8e
+	.byte 0x23
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xc6
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc1
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xcb
+	.byte 0x48
+	.byte 0x83
+	.byte 0xc1
+	.byte 0xfe
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xf0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xdf
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xf9
+	.byte 0xe9
+	.byte 0xd6
+	.byte 0xff
+	.byte 0xff
+	.byte 0xff
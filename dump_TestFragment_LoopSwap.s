@@ -0,0 +1,68 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x5d
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x75
+	.byte 0x8
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x7d
+	.byte 0x10
+	.byte 0x48
+	.byte 0x83
+	.byte 0xff
+	.byte 0x0
+	.byte 0xf
+	.byte 0x8e
+	.byte 0x2c
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xc7
+	.byte 0x49
+	.byte 0x83
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x49
+	.byte 0x83
+	.byte 0xf8
+	.byte 0x0
+	.byte 0xf
+	.byte 0x8e
+	.byte 0x1f
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xc7
+	.byte 0x48
+	.byte 0x83
+	.byte 0xc0
+	.byte 0xfe
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xf8
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xc0
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xfe
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xf3
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xdf
+	.byte 0xe9
+	.byte 0xdb
+	.byte 0xff
+	.byte 0xff
+	.byte 0xff
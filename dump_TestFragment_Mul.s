@@ -0,0 +1,75 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0xb8
+	.byte 0xf3
+	.byte 0x68
+	.byte 0x54
+	.byte 0x6a
+	.byte 0x74
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x75
+	.byte 0x8
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x7d
+	.byte 0x10
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xd0
+	.byte 0x48
+	.byte 0xf
+	.byte 0xaf
+	.byte 0xd6
+	.byte 0x48
+	.byte 0x6b
+	.byte 0xce
+	.byte 0x85
+	.byte 0x48
+	.byte 0x69
+	.byte 0xdf
+	.byte 0x39
+	.byte 0x30
+	.byte 0x0
+	.byte 0x0
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x45
+	.byte 0x30
+	.byte 0x48
+	.byte 0x89
+	.byte 0x7d
+	.byte 0x28
+	.byte 0x48
+	.byte 0x89
+	.byte 0x75
+	.byte 0x20
+	.byte 0x48
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x18
+	.byte 0x48
+	.byte 0x89
+	.byte 0x55
+	.byte 0x10
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x0
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
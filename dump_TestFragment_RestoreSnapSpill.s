@@ -0,0 +1,497 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x5d
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x7d
+	.byte 0x8
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x10
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x18
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x7d
+	.byte 0x20
+	.byte 0x4c
+	.byte 0x89
+	.byte 0xbc
+	.byte 0x24
+	.byte 0x98
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xf3
+	.byte 0x48
+	.byte 0x3
+	.byte 0xf3
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xcb
+	.byte 0x48
+	.byte 0x3
+	.byte 0xcf
+	.byte 0x48
+	.byte 0x89
+	.byte 0x8c
+	.byte 0x24
+	.byte 0x80
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xf3
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xf0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xcb
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x30
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xd7
+	.byte 0x48
+	.byte 0x3
+	.byte 0xd3
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xcf
+	.byte 0x48
+	.byte 0x3
+	.byte 0xcf
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x38
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xcf
+	.byte 0x49
+	.byte 0x3
+	.byte 0xc8
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xff
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xf8
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x7c
+	.byte 0x24
+	.byte 0x40
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xd0
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xd3
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xc8
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xcf
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x48
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xe8
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xe8
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xd8
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xd8
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x5c
+	.byte 0x24
+	.byte 0x50
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xf8
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xfb
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xd8
+	.byte 0x48
+	.byte 0x3
+	.byte 0xdf
+	.byte 0x48
+	.byte 0x89
+	.byte 0x5c
+	.byte 0x24
+	.byte 0x58
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xf8
+	.byte 0x49
+	.byte 0x3
+	.byte 0xf8
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0xc0
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xc0
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x44
+	.byte 0x24
+	.byte 0x60
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x45
+	.byte 0x28
+	.byte 0x48
+	.byte 0x89
+	.byte 0x84
+	.byte 0x24
+	.byte 0x90
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x84
+	.byte 0x24
+	.byte 0x98
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xf0
+	.byte 0x48
+	.byte 0x89
+	.byte 0xb4
+	.byte 0x24
+	.byte 0x88
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xb4
+	.byte 0x24
+	.byte 0x80
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xf0
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xf0
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x74
+	.byte 0x24
+	.byte 0x68
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x74
+	.byte 0x24
+	.byte 0x30
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xf0
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xd0
+	.byte 0x48
+	.byte 0x89
+	.byte 0x54
+	.byte 0x24
+	.byte 0x70
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x54
+	.byte 0x24
+	.byte 0x38
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xd0
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xc8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x78
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x40
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xc8
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xd0
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xc8
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xe8
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xd8
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xf8
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xd8
+	.byte 0x48
+	.byte 0x2b
+	.byte 0xf8
+	.byte 0x4c
+	.byte 0x2b
+	.byte 0xc0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x84
+	.byte 0x24
+	.byte 0x90
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x83
+	.byte 0xf8
+	.byte 0x0
+	.byte 0xf
+	.byte 0x85
+	.byte 0xc4
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x84
+	.byte 0x24
+	.byte 0x88
+	.byte 0x0
+	.byte 0x0
+	.byte 0x0
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc6
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x74
+	.byte 0x24
+	.byte 0x68
+	.byte 0x49
+	.byte 0x3
+	.byte 0xf6
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x74
+	.byte 0x24
+	.byte 0x70
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xf2
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x54
+	.byte 0x24
+	.byte 0x78
+	.byte 0x48
+	.byte 0x3
+	.byte 0xd1
+	.byte 0x49
+	.byte 0x8b
+	.byte 0xca
+	.byte 0x49
+	.byte 0x3
+	.byte 0xc9
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xcd
+	.byte 0x4d
+	.byte 0x3
+	.byte 0xcb
+	.byte 0x4d
+	.byte 0x8b
+	.byte 0xdf
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xdb
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xdf
+	.byte 0x49
+	.byte 0x3
+	.byte 0xd8
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x44
+	.byte 0x24
+	.byte 0x78
+	.byte 0x48
+	.byte 0x3
+	.byte 0xc6
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x74
+	.byte 0x24
+	.byte 0x70
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xf2
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x54
+	.byte 0x24
+	.byte 0x68
+	.byte 0x49
+	.byte 0x3
+	.byte 0xc9
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x60
+	.byte 0x4c
+	.byte 0x3
+	.byte 0xdb
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x5c
+	.byte 0x24
+	.byte 0x58
+	.byte 0x49
+	.byte 0x3
+	.byte 0xc6
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x74
+	.byte 0x24
+	.byte 0x50
+	.byte 0x49
+	.byte 0x3
+	.byte 0xcb
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x5c
+	.byte 0x24
+	.byte 0x48
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x78
+	.byte 0x4c
+	.byte 0x8b
+	.byte 0x4c
+	.byte 0x24
+	.byte 0x40
+	.byte 0x48
+	.byte 0x89
+	.byte 0x7d
+	.byte 0x70
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x7c
+	.byte 0x24
+	.byte 0x38
+	.byte 0x48
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x68
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x5c
+	.byte 0x24
+	.byte 0x30
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x7d
+	.byte 0x60
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x75
+	.byte 0x58
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x6d
+	.byte 0x50
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x48
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x55
+	.byte 0x40
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x38
+	.byte 0x4c
+	.byte 0x89
+	.byte 0x45
+	.byte 0x30
+	.byte 0x48
+	.byte 0x89
+	.byte 0x7d
+	.byte 0x28
+	.byte 0x48
+	.byte 0x89
+	.byte 0x75
+	.byte 0x20
+	.byte 0x48
+	.byte 0x89
+	.byte 0x5d
+	.byte 0x18
+	.byte 0x48
+	.byte 0x89
+	.byte 0x55
+	.byte 0x10
+	.byte 0x48
+	.byte 0x89
+	.byte 0x4d
+	.byte 0x8
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x4
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
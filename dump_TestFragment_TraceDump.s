@@ -0,0 +1,32 @@
+.text
+dump:
+	.byte 0x48
+	.byte 0x8b
+	.byte 0x4d
+	.byte 0x0
+	.byte 0x48
+	.byte 0x8b
+	.byte 0xc1
+	.byte 0x48
+	.byte 0x83
+	.byte 0xc0
+	.byte 0x5
+	.byte 0x48
+	.byte 0x83
+	.byte 0xf9
+	.byte 0x5
+	.byte 0xf
+	.byte 0x8d
+	.byte 0x9
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
+	.byte 0x48
+	.byte 0x89
+	.byte 0x45
+	.byte 0x0
+	.byte 0xe9
+	.byte 0x4
+	.byte 0x0
+	.byte 0xc0
+	.byte 0xff
@@ -0,0 +1,135 @@
+.text
+stub_group_0:
+	.byte 0x6a
+	.byte 0x0
+	.byte 0xeb
+	.byte 0x7a
+	.byte 0x6a
+	.byte 0x1
+	.byte 0xeb
+	.byte 0x76
+	.byte 0x6a
+	.byte 0x2
+	.byte 0xeb
+	.byte 0x72
+	.byte 0x6a
+	.byte 0x3
+	.byte 0xeb
+	.byte 0x6e
+	.byte 0x6a
+	.byte 0x4
+	.byte 0xeb
+	.byte 0x6a
+	.byte 0x6a
+	.byte 0x5
+	.byte 0xeb
+	.byte 0x66
+	.byte 0x6a
+	.byte 0x6
+	.byte 0xeb
+	.byte 0x62
+	.byte 0x6a
+	.byte 0x7
+	.byte 0xeb
+	.byte 0x5e
+	.byte 0x6a
+	.byte 0x8
+	.byte 0xeb
+	.byte 0x5a
+	.byte 0x6a
+	.byte 0x9
+	.byte 0xeb
+	.byte 0x56
+	.byte 0x6a
+	.byte 0xa
+	.byte 0xeb
+	.byte 0x52
+	.byte 0x6a
+	.byte 0xb
+	.byte 0xeb
+	.byte 0x4e
+	.byte 0x6a
+	.byte 0xc
+	.byte 0xeb
+	.byte 0x4a
+	.byte 0x6a
+	.byte 0xd
+	.byte 0xeb
+	.byte 0x46
+	.byte 0x6a
+	.byte 0xe
+	.byte 0xeb
+	.byte 0x42
+	.byte 0x6a
+	.byte 0xf
+	.byte 0xeb
+	.byte 0x3e
+	.byte 0x6a
+	.byte 0x10
+	.byte 0xeb
+	.byte 0x3a
+	.byte 0x6a
+	.byte 0x11
+	.byte 0xeb
+	.byte 0x36
+	.byte 0x6a
+	.byte 0x12
+	.byte 0xeb
+	.byte 0x32
+	.byte 0x6a
+	.byte 0x13
+	.byte 0xeb
+	.byte 0x2e
+	.byte 0x6a
+	.byte 0x14
+	.byte 0xeb
+	.byte 0x2a
+	.byte 0x6a
+	.byte 0x15
+	.byte 0xeb
+	.byte 0x26
+	.byte 0x6a
+	.byte 0x16
+	.byte 0xeb
+	.byte 0x22
+	.byte 0x6a
+	.byte 0x17
+	.byte 0xeb
+	.byte 0x1e
+	.byte 0x6a
+	.byte 0x18
+	.byte 0xeb
+	.byte 0x1a
+	.byte 0x6a
+	.byte 0x19
+	.byte 0xeb
+	.byte 0x16
+	.byte 0x6a
+	.byte 0x1a
+	.byte 0xeb
+	.byte 0x12
+	.byte 0x6a
+	.byte 0x1b
+	.byte 0xeb
+	.byte 0xe
+	.byte 0x6a
+	.byte 0x1c
+	.byte 0xeb
+	.byte 0xa
+	.byte 0x6a
+	.byte 0x1d
+	.byte 0xeb
+	.byte 0x6
+	.byte 0x6a
+	.byte 0x1e
+	.byte 0xeb
+	.byte 0x2
+	.byte 0x6a
+	.byte 0x1f
+	.byte 0x6a
+	.byte 0x0
+	.byte 0xe9
+	.byte 0xdf
+	.byte 0x8d
+	.byte 0x53
+	.byte 0xdb
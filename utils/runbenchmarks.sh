@@ -10,11 +10,11 @@ Bench.Nofib.Spectral.Circsim
 Bench.Fibon.Agum.Main"
 for bench in ${BENCHMARKS}; do
     echo "=== ${bench}"
-    ./lcvm -e bench ${bench} --stack=10m
+    ./lcvm -e bench ${bench}
 done
 
 BENCHMARKS2="Bench.Fibon.Agum.Main"
 for bench in ${BENCHMARKS2}; do
     echo "=== ${bench}"
-    ./lcvm -e test ${bench} --stack=10m
+    ./lcvm -e test ${bench}
 done
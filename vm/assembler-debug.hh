@@ -45,7 +45,8 @@ static void ra_dprintf(Assembler *as, const char *fmt, ...)
       Reg r = va_arg(argp, Reg) & RID_MASK;
       if (r <= RID_MAX) {
 	const char *q;
-	for (q = regNames64[r]; *q; q++)
+	for (q = r < RID_MAX_GPR ? regNames64[r] : fpRegNames[r - RID_MIN_FPR];
+	     *q; q++)
 	  *p++ = *q >= 'A' && *q <= 'Z' ? *q + 0x20 : *q;
       } else {
 	*p++ = '?';
@@ -1,5 +1,9 @@
 #include "assembler.hh"
 #include "jit.hh"
+#include "memorymanager.hh"
+#include "capability.hh"
+#include "thread.hh"
+#include "perfmap.hh"
 #include "ir-inl.hh"
 
 #include <iostream>
@@ -78,11 +82,24 @@ void Assembler::setupMachineCode(MachineCode *mcode) {
   mctop = mcode->reserve(&mcbot);
   mcend = mctop;
   mcp = mctop;
+  setupLimit(mcode);
+}
+
+void Assembler::setupLimit(MachineCode *mcode) {
   mclim = mcbot + MCLIM_REDZONE;
+  if (mcode->traceLimit() > mclim)
+    mclim = mcode->traceLimit();
+}
+
+// Gives up on the current trace if it doesn't fit into the machine
+// code area.  The JIT then flushes the area.
+inline void Assembler::checkLimit() {
+  if (LC_UNLIKELY(mcp < mclim))
+    throw (int)IROPTERR_MCODE_FULL;
 }
 
 void Assembler::setupRegAlloc() {
-  freeset_ = kGPR;
+  freeset_ = kAllocRegs;
   modset_ = RegSet();
   //  weakset_ =
   phiset_ = RegSet();
@@ -105,6 +122,7 @@ void Assembler::setupRegAlloc() {
 void Assembler::setup(IRBuffer *buf) {
   numHeapChecks_ = buf->setHeapOffsets();
   mcQuickHeapCheck_ = NULL;
+  mcLoop_ = NULL;
 
   setupRegAlloc();
 
@@ -293,9 +311,15 @@ void Assembler::emit_gmrmi(x86Group xg, Reg rb, int32_t i) {
 
 void Assembler::move(Reg dst, Reg src) {
   if (dst < RID_MAX_GPR) {
-    emit_rr(XO_MOV, REX_64 | dst, REX_64 | src);
+    if (src < RID_MAX_GPR)
+      emit_rr(XO_MOV, REX_64 | dst, REX_64 | src);
+    else  // movq r64, xmm
+      emit_rr(XO_MOVDto, REX_64 | src, dst);
   } else { // XMM registers
-    emit_rr(XO_MOVAPS, dst, src);
+    if (src < RID_MAX_GPR)  // movq xmm, r64
+      emit_rr(XO_MOVD, REX_64 | dst, src);
+    else
+      emit_rr(XO_MOVAPS, dst, src);
   }
 }
 
@@ -401,6 +425,10 @@ inline int32_t Assembler::spillOffset(uint8_t spillSlot) const {
   return SPILL_SP_OFFS + sizeof(Word) * spillSlot;
 }
 
+inline RegSet Assembler::regClass(IRRef ref) {
+  return buf_->inFloatReg(ref) ? kFPR : kGPR;
+}
+
 int32_t Assembler::spill(IR *ins) {
   int32_t slot = ins->spill();
   if (slot == 0) {
@@ -421,6 +449,7 @@ Reg Assembler::restoreReg(IRRef ref) {
     setHint(ins, r);  // Keep hint.
     freeReg(r);
     RA_DBGX((this, "restore   $i $r", ins, r));
+    modifiedReg(r);
     load_u64(r, RID_ESP, ofs);
     //    store_u64(RID_BASE, ofs, r);
     return r;
@@ -428,7 +457,7 @@ Reg Assembler::restoreReg(IRRef ref) {
 }
 
 #define MINCOST(name) \
-  if (kGPR.test(RID_##name) && /* constant-foldable */ \
+  if (kAllocRegs.test(RID_##name) && /* constant-foldable */ \
       LC_LIKELY(allow.test(RID_##name)) && \
       cost_[RID_##name].raw() < cost.raw())     \
     cost = cost_[RID_##name];
@@ -436,14 +465,15 @@ Reg Assembler::restoreReg(IRRef ref) {
 Reg Assembler::evictReg(RegSet allow) {
   IRRef ref;
   RegCost cost = kMaxCost;
+  // PHI registers must hold their value until the loop back-edge.
+  allow = allow.intersect(phiset_.complement());
   LC_ASSERT(!allow.isEmpty());
-  if (allow.raw() < (1 << RID_MAX_GPR)) {
-    // Unrolled linear search for register with smallest cost.
+  // Unrolled linear search for register with smallest cost.
+  if (!allow.intersect(kGPR).isEmpty()) {
     GPRDEF(MINCOST);
-  } else {
-    cerr << "Trying to evict FP regs. (allow="
-         << hex << allow.raw() << ", max_gpr=" << RID_MAX_GPR << ')' << endl;
-    exit(13);
+  }
+  if (!allow.intersect(kFPR).isEmpty()) {
+    FPRDEF(MINCOST);
   }
   ref = cost.ref();
   return restoreReg(ref);
@@ -489,7 +519,17 @@ Reg Assembler::alloc1(IRRef ref, RegSet allow) {
 
 Reg Assembler::destReg(IR *ins, RegSet allow) {
   Reg dest = ins->reg();
-  if (isReg(dest)) {
+  if (isReg(dest) && !allow.test(dest)) {
+    // The result is used in a register of the other class (e.g., a
+    // double stored into a heap object).  Compute it into a register
+    // that the instruction can write and move it over afterwards.
+    Reg r = dest;
+    freeReg(r);
+    modifiedReg(r);
+    dest = allocScratchReg(allow);
+    move(r, dest);
+    ins->setReg(dest);
+  } else if (isReg(dest)) {
     freeReg(dest);
     modifiedReg(dest);
   } else {
@@ -525,7 +565,7 @@ Reg Assembler::allocScratchReg(RegSet allow) {
 
 void Assembler::evictSet(RegSet drop) {
   RegSet work;
-  work = drop.intersect(freeset_.complement()).intersect(kGPR);
+  work = drop.intersect(freeset_.complement()).intersect(kAllocRegs);
   while (!work.isEmpty()) {
     Reg r = work.pickBot();
     restoreReg(cost_[r].ref());
@@ -548,15 +588,18 @@ void Assembler::allocLeft(Reg dest, IRRef lref) {
   Reg left = ins->reg();
   if (!isReg(left)) {
     if (irref_islit(lref)) {
-      ins->setReg(dest);
-      rematConstant(lref);
-      return;
+      if (dest < RID_MAX_GPR) {
+        ins->setReg(dest);
+        rematConstant(lref);
+        return;
+      }
+      // Constants are only materialised in GPRs.
+      left = allocRef(lref, kGPR);
+    } else {
+      if (!hasHint(left))
+        setHint(ins, dest);  // Propagate register hint.
+      left = allocRef(lref, regClass(lref));
     }
-    if (!hasHint(left))
-      setHint(ins, dest);  // Propagate register hint.
-
-    LC_ASSERT(dest < RID_MAX_GPR); // FIXME: FP support.
-    left = allocRef(lref, kGPR);
   }
   if (dest != left) {
     // TODO: Special PHI stuff here?
@@ -694,7 +737,8 @@ Assembler::bitshift(IR *ins, x86Shift xs)
     right = rins->reg();
     if (!isReg(right)) {
       right = allocRef(rref, kGPR.exclude(RID_ECX));
-    } else if (right != RID_ECX) {
+    }
+    if (right != RID_ECX) {
       // Free up ECX
       allocScratchReg(RegSet::fromReg(RID_ECX));
     }
@@ -753,6 +797,8 @@ void Assembler::divmod(IR *ins, DivModOp op, bool useSigned) {
   LC_ASSERT(right != RID_EAX && right != RID_EDX);
 
   x86Group3 xg = useSigned ? XOg_IDIV : XOg_DIV;
+  modifiedReg(RID_EAX);
+  modifiedReg(RID_EDX);
   emit_rr(XO_GROUP3, xg | REX_64, right);
   if (useSigned) {
     emit_i8(XI_CDQ);  // sign-extend rax into rdx:rax
@@ -764,6 +810,58 @@ void Assembler::divmod(IR *ins, DivModOp op, bool useSigned) {
   allocLeft(RID_EAX, ins->op1());
 }
 
+// Double arithmetic.  The operands are always in XMM registers (see
+// IRBuffer::doubleSlot), so only the right operand may be a memory
+// operand (a spill slot).
+void Assembler::fpArith(IR *ins, x86Op xo) {
+  RegSet allow = kFPR;
+  IRRef lref = ins->op1();
+  IRRef rref = ins->op2();
+
+  Reg right = ir(rref)->reg();
+  if (isReg(right)) {
+    allow.clear(right);
+  }
+  Reg dest = destReg(ins, allow);
+
+  if (!isReg(right)) {
+    allow.clear(dest);
+    right = fuseLoad(rref, allow);
+  }
+  emit_mrm(xo, dest, right);
+  allocLeft(dest, lref);
+}
+
+void Assembler::fpSqrt(IR *ins) {
+  Reg dest = destReg(ins, kFPR);
+  Reg src = fuseLoad(ins->op1(), kFPR);
+  emit_mrm(XO_SQRTSD, dest, src);
+}
+
+void Assembler::conv(IR *ins) {
+  IRRef lref = ins->op1();
+  int from = ins->op2();
+  if (from & IRCONV_RAW) {
+    // Only the register class changes.
+    Reg dest = destReg(ins, regClass(curins_));
+    Reg src = alloc1(lref, irref_islit(lref) ? kGPR : regClass(lref));
+    move(dest, src);
+  } else if (isFloatType(ins->type())) {
+    LC_ASSERT(isIntegerType((IRType)from));
+    Reg dest = destReg(ins, kFPR);
+    Reg src = alloc1(lref, kGPR);
+    emit_mrm(XO_CVTSI2SD, dest | REX_64, src);
+    // CVTSI2SD only writes the lower half of dest.  Clear it to break
+    // the dependency on its previous value.
+    emit_rr(XO_XORPS, dest, dest);
+  } else {
+    LC_ASSERT(isFloatType((IRType)from));
+    Reg dest = destReg(ins, kGPR);
+    Reg src = alloc1(lref, kFPR);
+    emit_mrm(XO_CVTTSD2SI, dest | REX_64, src);
+  }
+}
+
 bool Assembler::mergeWithParent() {
   // 1. Construct parallel assignment data.
   uint32_t p;
@@ -967,15 +1065,23 @@ void Assembler::assemble(IRBuffer *buf, MachineCode *mcode) {
   setupMachineCode(mcode);
   setupExitStubs(buf->numSnapshots(), mcode);
 
+  // The counters are handed to the Fragment by Jit::saveFragment.
+  if (jit()->getOption(Jit::kOptProfile)) {
+    uint32_t nStatCounters = 1 + buf->numSnapshots();
+    delete[] jit()->stats_;
+    jit()->stats_ = new uint64_t[nStatCounters];
+    memset(jit()->stats_, 0, sizeof(uint64_t) * nStatCounters);
+  }
+
   curins_ = nins_;
   snapno_ = buf->numSnapshots() - 1;
 
   prepareTail(buf, saveref);
+  if (buf->loop_ != 0)
+    phiMoves();
 
-#ifdef LC_TRACE_STATS
   if (jit()->stats_ != NULL)
     incrementCounter(&jit()->stats_[0]);
-#endif
 
   for (curins_--; curins_ >= stopins_; curins_--) {
     IR *ins = ir(curins_);
@@ -992,6 +1098,7 @@ void Assembler::assemble(IRBuffer *buf, MachineCode *mcode) {
       --snapno_;
     } else
       emit(ins);
+    checkLimit();
   }
 
   evictConstants();
@@ -1027,10 +1134,9 @@ void Assembler::assemble(IRBuffer *buf, MachineCode *mcode) {
       adjustHeapPointer(-(int32_t)(buf_->parentHeapReserved_ * sizeof(Word)));
     }
 
-#ifdef LC_TRACE_STATS
     // Bump the parent trace's exit counter.
-    incrementCounter(buf_->parent_->exitCounterAddress(jit()->parentExitNo_));
-#endif
+    if (buf_->parent_->stats_ != NULL)
+      incrementCounter(buf_->parent_->exitCounterAddress(jit()->parentExitNo_));
   }
 
   if (loop_entry == NULL) {
@@ -1041,7 +1147,7 @@ void Assembler::assemble(IRBuffer *buf, MachineCode *mcode) {
   if (saveref && ir(saveref)->op1() != IR_SAVE_FALLTHROUGH) {
     int save_type = ir(saveref)->op1();
     if (save_type == IR_SAVE_LOOP) {
-      target = loop_entry;
+      target = mcLoop_ != NULL ? mcLoop_ : loop_entry;
     } else if (save_type == IR_SAVE_LINK) {
       Fragment *parent = jit()->traceById(ir(saveref)->op2());
       LC_ASSERT(parent != NULL);
@@ -1052,8 +1158,9 @@ void Assembler::assemble(IRBuffer *buf, MachineCode *mcode) {
 
   buf->setRegsAllocated();
   // TODO: Save to trace fragment
-  LC_ASSERT_MSG(freeset_.raw() == kGPR.raw(),
-                "free = %x, gpr = %x\n", freeset_.raw(), kGPR.raw());
+  LC_ASSERT_MSG(freeset_.raw() == kAllocRegs.raw(),
+                "free = %x, regs = %x\n", freeset_.raw(), kAllocRegs.raw());
+  checkLimit();
   mcode->commit(mcp);
 
   RA_DBG_FLUSH();
@@ -1077,7 +1184,7 @@ Assembler::incrementCounter(uint64_t *counterAddr)
 void Assembler::emitSLOAD(IR *ins) {
   int32_t ofs = 8 * (int16_t)ins->op1();
   Reg base = RID_BASE;
-  RegSet allow = kGPR;
+  RegSet allow = regClass(curins_);
   Reg dst = destReg(ins, allow);
   load_u64(dst, base, ofs);
 }
@@ -1163,6 +1270,158 @@ void Assembler::patchFallthrough(Fragment *parent, ExitNo exitno, Fragment *targ
   patchGuard(parent, exitno, bridge_start);
 }
 
+// Compiled Exit Handlers
+// ----------------------
+//
+// A side exit that is taken often, but never gets a side trace,
+// pays for the generic Fragment::restoreSnapshot every time.  Once
+// that has happened EXIT_HANDLER_THRESHOLD times, we generate code
+// that writes the snapshot straight back into the stack frame and
+// leaves the trace, and redirect the guard to it:
+//
+//          push  %rax
+//          lea   <relbase*8>(%rbp), %rax     ; only if relbase > 0
+//          cmp   8+SPLIM_SP_OFFS(%rsp), %rax
+//          ja    generic
+//          mov   $&snap.exitCounter_, %rax
+//          cmpw  $1, (%rax)                  ; would the exit get hot?
+//          jbe   generic
+//          decw  (%rax)
+//          pop   %rax
+//          mov   %reg, <slot*8>(%rbp)        ; entries held in registers
+//          mov   <spill>(%rsp), %rax         ; spilled entries
+//          mov   %rax, <slot*8>(%rbp)
+//          movq  $<lit>, <slot*8>(%rbp)      ; literals
+//          lea   <relbase*8>(%rbp), %rbp
+//          mov   THREAD_SP_OFFS(%rsp), %rax
+//          mov   %rbp, base_(%rax)
+//          lea   <framesize*8>(%rbp), %rcx
+//          mov   %rcx, top_(%rax)
+//          mov   $<pc>, %rcx
+//          mov   %rcx, pc_(%rax)
+//          mov   owner_(%rax), %rax
+//          mov   %r12, traceExitHp_(%rax)
+//          mov   HPLIM_SP_OFFS(%rsp), %rcx
+//          mov   %rcx, traceExitHpLim_(%rax)
+//          jmp   asmLeaveTrace
+//   generic:
+//          pop   %rax
+//          jmp   <exit stub>
+//
+// The generic path still counts towards a side trace and grows the
+// stack if necessary.
+//
+// Returns NULL if the snapshot contains allocations that have not
+// been performed yet, or if the handler does not fit into the machine
+// code area.
+MCode *Assembler::exitHandler(Capability *cap, Fragment *F, ExitNo exitno) {
+  Snapshot &snap = F->snap(exitno);
+  SnapshotData *snapmap = &F->snapmap_;
+  MachineCode *mcode = jit()->mcode();
+  int32_t relbase = snap.relbase() * sizeof(Word);
+
+  if (snap.mcode_ == NULL)
+    return NULL;
+  for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se) {
+    IRRef ref = snapmap->slotRef(se);
+    if (!irref_islit(ref) && isDeferredAlloc(F->ir(ref), ref, snap))
+      return NULL;
+  }
+
+  setupMachineCode(mcode);
+  // Each entry needs at most 18 bytes, everything else < 160 bytes.
+  if (mcp - mclim < snap.entries() * 18 + 160) {
+    mcode->abort();
+    return NULL;
+  }
+
+  emit_jmp(exitstubAddr(exitno));
+  *--mcp = XI_POP + RID_EAX;
+  MCode *generic = mcp;
+
+  emit_jmp((MCode *)(void *)asmLeaveTrace);
+  store_u64(RID_EAX, (char *)&cap->traceExitHpLim_ - (char *)cap, RID_ECX);
+  load_u64(RID_ECX, RID_ESP, HPLIM_SP_OFFS);
+  store_u64(RID_EAX, (char *)&cap->traceExitHp_ - (char *)cap, RID_HP);
+  load_u64(RID_EAX, RID_EAX, offsetof(Thread, owner_));
+  store_u64(RID_EAX, offsetof(Thread, pc_), RID_ECX);
+  loadi_u64(RID_ECX, (uint64_t)snap.pc());
+  store_u64(RID_EAX, offsetof(Thread, top_), RID_ECX);
+  emit_rmro(XO_LEA, RID_ECX | REX_64, RID_BASE,
+            snap.framesize() * sizeof(Word));
+  store_u64(RID_EAX, offsetof(Thread, base_), RID_BASE);
+  load_u64(RID_EAX, RID_ESP, THREAD_SP_OFFS);
+  if (relbase != 0)
+    emit_rmro(XO_LEA, RID_BASE | REX_64, RID_BASE, relbase);
+
+  // Literals and spilled values go through %rax, so they must be
+  // written after all registers have been saved.
+  for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se) {
+    IRRef ref = snapmap->slotRef(se);
+    int32_t ofs = snapmap->slotId(se) * sizeof(Word);
+    IR *ins = F->ir(ref);
+    if (irref_islit(ref)) {
+      if (ins->opcode() == IR::kKBASEO) {
+        store_u64(RID_BASE, ofs, RID_EAX);
+        emit_rmro(XO_LEA, RID_EAX | REX_64, RID_BASE,
+                  ins->i32() * sizeof(Word));
+      } else {
+        uint64_t k = F->literalValue(ref, NULL);
+        if (checki32(k)) {
+          storei_u64(RID_BASE, ofs, (int32_t)k);
+        } else {
+          store_u64(RID_BASE, ofs, RID_EAX);
+          loadi_u64(RID_EAX, k);
+        }
+      }
+    } else if (ins->spill() != 0) {
+      store_u64(RID_BASE, ofs, RID_EAX);
+      load_u64(RID_EAX, RID_ESP, spillOffset(ins->spill()));
+    }
+  }
+  for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se) {
+    IRRef ref = snapmap->slotRef(se);
+    IR *ins = F->ir(ref);
+    if (!irref_islit(ref) && ins->spill() == 0) {
+      LC_ASSERT(isReg(ins->reg()));
+      store_u64(RID_BASE, snapmap->slotId(se) * sizeof(Word), ins->reg());
+    }
+  }
+
+  if (F->stats_ != NULL)
+    incrementCounter(F->exitCounterAddress(exitno));
+
+  *--mcp = XI_POP + RID_EAX;
+  emit_i8(0x08);  // decw (%rax)
+  emit_i8(0xff);
+  emit_i8(0x66);
+  MCode *p = mcp;
+  *(int32_t *)(p - 4) = jmprel(p, generic);
+  p[-5] = (MCode)(XI_JCCn + (CC_BE & 15));
+  p[-6] = 0x0f;
+  mcp = p - 6;
+  emit_i8(0x01);  // cmpw $1, (%rax)
+  emit_i8(0x38);
+  emit_i8(0x83);
+  emit_i8(0x66);
+  loadi_u64(RID_EAX, (uint64_t)&snap.exitCounter_);
+  if (relbase > 0) {
+    p = mcp;
+    *(int32_t *)(p - 4) = jmprel(p, generic);
+    p[-5] = (MCode)(XI_JCCn + (CC_A & 15));
+    p[-6] = 0x0f;
+    mcp = p - 6;
+    emit_rmro(XO_CMP, RID_EAX | REX_64, RID_ESP | REX_64,
+              sizeof(Word) + SPLIM_SP_OFFS);
+    emit_rmro(XO_LEA, RID_EAX | REX_64, RID_BASE, relbase);
+  }
+  *--mcp = XI_PUSH + RID_EAX;
+
+  mcode->commit(mcp);
+  mcode->syncCache(mcp, generic + 6);
+  return mcp;
+}
+
 void Assembler::compare(IR *ins, int cc) {
   IRRef lref = ins->op1(), rref = ins->op2();
   int32_t imm = 0;
@@ -1178,13 +1437,63 @@ void Assembler::compare(IR *ins, int cc) {
   }
 }
 
+// UCOMISD sets the flags like an unsigned comparison.  If either
+// operand is NaN (unordered) it sets ZF, PF and CF, so every guard
+// except FNE must fail in that case.  LT and LE are turned into GT
+// and GE by swapping the operands, which makes the unordered case
+// fail the guard via CF.
+void Assembler::fpCompare(IR *ins) {
+  IR::Opcode op = ins->opcode();
+  IRRef lref = ins->op1(), rref = ins->op2();
+  if (op == IR::kFLT || op == IR::kFLE) {
+    IRRef tmp = lref;
+    lref = rref;
+    rref = tmp;
+  }
+  Reg left = alloc1(lref, kFPR);
+  Reg right = alloc1(rref, kFPR.exclude(left));
+  switch (op) {
+  case IR::kFLT:
+  case IR::kFGT:
+    guardcc(CC_BE);
+    break;
+  case IR::kFLE:
+  case IR::kFGE:
+    guardcc(CC_B);
+    break;
+  case IR::kFEQ: {
+    // jp <exit>; jne <exit>.  Only the JNE is patched when a side
+    // trace is attached, unordered operands always use the exit stub.
+    guardcc(CC_NE);
+    MCode *p = mcp;
+    *(int32_t *)(p - 4) = jmprel(p, exitstubAddr(snapno_));
+    p[-5] = (MCode)(XI_JCCn + (CC_P & 15));
+    p[-6] = 0x0f;
+    mcp = p - 6;
+    break;
+  }
+  case IR::kFNE: {
+    // jp >1; je <exit>; 1:
+    guardcc(CC_E);
+    MCode *p = mcp;
+    p[-1] = 6;  // Length of the JE.
+    p[-2] = (MCode)(XI_JCCs + (CC_P & 15));
+    mcp = p - 2;
+    break;
+  }
+  default:
+    LC_ASSERT(0 && "Not a floating point comparison");
+  }
+  emit_mrm(XO_UCOMISD, left, right);
+}
+
 void Assembler::fieldLoad(IR *ins) {
   IRRef fref = ins->op1();
   LC_ASSERT(fref && ir(fref)->opcode() == IR::kFREF);
   IR *frefins = ir(fref);
   IRRef base = frefins->op1();
   int fieldid = frefins->op2();
-  Reg dst = destReg(ins, kGPR);
+  Reg dst = destReg(ins, regClass(curins_));
   Reg basereg = alloc1(base, kGPR);
   load_u64(dst, basereg, sizeof(Word) * fieldid);
 }
@@ -1249,6 +1558,9 @@ void Assembler::heapCheck(IR *ins) {
 }
 
 void Assembler::insNew(IR *ins) {
+  if (ins->isSunk())
+    return;  // Constructed on exit, if at all.
+
   IRBuffer::HeapEntry eid = ins->op2();
   AbstractHeapEntry &entry = buf_->heap_.entry(eid);
   LC_ASSERT(ir(entry.ref()) == ins);
@@ -1268,12 +1580,100 @@ void Assembler::insNew(IR *ins) {
   }
   // Write info table.
   memstore(RID_HP, sizeof(Word) * ofs, ins->op1(), kGPR);
+
+  HeapProfile *profile = jit()->heapProfile();
+  if (profile != NULL && irref_islit(ins->op1())) {
+    InfoTable *info = (InfoTable *)buf_->literalValue(ins->op1());
+    MCode *counter = (MCode *)(void *)
+      profile->traceAllocCounter(Jit::numFragments(), info,
+                                 (entry.size() + 1) * sizeof(Word));
+    // The counter must be reachable from the INC.
+    if (counter != NULL && (counter - mcp) == (int32_t)(counter - mcp))
+      incrementCounter((uint64_t *)counter);
+  }
 }
 
 void Assembler::insUpdate(IR *ins) {
   Reg oldptr = alloc1(ins->op1(), kGPR);
   memstore(oldptr, sizeof(Word), ins->op2(), kGPR.exclude(oldptr));
   memstore(oldptr, 0, REF_IND, kGPR.exclude(oldptr));
+  writeBarrier(oldptr);
+}
+
+// Add the object in register obj to the remembered set of its region
+// (see Region::remember).  We don't check whether the object is in the
+// old generation; the GC ignores remembered bits of nursery objects.
+//
+//     mov  tmp1, obj
+//     and  tmp1, ~kRegionMask          ; tmp1 = region
+//     mov  tmp2, obj
+//     and  tmp2, kRegionMask
+//     shr  tmp2, 3                     ; tmp2 = word index in region
+//     bts  [tmp1 + rememberedSetOffset], tmp2
+//
+void Assembler::writeBarrier(Reg obj) {
+  Reg tmp1 = allocScratchReg(kGPR.exclude(obj));
+  Reg tmp2 = allocScratchReg(kGPR.exclude(obj).exclude(tmp1));
+  emit_rmro(XO_BTS, tmp2 | REX_64, tmp1 | REX_64,
+            Region::rememberedSetOffset());
+  emit_shifti(XOg_SHR | REX_64, tmp2, LC_ARCH_BYTES_LOG2);
+  emit_gri(XG_ARITHi(XOg_AND), tmp2 | REX_64, (int32_t)Region::kRegionMask);
+  emit_rr(XO_MOV, REX_64 | tmp2, REX_64 | obj);
+  emit_gri(XG_ARITHi(XOg_AND), tmp1 | REX_64, ~(int32_t)Region::kRegionMask);
+  emit_rr(XO_MOV, REX_64 | tmp1, REX_64 | obj);
+}
+
+// DIV/MOD and variable shifts need RAX, RDX and RCX, so these cannot
+// be reserved for a loop-carried value.
+static const RegSet kPhiRegs =
+  kGPR.exclude(RID_EAX).exclude(RID_ECX).exclude(RID_EDX);
+
+// Emits the moves at the loop back-edge.  The left operand of each
+// PHI gets a register which is reserved until its definition in the
+// preamble, and at the end of the loop body the right operand is
+// moved into it.
+void Assembler::phiMoves() {
+  ParAssign pa;
+  uint32_t moves = 0;
+  IRRef ref;
+  for (ref = buf_->loop_ + 1; ref < nins_; ++ref) {
+    IR *ins = ir(ref);
+    if (ins->opcode() == IR::kPHI) {
+      Reg r = allocRef(ins->op1(), buf_->inFloatReg(ins->op1()) ?
+                       kFPR : kPhiRegs);
+      phiset_.set(r);
+    }
+  }
+  for (ref = buf_->loop_ + 1; ref < nins_; ++ref) {
+    IR *ins = ir(ref);
+    if (ins->opcode() == IR::kPHI) {
+      pa.dest[moves].reg = ir(ins->op1())->reg();
+      pa.dest[moves].spill = 0;
+      pa.source[moves].reg = alloc1(ins->op2(), regClass(ins->op2()));
+      pa.source[moves].spill = 0;
+      ++moves;
+    }
+  }
+  if (moves > 0) {
+    pa.size = moves;
+    parallelAssign(&pa, RID_NONE);
+  }
+}
+
+// Preamble values that are used inside the loop must be in the same
+// register at the loop entry and at the back-edge.  If the loop body
+// overwrites the register, reload the value from its spill slot at
+// the start of each iteration.
+void Assembler::insLoop(IR *ins) {
+  RegSet work = freeset_.complement().intersect(kAllocRegs)
+    .intersect(modset_).intersect(phiset_.complement());
+  while (!work.isEmpty()) {
+    Reg r = work.pickBot();
+    LC_ASSERT(cost_[r].ref() < curins_);
+    restoreReg(cost_[r].ref());
+    work.clear(r);
+  }
+  mcLoop_ = mcp;
 }
 
 void Assembler::emit(IR *ins) {
@@ -1342,6 +1742,25 @@ void Assembler::emit(IR *ins) {
     compare(ins, (asm_compmap[idx] >> 4) & 15);
     break;
   }
+  case IR::kFLT:
+  case IR::kFGE:
+  case IR::kFLE:
+  case IR::kFGT:
+  case IR::kFEQ:
+  case IR::kFNE:
+    LC_ASSERT(buf_->snap(snapno_).ref() == curins_);
+    fpCompare(ins);
+    break;
+  case IR::kFADD: fpArith(ins, XO_ADDSD); break;
+  case IR::kFSUB: fpArith(ins, XO_SUBSD); break;
+  case IR::kFMUL: fpArith(ins, XO_MULSD); break;
+  case IR::kFDIV: fpArith(ins, XO_DIVSD); break;
+  case IR::kFSQRT:
+    fpSqrt(ins);
+    break;
+  case IR::kCONV:
+    conv(ins);
+    break;
   case IR::kEQINFO:
   case IR::kNEINFO:
     itblGuard(ins, ins->opcode() == IR::kNEINFO);
@@ -1364,6 +1783,14 @@ void Assembler::emit(IR *ins) {
   case IR::kPLOAD:
     insPLOAD(ins);
     break;
+  case IR::kLOOP:
+    insLoop(ins);
+    break;
+  case IR::kPHI:
+    // Handled by phiMoves.
+    break;
+  case IR::kNOP:
+    break;
   case IR::kBSHL: bitshift(ins, XOg_SHL); break;
   case IR::kBSHR: bitshift(ins, XOg_SHR); break;
   case IR::kBSAR: bitshift(ins, XOg_SAR); break;
@@ -1378,7 +1805,7 @@ void Assembler::emit(IR *ins) {
 void Assembler::snapshotAlloc1(IRRef ref) {
   IR *ins = ir(ref);
   if (!ins->hasRegOrSpill()) {
-    RegSet allow = kGPR;
+    RegSet allow = regClass(ref);
     if (!freeset_.intersect(allow).isEmpty()) {
       allocRef(ref, allow);
       RA_DBGX((this, "snapreg   $f $r", ref, ins->reg()));
@@ -1389,13 +1816,34 @@ void Assembler::snapshotAlloc1(IRRef ref) {
   }
 }
 
+/// Allocate registers to the fields of an object that is constructed
+/// by the exit handler.
+void Assembler::snapshotAllocNew(IRRef ref, Snapshot &snap) {
+  IR *ins = ir(ref);
+  IRBuffer::HeapEntry eid = ins->op2();
+  if (!irref_islit(ins->op1()))
+    snapshotAlloc1(ins->op1());
+  for (int i = 0; i < buf_->numFields(eid); ++i) {
+    IRRef field = buf_->getField(eid, i);
+    if (irref_islit(field))
+      continue;
+    if (isDeferredAlloc(ir(field), field, snap))
+      snapshotAllocNew(field, snap);
+    else
+      snapshotAlloc1(field);
+  }
+}
+
 /// Allocate registers to refs escaping to a snapshot.
 void Assembler::snapshotAlloc(Snapshot &snap, SnapshotData *snapmap) {
   RA_DBGX((this, "<<SNAP $x>>", snapno_));
   for (Snapshot::MapRef se = snap.begin(); se != snap.end(); ++se) {
     IRRef ref = snapmap->slotRef(se);
     if (!irref_islit(ref)) {
-      snapshotAlloc1(ref);
+      if (isDeferredAlloc(ir(ref), ref, snap))
+        snapshotAllocNew(ref, snap);
+      else
+        snapshotAlloc1(ref);
     }
   }
 }
@@ -1406,9 +1854,15 @@ void Assembler::adjustBase(int32_t relbase) {
   emit_gri(XG_ARITHi(XOg_ADD), RID_BASE | REX_64, relbase * sizeof(Word));
 }
 
+// Leaves the trace through the exit of the current SAVE snapshot if
+// BASE is beyond the stack limit.  At this point the snapshot has
+// been written and BASE adjusted, so the exit handler only needs to
+// grow the stack and resume in the interpreter.  The snapshot's
+// mcode_ is not updated, so the check will never be patched to jump
+// to a side trace.
 void Assembler::stackCheck(void) {
   MCode *p = mcp;
-  *(int32_t *)(p - 4) = jmprel(p, (MCode *)(void *)asmStackOverflow);
+  *(int32_t *)(p - 4) = jmprel(p, exitstubAddr(snapno_));
   p[-5] = (MCode)(XI_JCCn + (CC_A & 15));
   p[-6] = 0x0f;
   mcp = p - 6;
@@ -1423,13 +1877,19 @@ void Assembler::save(IR *ins) {
   SnapshotData *snapmap = buf_->snapmap();
   int relbase = snap.relbase();
 
+  if (loop == IR_SAVE_LOOP && buf_->loop_ != 0) {
+    // Loop-carried values are passed in registers (see phiMoves).
+    LC_ASSERT(relbase == 0);
+    return;
+  }
+
   if (loop == IR_SAVE_FALLTHROUGH)
     exitTo(snapno);
 
   // Adjust base pointer if necessary.
   if (relbase != 0) {
     if (relbase > 0) {
-      // TODO: Stack check (done after adjusting BASE)
+      // The stack check is done after adjusting BASE.
       stackCheck();
     }
     adjustBase(relbase);
@@ -1471,6 +1931,8 @@ void Assembler::memstore(Reg base, int32_t ofs, IRRef ref, RegSet allow) {
   if (irref_islit(ref) && is32BitLiteral(ref, &k)) {
     storei_u64(base, ofs, k);
   } else {
+    if (buf_->inFloatReg(ref))
+      allow = kFPR;
     Reg r = alloc1(ref, allow);
     store_u64(base, ofs, r);
   }
@@ -1512,7 +1974,7 @@ getTemp(Assembler *as, ParAssign *assign)
   }
   
   Reg r;
-  if (as->hasFreeReg()) {
+  if (as->hasFreeReg(kGPR)) {
     r = as->allocScratchReg(kGPR);
   } else {
     // Use heap pointer.  Free it up if necessary.
@@ -1612,6 +2074,11 @@ void Assembler::transfer(RegSpill dst, RegSpill src, ParAssign *assign) {
 
 */
 
+static inline const char *
+anyRegName(Reg r) {
+  return r < RID_MAX_GPR ? regNames64[r] : fpRegNames[r - RID_MIN_FPR];
+}
+
 static void
 debugPrintSingleParallelAssign(ostream &out, RegSpill dst, RegSpill src)
 {
@@ -1619,8 +2086,8 @@ debugPrintSingleParallelAssign(ostream &out, RegSpill dst, RegSpill src)
       << '.' << (uint32_t)dst.spill
       << ":" << (uint32_t)src.reg
       << '.' << (uint32_t)src.spill << "] ";
-  const char *dreg = isReg(dst.reg) ? regNames64[dst.reg] : " - ";
-  const char *sreg = isReg(src.reg) ? regNames64[src.reg] : " - ";
+  const char *dreg = isReg(dst.reg) ? anyRegName(dst.reg) : " - ";
+  const char *sreg = isReg(src.reg) ? anyRegName(src.reg) : " - ";
   out << "   " << dreg;
   if (hasSpill(dst)) out << '[' << (uint32_t)dst.spill << ']';
   out << " <- " << sreg;
@@ -1739,10 +2206,8 @@ MCode *Assembler::generateExitstubGroup(ExitNo group, MachineCode *mcode) {
   ExitNo groupofs = (group * EXITSTUBS_PER_GROUP) & 0xff;
   MCode *mxp = mcbot;
   MCode *mxpstart = mxp;
-  if (mxp + (2 + 2) * EXITSTUBS_PER_GROUP + 8 + 5 >= mctop) {
-    cerr << "NYI: Overflow when generating exit stubs." << endl;
-    exit(2);
-  }
+  if (mxp + (2 + 2) * EXITSTUBS_PER_GROUP + 8 + 5 >= mctop)
+    throw (int)IROPTERR_MCODE_FULL;
   // For each ExitNo in the group generate:
   //     push $(exitno)   // 8-bit immediate
   //     jmp END      // 8-bit offset
@@ -1773,7 +2238,7 @@ MCode *Assembler::generateExitstubGroup(ExitNo group, MachineCode *mcode) {
   // Commit code for this group (even if assembly fails later on).
   mcode->commitStub(mxp);
   mcbot = mxp;
-  mclim = mcbot + MCLIM_REDZONE;
+  setupLimit(mcode);
 
   return mxpstart;
 }
@@ -1788,6 +2253,13 @@ void Assembler::setupExitStubs(ExitNo nexits, MachineCode *mcode) {
   for (i = 0; i < ngroups; ++i) {
     if (jit_->exitStubGroup_[i] == NULL) {
       jit_->exitStubGroup_[i] = generateExitstubGroup(i, mcode);
+      if (jit_->perfMap() != NULL) {
+        char name[32];
+        snprintf(name, sizeof(name), "lc_exit_stubs_%u", (unsigned)i);
+        jit_->perfMap()->addCode(jit_->exitStubGroup_[i],
+                                 mcode->stubEnd() - jit_->exitStubGroup_[i],
+                                 name);
+      }
       if (true) {
         MCode *start = jit_->exitStubGroup_[i];
         MCode *end = mcode->stubEnd();
@@ -164,6 +164,12 @@ static const RegSet kGPR =
   RegSet::range(RID_MIN_GPR, RID_MAX_GPR).exclude(RID_ESP)
   .exclude(RID_BASE).exclude(RID_HP);
 
+// The SSE registers.  Only the low 64 bits are used (for doubles).
+static const RegSet kFPR = RegSet::range(RID_MIN_FPR, RID_MAX_FPR);
+
+// All registers available to the register allocator.
+static const RegSet kAllocRegs = kGPR.setunion(kFPR);
+
 LC_STATIC_ASSERT(sizeof(RegSet) == sizeof(uint32_t));
 
 class SpillSet {
@@ -310,6 +316,7 @@ typedef enum {
   XO_MOVSXw =	XO_0f(bf),
   XO_MOVSXd =	XO_(63),
   XO_BSWAP =	XO_0f(c8),
+  XO_BTS =	XO_0f(ab),
   XO_CMOV =	XO_0f(40),
 
   XO_MOVSD =	XO_f20f(10),
@@ -486,9 +493,12 @@ public:
   /// within a single IR instruction.  It is not marked as used.
   Reg allocScratchReg(RegSet allow);
 
-  inline bool hasFreeReg() const { return !freeset_.isEmpty(); }
+  inline bool hasFreeReg(RegSet allow) const {
+    return !freeset_.intersect(allow).isEmpty();
+  }
 
   void snapshotAlloc1(IRRef ref);
+  void snapshotAllocNew(IRRef ref, Snapshot &snap);
   void snapshotAlloc(Snapshot &snap, SnapshotData *snapmap);
 
   /// Allocating registers for two-address architectures.
@@ -532,6 +542,11 @@ public:
   };
   void divmod(IR *ins, DivModOp op, bool useSigned);
 
+  void fpArith(IR *ins, x86Op xo);
+  void fpSqrt(IR *ins);
+  void conv(IR *ins);
+  void fpCompare(IR *ins);
+
   /// Generate code for the given instruction.
   void itblGuard(IR *ins, bool inverted);
   void fieldLoad(IR *ins);
@@ -539,13 +554,17 @@ public:
   void heapCheck(IR *ins);
   void insNew(IR *ins);
   void insUpdate(IR *ins);
+  void writeBarrier(Reg obj);
   void emit(IR *ins);
   void save(IR *ins);
   void memstore(Reg base, int32_t ofs, IRRef ref, RegSet allow);
   void patchGuard(Fragment *, ExitNo, MCode *target);
   void patchFallthrough(Fragment *parent, ExitNo, Fragment *target);
+  MCode *exitHandler(Capability *cap, Fragment *F, ExitNo exitno);
   void adjustBase(int32_t relbase);
   void insPLOAD(IR *ins);
+  void insLoop(IR *ins);
+  void phiMoves();
   void stackCheck(void);
 
   // Emits code to increment the value of the value at the target
@@ -564,9 +583,14 @@ public:
 
 private:
   inline int32_t spillOffset(uint8_t spillSlot) const;
+
+  /// The registers that may hold the value of ref.
+  inline RegSet regClass(IRRef ref);
   
   MCode *generateExitstubGroup(ExitNo group, MachineCode *);
   void setupExitStubs(ExitNo nexits, MachineCode *mcode);
+  void setupLimit(MachineCode *mcode);
+  inline void checkLimit();
   MCode *exitstubAddr(ExitNo);
   void emitSLOAD(IR *);
   void exitTo(SnapNo);
@@ -596,8 +620,9 @@ private:
   bool swapOperands(IR *ins);
   Reg fuseLoad(IRRef ref, RegSet allow);
 
-  /// Mark the register as free.
-  inline void freeReg(Reg reg) { freeset_.set(reg); }
+  /// Mark the register as free.  A free register no longer holds a
+  /// loop-carried value.
+  inline void freeReg(Reg reg) { freeset_.set(reg); phiset_.clear(reg); }
 
   /// Mark the register as modified inside the loop.
   inline void modifiedReg(Reg reg) { modset_.set(reg); }
@@ -665,6 +690,7 @@ private:
   MCode *mctop; // Top of generated MCode
 
   MCode *mcQuickHeapCheck_;
+  MCode *mcLoop_;  // Target of the loop back-edge, if any.
   uint32_t numHeapChecks_;
 
   Jit *jit_;
@@ -0,0 +1,47 @@
+/* vm/autoconfig.h.  Generated from autoconfig.h.in by configure.  */
+/* vm/autoconfig.h.in.  Generated from configure.in by autoheader.  */
+
+/* the name of <hash_map> */
+#define HASH_MAP_CLASS unordered_map
+
+/* the location of <unordered_map> or <hash_map> */
+#define HASH_MAP_H <unordered_map>
+
+/* the namespace of hash_map/hash_set */
+#define HASH_NAMESPACE std
+
+/* the name of <hash_set> */
+#define HASH_SET_CLASS unordered_set
+
+/* the location of <unordered_set> or <hash_set> */
+#define HASH_SET_H <unordered_set>
+
+/* Define to 1 if you have the `clock_gettime' function. */
+#define HAVE_CLOCK_GETTIME 1
+
+/* define if the compiler has hash_map */
+#define HAVE_HASH_MAP 1
+
+/* define if the compiler has hash_set */
+#define HAVE_HASH_SET 1
+
+/* Define to 1 if you have the `rt' library (-lrt). */
+#define HAVE_LIBRT 1
+
+/* Define to the address where bug reports for this package should be sent. */
+#define PACKAGE_BUGREPORT ""
+
+/* Define to the full name of this package. */
+#define PACKAGE_NAME "lambdachine"
+
+/* Define to the full name and version of this package. */
+#define PACKAGE_STRING "lambdachine 0.1"
+
+/* Define to the one symbol short name of this package. */
+#define PACKAGE_TARNAME "lambdachine"
+
+/* Define to the home page for this package. */
+#define PACKAGE_URL ""
+
+/* Define to the version of this package. */
+#define PACKAGE_VERSION "0.1"
@@ -15,7 +15,7 @@ static const char *ins_name[] = {
 
 const char *BcIns::name() const {
   Opcode opc = opcode();
-  LC_ASSERT(opc <= BcIns::kSTOP);
+  LC_ASSERT(opc < countof(ins_name));
   return ins_name[opc];
 }
 
@@ -27,7 +27,7 @@ static const BcIns::InsFormat ins_format[] = {
 
 BcIns::InsFormat BcIns::format() const {
   Opcode opc = opcode();
-  LC_ASSERT(opc <= BcIns::kSTOP);
+  LC_ASSERT(opc < countof(ins_format));
   return ins_format[opc];
 }
 
@@ -84,6 +84,35 @@ static ostream &printInlineBitmaps(ostream &out, const BcIns *ins) {
   return out;
 }
 
+const BcIns *BcIns::next(const BcIns *ins) {
+  const BcIns i = *ins++;
+  switch (i.format()) {
+  case IFM_RRJ:
+    return ins + 1;
+  case IFM____:
+    switch (i.opcode()) {
+    case kEVAL:
+    case kALLOC1:
+    case kCALLT:
+      return ins + 1;
+    case kCASE:
+      return ins + (i.d() + 1) / 2;
+    case kCASE_S:
+      return ins + 1 + i.d();
+    case kALLOC:
+      return ins + 1 + BC_ROUND(i.c());
+    case kALLOCAP:
+      return ins + 1 + BC_ROUND(i.c() + 1);
+    case kCALL:
+      return ins + 1 + BC_ROUND(i.c()) + 1;
+    default:
+      return ins;
+    }
+  default:
+    return ins;
+  }
+}
+
 const BcIns *BcIns::debugPrint(ostream &out, const BcIns *ins,
                                bool oneline, const BcIns *baseaddr,
                                const Code *code) {
@@ -97,7 +97,30 @@ _START_LAMBDACHINE_NAMESPACE
   _(JRET,    RN) \
   _(IRET,    RN) \
   _(SYNC, ___) \
-  _(STOP, ___)
+  _(STOP, ___) \
+  /* Double# ops.  Added after all other instructions so that the \
+     numbering of existing opcodes does not change. */ \
+  /* Double comparisons, order significant */ \
+  _(ISLTD,   RRJ) \
+  _(ISGED,   RRJ) \
+  _(ISLED,   RRJ) \
+  _(ISGTD,   RRJ) \
+  _(ISEQD,   RRJ) \
+  _(ISNED,   RRJ) \
+  _(NEGD,    RR) \
+  _(SQRTD,   RR) \
+  _(I2D,     RR) /* int2Double# */ \
+  _(D2I,     RR) /* double2Int# (truncates) */ \
+  _(ADDD,    RRR) \
+  _(SUBD,    RRR) \
+  _(MULD,    RRR) \
+  _(DIVD,    RRR) \
+  _(CMPLTD,  RRR) \
+  _(CMPGED,  RRR) \
+  _(CMPLED,  RRR) \
+  _(CMPGTD,  RRR) \
+  _(CMPEQD,  RRR) \
+  _(CMPNED,  RRR)
 
 /**
  * A bytecode instruction.
@@ -130,6 +153,11 @@ class BcIns {
 
   static const u4 kMaxCallArgs = 13;
 
+  // The loader stores the index of a call site's inline cache in the
+  // B field of CALL and CALLT and in the D field of EVAL.  This value
+  // (which the compiler emits) means the instruction has no cache.
+  static const u4 kNoInlineCache = 0xff;
+
   typedef enum {
 #define DEF_BCINS_OPCODE(ins,format) k##ins,
     BCDEF(DEF_BCINS_OPCODE)
@@ -224,6 +252,9 @@ class BcIns {
       return (const u2*)((u1*)pc + offset);
   }
 
+  // Returns the instruction following ins and its payload.
+  static const BcIns *next(const BcIns *ins);
+
   static const BcIns *debugPrint(
     std::ostream& out, const BcIns *ins,
     bool oneline, const BcIns *baseaddr, const struct _Code*);
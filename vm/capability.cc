@@ -4,9 +4,11 @@
 #include "objects.hh"
 #include "miscclosures.hh"
 #include "time.hh"
+#include "utils.hh"
 
 #include <iomanip>
 #include <string.h>
+#include <math.h>
 
 _START_LAMBDACHINE_NAMESPACE
 
@@ -25,10 +27,9 @@ using namespace std;
 static BcIns reload_state_code[1] = { BcIns::ad(BcIns::kSYNC, 0, 0) };
 
 Capability::Capability(MemoryManager *mm)
-  : mm_(mm), currentThread_(NULL),
-    static_roots_(NULL),
+  : mm_(mm), currentThread_(NULL), heapProfile_(NULL),
     reload_state_pc_(&reload_state_code[0]),
-    counters_(HOT_THRESHOLD), // TODO: initialise from Options
+    counters_(HOT_THRESHOLD),
     flags_() {
   interpMsg(kModeInit);
 }
@@ -55,6 +56,39 @@ bool isStartOfTrace(BcIns *srcPc, BcIns *dstPc,
                            branchType == kReturn);
 }
 
+// The code of the function or thunk whose frame starts at `base`.
+static inline const Code *frameCode(Word *base) {
+  InfoTable *info = ((Closure *)base[-1])->info();
+  return info->hasCode() ? ((CodeInfoTable *)info)->code() : NULL;
+}
+
+// The inline cache of an EVAL, CALL or CALLT in code, or NULL.  The
+// interpreter starts without knowing the current code, hence the NULL
+// check.
+static inline InlineCache *
+inlineCache(const Code *code, u4 cacheIndex) {
+  if (LC_UNLIKELY(code == NULL) || cacheIndex >= code->sizecaches)
+    return NULL;
+  return &code->caches[cacheIndex];
+}
+
+// Returns the inline cache entry of a CALL or CALLT with the given
+// cache index, or NULL if the call must go through generic_apply.  On
+// a miss, exact calls of a FUN are added to the cache.
+static inline const InlineCacheEntry *
+lookupCall(const Code *code, u4 cacheIndex, const CodeInfoTable *info,
+           u4 nargs) {
+  InlineCache *cache = inlineCache(code, cacheIndex);
+  if (cache == NULL)
+    return NULL;
+  const InlineCacheEntry *cached = cache->lookup(info);
+  if (LC_LIKELY(cached != NULL))
+    return cached;
+  if (info->type() == FUN && info->code()->arity == nargs)
+    return cache->add(info, info->code());
+  return NULL;
+}
+
 // It's very important that we inline this because it takes so many
 // arguments.
 inline BcIns *
@@ -74,6 +108,7 @@ Capability::interpBranch(BcIns *srcPc, BcIns *dstPc,
   if (LC_UNLIKELY(isRecording())) {
     return dstPc;
   } else {
+    jit_.pollCompiler();
     if (isStartOfTrace(srcPc, dstPc, branchType)) {
       Fragment *F = jit_.traceAt(dstPc);
       if (F != NULL) {
@@ -105,8 +140,10 @@ Capability::interpBranch(BcIns *srcPc, BcIns *dstPc,
 
         return pc;
 
-      } else if (counters_.tick(dstPc) &&
-                 dstPc != MiscClosures::stg_UPD_return_pc) {
+      } else if (dstPc != MiscClosures::stg_UPD_return_pc &&
+                 !jit_.isCompiling() &&
+                 counters_.tick(dstPc, frameCode(base)) &&
+                 jit_.shouldRecord(dstPc)) {
         currentThread_->sync(dstPc, base);
 
         if (DEBUG_COMPONENTS & DEBUG_TRACE_RECORDER) {
@@ -178,6 +215,29 @@ bool stackOverflow(Thread *T, Word *top, u4 increment) {
   return T->stackLimit() < (top + increment + headroom);
 }
 
+// Ensures there are at least `increment` words above base (or top),
+// growing the stack if necessary.  Growing moves the stack, so the
+// local base (and top) pointers are adjusted.  The trace recorder
+// holds on to stack addresses, so recording is aborted.
+#define STACK_CHECK_BASE(increment) \
+  if (LC_UNLIKELY(stackOverflow(T, base, increment))) { \
+    ptrdiff_t moved; \
+    if (!T->growStack(base + (increment) + FRAME_SIZE + 1, base, &moved)) \
+      goto stack_overflow; \
+    if (isRecording()) jit_.requestAbort(AR_STACK_GROWN); \
+    base += moved; \
+  }
+
+#define STACK_CHECK_TOP(increment) \
+  if (LC_UNLIKELY(stackOverflow(T, top, increment))) { \
+    ptrdiff_t moved; \
+    if (!T->growStack(top + (increment) + FRAME_SIZE + 1, base, &moved)) \
+      goto stack_overflow; \
+    if (isRecording()) jit_.requestAbort(AR_STACK_GROWN); \
+    base += moved; \
+    top += moved; \
+  }
+
 // NOTE: Does not check for stack overflow.
 static inline
 void pushFrame(Word **top, Word **base, BcIns *ret, Closure *clos,
@@ -384,11 +444,73 @@ op_ISNE:
     pc += (pc - 1)->j();
   DISPATCH_NEXT;
 
+op_ISLTD:
+  DECODE_AD;
+  ++pc;
+  if (wordToDouble(base[opA]) < wordToDouble(base[opC]))
+    pc += (pc - 1)->j();
+  DISPATCH_NEXT;
+
+op_ISGED:
+  DECODE_AD;
+  ++pc;
+  if (wordToDouble(base[opA]) >= wordToDouble(base[opC]))
+    pc += (pc - 1)->j();
+  DISPATCH_NEXT;
+
+op_ISLED:
+  DECODE_AD;
+  ++pc;
+  if (wordToDouble(base[opA]) <= wordToDouble(base[opC]))
+    pc += (pc - 1)->j();
+  DISPATCH_NEXT;
+
+op_ISGTD:
+  DECODE_AD;
+  ++pc;
+  if (wordToDouble(base[opA]) > wordToDouble(base[opC]))
+    pc += (pc - 1)->j();
+  DISPATCH_NEXT;
+
+op_ISEQD:
+  DECODE_AD;
+  ++pc;
+  if (wordToDouble(base[opA]) == wordToDouble(base[opC]))
+    pc += (pc - 1)->j();
+  DISPATCH_NEXT;
+
+op_ISNED:
+  DECODE_AD;
+  ++pc;
+  if (wordToDouble(base[opA]) != wordToDouble(base[opC]))
+    pc += (pc - 1)->j();
+  DISPATCH_NEXT;
+
 op_NEG:
   DECODE_AD;
   base[opA] = -(WordInt)base[opC];
   DISPATCH_NEXT;
 
+op_NEGD:
+  DECODE_AD;
+  base[opA] = doubleToWord(-wordToDouble(base[opC]));
+  DISPATCH_NEXT;
+
+op_SQRTD:
+  DECODE_AD;
+  base[opA] = doubleToWord(sqrt(wordToDouble(base[opC])));
+  DISPATCH_NEXT;
+
+op_I2D:
+  DECODE_AD;
+  base[opA] = doubleToWord((double)(WordInt)base[opC]);
+  DISPATCH_NEXT;
+
+op_D2I:
+  DECODE_AD;
+  base[opA] = (Word)(WordInt)wordToDouble(base[opC]);
+  DISPATCH_NEXT;
+
 op_MOV:
   DECODE_AD;
   base[opA] = base[opC];
@@ -448,6 +570,26 @@ op_REMRR:
   base[opA] = (WordInt)base[opB] % (WordInt)base[opC];
   DISPATCH_NEXT;
 
+op_ADDD:
+  DECODE_BC;
+  base[opA] = doubleToWord(wordToDouble(base[opB]) + wordToDouble(base[opC]));
+  DISPATCH_NEXT;
+
+op_SUBD:
+  DECODE_BC;
+  base[opA] = doubleToWord(wordToDouble(base[opB]) - wordToDouble(base[opC]));
+  DISPATCH_NEXT;
+
+op_MULD:
+  DECODE_BC;
+  base[opA] = doubleToWord(wordToDouble(base[opB]) * wordToDouble(base[opC]));
+  DISPATCH_NEXT;
+
+op_DIVD:
+  DECODE_BC;
+  base[opA] = doubleToWord(wordToDouble(base[opB]) / wordToDouble(base[opC]));
+  DISPATCH_NEXT;
+
 op_CMPLT:
   DECODE_BC;
   base[opA] = (WordInt)base[opB] < (WordInt)base[opC] ? 1 : 0;
@@ -498,6 +640,36 @@ op_CMPGTU:
   base[opA] = (Word)base[opB] > (Word)base[opC] ? 1 : 0;
   DISPATCH_NEXT;
 
+op_CMPLTD:
+  DECODE_BC;
+  base[opA] = wordToDouble(base[opB]) < wordToDouble(base[opC]) ? 1 : 0;
+  DISPATCH_NEXT;
+
+op_CMPGED:
+  DECODE_BC;
+  base[opA] = wordToDouble(base[opB]) >= wordToDouble(base[opC]) ? 1 : 0;
+  DISPATCH_NEXT;
+
+op_CMPLED:
+  DECODE_BC;
+  base[opA] = wordToDouble(base[opB]) <= wordToDouble(base[opC]) ? 1 : 0;
+  DISPATCH_NEXT;
+
+op_CMPGTD:
+  DECODE_BC;
+  base[opA] = wordToDouble(base[opB]) > wordToDouble(base[opC]) ? 1 : 0;
+  DISPATCH_NEXT;
+
+op_CMPEQD:
+  DECODE_BC;
+  base[opA] = wordToDouble(base[opB]) == wordToDouble(base[opC]) ? 1 : 0;
+  DISPATCH_NEXT;
+
+op_CMPNED:
+  DECODE_BC;
+  base[opA] = wordToDouble(base[opB]) != wordToDouble(base[opC]) ? 1 : 0;
+  DISPATCH_NEXT;
+
 op_BNOT:
   DECODE_AD;
   base[opA] = ~base[opC];
@@ -561,6 +733,12 @@ op_PTROFSC:
     goto heapOverflow; \
   }
 
+# define PROFILE_ALLOC(info, payloadWords) \
+  if (LC_UNLIKELY(heapProfile_ != NULL)) { \
+    heapProfile_->allocated(pc, (Closure *)base[-1], (info), \
+                            (1 + (payloadWords)) * sizeof(Word)); \
+  }
+
 op_ALLOC1:
   // A = target
   // B = itbl
@@ -569,6 +747,7 @@ op_ALLOC1:
     DECODE_BC;
     Closure *cl = (Closure *)heap;
     BUMP_HEAP(1);
+    PROFILE_ALLOC((InfoTable *)base[opB], 1);
     ++pc;
     cl->setInfo((InfoTable *)base[opB]);
     cl->setPayload(0, base[opC]);
@@ -587,6 +766,7 @@ op_ALLOC:
     const u1 *arg = (const u1 *)pc;
 
     BUMP_HEAP(opC);
+    PROFILE_ALLOC((InfoTable *)base[opB], opC);
     cl->setInfo((InfoTable *)base[opB]);
     for (u4 i = 0; i < opC; ++i) {
       // cerr << "payload[" << i << "]=base[" << (int)*arg << "] ("
@@ -616,6 +796,7 @@ op_ALLOCAP:
 
     Closure *cl = (Closure *)heap;
     BUMP_HEAP(nargs + 1);
+    PROFILE_ALLOC(MiscClosures::getApInfo(nargs, pointerMask), nargs + 1);
     cl->setInfo(MiscClosures::getApInfo(nargs, pointerMask));
     for (u4 i = 0; i < nargs + 1; ++i, ++args) {
       cl->setPayload(i, base[*args]);
@@ -651,11 +832,14 @@ op_EVAL:
   // Format of an EVAL instruction:
   //
   //  +-----------+-----+-----+
-  //  |     -     |  A  | OPC |
+  //  |     D     |  A  | OPC |
   //  +-----------+-----+-----+
   //  |   live-outs bitmask   |
   //  +-----------+-----------+
   //
+  //  A = closure to evaluate
+  //  D = index of the inline cache (see Code::initInlineCaches)
+  //
   {
     Closure *tnode = (Closure *)base[opA];
 
@@ -668,18 +852,29 @@ op_EVAL:
 
     LC_ASSERT(tnode->info() != MiscClosures::stg_IND_info);
 
-    if (tnode->isHNF()) {
+    // The code of tnode, or NULL if it is already a value.
+    const Code *tcode;
+    InlineCache *cache = inlineCache(code, opC);
+    const InlineCacheEntry *cached =
+      cache != NULL ? cache->lookup(tnode->info()) : NULL;
+    if (LC_LIKELY(cached != NULL)) {
+      tcode = cached->code;
+    } else {
+      tcode = tnode->isHNF() ? NULL
+        : static_cast<CodeInfoTable *>(tnode->info())->code();
+      if (cache != NULL)
+        cache->add(tnode->info(), tcode);
+    }
+
+    if (tcode == NULL) {
       T->top_[FRAME_SIZE] = (Word)tnode;
       ++pc;  // skip live-out info
       DISPATCH_NEXT;
     } else {
-      CodeInfoTable *info = static_cast<CodeInfoTable *>(tnode->info());
-      u4 framesize = info->code()->framesize;
+      u4 framesize = tcode->framesize;
       Word *top = T->top();
 
-      if (stackOverflow(T, top, kStackFrameWords + kUpdateFrameWords
-                        + framesize))
-        goto stack_overflow;
+      STACK_CHECK_TOP(kStackFrameWords + kUpdateFrameWords + framesize);
 
       Word *top_orig = top;
 
@@ -692,7 +887,7 @@ op_EVAL:
       LC_ASSERT(base == top_orig + kStackFrameWords + kUpdateFrameWords);
       LC_ASSERT(top == base + framesize);
       T->top_ = top;
-      code = info->code();
+      code = tcode;
 
       opC = 0;                  // No arguments.
       BRANCH_TO(code->code, kCall);
@@ -749,13 +944,14 @@ op_UPDATE: {
     // cerr << "UPDATING: " << oldnode << " (" << oldnode->info()->name() << ") with "
     //      << newnode << " (" << newnode->info()->name() << ")\n";
 
+    if (info->type() == CAF)
+      mm_->recordCAF(oldnode);
+
     oldnode->setInfo(MiscClosures::stg_IND_info);
     oldnode->setPayload(0, (Word)newnode);
 
-    if (info->type() == CAF) {
-      oldnode->setPayload(1, (Word)static_roots_);
-      static_roots_ = oldnode;
-    }
+    if (info->type() != CAF)
+      mm_->writeBarrier(oldnode);
 
     DISPATCH_NEXT;
   }
@@ -767,9 +963,9 @@ op_MOV_RES:
 
 op_CALL: {
     // opA = function
-    // opB = argument pointer mask
+    // opB = index of the inline cache
     // opC = no of arguments
-    // following bytes: argument regs, bitmask
+    // following bytes: argument pointer mask, argument regs, bitmask
     DECODE_BC;
     u4 callargs = opC;
     u4 pointer_mask = *((const uint32_t *)pc);
@@ -796,11 +992,11 @@ op_CALL: {
               fnode->info()->type() == PAP);
 
     CodeInfoTable *info = (CodeInfoTable *)fnode->info();
+    const InlineCacheEntry *cached = lookupCall(code, opB, info, nargs);
 
     DLOG("   ENTER: %s\n", info->name());
 
-    if (stackOverflow(T, top, kStackFrameWords + nargs))
-      goto stack_overflow;
+    STACK_CHECK_TOP(kStackFrameWords + nargs);
 
     // Each additional argument requires 1 byte, we pad to multiples
     // of an instruction.  The liveness mask follows.
@@ -815,6 +1011,12 @@ op_CALL: {
     }
 
     T->top_ = top;
+    if (LC_LIKELY(cached != NULL)) {
+      // Exact call of a known function.  See generic_apply.
+      code = cached->code;
+      T->top_ = base + code->framesize;
+      BRANCH_TO(cached->entry, kCall);
+    }
     code = info->code();
     opC = (nargs & 0xff) | (pointer_mask << 8);
     goto generic_apply;
@@ -824,7 +1026,8 @@ op_CALLT: {
     DECODE_BC;
     // opA = function
     // opC = no of args
-    // opB = argument pointer mask
+    // opB = index of the inline cache
+    // following word: argument pointer mask
     u4 callargs = opC; // arguments from this call
     u4 pointer_mask = *((const uint32_t *)pc);
     ++pc;
@@ -855,16 +1058,20 @@ op_CALLT: {
     // blackhole.
 
     CodeInfoTable *info = (CodeInfoTable *)fnode->info();
+    const InlineCacheEntry *cached = lookupCall(code, opB, info, nargs);
 
     DLOG("   ENTER: %s\n", info->name());
 
-    if (stackOverflow(T, base, nargs)) {
-      goto stack_overflow;
-    }
+    STACK_CHECK_BASE(nargs);
 
     // Arguments are already in place.  Just dispatch to target.
 
     base[-1] = (Word)fnode;
+    if (LC_LIKELY(cached != NULL)) {
+      code = cached->code;
+      T->top_ = base + code->framesize;
+      BRANCH_TO(cached->entry, kCall);
+    }
     code = info->code();
     opC = (nargs & 0xff) | (pointer_mask << 8);
     goto generic_apply;
@@ -986,6 +1193,8 @@ op_INITF:
     DECODE_BC;
     Closure *cl = (Closure *)base[opA];
     cl->setPayload(opC - 1, base[opB]);
+    // A GC may have promoted the object since it was allocated.
+    mm_->writeBarrier(cl);
     DISPATCH_NEXT;
   }
 
@@ -1127,7 +1336,8 @@ op_STOP:
 stack_overflow:
   T->sync(pc, base);
   mm_->sync(heap, heaplim);
-  cerr << "\nERROR: Stack overflow.\n";
+  cerr << "\nERROR: Stack overflow (maximum stack size is "
+       << Thread::maxStackSize() * sizeof(Word) << " bytes).\n";
   return kInterpStackOverflow;
 
 generic_apply: {
@@ -1173,9 +1383,7 @@ generic_apply: {
            << endl;
 
       u4 framesize = papArgs + given_args;
-      if (stackOverflow(T, base, framesize)) {
-        goto stack_overflow;
-      }
+      STACK_CHECK_BASE(framesize);
       T->top_ = base + framesize;
 
       // Move up a_1 .. a_N
@@ -1205,14 +1413,13 @@ generic_apply: {
                               given_args, pointer_mask);
       uint32_t apk_framesize = MiscClosures::apContFrameSize(given_args);
       base[-1] = (Word)apk_closure;
-      Word *top = &base[apk_framesize];
       const CodeInfoTable *info = (CodeInfoTable *)fnode->info();
       code = info->code();
 
-      if (stackOverflow(T, base, apk_framesize + kStackFrameWords +
-                        kUpdateFrameWords + kStackFrameWords +
-                        code->framesize))
-        goto stack_overflow;
+      STACK_CHECK_BASE(apk_framesize + kStackFrameWords +
+                       kUpdateFrameWords + kStackFrameWords +
+                       code->framesize);
+      Word *top = &base[apk_framesize];
 
       pushFrame(&top, &base, apk_return_addr,
                 MiscClosures::stg_UPD_closure_addr, 2);
@@ -1250,8 +1457,7 @@ generic_apply: {
         //
         u4 extra_args = given_args - arity;
         u4 apk_frame_size = MiscClosures::apContFrameSize(extra_args) + 3;
-        if (stackOverflow(T, base, apk_frame_size + given_args))
-          goto stack_overflow;
+        STACK_CHECK_BASE(apk_frame_size + given_args);
 
         // We could do some clever swapping scheme here, but it
         // would be very branchy and probably not worth it.
@@ -31,11 +31,18 @@ public:
   // Eval given closure using current thread.
   bool eval(Thread *, Closure *);
   bool run(Thread *);
-  inline Closure *staticRoots() const { return static_roots_; }
   inline bool isRecording() const {
     return flags_.get(kRecording);
   }
   inline Jit *jit() { return &jit_; }
+  inline HotCounters *hotCounters() { return &counters_; }
+
+  // Sample allocations made by the interpreter and by traces compiled
+  // from now on.
+  inline void setHeapProfile(HeapProfile *profile) {
+    heapProfile_ = profile;
+    jit_.setHeapProfile(profile);
+  }
 
   inline Word *traceExitHp() const { return traceExitHp_; }
   inline Word *traceExitHpLim() const { return traceExitHpLim_; }
@@ -81,7 +88,7 @@ private:
 
   MemoryManager *mm_;
   Thread *currentThread_;
-  Closure *static_roots_;
+  HeapProfile *heapProfile_;  // Only if sampling allocations
 
   const AsmFunction *dispatch_;
 
@@ -103,6 +110,7 @@ private:
   Word *traceExitHpLim_;
 
   friend class Fragment;
+  friend class Assembler;  // Compiled exit handlers set traceExitHp_.
   friend class BranchTargetBuffer;  // For resetting hot counters.
 };
 
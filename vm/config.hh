@@ -29,6 +29,7 @@
 #define LC_JIT   1
 
 // #define LC_DUMP_TRACES
+// Profile all traces, as if --jit-profile was given.
 // #define LC_TRACE_STATS
 #define LC_CLEAR_DOM_COUNTERS
 
@@ -36,6 +37,13 @@
 
 #define HOT_THRESHOLD            53
 #define HOT_SIDE_EXIT_THRESHOLD  7
+// Number of aborted recordings before a trace start is blacklisted.
+#define TRACE_MAX_ABORTS         6
+// Number of generic (C++) restores of a side exit before it gets its
+// own compiled exit handler.
+#define EXIT_HANDLER_THRESHOLD   10
+// Number of info tables remembered per EVAL/CALL/CALLT instruction.
+#define INLINE_CACHE_ENTRIES     4
 
 #define LC_DEFAULT_HEAP_SIZE  (1UL * 1024 * 1024)
 
@@ -8,4 +8,18 @@ bool fileExists(const char *path) {
   return S_ISREG(st.st_mode) != 0;
 }
 
+bool fileHash(const char *path, uint64_t *hash) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return false;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    h ^= (uint8_t)c;
+    h *= 0x100000001b3ULL;
+  }
+  fclose(f);
+  *hash = h;
+  return true;
+}
+
 _END_LAMBDACHINE_NAMESPACE
@@ -12,6 +12,9 @@ _START_LAMBDACHINE_NAMESPACE
 /* TODO: make Windows compatible */
 bool fileExists(const char *path);
 
+/* Stores a 64 bit FNV-1a hash of the file's contents in *hash. */
+bool fileHash(const char *path, uint64_t *hash);
+
 inline Word zigZagEncode(Word v)
 {
   if (v & ((Word)1u << (sizeof(Word) * 8 - 1)))
@@ -0,0 +1,144 @@
+#include "gcstats.hh"
+
+#include <algorithm>
+
+_START_LAMBDACHINE_NAMESPACE
+
+static const char *histogramLabel[GCStats::kHistogramBuckets] = {
+  "<1us", "<10us", "<100us", "<1ms", "<10ms", "<100ms", ">=100ms"
+};
+
+Time GCStats::pausePercentile(double pct) const {
+  if (events_.empty())
+    return 0;
+  std::vector<Time> pauses;
+  pauses.reserve(events_.size());
+  for (size_t i = 0; i < events_.size(); ++i) {
+    pauses.push_back(events_[i].pause);
+  }
+  std::sort(pauses.begin(), pauses.end());
+  size_t rank = (size_t)(pct / 100 * pauses.size() + 0.999999);
+  if (rank < 1) rank = 1;
+  if (rank > pauses.size()) rank = pauses.size();
+  return pauses[rank - 1];
+}
+
+Time GCStats::totalPause() const {
+  Time total = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    total += events_[i].pause;
+  }
+  return total;
+}
+
+uint64_t GCStats::totalCopied() const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    total += events_[i].bytesCopied;
+  }
+  return total;
+}
+
+uint64_t GCStats::totalSelectorsEliminated() const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    total += events_[i].selectorsEliminated;
+  }
+  return total;
+}
+
+uint64_t GCStats::totalCAFsReverted() const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    total += events_[i].cafsReverted;
+  }
+  return total;
+}
+
+double GCStats::survivalRate(const GCEvent &ev) const {
+  if (ev.bytesBefore == 0)
+    return 0;
+  return (double)ev.bytesCopied / (double)ev.bytesBefore;
+}
+
+void GCStats::pauseHistogram(u4 *buckets) const {
+  for (int b = 0; b < kHistogramBuckets; ++b) {
+    buckets[b] = 0;
+  }
+  for (size_t i = 0; i < events_.size(); ++i) {
+    Time limit = USToTime(1);
+    int b = 0;
+    while (b < kHistogramBuckets - 1 && events_[i].pause >= limit) {
+      ++b;
+      limit *= 10;
+    }
+    ++buckets[b];
+  }
+}
+
+void GCStats::printSummary(FILE *out) const {
+  if (events_.empty())
+    return;
+
+  uint64_t before = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    before += events_[i].bytesBefore;
+  }
+  fprintf(out, "  GC pauses (us): p50 %" FMT_Word64 "  p90 %" FMT_Word64
+          "  p99 %" FMT_Word64 "  max %" FMT_Word64 "\n",
+          TimeToUS(pausePercentile(50)), TimeToUS(pausePercentile(90)),
+          TimeToUS(pausePercentile(99)), TimeToUS(pausePercentile(100)));
+
+  u4 buckets[kHistogramBuckets];
+  pauseHistogram(buckets);
+  fprintf(out, "   ");
+  for (int b = 0; b < kHistogramBuckets; ++b) {
+    fprintf(out, " %s:%u", histogramLabel[b], buckets[b]);
+  }
+  fprintf(out, "\n");
+  fprintf(out, "    %18" FMT_Word64 " bytes copied (%.1f%% survival)\n",
+          totalCopied(),
+          before == 0 ? 0.0 : 100 * (double)totalCopied() / (double)before);
+  fprintf(out, "    %18" FMT_Word64 " selector thunks eliminated\n",
+          totalSelectorsEliminated());
+  fprintf(out, "    %18" FMT_Word64 " unreachable CAFs reverted\n\n",
+          totalCAFsReverted());
+}
+
+void GCStats::writeJSON(FILE *out) const {
+  fprintf(out, "{\n    \"collections\": %lu,\n", (unsigned long)events_.size());
+  fprintf(out, "    \"pause_ns\": { \"total\": %" FMT_Word64
+          ", \"p50\": %" FMT_Word64 ", \"p90\": %" FMT_Word64
+          ", \"p99\": %" FMT_Word64 ", \"max\": %" FMT_Word64 " },\n",
+          TimeToNS(totalPause()),
+          TimeToNS(pausePercentile(50)), TimeToNS(pausePercentile(90)),
+          TimeToNS(pausePercentile(99)), TimeToNS(pausePercentile(100)));
+
+  u4 buckets[kHistogramBuckets];
+  pauseHistogram(buckets);
+  fprintf(out, "    \"pause_histogram\": {");
+  for (int b = 0; b < kHistogramBuckets; ++b) {
+    fprintf(out, "%s \"%s\": %u", b == 0 ? "" : ",", histogramLabel[b],
+            buckets[b]);
+  }
+  fprintf(out, " },\n");
+  fprintf(out, "    \"bytes_copied\": %" FMT_Word64 ",\n", totalCopied());
+
+  fprintf(out, "    \"events\": [");
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const GCEvent &ev = events_[i];
+    fprintf(out, "%s\n      { \"pause_ns\": %" FMT_Word64
+            ", \"major\": %s, \"bytes_before\": %" FMT_Word64
+            ", \"bytes_copied\": %" FMT_Word64
+            ", \"blocks_scavenged\": %u"
+            ", \"selectors_eliminated\": %u, \"cafs_reverted\": %u"
+            ", \"survival\": %.4f }",
+            i == 0 ? "" : ",", TimeToNS(ev.pause),
+            ev.major ? "true" : "false", ev.bytesBefore, ev.bytesCopied,
+            ev.blocksScavenged,
+            ev.selectorsEliminated, ev.cafsReverted, survivalRate(ev));
+  }
+  fprintf(out, "%s]\n  }", events_.empty() ? "" : "\n    ");
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -0,0 +1,55 @@
+#ifndef _GCSTATS_H_
+#define _GCSTATS_H_
+
+#include "common.hh"
+#include "time.hh"
+
+#include <stdio.h>
+#include <vector>
+
+_START_LAMBDACHINE_NAMESPACE
+
+// What happened during a single GC.
+typedef struct {
+  Time pause;                 // Wall clock time of the GC.
+  uint64_t bytesBefore;       // Bytes in from-space.
+  uint64_t bytesCopied;       // Bytes evacuated.
+  u4 blocksScavenged;         // To-space blocks filled by this GC.
+  bool major;                 // false for a nursery-only GC.
+  u4 selectorsEliminated;     // Selector thunks short-cut by the GC.
+  u4 cafsReverted;            // Unreachable CAFs whose value was freed.
+} GCEvent;
+
+// Records all GCs of a program run and summarises them.
+class GCStats {
+public:
+  // Pause time histogram buckets.  Bucket i counts pauses shorter
+  // than 10^i microseconds; the last bucket counts everything else.
+  static const int kHistogramBuckets = 7;
+
+  inline void record(const GCEvent &ev) { events_.push_back(ev); }
+  inline size_t numEvents() const { return events_.size(); }
+  inline const GCEvent &event(size_t i) const { return events_[i]; }
+
+  // Nearest-rank percentile of the pause times (0 < pct <= 100).
+  // Returns 0 if there were no GCs.
+  Time pausePercentile(double pct) const;
+  Time totalPause() const;
+  uint64_t totalCopied() const;
+  uint64_t totalSelectorsEliminated() const;
+  uint64_t totalCAFsReverted() const;
+  double survivalRate(const GCEvent &ev) const;
+  void pauseHistogram(u4 *buckets) const;
+
+  void printSummary(FILE *out) const;
+
+  // Writes a JSON object with the summary and all the events.
+  void writeJSON(FILE *out) const;
+
+private:
+  std::vector<GCEvent> events_;
+};
+
+_END_LAMBDACHINE_NAMESPACE
+
+#endif /* _GCSTATS_H_ */
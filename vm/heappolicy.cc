@@ -0,0 +1,95 @@
+#include "heappolicy.hh"
+#include "memorymanager.hh"
+
+_START_LAMBDACHINE_NAMESPACE
+
+#define DLOG(...) \
+  if (DEBUG_COMPONENTS & DEBUG_MEMORY_MANAGER) { \
+    fprintf(stderr, "MM: " __VA_ARGS__); }
+
+const double HeapSizingPolicy::kDefaultGrowthFactor = 2.0;
+const double HeapSizingPolicy::kMaxGrowthFactor = 32.0;
+
+HeapSizingPolicy::HeapSizingPolicy()
+  : minHeapBlocks_(2), maxHeapBlocks_(0),
+    initialFactor_(kDefaultGrowthFactor), factor_(kDefaultGrowthFactor),
+    overheadTarget_(0), overhead_(0),
+    decisions_(0), grown_(0), shrunk_(0), capped_(0), peakHeapBlocks_(0)
+{
+}
+
+void HeapSizingPolicy::setGrowthFactor(double factor) {
+  LC_ASSERT(factor > 1);
+  if (factor > kMaxGrowthFactor) factor = kMaxGrowthFactor;
+  initialFactor_ = factor;
+  factor_ = factor;
+}
+
+// Adjust the growth factor to the measured GC overhead.  The overhead
+// is smoothed a bit so that a single unusual GC doesn't cause the
+// heap to jump around.
+void HeapSizingPolicy::adapt(Time mutTime, Time gcTime) {
+  if (overheadTarget_ <= 0 || mutTime + gcTime == 0)
+    return;
+
+  double overhead = (double)gcTime / (double)(mutTime + gcTime);
+  overhead_ = decisions_ == 0 ? overhead : (overhead_ + overhead) / 2;
+
+  if (overhead_ > overheadTarget_ && factor_ < kMaxGrowthFactor) {
+    // GC cost per allocated byte is proportional to 1/(F-1).
+    factor_ = 1 + (factor_ - 1) * overhead_ / overheadTarget_;
+    if (factor_ > kMaxGrowthFactor) factor_ = kMaxGrowthFactor;
+    ++grown_;
+  } else if (overhead_ < overheadTarget_ / 2 && factor_ > initialFactor_) {
+    factor_ = 1 + (factor_ - 1) / 1.5;
+    if (factor_ < initialFactor_) factor_ = initialFactor_;
+    ++shrunk_;
+  }
+}
+
+u4 HeapSizingPolicy::heapTarget(u4 liveBlocks, Time mutTime, Time gcTime) {
+  adapt(mutTime, gcTime);
+  ++decisions_;
+
+  double wanted = liveBlocks * factor_;
+  u4 target = wanted > (double)~(u4)0 ? ~(u4)0 : (u4)wanted;
+  if (target < minHeapBlocks_) target = minHeapBlocks_;
+  // Always leave room for at least one block of allocation.
+  if (target <= liveBlocks) target = liveBlocks + 1;
+
+  if (maxHeapBlocks_ != 0 && target > maxHeapBlocks_) {
+    ++capped_;
+    if (liveBlocks >= maxHeapBlocks_) {
+      DLOG("Live data (%u blocks) exceeds max heap (%u blocks)\n",
+           liveBlocks, maxHeapBlocks_);
+      return 0;
+    }
+    target = maxHeapBlocks_;
+  }
+
+  DLOG("Heap target: live=%u factor=%.2f overhead=%.1f%% -> %u blocks\n",
+       liveBlocks, factor_, overhead_ * 100, target);
+
+  if (target > peakHeapBlocks_) peakHeapBlocks_ = target;
+  return target;
+}
+
+void HeapSizingPolicy::printStats(FILE *out) const {
+  fprintf(out, "  heap sizing: factor %.2f", factor_);
+  if (overheadTarget_ > 0) {
+    fprintf(out, " (initial %.2f, GC overhead %.1f%%, target %.1f%%)",
+            initialFactor_, overhead_ * 100, overheadTarget_ * 100);
+  }
+  fprintf(out, "\n");
+  fprintf(out, "    %18u sizing decisions (%u grow, %u shrink, %u capped)\n",
+          decisions_, grown_, shrunk_, capped_);
+  fprintf(out, "    %18" FMT_Word64 " KB peak heap target",
+          (uint64_t)peakHeapBlocks_ * Block::kBlockSize / 1024);
+  if (maxHeapBlocks_ != 0) {
+    fprintf(out, " (max %" FMT_Word64 " KB)",
+            (uint64_t)maxHeapBlocks_ * Block::kBlockSize / 1024);
+  }
+  fprintf(out, "\n\n");
+}
+
+_END_LAMBDACHINE_NAMESPACE
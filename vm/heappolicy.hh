@@ -0,0 +1,74 @@
+#ifndef _HEAPPOLICY_H_
+#define _HEAPPOLICY_H_
+
+#include "common.hh"
+#include "time.hh"
+
+#include <stdio.h>
+
+_START_LAMBDACHINE_NAMESPACE
+
+// Decides how large the heap may grow before the next GC.
+//
+// After each GC the heap may grow to growthFactor() times the size of
+// the live data (which, for a copying GC, is the amount of data that
+// was copied).  This bounds the amount of work per allocated byte:
+// with a factor of F each GC copies at most 1/(F-1) bytes for every
+// byte allocated since the previous GC.
+//
+// If an overhead target is set, the factor adapts to the fraction of
+// time actually spent in the GC: if GC takes more than the target the
+// heap grows faster, if it takes much less the heap shrinks back
+// towards the initial factor.  A maximum heap size, if set, always
+// takes precedence.
+//
+// All sizes are in blocks.
+class HeapSizingPolicy {
+public:
+  HeapSizingPolicy();
+
+  static const double kDefaultGrowthFactor;
+  static const double kMaxGrowthFactor;
+
+  inline void setMinHeapBlocks(u4 blocks) { minHeapBlocks_ = blocks; }
+  inline void setMaxHeapBlocks(u4 blocks) { maxHeapBlocks_ = blocks; }
+  inline u4 maxHeapBlocks() const { return maxHeapBlocks_; }
+  void setGrowthFactor(double factor);
+  inline double growthFactor() const { return factor_; }
+
+  // Target for the fraction of time spent in the GC, in percent.
+  // Zero disables adaptation.
+  inline void setOverheadTarget(double percent) {
+    overheadTarget_ = percent / 100;
+  }
+
+  // Returns the size the heap may grow to before the next GC, given
+  // the live data after a GC and the time spent in the mutator and
+  // the GC since the previous decision.
+  //
+  // Returns 0 if the live data alone exceeds the maximum heap size.
+  u4 heapTarget(u4 liveBlocks, Time mutTime, Time gcTime);
+
+  inline u4 peakHeapBlocks() const { return peakHeapBlocks_; }
+  void printStats(FILE *out) const;
+
+private:
+  void adapt(Time mutTime, Time gcTime);
+
+  u4 minHeapBlocks_;
+  u4 maxHeapBlocks_;   // 0 = unlimited
+  double initialFactor_;
+  double factor_;
+  double overheadTarget_;
+  double overhead_;    // Smoothed GC overhead.
+
+  u4 decisions_;
+  u4 grown_;           // Times the factor was increased.
+  u4 shrunk_;          // Times the factor was decreased.
+  u4 capped_;          // Times the target was capped by the max heap.
+  u4 peakHeapBlocks_;
+};
+
+_END_LAMBDACHINE_NAMESPACE
+
+#endif /* _HEAPPOLICY_H_ */
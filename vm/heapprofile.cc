@@ -0,0 +1,202 @@
+#include "heapprofile.hh"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <string.h>
+#include <time.h>
+
+_START_LAMBDACHINE_NAMESPACE
+
+static const char *closureTypeName[] = {
+#define DEF_CLOS_NAME(name, flags) #name,
+  CTDEF(DEF_CLOS_NAME)
+#undef DEF_CLOS_NAME
+};
+
+uint64_t HeapProfile::traceAllocCounters_[kMaxTraceAllocSites];
+
+HeapProfile::HeapProfile()
+  : out_(NULL), start_(0), interval_(0), nextCensus_(0), numCensuses_(0),
+    lastSample_(0), sampleInterval_(0), sampleCountdown_(0)
+{
+  // There is only one profile per process.
+  memset(traceAllocCounters_, 0, sizeof(traceAllocCounters_));
+}
+
+HeapProfile::~HeapProfile() {
+  if (out_ != NULL)
+    fclose(out_);
+}
+
+bool HeapProfile::open(const char *file, const char *job, Time interval) {
+  LC_ASSERT(out_ == NULL);
+  out_ = fopen(file, "w");
+  if (out_ == NULL)
+    return false;
+
+  time_t now = time(NULL);
+  char date[64];
+  strftime(date, sizeof(date), "%a %b %d %H:%M %Y", localtime(&now));
+
+  fprintf(out_, "JOB \"%s\"\n", job);
+  fprintf(out_, "DATE \"%s\"\n", date);
+  fprintf(out_, "SAMPLE_UNIT \"seconds\"\n");
+  fprintf(out_, "VALUE_UNIT \"bytes\"\n");
+  fprintf(out_, "BEGIN_SAMPLE 0.00\nEND_SAMPLE 0.00\n");
+
+  start_ = getProcessElapsedTime();
+  interval_ = interval;
+  nextCensus_ = start_ + interval;
+  return true;
+}
+
+void HeapProfile::close(Time now) {
+  if (out_ == NULL)
+    return;
+  double t = (double)(now - start_) / TIME_RESOLUTION;
+  if (t < lastSample_) t = lastSample_;
+  fprintf(out_, "BEGIN_SAMPLE %.2f\nEND_SAMPLE %.2f\n", t, t);
+  fclose(out_);
+  out_ = NULL;
+}
+
+void HeapProfile::beginCensus(Time now) {
+  census_.clear();
+  lastSample_ = (double)(now - start_) / TIME_RESOLUTION;
+  nextCensus_ = now + interval_;
+}
+
+static bool largerCensusEntry(const std::pair<std::string, uint64_t> &a,
+                              const std::pair<std::string, uint64_t> &b) {
+  return a.second > b.second;
+}
+
+void HeapProfile::endCensus() {
+  // Different info tables may have the same name, but hp2ps needs
+  // unique band names.
+  std::map<std::string, uint64_t> bands;
+  HASH_NAMESPACE::HASH_MAP_CLASS<Word, uint64_t>::const_iterator it;
+  for (it = census_.begin(); it != census_.end(); ++it) {
+    const InfoTable *info = (const InfoTable *)it->first;
+    std::string band = std::string(info->name()) + "/" +
+      closureTypeName[info->type()];
+    bands[band] += it->second;
+  }
+  std::vector<std::pair<std::string, uint64_t> > entries(bands.begin(),
+                                                          bands.end());
+  std::sort(entries.begin(), entries.end(), largerCensusEntry);
+
+  fprintf(out_, "BEGIN_SAMPLE %.2f\n", lastSample_);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    fprintf(out_, "%s\t%" FMT_Word64 "\n", entries[i].first.c_str(),
+            entries[i].second);
+  }
+  fprintf(out_, "END_SAMPLE %.2f\n", lastSample_);
+  fflush(out_);
+  ++numCensuses_;
+}
+
+void HeapProfile::setSampleInterval(u4 bytes) {
+  sampleInterval_ = bytes;
+  sampleCountdown_ = bytes != 0 ? bytes : (int64_t)(~(uint64_t)0 >> 1);
+}
+
+void HeapProfile::recordSample(const BcIns *pc, const Closure *node,
+                               const InfoTable *info) {
+  // A large allocation may cover several samples.
+  u4 samples = 0;
+  while (sampleCountdown_ <= 0) {
+    sampleCountdown_ += sampleInterval_;
+    ++samples;
+  }
+  InterpSite &site = interpSites_[(Word)pc];
+  if (site.samples == 0) {
+    site.fn = node->info();
+    site.info = info;
+  }
+  site.samples += samples;
+}
+
+uint64_t HeapProfile::sampledBytes(const BcIns *pc) const {
+  HASH_NAMESPACE::HASH_MAP_CLASS<Word, InterpSite>::const_iterator it =
+    interpSites_.find((Word)pc);
+  if (it == interpSites_.end())
+    return 0;
+  return it->second.samples * sampleInterval_;
+}
+
+uint64_t *HeapProfile::traceAllocCounter(u4 traceId, const InfoTable *info,
+                                         size_t bytes) {
+  if (traceSites_.size() >= kMaxTraceAllocSites)
+    return NULL;
+  TraceSite site = { traceId, info, bytes };
+  traceSites_.push_back(site);
+  return &traceAllocCounters_[traceSites_.size() - 1];
+}
+
+typedef struct {
+  uint64_t bytes;
+  uint64_t allocs;
+  const InfoTable *info;
+  const InfoTable *fn;
+  long offset;     // Instruction offset in fn, or -1 for traces.
+  u4 traceId;
+} AllocSiteSummary;
+
+static bool largerAllocSite(const AllocSiteSummary &a,
+                            const AllocSiteSummary &b) {
+  return a.bytes > b.bytes;
+}
+
+void HeapProfile::writeAllocSites(FILE *out) const {
+  std::vector<AllocSiteSummary> sites;
+
+  HASH_NAMESPACE::HASH_MAP_CLASS<Word, InterpSite>::const_iterator it;
+  for (it = interpSites_.begin(); it != interpSites_.end(); ++it) {
+    const InterpSite &s = it->second;
+    AllocSiteSummary sum;
+    sum.bytes = s.samples * sampleInterval_;
+    // The pc points just after the ALLOC instruction.
+    sum.offset = -1;
+    if (s.fn->hasCode()) {
+      const Code *code = ((const CodeInfoTable *)s.fn)->code();
+      sum.offset = (const BcIns *)it->first - 1 - code->code;
+    }
+    sum.allocs = 0;
+    sum.info = s.info;
+    sum.fn = s.fn;
+    sum.traceId = 0;
+    sites.push_back(sum);
+  }
+  for (size_t i = 0; i < traceSites_.size(); ++i) {
+    const TraceSite &s = traceSites_[i];
+    AllocSiteSummary sum;
+    sum.allocs = traceAllocCounters_[i];
+    sum.bytes = sum.allocs * s.bytes;
+    sum.info = s.info;
+    sum.fn = NULL;
+    sum.offset = -1;
+    sum.traceId = s.traceId;
+    sites.push_back(sum);
+  }
+  std::sort(sites.begin(), sites.end(), largerAllocSite);
+
+  fprintf(out, "Allocation sites (interpreter sampled every %u bytes, "
+          "traces exact)\n\n", sampleInterval_);
+  fprintf(out, "%18s %14s  %-32s %s\n", "bytes", "allocs", "closure", "site");
+  for (size_t i = 0; i < sites.size(); ++i) {
+    const AllocSiteSummary &s = sites[i];
+    if (s.bytes == 0)
+      continue;
+    if (s.fn != NULL) {
+      fprintf(out, "%18" FMT_Word64 " %14s  %-32s %s+%ld\n",
+              s.bytes, "~", s.info->name(), s.fn->name(), s.offset);
+    } else {
+      fprintf(out, "%18" FMT_Word64 " %14" FMT_Word64 "  %-32s trace %u\n",
+              s.bytes, s.allocs, s.info->name(), s.traceId);
+    }
+  }
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -0,0 +1,110 @@
+#ifndef _HEAPPROFILE_H_
+#define _HEAPPROFILE_H_
+
+#include "common.hh"
+#include "objects.hh"
+#include "time.hh"
+
+#include <stdio.h>
+#include <vector>
+#include HASH_MAP_H
+
+_START_LAMBDACHINE_NAMESPACE
+
+// Heap profiling.
+//
+// A census of the live heap is taken after a major GC if at least
+// the census interval has passed since the previous census.  Live
+// closures are classified by the name of their info table and their
+// closure type.  The censuses are written in the format of GHC's .hp
+// files, so they can be rendered with hp2ps.  Large objects are not
+// included.
+//
+// Optionally, allocations are sampled as well.  The interpreter
+// records one allocation for every sample interval bytes allocated,
+// together with the allocating instruction.  Compiled traces count
+// every execution of their allocation sites exactly.
+class HeapProfile {
+public:
+  HeapProfile();
+  ~HeapProfile();
+
+  // Starts writing censuses to the given file.  Returns false if the
+  // file could not be opened.
+  bool open(const char *file, const char *job, Time interval);
+  // Writes the final (empty) sample and closes the file.
+  void close(Time now);
+
+  inline bool censusDue(Time now) const {
+    return out_ != NULL && now >= nextCensus_;
+  }
+  void beginCensus(Time now);
+  inline void census(const Closure *cl, size_t bytes) {
+    census_[(Word)cl->info()] += bytes;
+  }
+  void endCensus();
+  inline u4 numCensuses() const { return numCensuses_; }
+
+  // Zero disables allocation sampling.
+  void setSampleInterval(u4 bytes);
+  inline bool sampleAllocs() const { return sampleInterval_ != 0; }
+
+  // Called by the interpreter for each allocation.  The pc identifies
+  // the allocation instruction, node is the closure whose code is
+  // running.
+  inline void allocated(const BcIns *pc, const Closure *node,
+                        const InfoTable *info, size_t bytes) {
+    sampleCountdown_ -= (int64_t)bytes;
+    if (LC_UNLIKELY(sampleCountdown_ <= 0))
+      recordSample(pc, node, info);
+  }
+
+  // Returns the counter for an allocation site in a trace, or NULL if
+  // there are too many sites.
+  uint64_t *traceAllocCounter(u4 traceId, const InfoTable *info,
+                              size_t bytes);
+
+  // Estimated bytes allocated at the given interpreter site.
+  uint64_t sampledBytes(const BcIns *pc) const;
+
+  void writeAllocSites(FILE *out) const;
+
+  static const u4 kMaxTraceAllocSites = 4096;
+
+private:
+  void recordSample(const BcIns *pc, const Closure *node,
+                    const InfoTable *info);
+
+  typedef struct {
+    const InfoTable *fn;    // The code containing the site
+    const InfoTable *info;  // What was allocated
+    uint64_t samples;
+  } InterpSite;
+
+  typedef struct {
+    u4 traceId;
+    const InfoTable *info;
+    size_t bytes;           // Size of each allocation
+  } TraceSite;
+
+  FILE *out_;
+  Time start_;
+  Time interval_;
+  Time nextCensus_;
+  u4 numCensuses_;
+  double lastSample_;
+  HASH_NAMESPACE::HASH_MAP_CLASS<Word, uint64_t> census_;
+
+  u4 sampleInterval_;
+  int64_t sampleCountdown_;
+  HASH_NAMESPACE::HASH_MAP_CLASS<Word, InterpSite> interpSites_;
+  std::vector<TraceSite> traceSites_;
+
+  // Must be within reach of a RIP-relative INC from machine code,
+  // hence a static array.
+  static uint64_t traceAllocCounters_[kMaxTraceAllocSites];
+};
+
+_END_LAMBDACHINE_NAMESPACE
+
+#endif /* _HEAPPROFILE_H_ */
@@ -39,6 +39,16 @@ static const char *tyname[] = {
 #undef IRTNAME
 };
 
+static const char *tyfullname[] = {
+#define IRTFULLNAME(name, str, col) #name,
+  IRTDEF(IRTFULLNAME)
+#undef IRTFULLNAME
+};
+
+const char *IR::typeName(uint8_t ty) {
+  return tyfullname[ty & IRT_TYPE];
+}
+
 enum {
   TC_NONE, TC_PRIM, TC_HEAP, TC_GREY,
   TC_MAX
@@ -174,7 +184,8 @@ void IR::debugPrint(ostream &out, IRRef self, IRBuffer *buf, bool regs) {
     print_reg(out, reg(), type());
     print_spill(out, spill());
   }
-  out << "    "; // TODO: flags go here
+  // TODO: other flags go here
+  out << ((op == IR::kNEW && isSunk()) ? " }  " : "    ");
   printType(out, ty);
   out << setw(8) << setfill(' ') << left << name_[op];
   uint8_t mod = mode(op);
@@ -222,6 +233,7 @@ void IRBuffer::reset(Word *base, Word *top) {
   snaps_.clear();
   snapmap_.reset();
   steps_ = 0;
+  pc_ = NULL;
 
   size_t nliterals = size_ / 4;
 
@@ -234,12 +246,16 @@ void IRBuffer::reset(Word *base, Word *top) {
 
   stopins_ = REF_FIRST;
   entry_relbase_ = 0;
+  loop_ = 0;
   parent_ = NULL;
   parentHeapReserved_ = 0;
 
   flags_.clear();
   flags_.set(kOptCSE);
   flags_.set(kOptFold);
+  flags_.set(kOptLoop);
+  flags_.set(kOptSink);
+  flags_.set(kOptDCE);
 
   memset(chain_, 0, sizeof(chain_));
   emitRaw(IRT(IR::kBASE, IRT_PTR), 0, 0);
@@ -330,7 +346,10 @@ found:
 }
 
 TRef IRBuffer::baseLiteral(Word *p) {
-  int offset = slots_.baseOffset(p);
+  return baseOffsetLiteral(slots_.baseOffset(p));
+}
+
+TRef IRBuffer::baseOffsetLiteral(int offset) {
   IRRef ref;
   IR *tir;
   for (ref = chain_[IR::kKBASEO]; ref != 0; ref = buffer_[ref].prev()) {
@@ -368,6 +387,16 @@ uint64_t IRBuffer::literalValue(IRRef ref) {
   return 0;
 }
 
+void IRBuffer::closureConstants(std::vector<Closure *> *out) {
+  for (IRRef ref = bufmin_; ref < REF_BIAS; ++ref) {
+    IR *ins = ir(ref);
+    if (ins->type() == IRT_CLOS &&
+        (ins->opcode() == IR::kKINT || ins->opcode() == IR::kKWORD)) {
+      out->push_back((Closure *)literalValue(ref));
+    }
+  }
+}
+
 TRef IRBuffer::optCSE() {
   if (flags_.get(kOptCSE)) {
     IRRef2 op12 =
@@ -428,17 +457,21 @@ uint32_t IRBuffer::setHeapOffsets() {
       // Check that we've reserved exactly the amount needed.
       LC_ASSERT((int)ir(chkref)->op1() == -offset);
       offset = 0;
-      ++heapchecks;
+      // Heap checks may become empty due to allocation sinking.
+      if (ir(chkref)->op1() != 0)
+        ++heapchecks;
       chkref = ir(chkref)->prev();
     }
     if (!cur)
       break;
+    LC_ASSERT(ir(cur)->opcode() == IR::kNEW);
     AbstractHeapEntry &entry = heap_.entry(ir(cur)->op2());
-    int sz = entry.size() + 1;
     LC_ASSERT(offset <= 0);
     entry.overallocated_ = -offset;
-    offset -= sz;
-    entry.hpofs_ = offset;
+    if (!ir(cur)->isSunk()) {
+      offset -= entry.size() + 1;
+      entry.hpofs_ = offset;
+    }
     cur = ir(cur)->prev();
   }
   // Non-zero offset indicates missing heap check.
@@ -482,6 +515,8 @@ bool AbstractStack::frame(Word *base, Word *top) {
   return true;
 }
 
+uint16_t Snapshot::hotExitThreshold_ = HOT_SIDE_EXIT_THRESHOLD;
+
 void AbstractStack::snapshot(Snapshot *snap, SnapshotData *snapmap,
                              IRRef1 ref, void *pc) {
   unsigned int slot = low_;
@@ -506,7 +541,8 @@ void AbstractStack::snapshot(Snapshot *snap, SnapshotData *snapmap,
   snap->relbase_ = base_ - kInitialBase;
   snap->entries_ = entries;
   snap->framesize_ = top_ - base_;
-  snap->exitCounter_ = HOT_SIDE_EXIT_THRESHOLD;
+  snap->exitCounter_ = Snapshot::hotExitThreshold_;
+  snap->genericExits_ = 0;
   snap->pc_ = pc;
   snap->mcode_ = NULL;
 
@@ -724,6 +760,8 @@ const char *IR::regName(uint8_t r, IRType ty) {
     return regNames32[r];
   case IRT_F32:
   case IRT_F64:
+    if (r < RID_MAX_GPR)  // Literals are materialised in GPRs.
+      return regNames64[r];
     LC_ASSERT(RID_MIN_FPR <= r && r < RID_MAX_FPR);
     return fpRegNames[r - RID_MIN_FPR];
   default:
@@ -806,11 +844,12 @@ void BranchTargetBuffer::growBuffer() {
   buf_ = (Entry *)realloc(buf_, size_ * sizeof(Entry));
 }
 
-void BranchTargetBuffer::emit(BcIns *pc) {
+void BranchTargetBuffer::emit(BcIns *pc, const Code *code) {
   if (LC_UNLIKELY(next_ >= size_))
     growBuffer();
   // TODO: add pc to bloom filter.
   buf_[next_].addr = pc;
+  buf_[next_].code = code;
   buf_[next_].stack = stack_->current();
   ++next_;
 }
@@ -822,7 +861,7 @@ BranchTargetBuffer::resetDominatedCounters(Capability *cap)
   for (uint32_t i = 0; i < next_; ++i) {
     void *new_tgt = buf_[i].addr;
     if (new_tgt < tgt)
-      cap->counters_.reset(new_tgt);
+      cap->counters_.reset(buf_[i].addr, buf_[i].code);
     tgt = new_tgt;
   }
 }
@@ -44,6 +44,12 @@ typedef u4 IRRef;               /* Used to pass around references */
   _(GEU,     G,   ref, ref) \
   _(LEU,     G,   ref, ref) \
   _(GTU,     G,   ref, ref) \
+  _(FLT,     G,   ref, ref) \
+  _(FGE,     G,   ref, ref) \
+  _(FLE,     G,   ref, ref) \
+  _(FGT,     G,   ref, ref) \
+  _(FEQ,     G,   ref, ref) \
+  _(FNE,     G,   ref, ref) \
   _(EQRET,   G,   ref, ref) \
   _(EQINFO,  G,   ref, ref) \
   _(NEINFO,  G,   ref, ref) \
@@ -79,6 +85,13 @@ typedef u4 IRRef;               /* Used to pass around references */
   _(REM,     N,   ref, ref) \
   _(NEG,     N,   ref, ___) \
   \
+  _(FADD,    C,   ref, ref) \
+  _(FSUB,    N,   ref, ref) \
+  _(FMUL,    C,   ref, ref) \
+  _(FDIV,    N,   ref, ref) \
+  _(FSQRT,   N,   ref, ___) \
+  _(CONV,    N,   ref, lit) /* op2 = IRType of op1 */ \
+  \
   _(FREF,    R,   ref, lit) \
   _(FLOAD,   L,   ref, ___) \
   _(SLOAD,   L,   lit, lit) \
@@ -167,6 +180,7 @@ typedef enum {
 
   // Flags
   IRT_MARK  = 0x20,  // Marker for various purposes
+  IRT_SUNK  = 0x20,  // NEW: Allocation sunk into exits (see ir_sink.cc)
   IRT_ISPHI = 0x40,  // Used by register allocator
   IRT_GUARD = 0x80,  // Used by asm code generator
 
@@ -205,13 +219,16 @@ inline bool isFloatType(IRType t) {
 
 // Exception error codes
 enum {
-  IROPTERR_FAILING_GUARD = 1
+  IROPTERR_FAILING_GUARD = 1,
+  IROPTERR_MCODE_FULL        // Thrown by the assembler.
 };
 
 // Forward references, defined in this file.
 class IRBuffer;
 class AbstractHeap;
 
+typedef struct _Closure Closure;
+
 class IR {
 public:
   IR() : data_() {}
@@ -274,6 +291,10 @@ public:
 
   inline bool isGuard() { return data_.t & IRT_GUARD; }
 
+  /// Returns whether this (NEW) instruction has been sunk, i.e., the
+  /// object is only allocated if the trace is left.
+  inline bool isSunk() { return data_.t & IRT_SUNK; }
+
   inline void setOpcode(Opcode op) { data_.o = op; }
   inline void setT(uint8_t ty) { data_.t = ty; }
   inline void setOt(uint16_t ot) { data_.ot = ot; }
@@ -294,10 +315,13 @@ public:
   }
 
   static inline bool hasSideEffect(Opcode op) {
-    return mode_[op] & IRM_S;
+    return (mode_[op] & IRM_S) == IRM_S;
   }
 
   static const char *regName(uint8_t reg, IRType ty);
+  static inline const char *name(Opcode op) { return name_[op]; }
+  // The unpadded name of the type, e.g., "I64".
+  static const char *typeName(uint8_t ty);
   static void printIRRef(std::ostream &out, IRRef ref);
   void debugPrint(std::ostream &out, IRRef self) {
     debugPrint(out, self, NULL, false);
@@ -325,6 +349,11 @@ private:
 #define IR_SAVE_LINK  2
 
 #define IR_SLOAD_DEFAULT 0
+
+// CONV: Reinterpret the bits of op1 instead of converting the value.
+// Used to move a value between general purpose and floating point
+// registers.
+#define IRCONV_RAW 0x100
 #define IR_SLOAD_INHERIT 1
 
 #define irmode_left(mode) ((uint8_t)(mode) & 3)
@@ -420,7 +449,8 @@ inline SnapEntry::SnapEntry(int s, IRRef1 r)
 class Snapshot {
 public:
   /// Default constructor.
-  Snapshot() : ref_(0), entries_(0), exitCounter_(HOT_SIDE_EXIT_THRESHOLD) {}
+  Snapshot() : ref_(0), entries_(0), exitCounter_(hotExitThreshold_),
+               genericExits_(0) {}
 
   /// Returns the snapshot reference.  The snapshot describes the
   /// state BEFORE the referenced instruction is executed.
@@ -456,6 +486,19 @@ public:
   // Returns true if the side exit become hot.
   inline bool bumpExitCounter();
 
+  // Returns true exactly once, when the exit has been restored by the
+  // generic exit handler EXIT_HANDLER_THRESHOLD times.
+  inline bool bumpGenericExits() {
+    return genericExits_ < EXIT_HANDLER_THRESHOLD &&
+      ++genericExits_ == EXIT_HANDLER_THRESHOLD;
+  }
+
+  // Sets the number of times a side exit must be taken before a side
+  // trace is recorded.  Only affects snapshots created afterwards.
+  static inline void setHotExitThreshold(uint16_t n) {
+    hotExitThreshold_ = n;
+  }
+
   // Returns the number of interpreter instructions executed since the
   // start of the trace.  Each new loop iteration resets this number
   // to zero.  It is used by the shadow interpreter.
@@ -475,11 +518,15 @@ private:
   uint16_t exitCounter_;
   uint16_t steps_;
   int16_t lastHeapEntry_;
+  uint16_t genericExits_;
   void *pc_;
   MCode *mcode_;
+  static uint16_t hotExitThreshold_;
   friend class AbstractStack;
   friend class Assembler;  // Sets mcode_
   friend class IRBuffer;  // Sets steps_
+  friend class Jit;  // Restores cached traces
+  friend class TraceDump;
 };
 
 typedef Snapshot::MapRef SnapmapRef;
@@ -488,12 +535,21 @@ inline bool Snapshot::bumpExitCounter() {
   --exitCounter_;
   bool is_hot = exitCounter_ == 0;
   if (is_hot) {
-    exitCounter_ = HOT_SIDE_EXIT_THRESHOLD;
+    exitCounter_ = hotExitThreshold_;
   }
   return is_hot;
 }
 
 
+// Returns whether the object allocated by the instruction at `ref`
+// must be constructed when leaving the trace through `snap`.  That's
+// the case if the allocation has been sunk or has not yet been
+// performed at that point.
+inline bool isDeferredAlloc(IR *ins, IRRef ref, const Snapshot &snap) {
+  return ins->opcode() == IR::kNEW &&
+    (ins->isSunk() || ref > snap.ref());
+}
+
 class SnapshotData {
 public:
   SnapshotData();
@@ -511,6 +567,7 @@ private:
   friend class AbstractStack;
   friend class Snapshot;
   friend class Jit;
+  friend class IRBuffer;
 };
 
 
@@ -595,6 +652,10 @@ public:
     LC_ASSERT(n < nextentry_);
     return entries_[n];
   }
+  inline IRRef1 field(int n, int i) {
+    return data_.at(entry(n).mapentry() + i);
+  }
+  inline uint32_t numEntries() const { return nextentry_; }
 private:
   void grow();
   AbstractHeapEntry *entries_;
@@ -661,13 +722,14 @@ public:
 
   void debugPrint(std::ostream &);
 
-private:
   inline bool inRange(int n) const {
     return
       ((int)base_ + n >= 0) && (base_ + n < kSlots);
   }
 
   static const unsigned int kSlots = 500;
+
+private:
   static const unsigned int kInitialBase = 250;
 
   TRef *slots_;
@@ -765,8 +827,9 @@ public:
   int isTrueLoop(BcIns *pc) const;
 
   /// Append the given pc to the end of the trace buffer.  Annotates
-  /// it with a reference to the current stack.
-  void emit(BcIns *pc);
+  /// it with a reference to the current stack and the code it
+  /// belongs to.
+  void emit(BcIns *pc, const struct _Code *code = NULL);
 
   inline uint32_t size() const { return next_; }
 
@@ -779,6 +842,7 @@ private:
 
   typedef struct {
     BcIns *addr;
+    const struct _Code *code;
     StackNodeRef1 stack;
   } Entry;
 
@@ -836,6 +900,32 @@ public:
     return s;
   }
 
+  /// Like slot(), but the result is always in a floating point
+  /// register.  A slot that hasn't been read yet is loaded directly
+  /// into one.
+  inline TRef doubleSlot(int n) {
+    TRef s = slots_.get(n);
+    if (s.isNone()) {
+      s = emitRaw(IRT(IR::kSLOAD, IRT_F64), slots_.absolute(n),
+                  IR_SLOAD_DEFAULT);
+      slots_.set(n, s);
+    }
+    return toFloatReg(s);
+  }
+
+  /// Returns a reference to the bits of tr in a floating point register.
+  inline TRef toFloatReg(TRef tr) {
+    if (inFloatReg(tr.ref()))
+      return tr;
+    return emit(IR::kCONV, IRT_F64, tr, IRCONV_RAW | (tr.t() & IRT_TYPE));
+  }
+
+  /// The register class of a reference is determined by its type.
+  /// Literals are always materialised in general purpose registers.
+  inline bool inFloatReg(IRRef ref) {
+    return !irref_islit(ref) && isFloatType(ir(ref)->type());
+  }
+
   inline void setSlot(int n, TRef tr) {
     if (tr.ref() != 0) tr.markWritten();
     slots_.set(n, tr);
@@ -843,12 +933,32 @@ public:
 
   TRef literal(IRType ty, uint64_t lit);
   uint64_t literalValue(IRRef ref);
+  // Appends the closures referenced by constants.
+  void closureConstants(std::vector<Closure *> *out);
 
   /// A literal that represents a pointer into the stack.
   TRef baseLiteral(Word *p);
+  TRef baseOffsetLiteral(int offset);
   TRef optFold();
   TRef optCSE();
 
+  // Unrolls a trace that loops back to its own entry (see
+  // ir_loop.cc).  Must be called right after emitting the final
+  // `SAVE IR_SAVE_LOOP`.  Returns false and leaves the buffer
+  // unchanged if the trace cannot be optimised.
+  bool optLoop();
+
+  // Reference of the LOOP instruction, or 0 if the trace has none.
+  inline IRRef loopRef() const { return loop_; }
+
+  // Removes allocations whose result does not escape the trace (see
+  // ir_sink.cc).  Returns the number of sunk allocations.
+  int optSink();
+
+  // Replaces instructions whose results are not needed by NOPs (see
+  // ir_dce.cc).  Returns the number of removed instructions.
+  int optDCE();
+
   inline int size() { return (bufmax_ - bufmin_); }
 
   inline IR *ir(IRRef ref) {
@@ -860,6 +970,9 @@ public:
 
   static const int kOptCSE = 0;
   static const int kOptFold = 1;
+  static const int kOptLoop = 2;
+  static const int kOptSink = 3;
+  static const int kOptDCE = 4;
   static const int kRegsAllocated = 16;
 
   inline void enableOptimisation(int optId) { flags_.set(optId); }
@@ -939,9 +1052,15 @@ private:
   TRef emit(); // Emit without optimisation.
 
   IRRef foldHeapcheck();
+  IRRef foldLoad();
+  bool isKnownHNF(IRRef ref);
 
   IRRef doFold();
 
+  void loopSnapshot(const Snapshot &orig,
+                    const std::vector<uint32_t> &loopmap,
+                    const std::vector<IRRef1> &subst);
+
   inline void set(uint16_t ot, IRRef1 op1, IRRef op2) {
     fold_.ins.setOt(ot);
     fold_.ins.setOp1(op1);
@@ -975,6 +1094,7 @@ private:
   Fragment *parent_;
   int32_t parentHeapReserved_;
   int32_t entry_relbase_;
+  IRRef loop_;
   // no. of inherited slots = stopins_ - REF_FIRST.
 
   friend class Jit;
@@ -1048,6 +1168,9 @@ LC_STATIC_ASSERT((IR::kLT + 2) == IR::kLE);
 LC_STATIC_ASSERT((IR::kLE + 2) == IR::kEQ);
 LC_STATIC_ASSERT((IR::kLTU & 1) == 0);
 LC_STATIC_ASSERT((IR::kLTU + 2) == IR::kLEU);
+LC_STATIC_ASSERT((IR::kFLT & 1) == 0);
+LC_STATIC_ASSERT((IR::kFLT + 2) == IR::kFLE);
+LC_STATIC_ASSERT((IR::kFLE + 2) == IR::kFEQ);
 
 _END_LAMBDACHINE_NAMESPACE
 
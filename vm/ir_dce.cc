@@ -0,0 +1,94 @@
+#include "ir.hh"
+
+#include <vector>
+
+_START_LAMBDACHINE_NAMESPACE
+
+using namespace std;
+
+/// Dead Code Elimination
+/// =====================
+///
+/// Folding often leaves instructions behind whose results are no
+/// longer needed, e.g., the FREF of a forwarded FLOAD, or the fields
+/// of a sunk allocation that is not mentioned by any snapshot.  The
+/// register allocator would still assign registers to them.
+///
+/// An instruction is live if it is a guard, has a side effect, is a
+/// (non-sunk) allocation, or if its result is used by a live
+/// instruction or a snapshot.  Since all uses come after the
+/// definition, a single backwards pass suffices.  Dead instructions
+/// are turned into NOPs, which the code generator skips.
+///
+/// Every snapshot belongs to a guard, so all snapshot entries are
+/// live.  Inherited slots of side traces must stay where they are,
+/// so we never remove them.
+///
+/// A dead sunk allocation is not turned into a NOP: it is still
+/// linked into the NEW chain that IRBuffer::setHeapOffsets walks and
+/// a NOP would look like a real allocation of heap entry 0.  Since no
+/// code is emitted for it anyway, we simply leave it alone, but its
+/// fields are not kept alive.
+
+static inline bool isRoot(IR *ins) {
+  IR::Opcode op = ins->opcode();
+  if (ins->isGuard() || IR::hasSideEffect(op))
+    return true;
+  switch (op) {
+  case IR::kBASE:
+  case IR::kLOOP:
+  case IR::kPHI:
+    return true;
+  case IR::kNEW:
+    return !ins->isSunk();
+  default:
+    return false;
+  }
+}
+
+int IRBuffer::optDCE() {
+  if (!flags_.get(kOptDCE))
+    return 0;
+
+  vector<uint8_t> live(bufmax_ - REF_BIAS, 0);
+
+  for (SnapNo n = 0; n < snaps_.size(); ++n) {
+    Snapshot &snap = snaps_[n];
+    for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se) {
+      IRRef ref = snapmap_.slotRef(se);
+      if (!irref_islit(ref))
+        live[ref - REF_BIAS] = 1;
+    }
+  }
+
+  int removed = 0;
+  for (IRRef ref = bufmax_ - 1; ref >= REF_FIRST; --ref) {
+    IR *ins = ir(ref);
+    IR::Opcode op = ins->opcode();
+    if (!live[ref - REF_BIAS] && !isRoot(ins)) {
+      if (ref >= stopins_ && op != IR::kNOP && op != IR::kNEW) {
+        ins->setOt(IRT(IR::kNOP, IRT_VOID));
+        ins->setOp1(0);
+        ins->setOp2(0);
+        ++removed;
+      }
+      continue;
+    }
+    uint8_t mode = IR::mode(op);
+    if (irmode_left(mode) == IR::IRMref && !irref_islit(ins->op1()))
+      live[ins->op1() - REF_BIAS] = 1;
+    if (irmode_right(mode) == IR::IRMref && !irref_islit(ins->op2()))
+      live[ins->op2() - REF_BIAS] = 1;
+    if (op == IR::kNEW) {
+      HeapEntry entry = ins->op2();
+      for (int i = 0; i < numFields(entry); ++i) {
+        IRRef field = getField(entry, i);
+        if (!irref_islit(field))
+          live[field - REF_BIAS] = 1;
+      }
+    }
+  }
+  return removed;
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -287,7 +287,8 @@ FOLDF(simplify_intsubaddadd_cancel) {
 
 IRRef IRBuffer::foldHeapcheck() {
   IRRef hpchkref = chain_[IR::kHEAPCHK];
-  if (hpchkref /* && hpchkref >= loop_ */) {
+  // Don't merge heap checks across the loop boundary.
+  if (hpchkref && hpchkref >= loop_) {
     IR *hpchk = ir(hpchkref);
     uint16_t nwords = hpchk->op1() + fins->op1();
     hpchk->setOp1(nwords);
@@ -296,6 +297,67 @@ IRRef IRBuffer::foldHeapcheck() {
   return NEXTFOLD;
 }
 
+// Returns true if `ref` is known to point to an object in head normal
+// form.  Such an object is never the target of an UPDATE, so none of
+// its fields can change.
+bool IRBuffer::isKnownHNF(IRRef ref) {
+  if (irref_islit(ref)) {
+    Closure *cl = (Closure *)literalValue(ref);
+    return cl->isHNF();
+  }
+  for (IRRef g = chain_[IR::kEQINFO]; g > ref; g = ir(g)->prev()) {
+    IR *guard = ir(g);
+    if (guard->op1() == ref) {
+      InfoTable *itbl = (InfoTable *)literalValue(guard->op2());
+      return closureFlags[itbl->type()] & CF_HNF;
+    }
+  }
+  return false;
+}
+
+// Forwards the result of an earlier load of the same field.
+//
+// FREFs are CSE'd, so loads of the same field share their FREF.  The
+// only instruction that changes the heap is UPDATE, which overwrites
+// the info table and the first payload word of a thunk:
+//
+//   UPDATE x y;  FLOAD (FREF x 1)  ==>  y
+//
+// An UPDATE of some other object may alias the loaded object unless
+// that is known to be in head normal form, or the updated object was
+// allocated on the trace after the loaded object already existed.
+IRRef IRBuffer::foldLoad() {
+  IRRef fref = fins->op1();
+  IRRef base = ir(fref)->op1();
+  int offset = ir(fref)->op2();
+  bool immutable = isKnownHNF(base);
+  // A load in the loop body may not reuse a value loaded in an
+  // earlier iteration unless the field cannot change.
+  IRRef looplim = (!immutable && loop_) ? loop_ : 0;
+
+  IRRef lim = fref > looplim ? fref : looplim;
+  IRRef load = chain_[IR::kFLOAD];
+  while (load > lim && ir(load)->op1() != fref)
+    load = ir(load)->prev();
+  if (load > lim) {
+    lim = load;
+  } else {
+    lim = base > looplim ? base : looplim;
+    load = NEXTFOLD;
+  }
+
+  if (!immutable) {
+    for (IRRef u = chain_[IR::kUPDATE]; u > lim; u = ir(u)->prev()) {
+      IR *upd = ir(u);
+      if (upd->op1() == base)
+        return offset == 1 ? (IRRef)upd->op2() : (IRRef)NEXTFOLD;
+      if (!(upd->op1() > base && ir(upd->op1())->opcode() == IR::kNEW))
+        return NEXTFOLD;
+    }
+  }
+  return load;
+}
+
 // Constant-fold an EQGUARD where the closure is a literal. The
 // second operand will always be a literal.
 FOLDF(kfold_eqinfo) {
@@ -471,6 +533,7 @@ retry:
     break;
   case IR::kFLOAD:
     PATTERN(any, any, load_fwd);
+    ref = foldLoad();
     break;
   default:
     break;
@@ -0,0 +1,300 @@
+#include "ir.hh"
+
+#include <string.h>
+#include <vector>
+
+_START_LAMBDACHINE_NAMESPACE
+
+using namespace std;
+
+/// Loop Optimisation
+/// =================
+///
+/// A root trace that ends in `SAVE IR_SAVE_LOOP` jumps back to its
+/// own entry.  Without this pass every iteration reloads all stack
+/// slots, re-checks every guard and writes all modified slots back
+/// to the stack.  Following LuaJIT, we unroll the trace once:
+///
+///     <preamble>               ; the trace as recorded
+///     LOOP
+///     <body>                   ; a copy of the preamble
+///     PHI ...
+///     SAVE IR_SAVE_LOOP        ; jumps back to LOOP
+///
+/// Each preamble instruction is copied into the body via the fold
+/// engine, with its operands replaced by their copies (`subst`).  An
+/// SLOAD is replaced by the value the preamble writes to that slot,
+/// or by itself if the slot isn't written.  Copies whose operands are
+/// the same in every iteration are CSE'd to the preamble
+/// instruction, which hoists invariant computations and guards out
+/// of the loop.  Loads from the heap are only hoisted if the trace
+/// contains no UPDATE, since that is the only way the heap changes.
+///
+/// A preamble reference P used in the body stands for the value P
+/// had in the previous iteration.  If its copy subst[P] differs from
+/// P, we emit `PHI P subst[P]`; the register allocator moves subst[P]
+/// into P's register at the end of the body.  Loop-carried values
+/// stay in registers, so the body doesn't write to the stack at all.
+/// Instead, a snapshot in the body is the loop snapshot (the slots
+/// written by the preamble) overlaid with the copied entries of the
+/// corresponding preamble snapshot.
+
+// Each PHI occupies a register for the whole loop.
+static const size_t kMaxLoopPhis = 8;
+
+static inline IRRef1 substRef(const vector<IRRef1> &subst, IRRef ref) {
+  if (irref_islit(ref))
+    return (IRRef1)ref;
+  LC_ASSERT(ref - REF_BIAS < subst.size());
+  return subst[ref - REF_BIAS];
+}
+
+static inline int loopmapSlot(uint32_t data) {
+  return (int32_t)data >> 16;
+}
+
+// Replaces the snapshot of the guard just copied into the loop body.
+void IRBuffer::loopSnapshot(const Snapshot &orig,
+                            const vector<uint32_t> &loopmap,
+                            const vector<IRRef1> &subst) {
+  Snapshot &snap = snaps_.back();
+  size_t ofs = snap.mapofs_;
+  unsigned int entries = 0;
+  snapmap_.data_.resize(ofs + orig.entries() + loopmap.size());
+
+  // Both lists of entries are sorted by slot.
+  Snapshot::MapRef se = orig.begin();
+  size_t l = 0;
+  while (se < orig.end() || l < loopmap.size()) {
+    uint32_t data;
+    if (l >= loopmap.size() ||
+        (se < orig.end() &&
+         snapmap_.slotId(se) <= loopmapSlot(loopmap[l]))) {
+      int slot = snapmap_.slotId(se);
+      if (l < loopmap.size() && loopmapSlot(loopmap[l]) == slot)
+        ++l;
+      data = ((uint32_t)slot << 16) |
+        (uint32_t)substRef(subst, snapmap_.slotRef(se));
+      ++se;
+    } else {
+      data = loopmap[l++];
+    }
+    snapmap_.data_.at(ofs++) = data;
+    ++entries;
+  }
+
+  snap.relbase_ = orig.relbase_;
+  snap.entries_ = entries;
+  snap.framesize_ = orig.framesize_;
+  snap.steps_ = orig.steps_;
+  snap.pc_ = orig.pc_;
+  snapmap_.index_ = ofs;
+}
+
+bool IRBuffer::optLoop() {
+  IRRef saveref = bufmax_ - 1;
+  if (!flags_.get(kOptLoop) || loop_ != 0 || parent_ != NULL ||
+      stopins_ != REF_FIRST || chain_[IR::kSAVE] != saveref ||
+      ir(saveref)->op1() != IR_SAVE_LOOP)
+    return false;
+
+  const Snapshot loopsnap = snaps_.back();
+  // TODO: Support loops that don't leave the stack frame unchanged.
+  if (loopsnap.ref() != saveref || loopsnap.relbase() != 0)
+    return false;
+
+  vector<uint32_t> loopmap(snapmap_.data_.begin() + loopsnap.begin(),
+                           snapmap_.data_.begin() + loopsnap.end());
+
+  // Remember enough state to undo the transformation.
+  IR saveins = *ir(saveref);
+  IRRef1 savedchain[IR::k_MAX];
+  memcpy(savedchain, chain_, sizeof(chain_));
+  size_t nsnaps = snaps_.size();
+  size_t mapindex = snapmap_.index_;
+  uint32_t nentries = heap_.nextentry_;
+  size_t heapdata = heap_.data_.next_;
+  int reserved = heap_.reserved_;
+  vector<IRRef1> fwdrefs;
+  for (uint32_t i = 0; i < nentries; ++i)
+    fwdrefs.push_back(heap_.entries_[i].fwdref_);
+
+  // Drop the SAVE, but leave the loop snapshot's entries in the
+  // snapshot map.
+  bufmax_ = saveref;
+  chain_[IR::kSAVE] = saveins.prev();
+  snaps_.pop_back();
+
+  IRRef invar = saveref;
+  vector<IRRef1> subst(invar - REF_BIAS, 0);
+  subst[0] = REF_BASE;
+  bool immutableHeap = chain_[IR::kUPDATE] == 0;
+  vector<IRRef1> phis;
+
+  try {
+    loop_ = emitRaw(IRT(IR::kLOOP, IRT_VOID), 0, 0).ref();
+    LC_ASSERT(loop_ == invar);
+
+    SnapNo snapno = 0;
+    for (IRRef ref = REF_FIRST; ref < invar; ++ref) {
+      IR *ins = ir(ref);
+      IR::Opcode op = ins->opcode();
+      uint8_t mode = IR::mode(op);
+      IRRef1 op1 = ins->op1();
+      IRRef1 op2 = ins->op2();
+      if (irmode_left(mode) == IR::IRMref) op1 = substRef(subst, op1);
+      if (irmode_right(mode) == IR::IRMref) op2 = substRef(subst, op2);
+      uint16_t ot = IRT(op, ins->t() & (IRT_TYPE | IRT_GUARD));
+      bool invariant = op1 == ins->op1() && op2 == ins->op2();
+      size_t nsnapsBefore = snaps_.size();
+      TRef tr;
+
+      switch (op) {
+      case IR::kSLOAD: {
+        tr = TRef(ref, ins->t());
+        int slot = (int16_t)ins->op1();
+        for (size_t i = 0; i < loopmap.size(); ++i) {
+          if (loopmapSlot(loopmap[i]) == slot) {
+            IRRef1 r = (IRRef1)loopmap[i];
+            tr = TRef(r, ir(r)->t());
+            // The slot may now hold a value of the other register class.
+            if (inFloatReg(r) != inFloatReg(ref))
+              tr = emit(IR::kCONV, ins->type(), tr,
+                        IRCONV_RAW | ir(r)->type());
+            break;
+          }
+        }
+        break;
+      }
+      case IR::kFREF:
+        // Only reuse invariant field references.  The code generator
+        // fuses FREFs into their uses, so they cannot become PHIs.
+        tr = invariant ? emit(ot, op1, op2) : emitRaw(ot, op1, op2);
+        break;
+      case IR::kFLOAD:
+      case IR::kPLOAD:
+        if (invariant && immutableHeap)
+          tr = TRef(ref, ins->t());
+        else
+          tr = emit(ot, op1, op2);
+        break;
+      case IR::kEQINFO:
+      case IR::kNEINFO:
+      case IR::kILOAD:
+        // An UPDATE in the preamble may have overwritten the info
+        // table, so the body must check it again.
+        if (invariant && !immutableHeap && !irref_islit(op1))
+          tr = emitRaw(ot, op1, op2);
+        else
+          tr = emit(ot, op1, op2);
+        break;
+      case IR::kNEW: {
+        HeapEntry orig = op2;
+        HeapEntry entry = 0;
+        int nfields = numFields(orig);
+        tr = emitNEW(op1, nfields, &entry);
+        for (int i = 0; i < nfields; ++i)
+          setField(entry, i, substRef(subst, getField(orig, i)));
+        break;
+      }
+      case IR::kHEAPCHK:
+        emitHeapCheck(op1);
+        break;
+      default:
+        tr = emit(ot, op1, op2);
+        break;
+      }
+
+      if (ins->isGuard()) {
+        if (snaps_.size() > nsnapsBefore) {
+          LC_ASSERT(snaps_.size() == nsnapsBefore + 1);
+          loopSnapshot(snaps_[snapno], loopmap, subst);
+        }
+        ++snapno;
+      }
+      subst[ref - REF_BIAS] = tr.ref();
+    }
+    LC_ASSERT(snapno == nsnaps - 1);
+
+    // Find the preamble references used by the body.  A PHI's right
+    // operand counts as a use, so this has to iterate.
+    vector<uint8_t> used(invar - REF_BIAS, 0);
+    for (IRRef ref = invar + 1; ref < bufmax_; ++ref) {
+      IR *ins = ir(ref);
+      uint8_t mode = IR::mode(ins->opcode());
+      if (irmode_left(mode) == IR::IRMref && ins->op1() > REF_BASE &&
+          ins->op1() < invar)
+        used[ins->op1() - REF_BIAS] = 1;
+      if (irmode_right(mode) == IR::IRMref && ins->op2() > REF_BASE &&
+          ins->op2() < invar)
+        used[ins->op2() - REF_BIAS] = 1;
+      if (ins->opcode() == IR::kNEW) {
+        HeapEntry entry = ins->op2();
+        for (int i = 0; i < numFields(entry); ++i) {
+          IRRef r = getField(entry, i);
+          if (r > REF_BASE && r < invar)
+            used[r - REF_BIAS] = 1;
+        }
+      }
+    }
+    for (SnapNo n = nsnaps - 1; n < snaps_.size(); ++n) {
+      Snapshot &snap = snaps_[n];
+      for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se) {
+        IRRef r = snapmap_.slotRef(se);
+        if (r > REF_BASE && r < invar)
+          used[r - REF_BIAS] = 1;
+      }
+    }
+
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (IRRef ref = REF_FIRST; ref < invar; ++ref) {
+        IRRef1 s = subst[ref - REF_BIAS];
+        if (used[ref - REF_BIAS] != 1 || s == ref)
+          continue;
+        if (s == 0 || ir(ref)->opcode() == IR::kFREF)
+          throw 0;
+        used[ref - REF_BIAS] = 2;
+        phis.push_back(ref);
+        if (s > REF_BASE && s < invar && used[s - REF_BIAS] == 0) {
+          used[s - REF_BIAS] = 1;
+          changed = true;
+        }
+      }
+    }
+    if (phis.size() > kMaxLoopPhis)
+      throw 0;
+
+  } catch (int) {
+    // Guard in the loop body always fails, too many PHIs, etc.
+    bufmax_ = saveref;
+    *ir(saveref) = saveins;
+    bufmax_ = saveref + 1;
+    memcpy(chain_, savedchain, sizeof(chain_));
+    snaps_.resize(nsnaps - 1);
+    snaps_.push_back(loopsnap);
+    snapmap_.index_ = mapindex;
+    heap_.nextentry_ = nentries;
+    heap_.data_.next_ = heapdata;
+    heap_.reserved_ = reserved;
+    for (uint32_t i = 0; i < nentries; ++i)
+      heap_.entries_[i].fwdref_ = fwdrefs[i];
+    loop_ = 0;
+    return false;
+  }
+
+  for (size_t i = 0; i < phis.size(); ++i) {
+    IRRef ref = phis[i];
+    IR *ins = ir(ref);
+    ins->setT(ins->t() | IRT_ISPHI);
+    emitRaw(IRT(IR::kPHI, ins->type() | IRT_ISPHI),
+            ref, subst[ref - REF_BIAS]);
+  }
+
+  emitRaw(IRT(IR::kSAVE, IRT_VOID | IRT_GUARD), IR_SAVE_LOOP, 0);
+  loopSnapshot(loopsnap, loopmap, subst);
+  return true;
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -0,0 +1,98 @@
+#include "ir.hh"
+
+#include <vector>
+
+_START_LAMBDACHINE_NAMESPACE
+
+using namespace std;
+
+/// Allocation Sinking
+/// ==================
+///
+/// Many allocations on a trace are only needed if the trace is left.
+/// A typical example is a boxed loop counter:
+///
+///     x = SLOAD 0
+///     y = ADD x 1
+///         HEAPCHK #2
+///     z = NEW I# [y]
+///         LT y 1000           ; z is in the snapshot
+///     ...
+///
+/// If the fields of `z` are loaded again on the trace, the fold engine
+/// forwards the stored values, so the object itself is only needed by
+/// the snapshots.  We mark such allocations as sunk.  The code
+/// generator does not emit any code for them and the heap check no
+/// longer reserves space for them.  If the trace is left through a
+/// snapshot that mentions a sunk allocation, the exit handler
+/// constructs the object from the values of its fields (see
+/// Fragment::restoreSnapshot).  A side trace re-creates the object
+/// when it is entered (see Jit::replaySnapshot).
+///
+/// An allocation escapes (and cannot be sunk) if its result is:
+///
+///   - used as the operand of any instruction (including PHIs and
+///     field references that aren't forwarded),
+///   - stored in an allocation that escapes, or
+///   - written to the stack by the final SAVE.
+
+int IRBuffer::optSink() {
+  if (!flags_.get(kOptSink) || chain_[IR::kNEW] == 0)
+    return 0;
+
+  vector<uint8_t> used(bufmax_ - REF_BIAS, 0);
+
+  IRRef saveref = chain_[IR::kSAVE];
+  if (saveref && !snaps_.empty() && snaps_.back().ref() == saveref) {
+    Snapshot &snap = snaps_.back();
+    for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se) {
+      IRRef ref = snapmap_.slotRef(se);
+      if (!irref_islit(ref))
+        used[ref - REF_BIAS] = 1;
+    }
+  }
+
+  // Any use comes after the definition, so a single backwards pass
+  // finds all escaping allocations.
+  for (IRRef ref = bufmax_ - 1; ref >= REF_FIRST; --ref) {
+    IR *ins = ir(ref);
+    IR::Opcode op = ins->opcode();
+    if (op == IR::kFREF && !used[ref - REF_BIAS])
+      continue;  // Only used by forwarded loads.
+    if (op == IR::kNEW && used[ref - REF_BIAS]) {
+      HeapEntry entry = ins->op2();
+      for (int i = 0; i < numFields(entry); ++i) {
+        IRRef field = getField(entry, i);
+        if (!irref_islit(field))
+          used[field - REF_BIAS] = 1;
+      }
+    }
+    uint8_t mode = IR::mode(op);
+    if (irmode_left(mode) == IR::IRMref && !irref_islit(ins->op1()))
+      used[ins->op1() - REF_BIAS] = 1;
+    if (irmode_right(mode) == IR::IRMref && !irref_islit(ins->op2()))
+      used[ins->op2() - REF_BIAS] = 1;
+  }
+
+  int sunk = 0;
+  IRRef hpchkref = 0;
+  for (IRRef ref = REF_FIRST; ref < bufmax_; ++ref) {
+    IR *ins = ir(ref);
+    if (ins->opcode() == IR::kHEAPCHK) {
+      hpchkref = ref;
+    } else if (ins->opcode() == IR::kNEW && !used[ref - REF_BIAS] &&
+               hpchkref != 0) {
+      // Allocations before the first heap check (in a side trace) use
+      // memory reserved by the parent.  We leave those alone.
+      IR *hpchk = ir(hpchkref);
+      int words = numFields(ins->op2()) + 1;
+      LC_ASSERT(hpchk->op1() >= words);
+      hpchk->setOp1(hpchk->op1() - words);
+      ins->setT(ins->t() | IRT_SUNK);
+      ++sunk;
+    }
+  }
+  return sunk;
+}
+
+_END_LAMBDACHINE_NAMESPACE
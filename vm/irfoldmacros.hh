@@ -0,0 +1,55 @@
+/* DO NOT MODIFY: This file is auto-generated. */
+#ifndef _FOLD_IROP_MACROS_H
+#define _FOLD_IROP_MACROS_H
+
+#define LT(ref, opc) ((opc)==IR::kLT)
+#define GE(ref, opc) ((opc)==IR::kGE)
+#define LE(ref, opc) ((opc)==IR::kLE)
+#define GT(ref, opc) ((opc)==IR::kGT)
+#define EQ(ref, opc) ((opc)==IR::kEQ)
+#define NE(ref, opc) ((opc)==IR::kNE)
+#define LTU(ref, opc) ((opc)==IR::kLTU)
+#define GEU(ref, opc) ((opc)==IR::kGEU)
+#define LEU(ref, opc) ((opc)==IR::kLEU)
+#define GTU(ref, opc) ((opc)==IR::kGTU)
+#define EQRET(ref, opc) ((opc)==IR::kEQRET)
+#define EQINFO(ref, opc) ((opc)==IR::kEQINFO)
+#define NEINFO(ref, opc) ((opc)==IR::kNEINFO)
+#define HEAPCHK(ref, opc) ((opc)==IR::kHEAPCHK)
+#define NOP(ref, opc) ((opc)==IR::kNOP)
+#define BASE(ref, opc) ((opc)==IR::kBASE)
+#define FRAME(ref, opc) ((opc)==IR::kFRAME)
+#define RET(ref, opc) ((opc)==IR::kRET)
+#define LOOP(ref, opc) ((opc)==IR::kLOOP)
+#define PHI(ref, opc) ((opc)==IR::kPHI)
+#define RENAME(ref, opc) ((opc)==IR::kRENAME)
+#define KINT(ref, opc) ((opc)==IR::kKINT)
+#define KWORD(ref, opc) ((opc)==IR::kKWORD)
+#define KWORDHI(ref, opc) ((opc)==IR::kKWORDHI)
+#define KBASEO(ref, opc) ((opc)==IR::kKBASEO)
+#define BNOT(ref, opc) ((opc)==IR::kBNOT)
+#define BAND(ref, opc) ((opc)==IR::kBAND)
+#define BOR(ref, opc) ((opc)==IR::kBOR)
+#define BXOR(ref, opc) ((opc)==IR::kBXOR)
+#define BSHL(ref, opc) ((opc)==IR::kBSHL)
+#define BSHR(ref, opc) ((opc)==IR::kBSHR)
+#define BSAR(ref, opc) ((opc)==IR::kBSAR)
+#define BROL(ref, opc) ((opc)==IR::kBROL)
+#define BROR(ref, opc) ((opc)==IR::kBROR)
+#define ADD(ref, opc) ((opc)==IR::kADD)
+#define SUB(ref, opc) ((opc)==IR::kSUB)
+#define MUL(ref, opc) ((opc)==IR::kMUL)
+#define DIV(ref, opc) ((opc)==IR::kDIV)
+#define REM(ref, opc) ((opc)==IR::kREM)
+#define NEG(ref, opc) ((opc)==IR::kNEG)
+#define FREF(ref, opc) ((opc)==IR::kFREF)
+#define FLOAD(ref, opc) ((opc)==IR::kFLOAD)
+#define SLOAD(ref, opc) ((opc)==IR::kSLOAD)
+#define ILOAD(ref, opc) ((opc)==IR::kILOAD)
+#define RLOAD(ref, opc) ((opc)==IR::kRLOAD)
+#define PLOAD(ref, opc) ((opc)==IR::kPLOAD)
+#define NEW(ref, opc) ((opc)==IR::kNEW)
+#define FSTORE(ref, opc) ((opc)==IR::kFSTORE)
+#define UPDATE(ref, opc) ((opc)==IR::kUPDATE)
+#define SAVE(ref, opc) ((opc)==IR::kSAVE)
+#endif
@@ -5,12 +5,16 @@
 #include "capability.hh"
 #include "miscclosures.hh"
 #include "time.hh"
+#include "utils.hh"
+#include "perfmap.hh"
+#include "tracedump.hh"
 
 #include <iostream>
 #include <string.h>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -20,12 +24,24 @@ _START_LAMBDACHINE_NAMESPACE
 using namespace std;
 
 uint64_t record_aborts = 0;
-uint64_t record_abort_reasons[AR__MAX] = { 0, 0, 0, 0, 0 };
+uint64_t record_abort_reasons[AR__MAX] = { 0, 0, 0, 0, 0, 0 };
+uint64_t hotcount_triggers = 0;
+uint64_t hotexit_triggers = 0;
+uint64_t hotcount_collisions = 0;
+uint64_t mcode_flushes = 0;
+uint64_t traces_flushed = 0;
+uint64_t traces_from_cache = 0;
+uint64_t exit_handlers = 0;
+
+HotCounters::HotCounters(HotCount threshold) {
+  setThreshold(threshold);
+}
 
-HotCounters::HotCounters(HotCount threshold)
-  : threshold_(threshold) {
+void HotCounters::setThreshold(HotCount threshold) {
+  threshold_ = threshold;
   for (Word i = 0; i < kNumCounters; ++i) {
     counters_[i] = threshold;
+    owners_[i] = NULL;
   }
 }
 
@@ -48,6 +64,18 @@ void Jit::resetFragments() {
   fragmentMap_.clear();
 }
 
+void Jit::flush() {
+  for (size_t i = 0; i < fragments_.size(); ++i) {
+    Fragment *F = fragments_[i];
+    if (F->flags_.get(Fragment::kPatchedStart))
+      *F->startPc_ = F->startIns_;
+  }
+  traces_flushed += fragments_.size();
+  ++mcode_flushes;
+  resetFragments();
+  mcode_.flush();
+}
+
 uint32_t
 Jit::numFragments()
 {
@@ -56,24 +84,107 @@ Jit::numFragments()
 
 Jit::Jit()
   : cap_(NULL),
-    startPc_(NULL), startBase_(NULL), parent_(NULL),
-    flags_(), options_(), targets_(),
-    prng_(), mcode_(&prng_), asm_(this) {
+    startPc_(NULL), startBase_(NULL), startName_(NULL), parent_(NULL),
+    flags_(), options_(), traceType_(TT_ROOT), targets_(),
+    prng_(), mcode_(&prng_), asm_(this), heapProfile_(NULL), perfMap_(NULL),
+    traceDump_(NULL), abortReason_(AR__MAX),
+    job_(kJobNone), jobCap_(NULL), hasCompiler_(false),
+    stopCompiler_(false) {
   Jit::resetFragments();
   memset(exitStubGroup_, 0, sizeof(exitStubGroup_));
   resetRecorderState();
 #if (DEBUG_COMPONENTS & DEBUG_TRACE_PROGRESS)
   setDebugTrace(true);
 #endif
-#ifdef LC_TRACE_STATS
   stats_ = NULL;
-#endif
 }
 
 Jit::~Jit() {
+  if (hasCompiler_)
+    stopCompilerThread();
   Jit::resetFragments();
 }
 
+void Jit::startCompilerThread() {
+  LC_ASSERT(!hasCompiler_);
+  pthread_mutex_init(&compilerLock_, NULL);
+  pthread_cond_init(&compilerWakeup_, NULL);
+  pthread_cond_init(&compilerDone_, NULL);
+  if (pthread_create(&compiler_, NULL, &Jit::compilerMain, this) != 0) {
+    cerr << "Could not create JIT compiler thread.\n";
+    exit(1);
+  }
+  hasCompiler_ = true;
+}
+
+void Jit::stopCompilerThread() {
+  pthread_mutex_lock(&compilerLock_);
+  stopCompiler_ = true;
+  pthread_cond_signal(&compilerWakeup_);
+  pthread_mutex_unlock(&compilerLock_);
+  pthread_join(compiler_, NULL);
+  pthread_cond_destroy(&compilerWakeup_);
+  pthread_cond_destroy(&compilerDone_);
+  pthread_mutex_destroy(&compilerLock_);
+  hasCompiler_ = false;
+}
+
+void *Jit::compilerMain(void *arg) {
+  Jit *jit = (Jit *)arg;
+  pthread_mutex_lock(&jit->compilerLock_);
+  for (;;) {
+    while (jit->job_ != kJobQueued && !jit->stopCompiler_)
+      pthread_cond_wait(&jit->compilerWakeup_, &jit->compilerLock_);
+    if (jit->stopCompiler_)
+      break;
+    pthread_mutex_unlock(&jit->compilerLock_);
+    int state = kJobDone;
+    jit->mcode_.setConcurrentExecution(true);
+    try {
+      jit->compileTrace();
+    } catch (int err) {
+      if (err != IROPTERR_MCODE_FULL) {
+        cerr << "Unknown error condition.\n";
+        exit(1);
+      }
+      jit->mcode_.abort();
+      state = kJobFailed;
+    }
+    jit->mcode_.setConcurrentExecution(false);
+    pthread_mutex_lock(&jit->compilerLock_);
+    jit->job_ = state;
+    pthread_cond_broadcast(&jit->compilerDone_);
+  }
+  pthread_mutex_unlock(&jit->compilerLock_);
+  return NULL;
+}
+
+void Jit::waitForCompiler() {
+  if (!hasCompiler_)
+    return;
+  pthread_mutex_lock(&compilerLock_);
+  while (job_ == kJobQueued)
+    pthread_cond_wait(&compilerDone_, &compilerLock_);
+  pthread_mutex_unlock(&compilerLock_);
+}
+
+void Jit::installJob() {
+  // Taking the lock makes the compiler thread's writes visible.
+  pthread_mutex_lock(&compilerLock_);
+  int state = job_;
+  pthread_mutex_unlock(&compilerLock_);
+  if (state == kJobFailed) {
+    // Same as IROPTERR_MCODE_FULL in recordIns.
+    ++record_aborts;
+    logAbort("mcode_full");
+    flush();
+    resetRecorderState();
+  } else {
+    installTrace();
+  }
+  job_ = kJobNone;
+}
+
 void Jit::beginRecording(Capability *cap, BcIns *startPc, Word *base, bool isReturn)
 {
   LC_ASSERT(cap_ == NULL);
@@ -81,6 +192,46 @@ void Jit::beginRecording(Capability *cap, BcIns *startPc, Word *base, bool isRet
   initRecording(cap, base, startPc);
   flags_.set(kIsReturnTrace, isReturn);
   traceType_ = TT_ROOT;
+  startName_ = ((Closure *)base[-1])->info()->name();
+}
+
+bool Jit::shouldRecord(BcIns *pc) {
+  PENALTY_MAP::iterator it = penalties_.find((Word)pc);
+  if (LC_LIKELY(it == penalties_.end()))
+    return true;
+  TracePenalty &p = it->second;
+  if (p.aborts >= TRACE_MAX_ABORTS)
+    return false;
+  if (p.skip > 0) {
+    --p.skip;
+    return false;
+  }
+  return true;
+}
+
+void Jit::penaliseStart() {
+  if (traceType_ == TT_SIDE || abortReason_ == AR_STACK_GROWN)
+    return;
+  TracePenalty &p = penalties_[(Word)startPc_];
+  ++p.aborts;
+  p.name = startName_;
+  if (p.aborts >= TRACE_MAX_ABORTS) {
+    blacklisted_.push_back(startPc_);
+    if (startPc_->opcode() == BcIns::kFUNC)
+      *startPc_ = BcIns::ad(BcIns::kIFUNC, startPc_->a(), startPc_->d());
+  } else {
+    p.skip = 1u << p.aborts;
+  }
+}
+
+void Jit::printBlacklisted(FILE *out) {
+  fprintf(out, "  Blacklisted Trace Starts            %u\n",
+          (unsigned)blacklisted_.size());
+  for (size_t i = 0; i < blacklisted_.size(); ++i) {
+    const TracePenalty *p = penalty(blacklisted_[i]);
+    fprintf(out, "    %p  %-6s %s\n", (void *)blacklisted_[i],
+            blacklisted_[i]->name(), p->name);
+  }
 }
 
 void Jit::setFallthroughParent(Fragment *parent, SnapNo snapno) {
@@ -102,9 +253,11 @@ void Jit::initRecording(Capability *cap, Word *base, BcIns *startPc)
   buf_.reset(base, cap->currentThread()->top());
   callStack_.reset();
   btb_.reset(startPc_, &callStack_);
-#ifdef LC_TRACE_STATS
+  abortReason_ = AR__MAX;
+  // Left over if the previous trace didn't fit into the machine code
+  // area.
+  delete[] stats_;
   stats_ = NULL;
-#endif
 }
 
 /*
@@ -125,6 +278,49 @@ dedupSnapshotRef(IRBuffer *buf, Snapshot &snap, SnapshotData *snapmap,
   return TRef();
 }
 
+// Returns the side trace's version of a literal of the parent trace.
+static TRef
+replayLiteral(IRBuffer &buf, Fragment *parent, IR *ins, IRRef ref,
+              Word *parentBase)
+{
+  // Offsets from the base pointer are relative to the parent
+  // fragment's entry base.
+  uint64_t k = parent->literalValue(ref, parentBase);
+  if (ins->opcode() == IR::kKBASEO) {
+    return buf.baseLiteral((Word *)k);
+  } else {
+    return buf.literal(ins->type(), k);
+  }
+}
+
+static TRef
+lookupReplayed(const std::vector<std::pair<IRRef, TRef> > &replayed,
+               IRRef ref)
+{
+  for (size_t i = 0; i < replayed.size(); ++i)
+    if (replayed[i].first == ref)
+      return replayed[i].second;
+  return TRef();
+}
+
+TRef Jit::inheritRef(Fragment *parent, IRRef ref, int slot,
+                     uint32_t *numInheritedSlots)
+{
+  IR *ins = parent->ir(ref);
+  IRType ty = ins->type();
+  TRef tref = buf_.emitRaw(IRT(IR::kSLOAD, ty),
+                           buf_.slots_.absolute(slot),
+                           IR_SLOAD_INHERIT);
+  uint16_t inherit_info;
+  if (ins->spill() != 0) {
+    inherit_info = RID_INIT | ((uint16_t)ins->spill() << 8);
+  } else {
+    inherit_info = (uint16_t)ins->reg();
+  }
+  buf_.parentmap_[(*numInheritedSlots)++] = inherit_info;
+  return tref;
+}
+
 void Jit::replaySnapshot(Fragment *parent, SnapNo snapno, Word *base)
 {
   Snapshot &snap = parent->snap(snapno);
@@ -132,6 +328,7 @@ void Jit::replaySnapshot(Fragment *parent, SnapNo snapno, Word *base)
   int relbase = snap.relbase();
   BloomFilter seen = 0;
   uint32_t numInheritedSlots = 0;
+  std::vector<std::pair<int, IRRef> > sunkSlots;
   
   for (SnapmapRef i = snap.begin(); i < snap.end(); ++i) {
     int slot = snapmap->slotId(i) - relbase;
@@ -139,6 +336,12 @@ void Jit::replaySnapshot(Fragment *parent, SnapNo snapno, Word *base)
     IR *ins = parent->ir(ref);
     TRef tref;
 
+    if (!irref_islit(ref) && isDeferredAlloc(ins, ref, snap)) {
+      // The parent didn't allocate this object, so we have to.
+      sunkSlots.push_back(std::make_pair(slot, ref));
+      continue;
+    }
+
     // Check if we have seen this reference before.  Using a bloom
     // filter we avoid O(N^2) complexity.
     if (bloomtest(seen, ref)) { // We *may* have.
@@ -149,35 +352,105 @@ void Jit::replaySnapshot(Fragment *parent, SnapNo snapno, Word *base)
     bloomset(seen, ref);
 
     if (irref_islit(ref)) {
-      // Offsets from the base pointer are relative to the parent
-      // fragment's entry base.
-      uint64_t k = parent->literalValue(ref, base - relbase);
-      if (ins->opcode() == IR::kKBASEO) {
-        tref = buf_.baseLiteral((Word *)k);
-      } else {
-        tref = buf_.literal(ins->type(), k);
-      }
+      tref = replayLiteral(buf_, parent, ins, ref, base - relbase);
     } else {  // Not a literal.
-      IRType ty = ins->type();
-      tref = buf_.emitRaw(IRT(IR::kSLOAD, ty),
-                          buf_.slots_.absolute(slot),
-                          IR_SLOAD_INHERIT);
-      uint16_t inherit_info;
-      if (ins->spill() != 0) {
-        inherit_info = RID_INIT | ((uint16_t)ins->spill() << 8);
-      } else {
-        inherit_info = (uint16_t)ins->reg();
-      }
-      buf_.parentmap_[numInheritedSlots++] = inherit_info;
+      tref = inheritRef(parent, ref, slot, &numInheritedSlots);
     }
   setslot:
     buf_.setSlot(slot, tref);
   }
 
+  if (!sunkSlots.empty())
+    replaySunk(parent, snap, sunkSlots, base - relbase, &numInheritedSlots);
+
   buf_.stopins_ = REF_FIRST + numInheritedSlots;
   buf_.entry_relbase_ = relbase;
 }
 
+// Re-creates the objects of allocations sunk in the parent trace.
+// The fields of the objects are inherited from the parent, so the
+// objects are allocated right at the start of the side trace.
+void Jit::replaySunk(Fragment *parent, Snapshot &snap,
+                     const std::vector<std::pair<int, IRRef> > &sunkSlots,
+                     Word *parentBase, uint32_t *numInheritedSlots)
+{
+  // Find all sunk allocations reachable from the snapshot.
+  std::vector<IRRef> allocs;
+  for (size_t i = 0; i < sunkSlots.size(); ++i)
+    allocs.push_back(sunkSlots[i].second);
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    IR *ins = parent->ir(allocs[i]);
+    int entry = ins->op2();
+    for (int f = 0; f < parent->heap_.entry(entry).size(); ++f) {
+      IRRef field = parent->heap_.field(entry, f);
+      if (!irref_islit(field) &&
+          isDeferredAlloc(parent->ir(field), field, snap))
+        allocs.push_back(field);
+    }
+  }
+  // Fields only refer to earlier allocations.
+  std::sort(allocs.begin(), allocs.end());
+  allocs.erase(std::unique(allocs.begin(), allocs.end()), allocs.end());
+
+  // Inherit the contents of the objects.  Literals are created on
+  // demand below.
+  std::vector<std::pair<IRRef, TRef> > replayed;
+  int slot = sunkSlots[0].first;
+  int words = 0;
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    IR *ins = parent->ir(allocs[i]);
+    int entry = ins->op2();
+    int nfields = parent->heap_.entry(entry).size();
+    words += 1 + nfields;
+    for (int f = -1; f < nfields; ++f) {
+      IRRef ref = f < 0 ? ins->op1() : parent->heap_.field(entry, f);
+      if (!irref_islit(ref) &&
+          !isDeferredAlloc(parent->ir(ref), ref, snap) &&
+          lookupReplayed(replayed, ref).isNone()) {
+        replayed.push_back(std::make_pair(ref,
+          inheritRef(parent, ref, slot, numInheritedSlots)));
+      }
+    }
+  }
+
+  buf_.emitHeapCheck(words);
+  IRRef hpchkref = buf_.chain_[IR::kHEAPCHK];
+
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    IR *ins = parent->ir(allocs[i]);
+    int entry = ins->op2();
+    int nfields = parent->heap_.entry(entry).size();
+    std::vector<TRef> fields(nfields + 1);
+    for (int f = -1; f < nfields; ++f) {
+      IRRef ref = f < 0 ? ins->op1() : parent->heap_.field(entry, f);
+      if (irref_islit(ref))
+        fields[f + 1] = replayLiteral(buf_, parent, parent->ir(ref), ref,
+                                      parentBase);
+      else
+        fields[f + 1] = lookupReplayed(replayed, ref);
+      LC_ASSERT(!fields[f + 1].isNone());
+    }
+    IRBuffer::HeapEntry he = 0;
+    TRef obj = buf_.emitNEW(fields[0], nfields, &he);
+    for (int f = 0; f < nfields; ++f)
+      buf_.setField(he, f, fields[f + 1]);
+    replayed.push_back(std::make_pair(allocs[i], obj));
+  }
+
+  for (size_t i = 0; i < sunkSlots.size(); ++i)
+    buf_.setSlot(sunkSlots[i].first,
+                 lookupReplayed(replayed, sunkSlots[i].second));
+
+  // If the heap check fails, the exit handler must construct the
+  // objects, so retake its snapshot.
+  Snapshot &hpsnap = buf_.snaps_.back();
+  LC_ASSERT(hpsnap.ref() == hpchkref);
+  void *pc = hpsnap.pc();
+  buf_.snapmap_.index_ = hpsnap.begin();
+  buf_.snaps_.pop_back();
+  buf_.snapshot(hpchkref, pc);
+}
+
 void Jit::beginSideTrace(Capability *cap, Word *base, Fragment *parent, SnapNo snapno) {
   LC_ASSERT(cap_ == NULL);
   LC_ASSERT(targets_.size() == 0);
@@ -185,6 +458,7 @@ void Jit::beginSideTrace(Capability *cap, Word *base, Fragment *parent, SnapNo s
   
   Snapshot &snap = parent->snap(snapno);
   initRecording(cap, base, snap.pc());
+  startName_ = ((Closure *)base[-1])->info()->name();
 
   traceType_ = TT_SIDE;
   parent_ = parent;
@@ -213,6 +487,8 @@ static IRType littypeToIRType(uint8_t littype) {
     return IRT_PTR;
   case LIT_WORD:
     return IRT_U64;
+  case LIT_DOUBLE:
+    return IRT_F64;
   case LIT_CLOSURE:
     return IRT_CLOS;
   case LIT_INFO:
@@ -229,6 +505,14 @@ uint8_t bcCond2irCond(uint8_t bc, bool invert) {
   return (IR::kLT + (bc - BcIns::kISLT)) ^ (uint8_t)(invert ? 1 : 0);
 }
 
+// Note that the inverted condition is not the negation of the
+// original if one of the operands is NaN.  In that case the guard
+// simply fails and we leave the trace.
+static inline
+uint8_t bcCondD2irCond(uint8_t bc, bool invert) {
+  return (IR::kFLT + (bc - BcIns::kISLTD)) ^ (uint8_t)(invert ? 1 : 0);
+}
+
 static bool evalCond(BcIns::Opcode opc, Word left, Word right) {
   switch (opc) {
   case BcIns::kISLT:
@@ -251,6 +535,18 @@ static bool evalCond(BcIns::Opcode opc, Word left, Word right) {
     return (Word)left <= (Word)right;
   case BcIns::kISGTU:
     return (Word)left > (Word)right;
+  case BcIns::kISLTD:
+    return wordToDouble(left) < wordToDouble(right);
+  case BcIns::kISGED:
+    return wordToDouble(left) >= wordToDouble(right);
+  case BcIns::kISLED:
+    return wordToDouble(left) <= wordToDouble(right);
+  case BcIns::kISGTD:
+    return wordToDouble(left) > wordToDouble(right);
+  case BcIns::kISEQD:
+    return wordToDouble(left) == wordToDouble(right);
+  case BcIns::kISNED:
+    return wordToDouble(left) != wordToDouble(right);
   default:
     cerr << "FATAL: (REC) Cannot evaluate condition: " << (int)opc;
     exit(2);
@@ -367,7 +663,7 @@ Jit::recordGenericApply2(uint32_t call_info, Word *base,
     } else {
       // Adjust size of current frame.
       if (!buf_.slots_.frame(base, base + apk_framesize)) {
-        ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+        abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
         //        cerr << "Abstract stack overflow." << endl;
         return false;
       }
@@ -419,7 +715,7 @@ Jit::recordGenericApply2(uint32_t call_info, Word *base,
     } else {
       buf_.setSlot(-1, funref);
       if (!buf_.slots_.frame(base, base + framesize)) {
-        ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+        abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
         return false;
       }
     }
@@ -493,7 +789,7 @@ Jit::recordGenericApply2(uint32_t call_info, Word *base,
     } else {
       // Adjust size of current frame.
       if (!buf_.slots_.frame(base, base + apk_framesize)) {
-        ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+        abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
         return false;
       }
       buf_.setSlot(-1, apk_closure_ref);
@@ -602,7 +898,7 @@ Jit::recordGenericApply2(uint32_t call_info, Word *base,
       callStack_.returnTo(expectedReturnPc);
       Word *newbase = (Word *)base[-3];
       if (!buf_.slots_.frame(newbase, base - 3)) {
-        ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+        abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
         return false;
       }
     }
@@ -778,7 +1074,7 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
   try {
 
   if (LC_UNLIKELY(shouldAbort_)) {
-    ++record_abort_reasons[AR_INTERPRETER_REQUEST];
+    abortBecause(requestedAbort_);
     goto abort_recording;
   }
   buf_.pc_ = ins;
@@ -795,9 +1091,9 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
     if (ins != MiscClosures::stg_UPD_return_pc)  // HACK!
       loopentry = btb_.isTrueLoop(ins);
     if (LC_LIKELY(loopentry == -1)) {  // Not a loop.
-      btb_.emit(ins);
+      btb_.emit(ins, code);
       if (btb_.size() > 100) {
-        ++record_abort_reasons[AR_TRACE_TOO_LONG];
+        abortBecause(AR_TRACE_TOO_LONG);
         // cerr << COL_RED << "TRACE TOO LONG (" << btb_.size()
         //      << ")" << COL_RESET << endl;
         goto abort_recording;
@@ -806,6 +1102,7 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
       if (loopentry == 0) {
         DBG(cerr << "REC: Loop to entry detected." << endl);
         buf_.emit(IR::kSAVE, IRT_VOID | IRT_GUARD, IR_SAVE_LOOP, 0);
+        buf_.optLoop();
         finishRecording();
         return true;
 
@@ -867,6 +1164,19 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
     //    flags_.set(kLastInsWasBranch);
     break;
   }
+  case BcIns::kISLTD:
+  case BcIns::kISGED:
+  case BcIns::kISLED:
+  case BcIns::kISGTD:
+  case BcIns::kISEQD:
+  case BcIns::kISNED: {
+    bool taken = evalCond(ins->opcode(), base[ins->a()], base[ins->d()]);
+    TRef aref = buf_.doubleSlot(ins->a());
+    TRef bref = buf_.doubleSlot(ins->d());
+    uint8_t iropc = bcCondD2irCond(ins->opcode(), !taken);
+    buf_.emit(iropc, IRT_VOID | IRT_GUARD, aref, bref);
+    break;
+  }
 
 #define ARITH_OP_RRR(bcop, irop, irtype) \
   case BcIns::bcop: { \
@@ -903,6 +1213,45 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
 #undef ARITH_OP_RR
 #undef ARITH_OP_RRR
 
+#define DOUBLE_OP_RRR(bcop, irop) \
+  case BcIns::bcop: { \
+    TRef bref = buf_.doubleSlot(ins->b()); \
+    TRef cref = buf_.doubleSlot(ins->c()); \
+    TRef aref = buf_.emit(IR::irop, IRT_F64, bref, cref); \
+    buf_.setSlot(ins->a(), aref); \
+    break; \
+  }
+
+    DOUBLE_OP_RRR(kADDD, kFADD);
+    DOUBLE_OP_RRR(kSUBD, kFSUB);
+    DOUBLE_OP_RRR(kMULD, kFMUL);
+    DOUBLE_OP_RRR(kDIVD, kFDIV);
+
+#undef DOUBLE_OP_RRR
+
+  case BcIns::kNEGD: {
+    // -x == x * -1.0, including for zeros and infinities.
+    TRef dref = buf_.doubleSlot(ins->d());
+    TRef kref = buf_.toFloatReg(buf_.literal(IRT_F64, doubleToWord(-1.0)));
+    buf_.setSlot(ins->a(), buf_.emit(IR::kFMUL, IRT_F64, dref, kref));
+    break;
+  }
+  case BcIns::kSQRTD: {
+    TRef dref = buf_.doubleSlot(ins->d());
+    buf_.setSlot(ins->a(), buf_.emit(IR::kFSQRT, IRT_F64, dref, TRef()));
+    break;
+  }
+  case BcIns::kI2D: {
+    TRef dref = buf_.slot(ins->d());
+    buf_.setSlot(ins->a(), buf_.emit(IR::kCONV, IRT_F64, dref, IRT_I64));
+    break;
+  }
+  case BcIns::kD2I: {
+    TRef dref = buf_.doubleSlot(ins->d());
+    buf_.setSlot(ins->a(), buf_.emit(IR::kCONV, IRT_I64, dref, IRT_F64));
+    break;
+  }
+
   case BcIns::kPTROFSC: {
     TRef ptrref = buf_.slot(ins->b());
     TRef ofsref = buf_.slot(ins->c());
@@ -1098,7 +1447,7 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
     // is quite wasteful.
     Word *newbase = (Word *)base[-3];
     if (!buf_.slots_.frame(newbase, base - 3)) {
-      ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+      abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
       goto abort_recording;
     }
 
@@ -1128,7 +1477,7 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
     // is quite wasteful.
     Word *newbase = (Word *)base[-3];
     if (!buf_.slots_.frame(newbase, base - 3)) {
-      ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+      abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
       // cerr << "Abstract stack overflow/underflow" << endl;
       goto abort_recording;
     }
@@ -1156,7 +1505,7 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
 
     if (info->type() == CAF) {
       logNYI(NYI_RECORD_UPDATE_CAF);
-      ++record_abort_reasons[AR_NYI];
+      abortBecause(AR_NYI);
       goto abort_recording;
     }
 
@@ -1329,6 +1678,8 @@ bool Jit::recordIns(BcIns *ins, Word *base, const Code *code) {
 
 abort_recording:
   ++record_aborts;
+  logAbort();
+  penaliseStart();
   resetRecorderState();
   return true;
 
@@ -1338,7 +1689,19 @@ abort_recording:
     case IROPTERR_FAILING_GUARD:
       DBG(cerr << "Aborting due to permanently failing guard.\n");
       ++record_aborts;
-      ++record_abort_reasons[AR_KNOWN_TO_FAIL_GUARD];
+      abortBecause(AR_KNOWN_TO_FAIL_GUARD);
+      logAbort();
+      penaliseStart();
+      resetRecorderState();
+      return true;
+    case IROPTERR_MCODE_FULL:
+      // The trace didn't fit.  Start over with an empty code area.
+      // The parent of a side trace is gone now, too.
+      DBG(cerr << "Machine code area full, flushing all traces.\n");
+      mcode_.abort();
+      ++record_aborts;
+      logAbort("mcode_full");
+      flush();
       resetRecorderState();
       return true;
     default:
@@ -1348,25 +1711,63 @@ abort_recording:
   }
 }
 
+static const char *abortReasonName[AR__MAX + 1] = {
+  "abstract_stack_overflow", "known_to_fail_guard", "trace_too_long",
+  "interpreter_request", "nyi", "stack_grown", "unknown"
+};
+
+void Jit::logAbort(const char *reason) {
+  if (traceDump_ == NULL)
+    return;
+  if (reason == NULL)
+    reason = abortReasonName[abortReason_];
+  TraceId parent = TRACE_ID_NONE;
+  if (traceType_ == TT_SIDE && parent_ != NULL)
+    parent = parent_->traceId();
+  traceDump_->abortedRecording(startPc_, startName_, reason, parent,
+                               parentExitNo_);
+}
+
 inline void Jit::resetRecorderState() {
   flags_.clear();
   targets_.clear();
   cap_ = NULL;
   shouldAbort_ = false;
+  requestedAbort_ = AR_INTERPRETER_REQUEST;
 }
 
 void Jit::finishRecording() {
-  Time compilestart = getProcessElapsedTime();
   DBG(cerr << "Recorded: " << endl);
-#ifdef LC_TRACE_STATS
-  uint32_t nStatCounters = 1 + buffer()->snaps_.size();
-  stats_ = new uint64_t[nStatCounters];
-  memset(stats_, 0, sizeof(uint64_t) * nStatCounters);
-#endif
+  jobCap_ = cap_;
+  if (hasCompiler_ && heapProfile_ == NULL) {
+    // The recorder stays idle until the trace has been installed, so
+    // the remaining recorder state (flags_, targets_, etc.) is left
+    // alone for installTrace.  The heap profile isn't thread-safe.
+    cap_ = NULL;
+    shouldAbort_ = false;
+    pthread_mutex_lock(&compilerLock_);
+    job_ = kJobQueued;
+    pthread_cond_signal(&compilerWakeup_);
+    pthread_mutex_unlock(&compilerLock_);
+    return;
+  }
+  compileTrace();
+  installTrace();
+}
+
+// May run on the compiler thread.
+void Jit::compileTrace() {
+  Time compilestart = getProcessElapsedTime();
+  buf_.optSink();
+  buf_.optDCE();
   asm_.assemble(buffer(), mcode());
   if (DEBUG_COMPONENTS & DEBUG_ASSEMBLER)
     buf_.debugPrint(cerr, Jit::numFragments());
+  jit_time += getProcessElapsedTime() - compilestart;
+}
 
+void Jit::installTrace() {
+  Time installstart = getProcessElapsedTime();
   int tno = fragments_.size();
 
   Fragment *F = saveFragment();
@@ -1381,12 +1782,33 @@ void Jit::finishRecording() {
 #if (DEBUG_COMPONENTS & DEBUG_TRACE_RECORDER)
     cerr << "Writing JFUNC (isReturn=" << flags_.get(kIsReturnTrace) << ")\n";
 #endif
+    F->startIns_ = *startPc_;
+    F->flags_.set(Fragment::kPatchedStart);
     *startPc_ = BcIns::ad(BcIns::kJFUNC, 0, tno);
   }
 
+  if (perfMap_ != NULL) {
+    char name[256];
+    int n = snprintf(name, sizeof(name), "lc_trace_%d %s pc=%p",
+                     tno, startName_ != NULL ? startName_ : "?",
+                     (void *)startPc_);
+    if (traceType_ == TT_SIDE && n < (int)sizeof(name))
+      snprintf(name + n, sizeof(name) - n, " parent=%u exit=%u",
+               parent_->traceId(), (unsigned)parentExitNo_);
+    perfMap_->addCode(F->entry(), asm_.mctop - F->entry(), name);
+  }
+
+  if (traceDump_ != NULL &&
+      !traceDump_->writeTrace(F, startName_, asm_.mctop - F->entry(),
+                              mcode_flushes)) {
+    cerr << "Could not write trace dump for trace " << tno << " to "
+         << traceDump_->dir() << endl;
+  }
+
 #ifdef LC_CLEAR_DOM_COUNTERS
   // See Note "Reset Dominated Counters" below.
-  btb_.resetDominatedCounters(cap_);
+  if (jobCap_ != NULL)
+    btb_.resetDominatedCounters(jobCap_);
 #endif
 
 #ifdef LC_DUMP_TRACES
@@ -1410,13 +1832,35 @@ void Jit::finishRecording() {
     out.close();
   };
 
-  jit_time += getProcessElapsedTime() - compilestart;
+  jit_time += getProcessElapsedTime() - installstart;
 }
 
 void
 Jit::patchFallthrough(Fragment *parent, ExitNo exitno, Fragment *target)
 {
   asm_.patchFallthrough(parent, exitno, target);
+  if (perfMap_ != NULL) {
+    char name[64];
+    snprintf(name, sizeof(name), "lc_bridge_%u_%u to lc_trace_%u",
+             parent->traceId(), (unsigned)exitno, target->traceId());
+    perfMap_->addCode(mcode_.start(), asm_.mctop - mcode_.start(), name);
+  }
+}
+
+void
+Jit::compileExitHandler(Capability *cap, Fragment *F, ExitNo exitno)
+{
+  MCode *handler = asm_.exitHandler(cap, F, exitno);
+  if (handler != NULL) {
+    asm_.patchGuard(F, exitno, handler);
+    ++exit_handlers;
+    if (perfMap_ != NULL) {
+      char name[64];
+      snprintf(name, sizeof(name), "lc_exit_handler_%u_%u",
+               F->traceId(), (unsigned)exitno);
+      perfMap_->addCode(handler, asm_.mctop - handler, name);
+    }
+  }
 }
 
 /*
@@ -1452,19 +1896,19 @@ created.  It is not a 100% solution, but it shouldn't hurt either.
 */
 
 Fragment::Fragment()
-  : flags_(0), traceId_(0), startPc_(NULL), targets_(NULL) {
-#ifdef LC_TRACE_STATS
-  stats_ = NULL;
-#endif
+  : flags_(0), traceId_(0), startPc_(NULL), parent_(NULL), parentExit_(0),
+    targets_(NULL), buffer_(NULL), snaps_(NULL), stats_(NULL) {
 }
 
 Fragment::~Fragment() {
   if (targets_ != NULL)
     delete[] targets_;
-#ifdef LC_TRACE_STATS
+  if (buffer_ != NULL)
+    delete[] unbiasBuffer(buffer_, -(firstconstant_ - REF_BIAS));
+  if (snaps_ != NULL)
+    delete[] snaps_;
   if (stats_ != NULL)
     delete[] stats_;
-#endif
 }
 
 void Jit::genCode(IRBuffer *buf) {
@@ -1483,6 +1927,7 @@ Fragment *Jit::saveFragment() {
   F->traceId_ = fragments_.size();
   F->startPc_ = startPc_;
   F->parent_ = parent_;
+  F->parentExit_ = parentExitNo_;
 
   F->numTargets_ = targets_.size();
   F->targets_ = new BcIns*[F->numTargets_];
@@ -1512,10 +1957,8 @@ Fragment *Jit::saveFragment() {
   AbstractHeap::compactCopyInto(&F->heap_, &buf->heap_);
 
   F->mcode_ = as->mcp;
-#ifdef LC_TRACE_STATS
   F->stats_ = stats_;  // Transfers ownership.
   stats_ = NULL;
-#endif
 
   return F;
 }
@@ -1533,7 +1976,7 @@ Word *Jit::pushFrame(Word *base, BcIns *returnPc,
   buf_.setSlot(topslot + 2, noderef);
   Word *newbase = base + topslot + 3;
   if (!buf_.slots_.frame(newbase, newbase + framesize)) {
-    ++record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW];
+    abortBecause(AR_ABSTRACT_STACK_OVERFLOW);
     //    cerr << "Abstract stack overflow." << endl;
     return NULL;
   }
@@ -1548,7 +1991,7 @@ Jit::checkFreeHeapAvail(Fragment *F, SnapNo snapno)
   int32_t used = 0;
   while (ref >= REF_FIRST) {
     IR *ins = F->ir(ref);
-    if (ins->opcode() == IR::kNEW) {
+    if (ins->opcode() == IR::kNEW && !ins->isSunk()) {
       AbstractHeapEntry &entry = F->heap_.entry(ins->op2());
       used += 1 + entry.size();
     } else if (ins->opcode() == IR::kHEAPCHK) {
@@ -1568,7 +2011,7 @@ Jit::checkFreeHeapAvail(Fragment *F, SnapNo snapno)
 #define DBG(stmt) do {} while(0)
 #endif
 
-inline uint64_t Fragment::literalValue(IRRef ref, Word *base) {
+uint64_t Fragment::literalValue(IRRef ref, Word *base) {
   IR *ins = ir(ref);
   if (ins->opcode() == IR::kKINT) {
     if (kOpIsSigned & (1 << (int)ins->type()))
@@ -1583,6 +2026,16 @@ inline uint64_t Fragment::literalValue(IRRef ref, Word *base) {
   return 0;
 }
 
+void Fragment::closureConstants(std::vector<Closure *> *out) {
+  for (IRRef ref = firstconstant_; ref < REF_BIAS; ++ref) {
+    IR *ins = ir(ref);
+    if (ins->type() == IRT_CLOS &&
+        (ins->opcode() == IR::kKINT || ins->opcode() == IR::kKWORD)) {
+      out->push_back((Closure *)literalValue(ref, NULL));
+    }
+  }
+}
+
 static void printRegisters(ostream &out, Word *gpr) {
   for (RegSet work = kGPR; !work.isEmpty(); ) {
     Reg r = work.pickBot();
@@ -1609,19 +2062,84 @@ static void printExitState(ostream &out, ExitState *ex) {
 
 Word *traceDebugLastHp = NULL;
 
+// The bits of register `r` when the trace was left.
+static inline Word exitRegValue(ExitState *ex, Reg r) {
+  if (r < RID_MAX_GPR)
+    return ex->gpr[r];
+  return doubleToWord(ex->fpr[r - RID_MIN_FPR]);
+}
+
+// Returns the value of `ref` when leaving the trace via snapshot `sn`.
+Word Fragment::exitValue(IRRef ref, Snapshot &sn, ExitState *ex,
+                         Word *base, ExitHeap *heap) {
+  if (irref_islit(ref))
+    return literalValue(ref, base);
+  IR *ins = ir(ref);
+  if (isDeferredAlloc(ins, ref, sn))
+    return buildObject(ref, sn, ex, base, heap);
+  if (ins->spill() != 0)
+    return ex->spill[ins->spill()];
+  LC_ASSERT(isReg(ins->reg()));
+  return exitRegValue(ex, ins->reg());
+}
+
+// Constructs the object of an allocation that was not performed by
+// the trace.  An object referenced from multiple slots or fields is
+// only constructed once.
+Word Fragment::buildObject(IRRef ref, Snapshot &sn, ExitState *ex,
+                           Word *base, ExitHeap *heap) {
+  for (size_t i = 0; i < heap->objects.size(); ++i) {
+    if (heap->objects[i].first == ref)
+      return heap->objects[i].second;
+  }
+  IR *ins = ir(ref);
+  int entry = ins->op2();
+  int nfields = heap_.entry(entry).size();
+  Word *obj = (Word *)heap->mm->bumpAllocNoGC(&heap->hp, &heap->hplim,
+                                              (1 + nfields) * sizeof(Word));
+  obj[0] = exitValue(ins->op1(), sn, ex, base, heap);
+  for (int i = 0; i < nfields; ++i)
+    obj[1 + i] = exitValue(heap_.field(entry, i), sn, ex, base, heap);
+  heap->objects.push_back(std::make_pair(ref, (Word)obj));
+  return (Word)obj;
+}
+
 void Fragment::restoreSnapshot(ExitNo exitno, ExitState *ex) {
   Word *spill = ex->spill;
   LC_ASSERT(0 <= exitno && exitno < nsnaps_);
   DBG(cerr << "Restoring from snapshot " << (int)exitno
       << " of Trace " << traceId() << endl);
-#ifdef LC_TRACE_STATS
   if (stats_ != NULL)
     bumpExitCount(exitno);
-#endif
   Snapshot &sn = snap(exitno);
   IR *snapins = ir(sn.ref());
   Word *base = (Word *)ex->gpr[RID_BASE];
+  Capability *cap = ex->T->owner();
+  LC_ASSERT(cap != NULL);
+  ExitHeap heap;
+  heap.mm = cap->mm_;
+  heap.hp = (char *)ex->gpr[RID_HP];
+  heap.hplim = (char *)ex->hplim;
   traceDebugLastHp = NULL;
+
+  if (snapins->opcode() == IR::kHEAPCHK) {
+    // cerr << "Heap check failure" << endl;
+    // We exited due to a heap overflow.
+
+    // TODO: If we only reached the end of a block, then we only
+    // need to adjust r12 and HpLim.  This we could simply re-enter
+    // the trace.  That's probably better handled via specialised
+    // code in the codegen.  It's also a bit involved since we may
+    // have to take the full exit if a GC is indeed required.
+
+    // 1. Found out by how much we incremented.
+    heap.hp -= (int)snapins->op1() * sizeof(Word);
+
+    // 2. We could directly grab a new block, but we have to be
+    // careful about what happens if we trigger a GC.  So for now, we
+    // let the interpreter handle all of this.
+  }
+
   if (snapins->opcode() != IR::kSAVE) {
     DBG(sn.debugPrint(cerr, &snapmap_, exitno));
     DBG(printExitState(cerr, ex));
@@ -1635,6 +2153,10 @@ void Fragment::restoreSnapshot(ExitNo exitno, ExitState *ex) {
         uint64_t k = literalValue(ref, base);
         DBG(cerr << "literal (" << hex << k << ")" << endl);
         base[slot] = k;
+      } else if (isDeferredAlloc(ins, ref, sn)) {
+        base[slot] = buildObject(ref, sn, ex, base, &heap);
+        DBG(cerr << "sunk allocation (" << hex << base[slot] << ")"
+            << endl);
       } else if (ins->spill() != 0) {
         DBG(cerr << "spill[" << (int)ins->spill() << "] ("
             << hex << spill[ins->spill()] << "/"
@@ -1644,8 +2166,8 @@ void Fragment::restoreSnapshot(ExitNo exitno, ExitState *ex) {
       } else {
         LC_ASSERT(isReg(ins->reg()));
         DBG(cerr << IR::regName(ins->reg(), ins->type()) << " ("
-            << hex << ex->gpr[ins->reg()] << ")" << endl);
-        base[slot] = ex->gpr[ins->reg()];
+            << hex << exitRegValue(ex, ins->reg()) << ")" << endl);
+        base[slot] = exitRegValue(ex, ins->reg());
       }
     }
   }
@@ -1661,12 +2183,37 @@ void Fragment::restoreSnapshot(ExitNo exitno, ExitState *ex) {
   ex->T->top_ = base + sn.framesize();
   ex->T->pc_ = sn.pc();
 
-  Capability *cap = ex->T->owner();
-  LC_ASSERT(cap != NULL);
-  cap->traceExitHp_ = (Word *)ex->gpr[RID_HP];
-  cap->traceExitHpLim_ = ex->hplim;
+  cap->traceExitHp_ = (Word *)heap.hp;
+  cap->traceExitHpLim_ = (Word *)heap.hplim;
+
+  // A SAVE exits through its own snapshot if the new frame is beyond
+  // the stack limit.  Grow the stack so the trace can be re-entered.
+  if (base > ex->stacklim) {
+    Thread *T = ex->T;
+    ptrdiff_t moved;
+    if (!T->growStack(T->top_ + (T->stackLimit() - ex->stacklim),
+                      base, &moved)) {
+      fprintf(stderr, "Stack overflow (in JIT, maximum stack size is %"
+              FMT_Word " bytes)\n", Thread::maxStackSize() * sizeof(Word));
+      exit(1);
+    }
+    base += moved;
+    if (snapins->opcode() == IR::kSAVE &&
+        snapins->op1() != IR_SAVE_FALLTHROUGH)
+      return;
+  }
+
+  // Exits taken often enough get their own restore code.  Exits
+  // through a SAVE or heap check need the generic code above.
+  if (cap->jit()->getOption(Jit::kOptCompiledExits) &&
+      snapins->opcode() != IR::kHEAPCHK && snapins->opcode() != IR::kSAVE &&
+      !cap->jit()->isCompiling() && sn.bumpGenericExits()) {
+    cap->jit()->compileExitHandler(cap, this, exitno);
+  }
 
-  if (snapins->opcode() != IR::kHEAPCHK && sn.bumpExitCounter()) {
+  if (snapins->opcode() != IR::kHEAPCHK && !cap->jit()->isCompiling() &&
+      sn.bumpExitCounter()) {
+    ++hotexit_triggers;
     if (snapins->opcode() == IR::kSAVE && snapins->op1() == IR_SAVE_FALLTHROUGH) {
       // If the parent trace falls back directly to the interpreter
       // then this new traces should be treated like a root trace.
@@ -1679,7 +2226,7 @@ void Fragment::restoreSnapshot(ExitNo exitno, ExitState *ex) {
         Fragment *target = cap->jit()->lookupFragment(pc);
         LC_ASSERT(target && target->traceId() == pc->d());
         cap->jit()->patchFallthrough(this, exitno, target);
-      } else {
+      } else if (cap->jit()->shouldRecord(pc)) {
         bool isReturn = !(pc->opcode() == BcIns::kFUNC || pc->opcode() == BcIns::kIFUNC);
         cap->jit()->beginRecording(cap, pc, base, isReturn);
         cap->jit()->setFallthroughParent(this, exitno);
@@ -1691,24 +2238,6 @@ void Fragment::restoreSnapshot(ExitNo exitno, ExitState *ex) {
       cap->setState(Capability::STATE_RECORD);
     }
   }
-
-  if (snapins->opcode() == IR::kHEAPCHK) {
-    // cerr << "Heap check failure" << endl;
-    // We exited due to a heap overflow.
-
-    // TODO: If we only reached the end of a block, then we only
-    // need to adjust r12 and HpLim.  This we could simply re-enter
-    // the trace.  That's probably better handled via specialised
-    // code in the codegen.  It's also a bit involved since we may
-    // have to take the full exit if a GC is indeed required.
-
-    // 1. Found out by how much we incremented.
-    cap->traceExitHp_ -= (int)snapins->op1();
-
-    // 2. We could directly grab a new block, but we have to be
-    // careful about what happens if we trigger a GC.  So for now, we
-    // let the interpreter handle all of this.
-  }
 }
 
 #undef DBG
@@ -1786,7 +2315,6 @@ printLoggedNYIs(FILE *out)
   }
 }
 
-#ifdef LC_TRACE_STATS
 uint64_t
 Fragment::traceExits() const
 {
@@ -1796,6 +2324,5 @@ Fragment::traceExits() const
   }
   return exits;
 }
-#endif
 
 _END_LAMBDACHINE_NAMESPACE
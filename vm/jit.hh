@@ -10,10 +10,25 @@
 
 #include <vector>
 #include <iostream>
+#include <pthread.h>
 #include HASH_MAP_H
 
 _START_LAMBDACHINE_NAMESPACE
 
+// Number of root traces and side traces started because a counter
+// reached its threshold.
+extern uint64_t hotcount_triggers;
+extern uint64_t hotexit_triggers;
+// Number of times a hashed counter was used by a different pc.
+extern uint64_t hotcount_collisions;
+
+/// Hot counters for potential trace heads.
+///
+/// Code loaded from bytecode files has one counter per instruction,
+/// stored after the bytecode (see Code::hotcounts).  These count up
+/// to the threshold.  Code built by the runtime has no counters, so
+/// those instructions share a small hash table of counters which
+/// count down.
 class HotCounters {
 public:
   typedef uint16_t HotCount;
@@ -22,6 +37,10 @@ public:
   HotCounters(HotCount threshold);
   ~HotCounters() {}
 
+  /// Sets the hotness threshold and resets all hashed counters.
+  void setThreshold(HotCount threshold);
+  inline HotCount threshold() const { return threshold_; }
+
   inline HotCount get(void *pc) const {
     return counters_[hotCountHash(pc)];
   }
@@ -34,13 +53,44 @@ public:
     counters_[hotCountHash(pc)] = threshold_;
   }
 
+  inline void reset(BcIns *pc, const Code *code) {
+    if (LC_LIKELY(hasCounter(pc, code)))
+      code->hotcounts[pc - code->code] = 0;
+    else
+      reset(pc);
+  }
+
   /// Decrement the hot counter.
   ///
   /// @return true if the counter reached the hotness threshold.
   inline bool tick(void *pc) {
-    HotCount c = --counters_[hotCountHash(pc)];
+    Word h = hotCountHash(pc);
+    if (LC_UNLIKELY(owners_[h] != pc)) {
+      if (owners_[h] != NULL)
+        ++hotcount_collisions;
+      owners_[h] = pc;
+    }
+    HotCount c = --counters_[h];
     if (LC_UNLIKELY(c == 0)) {
       set(pc, threshold_);
+      ++hotcount_triggers;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  /// Increment the counter of instruction `pc`, which should be part
+  /// of `code`.
+  ///
+  /// @return true if the counter reached the hotness threshold.
+  inline bool tick(BcIns *pc, const Code *code) {
+    if (LC_UNLIKELY(!hasCounter(pc, code)))
+      return tick(pc);
+    HotCount *c = &code->hotcounts[pc - code->code];
+    if (LC_UNLIKELY(++*c >= threshold_)) {
+      *c = 0;
+      ++hotcount_triggers;
       return true;
     } else {
       return false;
@@ -53,7 +103,13 @@ private:
     return ((val >> 12) ^ (val >> 4)) & (kNumCounters - 1);
   }
 
+  static inline bool hasCounter(BcIns *pc, const Code *code) {
+    return code != NULL && code->hotcounts != NULL &&
+      pc >= code->code && pc < code->code + code->sizecode;
+  }
+
   HotCount counters_[kNumCounters];
+  void *owners_[kNumCounters];  // Last pc that used each counter.
   HotCount threshold_;
 };
 
@@ -84,7 +140,7 @@ public:
 
   /// Reserve the whole machine code area.  No code from the machine
   /// code area may be running at the same time.  (It will trigger a
-  /// page fault.)
+  /// page fault.)  Unless setConcurrentExecution(true) was called.
   ///
   /// @param limit Lower limit of the machine code area.
   /// @return Upper limit of the machine code area.
@@ -97,6 +153,26 @@ public:
   void commitStub(MCode *bot);
   void abort();
 
+  /// Discards all trace code.  Exit stubs are kept.
+  void flush();
+
+  /// Limits the size of the trace code to the given number of bytes.
+  /// Zero means no limit other than the size of the area.
+  inline void setMaxSize(size_t bytes) { maxSize_ = bytes; }
+
+  /// Trace code must not be written below this address.
+  inline MCode *traceLimit() const {
+    if (maxSize_ == 0 || maxSize_ >= size_)
+      return area_;
+    return end() - maxSize_;
+  }
+
+  /// While set, traces may run while code is generated by another
+  /// thread.  reserve() then only makes the unused whole pages
+  /// writable, so the new code starts on a fresh page.  Patching
+  /// existing code is not allowed.
+  void setConcurrentExecution(bool allow);
+
   /// Reserves the machine code area containing the given pointer.
   /// Used to modify existing machine code (e.g., for trace linking).
   ///
@@ -133,23 +209,55 @@ private:
 
   Prng *prng_;
   int protection_;
+  bool concurrent_;
   MCode *area_;
   MCode *top_;
   MCode *bottom_;
   size_t size_;
   size_t sizeTotal_;
+  size_t maxSize_;
 };
 
 
 // Forward declarations.
 class Capability;
 class Fragment;
+class HeapProfile;
+class PerfMap;
+class TraceDump;
+class MemoryManager;
+class Loader;
+class TraceSymbols;
+class CacheReader;
+class CacheWriter;
 
 #define FRAGMENT_MAP \
   HASH_NAMESPACE::HASH_MAP_CLASS<Word,TraceId>
 
 #define TRACE_ID_NONE  (~0)
 
+// Aborted recordings for a trace start.
+typedef struct {
+  uint32_t aborts;
+  uint32_t skip;       // Number of hot events to ignore.
+  const char *name;    // Function containing the trace start.
+} TracePenalty;
+
+#define PENALTY_MAP \
+  HASH_NAMESPACE::HASH_MAP_CLASS<Word,TracePenalty>
+
+typedef enum {
+  AR_ABSTRACT_STACK_OVERFLOW,
+  AR_KNOWN_TO_FAIL_GUARD,
+  AR_TRACE_TOO_LONG,
+  AR_INTERPRETER_REQUEST,
+  AR_NYI,
+  AR_STACK_GROWN,  // Not the trace's fault, so not penalised.
+  AR__MAX
+} AbortReason;
+
+extern uint64_t record_abort_reasons[AR__MAX];
+
 typedef enum {
   TT_ROOT,
   TT_FALLTHROUGH,
@@ -176,7 +284,28 @@ public:
 
   inline bool isRecording() const { return cap_ != NULL; }
 
-  inline void requestAbort() { shouldAbort_ = true; }
+  inline void requestAbort(AbortReason reason = AR_INTERPRETER_REQUEST) {
+    shouldAbort_ = true;
+    requestedAbort_ = reason;
+  }
+
+  /// Returns false if a hot event at `pc` should not start recording
+  /// because earlier recordings starting there were aborted.  Each
+  /// abort doubles the number of ignored hot events.  After
+  /// TRACE_MAX_ABORTS aborts, `pc` is blacklisted.  A blacklisted
+  /// FUNC is turned into an IFUNC, so it is no longer counted at all.
+  bool shouldRecord(BcIns *pc);
+
+  /// The blacklisted trace starts in the order they were blacklisted.
+  inline const std::vector<BcIns *> &blacklisted() const {
+    return blacklisted_;
+  }
+  inline const TracePenalty *penalty(BcIns *pc) {
+    PENALTY_MAP::iterator it = penalties_.find((Word)pc);
+    return it != penalties_.end() ? &it->second : NULL;
+  }
+  /// Prints the blacklisted trace starts for the run statistics.
+  void printBlacklisted(FILE *out);
 
   // Returns the fragment starting at the given PC. NULL, otherwise.
   inline Fragment *traceAt(BcIns *pc);
@@ -188,7 +317,10 @@ public:
 
   typedef enum {
     kOptDebugTrace,
-    kOptFastHeapCheckFail
+    kOptFastHeapCheckFail,
+    kOptCompiledExits,
+    // Count completions and exits of traces compiled from now on.
+    kOptProfile
   } JitOption;
 
   inline void setOption(JitOption option, bool value) {
@@ -199,11 +331,29 @@ public:
     return options_.get((int)option);
   }
 
+  // Count the executions of allocation sites in compiled traces.
+  inline void setHeapProfile(HeapProfile *profile) { heapProfile_ = profile; }
+  inline HeapProfile *heapProfile() const { return heapProfile_; }
+
+  // Describe generated code to perf.
+  inline void setPerfMap(PerfMap *perfMap) { perfMap_ = perfMap; }
+  inline PerfMap *perfMap() const { return perfMap_; }
+
+  // Write installed traces and aborted recordings as JSON.
+  inline void setTraceDump(TraceDump *dump) { traceDump_ = dump; }
+  inline TraceDump *traceDump() const { return traceDump_; }
+
   inline MachineCode *mcode() { return &mcode_; }
   inline IRBuffer *buffer() { return &buf_; }
   inline Assembler *assembler() { return &asm_; }
 
   Fragment *saveFragment();
+  // The start PC of fragments created by saveFragment.  Only needed
+  // if the IR buffer was filled without recording.
+  inline void setStartPc(BcIns *pc) { startPc_ = pc; }
+  // Compiles and installs the recorded trace, or hands it to the
+  // compiler thread.
+  void finishRecording();
   Fragment *lookupFragment(BcIns *pc) {
     Word idx = reinterpret_cast<Word>(pc) >> 2;
     return fragments_[fragmentMap_[idx]];
@@ -217,21 +367,89 @@ public:
   void setFallthroughParent(Fragment *parent, SnapNo snapno);
   void patchFallthrough(Fragment *parent, ExitNo exitno, Fragment *target);
 
+  /// Generates code that restores the snapshot of the given exit
+  /// without going through Fragment::restoreSnapshot, and redirects
+  /// the exit's guard to it.  Gives up quietly if the machine code
+  /// area is full.
+  void compileExitHandler(Capability *cap, Fragment *F, ExitNo exitno);
+
+  /// Throws away all traces and their machine code, and restores the
+  /// bytecode that entered them.  Must not be called while a trace
+  /// is running.
+  void flush();
+
+  /// Compiles recorded traces on a separate thread.  At the end of a
+  /// recording the IR buffer is handed to the compiler thread and the
+  /// interpreter continues.  No new trace is recorded until the
+  /// compiled trace has been installed by pollCompiler().
+  void startCompilerThread();
+
+  /// True from the end of a recording until its trace is installed.
+  inline bool isCompiling() const { return job_ != kJobNone; }
+
+  /// Installs the trace compiled by the compiler thread, if it is
+  /// done.  Must be called from the interpreter, outside any trace.
+  inline void pollCompiler() {
+    if (LC_UNLIKELY(job_ >= kJobDone)) installJob();
+  }
+
+  /// Blocks until the compiler thread has finished the pending job,
+  /// if any.  The trace is not installed.
+  void waitForCompiler();
+
+  /// Writes the root traces to a trace cache file (see
+  /// tracecache.cc).  Returns false if the file cannot be written.
+  bool saveTraceCache(const char *filename, Loader *loader);
+
+  /// Compiles the traces in a trace cache file written by an earlier
+  /// run.  Returns the number of traces installed, or -1 if the file
+  /// cannot be read or was written for different bytecode.
+  int loadTraceCache(const char *filename, Loader *loader);
+
 private:
   void initRecording(Capability *cap, Word *base, BcIns *startPc);
   Word *pushFrame(Word *base, BcIns *returnPc, TRef noderef,
                   uint32_t framesize);
-  void finishRecording();
+  void compileTrace();
+  void installTrace();
+  void installJob();
+  void stopCompilerThread();
+  static void *compilerMain(void *jit);
+  bool saveTrace(Fragment *F, TraceSymbols *syms,
+                 const std::vector<bool> &cached, CacheWriter *out);
+  bool loadTrace(CacheReader *in, TraceSymbols *syms,
+                 std::vector<TraceId> *ids);
+  void discardLoadedTrace();
   void resetRecorderState();
+  void penaliseStart();
+  inline void abortBecause(AbortReason reason) {
+    ++record_abort_reasons[reason];
+    abortReason_ = reason;
+  }
+  // Tells the trace dump, if any, that the current recording is being
+  // aborted.  reason overrides abortReason_ if not NULL.
+  void logAbort(const char *reason = NULL);
   void replaySnapshot(Fragment *parent, SnapNo snapno, Word *base);
+  void replaySunk(Fragment *parent, Snapshot &snap,
+                  const std::vector<std::pair<int, IRRef> > &sunkSlots,
+                  Word *parentBase, uint32_t *numInheritedSlots);
+  TRef inheritRef(Fragment *parent, IRRef ref, int slot,
+                  uint32_t *numInheritedSlots);
   int32_t checkFreeHeapAvail(Fragment *F, SnapNo snapno);
   
   static const int kLastInsWasBranch = 0;
   static const int kIsReturnTrace = 1;
 
+  // State of the trace handed to the compiler thread.
+  static const int kJobNone = 0;
+  static const int kJobQueued = 1;
+  static const int kJobDone = 2;
+  static const int kJobFailed = 3;
+
   Capability *cap_;
   BcIns *startPc_;
   Word *startBase_;
+  const char *startName_;
   Fragment *parent_;
   ExitNo parentExitNo_;
   Flags32 flags_;   // reset each time
@@ -246,9 +464,28 @@ private:
   BranchTargetBuffer btb_;
   MCode *exitStubGroup_[16];
   bool shouldAbort_;
-#ifdef LC_TRACE_STATS
+  AbortReason requestedAbort_;
+  HeapProfile *heapProfile_;
+  PerfMap *perfMap_;
+  TraceDump *traceDump_;
+  // Why the current recording is being aborted.  AR__MAX if unknown.
+  AbortReason abortReason_;
+  PENALTY_MAP penalties_;
+  std::vector<BcIns *> blacklisted_;
+
+  // While a job is pending, the recorder is idle and buf_, asm_ and
+  // mcode_ belong to the compiler thread.
+  volatile int job_;
+  Capability *jobCap_;
+  bool hasCompiler_;
+  bool stopCompiler_;
+  pthread_t compiler_;
+  pthread_mutex_t compilerLock_;
+  pthread_cond_t compilerWakeup_;
+  pthread_cond_t compilerDone_;
+  // Profile counters of the trace being compiled, if kOptProfile is
+  // set.  See Fragment::stats_.
   uint64_t *stats_;
-#endif
 
   static FRAGMENT_MAP fragmentMap_;
   static std::vector<Fragment*> fragments_;
@@ -293,6 +530,9 @@ public:
   uint64_t literalValue(IRRef, Word* base);
   void restoreSnapshot(ExitNo, ExitState *);
 
+  // Appends all closures that the trace refers to as constants.
+  void closureConstants(std::vector<Closure *> *out);
+
   ~Fragment();
 
   inline Snapshot &snap(SnapNo n) {
@@ -302,32 +542,51 @@ public:
 
   inline uint32_t numExits() const { return nsnaps_; }
 
-#ifdef LC_TRACE_STATS
+  inline Fragment *parent() const { return parent_; }
+  // Only valid for side traces.
+  inline ExitNo parentExit() const { return parentExit_; }
+
+  // Profile counters.  Only available if the trace was compiled with
+  // Jit::kOptProfile set.
+  inline bool hasStats() const { return stats_ != NULL; }
   inline uint64_t traceCompletions() const { return stats_[0]; }
   inline uint64_t traceExitsAt(ExitNo n) const {
     LC_ASSERT(n < nsnaps_);
     return stats_[1 + n];
   }
   uint64_t traceExits() const;
-  inline Fragment *parent() const { return parent_; }
 
 private:
   void bumpExitCount(ExitNo n) { ++stats_[1 + n]; }
   uint64_t *exitCounterAddress(ExitNo n) const { return &stats_[1 + n]; }
-#endif
 
 private:
   Fragment();
 
   inline IR *ir(IRRef ref) { return &buffer_[ref]; }
 
+  // Heap used for constructing sunk objects on exit.
+  typedef struct {
+    MemoryManager *mm;
+    char *hp;
+    char *hplim;
+    std::vector<std::pair<IRRef, Word> > objects;  // Already built.
+  } ExitHeap;
+
+  Word exitValue(IRRef ref, Snapshot &sn, ExitState *ex, Word *base,
+                 ExitHeap *heap);
+  Word buildObject(IRRef ref, Snapshot &sn, ExitState *ex, Word *base,
+                   ExitHeap *heap);
+
   static const int kIsCompiled = 1;
+  static const int kPatchedStart = 2;  // *startPc_ is a JFUNC.
 
   Flags32 flags_;
   uint32_t traceId_;
   BcIns *startPc_;
+  BcIns startIns_;       // Original instruction at startPc_.
   Fragment *parent_;
-  // ExitNo parentExit_;
+  ExitNo parentExit_;
 
   BcIns **targets_;
   uint32_t numTargets_;
@@ -345,12 +604,13 @@ private:
   MCode *mcode_;
   //  size_t sizemcode_;
 
-#ifdef LC_TRACE_STATS
+  // Number of completions followed by the number of exits through
+  // each snapshot.  NULL if the trace is not profiled.
   uint64_t *stats_;
-#endif
 
   friend class Jit;
   friend class Assembler;
+  friend class TraceDump;
 };
 
 inline void Jit::registerFragment(BcIns *startPc, Fragment *F, bool isSideTrace) {
@@ -385,30 +645,30 @@ struct _ExitState {
   Word     spill[256];
 };
 
-typedef enum {
-  AR_ABSTRACT_STACK_OVERFLOW,
-  AR_KNOWN_TO_FAIL_GUARD,
-  AR_TRACE_TOO_LONG,
-  AR_INTERPRETER_REQUEST,
-  AR_NYI,
-  AR__MAX
-} AbortReason;
-
 extern uint64_t record_aborts;
-extern uint64_t record_abort_reasons[AR__MAX];
+// Number of machine code flushes and of traces thrown away by them.
+extern uint64_t mcode_flushes;
+extern uint64_t traces_flushed;
+// Number of traces compiled from the trace cache.
+extern uint64_t traces_from_cache;
+// Number of compiled exit handlers.
+extern uint64_t exit_handlers;
 
 #define HPLIM_SP_OFFS  0
 #define SPLIM_SP_OFFS  8
 #define SPILL_SP_OFFS  (offsetof(ExitState, spill) - offsetof(ExitState, hplim))
 #define F_ID_OFFS      (offsetof(ExitState, F_id) - offsetof(ExitState, hplim))
+#define THREAD_SP_OFFS (offsetof(ExitState, T) - offsetof(ExitState, hplim))
 
 extern "C" void asmEnter(TraceId F_id, Thread *T,
                          Word *hp, Word *hplim, Word *stacklim, MCode *code);
 
 extern "C" void asmExit(int);
+// Leaves the trace from a compiled exit handler.  Expects the thread
+// state to be written back already.
+extern "C" void asmLeaveTrace(void);
 
 extern "C" void asmHeapOverflow(void);
-extern "C" void asmStackOverflow(void);
 extern "C" void asmTrace(void);
 extern "C" void debugTrace(ExitState *);
 
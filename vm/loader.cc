@@ -289,6 +289,8 @@ bool Loader::loadModule(const char *moduleName, int level) {
   mdl = loadModuleHeader(f);
   if (!mdl)
     return false;
+  if (!fileHash(filename, &mdl->hash_))
+    mdl->hash_ = 0;
 
   loadedModules_[moduleName] = mdl;
 
@@ -486,6 +488,7 @@ InfoTable *Loader::loadInfoTable(BytecodeFile &f,
       (mm_->allocInfoTable(h, wordsof(ConInfoTable)));
     info->type_ = cl_type;
     info->tagOrBitmap_ = f.get_varuint();  // tag
+    info->selector_ = 0;
     Word sz = f.get_varuint();
     assert(sz <= 32);
     info->size_ = sz;
@@ -505,12 +508,17 @@ InfoTable *Loader::loadInfoTable(BytecodeFile &f,
       (mm_->allocInfoTable(h, wordsof(CodeInfoTable)));
     info->type_ = cl_type;
     info->tagOrBitmap_ = 0; // TODO: anything useful to put in here?
+    info->selector_ = 0;
     Word sz = f.get_varuint();
     assert(sz <= 32);
     info->size_ = sz;
     info->layout_.bitmap = sz > 0 ? f.get_u4() : 0;
     info->name_ = loadId(f, strings, ".");
     loadCode(f, &info->code_, strings);
+    if (cl_type == THUNK && sz == 1 && info->layout_.bitmap == 1) {
+      // Lets the GC short-cut selector thunks.
+      info->selector_ = info->code_.selectorField();
+    }
     new_itbl = (InfoTable *)info;
   }
   break;
@@ -542,8 +550,10 @@ void Loader::loadCode(BytecodeFile &f, Code *code /* out */,
   for (u2 i = 0; i < code->sizelits; ++i) {
     loadLiteral(f, &code->littypes[i], &code->lits[i], strings);
   }
+  // The hot counters are stored right after the bitmaps.
   code->code = static_cast<BcIns *>
-               (mm_->allocCode(code->sizecode, code->sizebitmaps));
+               (mm_->allocCode(code->sizecode,
+                               code->sizebitmaps + code->sizecode));
   for (u2 i = 0; i < code->sizecode; ++i) {
     code->code[i] = f.get_u4();
   }
@@ -552,6 +562,9 @@ void Loader::loadCode(BytecodeFile &f, Code *code /* out */,
     *bitmaps = f.get_u2();
     ++bitmaps;
   }
+  code->hotcounts = bitmaps;
+  memset(code->hotcounts, 0, sizeof(u2) * code->sizecode);
+  code->initInlineCaches();
 }
 
 void Loader::loadLiteral(BytecodeFile &f,
@@ -572,6 +585,11 @@ void Loader::loadLiteral(BytecodeFile &f,
   case LIT_FLOAT:
     *literal = (Word)f.get_u4();
     break;
+  case LIT_DOUBLE: {
+    uint64_t hi = f.get_u4();
+    *literal = (Word)((hi << 32) | f.get_u4());
+    break;
+  }
   case LIT_STRING:
     i = f.get_varuint();
     *literal = (Word)strings[i].str;
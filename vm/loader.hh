@@ -54,8 +54,11 @@ struct hashstr {
 class Module {
 public:
   inline const char *name() const { return name_; }
+  // Hash of the bytecode file the module was loaded from.
+  inline uint64_t hash() const { return hash_; }
 private:
   const char *name_;
+  uint64_t hash_;
   uint32_t flags_;              // Currently unused
   uint32_t numInfoTables_;
   uint32_t numClosures_;
@@ -134,6 +137,17 @@ public:
     Closure *cl = closures_[name];
     return cl;
   }
+  // All loaded modules, info tables and closures.  Modules that could
+  // not be loaded map to NULL.
+  inline const STRING_MAP(Module*) &modules() const {
+    return loadedModules_;
+  }
+  inline const STRING_MAP(InfoTable*) &infoTables() const {
+    return infoTables_;
+  }
+  inline const STRING_MAP(Closure*) &closures() const {
+    return closures_;
+  }
 
 private:
   void initBasePath(const char *);
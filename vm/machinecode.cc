@@ -18,19 +18,20 @@ using namespace std;
 
 #define MCPROT_RW (PROT_READ|PROT_WRITE)
 #define MCPROT_RX (PROT_READ|PROT_EXEC)
-#define MCPROT_RWX  (PROT_READ|PROT_WRITE|PROT_EXEC)
 
 #define MCPROT_GEN  MCPROT_RW
 #define MCPROT_RUN  MCPROT_RX
+// Only the unused pages are writable, the rest is executable.
+#define MCPROT_MIXED  (-1)
 
 #define LC_TARGET_JUMPRANGE 31
 
 
 MachineCode::MachineCode(Prng *prng)
   : prng_(prng),
-    protection_(0),
+    protection_(0), concurrent_(false),
     area_(NULL), top_(NULL), bottom_(NULL),
-    size_(0), sizeTotal_(0) {
+    size_(0), sizeTotal_(0), maxSize_(0) {
 }
 
 MachineCode::~MachineCode() {
@@ -92,10 +93,27 @@ void MachineCode::setProtection(void *p, size_t size, int prot) {
 MCode *MachineCode::reserve(MCode **limit) {
   if (area_ == NULL)
     allocArea();
-  else
+  if (!concurrent_) {
     protect(MCPROT_GEN);
-  *limit = bottom_;
-  return top_;
+    *limit = bottom_;
+    return top_;
+  }
+  // Traces may be running, so no page may be writable and executable
+  // at the same time.  Code is only written to the pages between the
+  // exit stubs and the trace code.  The partial pages at either end
+  // stay executable and their unused bytes are lost.
+  uintptr_t mask = (uintptr_t)(LC_PAGESIZE - 1);
+  MCode *lo = (MCode *)(((uintptr_t)bottom_ + mask) & ~mask);
+  MCode *hi = (MCode *)((uintptr_t)top_ & ~mask);
+  if (lo > hi)
+    lo = hi;
+  protect(MCPROT_RUN);
+  if (lo < hi) {
+    setProtection(lo, hi - lo, MCPROT_GEN);
+    protection_ = MCPROT_MIXED;
+  }
+  *limit = lo;
+  return hi;
 }
 
 void MachineCode::allocArea() {
@@ -129,6 +147,14 @@ void MachineCode::abort() {
   protect(MCPROT_RUN);
 }
 
+void MachineCode::flush() {
+  top_ = end();
+}
+
+void MachineCode::setConcurrentExecution(bool allow) {
+  concurrent_ = allow;
+}
+
 void MachineCode::protect(int prot) {
   if (protection_ != prot) {
     setProtection(area_, size_, prot);
@@ -138,6 +164,7 @@ void MachineCode::protect(int prot) {
 
 MCode *MachineCode::patchBegin(MCode *ptr) {
   LC_ASSERT(area_ <= ptr && ptr < area_ + size_);
+  LC_ASSERT(!concurrent_);
   protect(MCPROT_GEN);
   return area_;
 }
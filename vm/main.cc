@@ -4,10 +4,15 @@
 #include "capability.hh"
 #include "thread.hh"
 #include "time.hh"
+#include "perfmap.hh"
+#include "tracedump.hh"
 
 
 #include <iostream>
 #include <memory>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 _USE_LAMBDACHINE_NAMESPACE
@@ -18,6 +23,8 @@ void printGCStats(FILE *out, MemoryManager *mm, Time mut_time);
 void printTraceStats(FILE *out);
 void printStats(FILE *out, MemoryManager *mm, Capability *cap,
                 Time startup_time, Time start_time, Time stop_time);
+bool writeStatsJSON(const char *file, MemoryManager *mm,
+                    Time startup_time, Time start_time, Time stop_time);
 
 inline double percent(double num, double denom) {
   return (num * 100) / denom;
@@ -33,8 +40,20 @@ int main(int argc, char *argv[]) {
 
   initializeTimer();
   Time startup_time = getProcessElapsedTime();
+  if (opts->hugePages() == 1)
+    Region::setPageMode(Region::kTransparentHugePages);
+  else if (opts->hugePages() == 2)
+    Region::setPageMode(Region::kHugeTLBPages);
   MemoryManager mm;
   mm.setMinHeapSize(1UL * 1024 * 1024);
+  mm.setGenerational(opts->generationalGC());
+  mm.setGCThreads(opts->gcThreads());
+  mm.setMaxHeapSize(opts->maxHeapSize());
+  if (opts->heapRetain() >= 0)
+    mm.setRetainedFreeSize(opts->heapRetain());
+  if (opts->gcGrowthFactor() > 0)
+    mm.heapPolicy().setGrowthFactor(opts->gcGrowthFactor());
+  mm.heapPolicy().setOverheadTarget(opts->gcOverhead());
   Loader loader(&mm, opts->basePath().c_str());
 
   if (!loader.loadWiredInModules())
@@ -68,16 +87,76 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  // Declared before cap, so they outlive the JIT's compiler thread.
+  PerfMap perfMap;
+  TraceDump traceDump;
   Capability cap(&mm);
+  if (opts->maxStackSize() > 0)
+    Thread::setMaxStackSize(opts->maxStackSize() / sizeof(Word));
   Thread *T = Thread::createThread(&cap, opts->stackSize() / sizeof(Word));
 
   cap.jit()->setOption(Jit::kOptFastHeapCheckFail, true);
+  cap.jit()->setOption(Jit::kOptCompiledExits, true);
+#ifdef LC_TRACE_STATS
+  cap.jit()->setOption(Jit::kOptProfile, true);
+#endif
+  if (opts->jitProfile())
+    cap.jit()->setOption(Jit::kOptProfile, true);
+  if (opts->hotLoopThreshold() > 0)
+    cap.hotCounters()->setThreshold(opts->hotLoopThreshold());
+  if (opts->hotExitThreshold() > 0)
+    Snapshot::setHotExitThreshold(opts->hotExitThreshold());
+  if (opts->maxMCodeSize() > 0)
+    cap.jit()->mcode()->setMaxSize(opts->maxMCodeSize());
+  if (opts->jitBackground())
+    cap.jit()->startCompilerThread();
 
   if (opts->traceInterpreter()) {
     cap.enableBytecodeTracing();
     cap.enableDecodeClosures();
   }
 
+  HeapProfile heapProfile;
+  if (opts->heapProfileInterval() > 0) {
+    string file = opts->inputModule(0) + ".hp";
+    string job = "lcvm " + opts->inputModule(0);
+    if (!heapProfile.open(file.c_str(), job.c_str(),
+                          (Time)(opts->heapProfileInterval() *
+                                 TIME_RESOLUTION))) {
+      cerr << "Could not open heap profile: " << file << endl;
+      return 1;
+    }
+    mm.setHeapProfile(&heapProfile);
+  }
+  if (opts->allocSampleInterval() > 0) {
+    heapProfile.setSampleInterval(opts->allocSampleInterval());
+    cap.setHeapProfile(&heapProfile);
+  }
+
+  if (opts->perfMap() && !perfMap.openMap()) {
+    cerr << "Could not open perf map: " << perfMap.mapFile() << endl;
+    return 1;
+  }
+  if (!opts->jitDumpDir().empty() &&
+      !perfMap.openJitDump(opts->jitDumpDir().c_str())) {
+    cerr << "Could not open jitdump file: " << perfMap.dumpFile() << endl;
+    return 1;
+  }
+  if (perfMap.isEnabled())
+    cap.jit()->setPerfMap(&perfMap);
+
+  if (!opts->traceDumpDir().empty()) {
+    if (!traceDump.open(opts->traceDumpDir().c_str())) {
+      cerr << "Could not open trace dump directory: "
+           << opts->traceDumpDir() << endl;
+      return 1;
+    }
+    cap.jit()->setTraceDump(&traceDump);
+  }
+
+  if (!opts->traceCacheFile().empty())
+    cap.jit()->loadTraceCache(opts->traceCacheFile().c_str(), &loader);
+
   Time start_time = getProcessElapsedTime();
 
   if (!cap.eval(T, entryClosure)) {
@@ -93,10 +172,51 @@ int main(int argc, char *argv[]) {
 
   delete T;
 
+  if (!opts->traceCacheFile().empty() &&
+      !cap.jit()->saveTraceCache(opts->traceCacheFile().c_str(), &loader)) {
+    cerr << "Could not write trace cache: " << opts->traceCacheFile() << endl;
+  }
+
+  cap.jit()->setTraceDump(NULL);
+  traceDump.close();
+
+  heapProfile.close(stop_time);
+  if (heapProfile.sampleAllocs()) {
+    string file = opts->inputModule(0) + ".alloc";
+    FILE *out = fopen(file.c_str(), "w");
+    if (out == NULL) {
+      cerr << "Could not open allocation profile: " << file << endl;
+      return 1;
+    }
+    heapProfile.writeAllocSites(out);
+    fclose(out);
+  }
+
+  if (opts->jitProfile()) {
+    FILE *out = stderr;
+    if (!opts->jitProfileFile().empty()) {
+      out = fopen(opts->jitProfileFile().c_str(), "w");
+      if (out == NULL) {
+        cerr << "Could not open JIT profile: " << opts->jitProfileFile()
+             << endl;
+        return 1;
+      }
+    }
+    printTraceStats(out);
+    if (out != stderr)
+      fclose(out);
+  }
+
   if (opts->printStats()) {
     printStats(stdout, &mm, &cap, startup_time, start_time, stop_time);
   }
 
+  if (!opts->statsFile().empty()) {
+    if (!writeStatsJSON(opts->statsFile().c_str(), &mm,
+                        startup_time, start_time, stop_time))
+      return 1;
+  }
+
   return 0;
 }
 
@@ -134,19 +254,50 @@ void printGCStats(FILE *out, MemoryManager *mm, Time mut_time) {
   uint64_t alloc_rate = (uint64_t)(total_alloc / mut_seconds);
   formatWithThousands(buf, alloc_rate);
   fprintf(out, "   (%18s bytes per MUT second)\n", buf);
-  fprintf(out, "    %18d collections\n\n", mm->numGCs());
+  if (mm->isGenerational()) {
+    fprintf(out, "    %18d collections (%d major)\n\n",
+            mm->numGCs(), mm->numMajorGCs());
+  } else {
+    fprintf(out, "    %18d collections\n\n", mm->numGCs());
+  }
+  if (mm->gcThreads() > 1) {
+    fprintf(out, "    %18u GC threads\n\n", mm->gcThreads());
+  }
+  if (mm->releasedBytes() > 0) {
+    formatWithThousands(buf, mm->releasedBytes());
+    fprintf(out, "  %20s bytes of free heap returned to the OS\n\n", buf);
+  }
+  mm->gcStats().printSummary(out);
+  mm->heapPolicy().printStats(out);
 }
 
+typedef struct {
+  uint64_t count;
+  uint32_t traceId;
+  ExitNo exitno;
+} ExitCount;
+
+static bool moreExits(const ExitCount &a, const ExitCount &b) {
+  return a.count > b.count;
+}
+
+// Reports the counters of all traces compiled with Jit::kOptProfile.
 void
 printTraceStats(FILE *out)
 {
-#ifdef LC_TRACE_STATS
   fprintf(out,
           "Trace Statistics:\n"
           " TRACE     Completions  C.Rate          Exits"
           "  Exit Points\n");
+  vector<ExitCount> exitCounts;
+  map<pair<uint32_t, ExitNo>, uint32_t> sideTraces;
   for (uint32_t traceId = 0; traceId < Jit::numFragments(); ++traceId) {
     Fragment *F = Jit::traceById(traceId);
+    if (F->parent() != NULL)
+      sideTraces[make_pair(F->parent()->traceId(), F->parentExit())] =
+        traceId;
+    if (!F->hasStats())
+      continue;
     uint64_t completions = F->traceCompletions();
     uint64_t exits = F->traceExits();
     uint64_t entries = completions + exits;
@@ -156,7 +307,7 @@ printTraceStats(FILE *out)
     formatWithThousands(exitsString, exits);
     fprintf(out, "  %04d %15s  %5.1f%% %14s ",
             traceId, completionsString,
-            100 * (double)completions / (double)entries,
+            entries > 0 ? 100 * (double)completions / (double)entries : 0.0,
             exitsString);
     if (exits > 0) {
       for (uint32_t e = 0; e < F->numExits(); ++e) {
@@ -164,15 +315,35 @@ printTraceStats(FILE *out)
         if (snapExits > 0) {
           fprintf(out, " #%d " COL_GREY "%3.1f%%" COL_RESET, e,
                   100 * (double)snapExits / (double)exits);
+          ExitCount c = { snapExits, traceId, e };
+          exitCounts.push_back(c);
         }
       }
     }
     fprintf(out, "\n");
   }
   fprintf(out, "\n");
-#else
-  UNUSED(out);
-#endif
+
+  // Exits taken often without a side trace are the ones to look at.
+  sort(exitCounts.begin(), exitCounts.end(), moreExits);
+  fprintf(out,
+          "Hottest Exits:\n"
+          " TRACE  EXIT           Exits  PC                  Side Trace\n");
+  for (size_t i = 0; i < exitCounts.size() && i < 20; ++i) {
+    const ExitCount &c = exitCounts[i];
+    Fragment *F = Jit::traceById(c.traceId);
+    char countString[30];
+    formatWithThousands(countString, c.count);
+    fprintf(out, "  %04d  #%-3d %15s  %-18p  ", c.traceId, (int)c.exitno,
+            countString, (void *)F->snap(c.exitno).pc());
+    map<pair<uint32_t, ExitNo>, uint32_t>::const_iterator side =
+      sideTraces.find(make_pair(c.traceId, c.exitno));
+    if (side != sideTraces.end())
+      fprintf(out, "%04d\n", side->second);
+    else
+      fprintf(out, "-\n");
+  }
+  fprintf(out, "\n");
 }
 
 void
@@ -193,13 +364,26 @@ printBasicStats(FILE *out, Capability *cap,
           "      trace too long         %10" FMT_Word64 "\n"
           "      always failing guard   %10" FMT_Word64 "\n"
           "      interrupted (e.g. GC)  %10" FMT_Word64 "\n"
-          "      unimplemented feature  %10" FMT_Word64 "\n\n",
+          "      unimplemented feature  %10" FMT_Word64 "\n"
+          "      stack grown            %10" FMT_Word64 "\n\n",
           record_abort_reasons[AR_ABSTRACT_STACK_OVERFLOW],
           record_abort_reasons[AR_TRACE_TOO_LONG],
           record_abort_reasons[AR_KNOWN_TO_FAIL_GUARD],
           record_abort_reasons[AR_INTERPRETER_REQUEST],
-          record_abort_reasons[AR_NYI]);
-  
+          record_abort_reasons[AR_NYI],
+          record_abort_reasons[AR_STACK_GROWN]);
+
+  cap->jit()->printBlacklisted(out);
+  fprintf(out, "\n");
+
+  fprintf(out,
+          "  Hot Counter Triggers (Root:Side)    %" FMT_Word64 ":%" FMT_Word64
+          "\n"
+          "  Hot Counter Collisions              %" FMT_Word64 "\n"
+          "  Compiled Exit Handlers              %" FMT_Word64 "\n\n",
+          hotcount_triggers, hotexit_triggers, hotcount_collisions,
+          exit_handlers);
+
   fprintf(out,
           "  Interpreter->MCode Switches         %" FMT_Word64
           " (%5.1f per MUT second)\n\n",
@@ -209,7 +393,11 @@ printBasicStats(FILE *out, Capability *cap,
   MachineCode *mcode = cap->jit()->mcode();
   char buf[50];
   formatWithThousands(buf, (uint64_t)(mcode->end() - mcode->start()));
-  fprintf(out, "  Compiled code: %20s bytes \n\n", buf);
+  fprintf(out, "  Compiled code: %20s bytes \n", buf);
+  fprintf(out, "  Machine Code Flushes  %" FMT_Word64 " (%" FMT_Word64
+          " traces discarded)\n", mcode_flushes, traces_flushed);
+  fprintf(out, "  Traces from cache     %" FMT_Word64 "\n\n",
+          traces_from_cache);
 
   formatTime(out, "  Startup ", start_time - startup_time);
   formatTime(out, "    LOAD  ", loader_time);
@@ -237,11 +425,50 @@ printStats(FILE *out, MemoryManager *mm, Capability *cap,
     printf("\n\n");
     printGCStats(out, mm, mut_time);
 
-#ifdef LC_TRACE_STATS
-    printf("\n\n");
-    printTraceStats(out);
-#endif
+    if (cap->jit()->getOption(Jit::kOptProfile)) {
+      printf("\n\n");
+      printTraceStats(out);
+    }
 
     printBasicStats(out, cap, startup_time, start_time, stop_time);
 
 }
+
+bool
+writeStatsJSON(const char *file, MemoryManager *mm,
+               Time startup_time, Time start_time, Time stop_time)
+{
+  FILE *out = fopen(file, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Could not open stats file: %s\n", file);
+    return false;
+  }
+
+  Time run_time = stop_time - start_time;
+  Time mut_time = run_time - jit_time - gc_time;
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"bytes_allocated\": %" FMT_Word64 ",\n", mm->allocated());
+  fprintf(out, "  \"major_collections\": %u,\n", mm->numMajorGCs());
+  fprintf(out, "  \"gc_threads\": %u,\n", mm->gcThreads());
+  fprintf(out, "  \"time_ns\": { \"startup\": %" FMT_Word64
+          ", \"load\": %" FMT_Word64 ", \"run\": %" FMT_Word64
+          ", \"mut\": %" FMT_Word64 ", \"jit\": %" FMT_Word64
+          ", \"gc\": %" FMT_Word64 " },\n",
+          TimeToNS(start_time - startup_time), TimeToNS(loader_time),
+          TimeToNS(run_time), TimeToNS(mut_time), TimeToNS(jit_time),
+          TimeToNS(gc_time));
+  fprintf(out, "  \"hot_counters\": { \"root_triggers\": %" FMT_Word64
+          ", \"side_triggers\": %" FMT_Word64
+          ", \"collisions\": %" FMT_Word64 " },\n",
+          hotcount_triggers, hotexit_triggers, hotcount_collisions);
+  fprintf(out, "  \"mcode_flushes\": %" FMT_Word64 ",\n", mcode_flushes);
+  fprintf(out, "  \"exit_handlers\": %" FMT_Word64 ",\n", exit_handlers);
+  fprintf(out, "  \"traces_from_cache\": %" FMT_Word64 ",\n",
+          traces_from_cache);
+  fprintf(out, "  \"gc\": ");
+  mm->gcStats().writeJSON(out);
+  fprintf(out, "\n}\n");
+  fclose(out);
+  return true;
+}
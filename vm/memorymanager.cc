@@ -4,10 +4,14 @@
 #include "capability.hh"
 #include "thread.hh"
 #include "time.hh"
+#include "parallelgc.hh"
+#include "jit.hh"
 
 #include <sys/mman.h>
 #include <stdio.h>
 #include <errno.h>
+#include <string.h>
+#include <vector>
 
 _START_LAMBDACHINE_NAMESPACE
 
@@ -48,6 +52,83 @@ static void outOfMemory() {
 const int kMMapProtection = PROT_READ | PROT_WRITE;
 const int kMMapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
 
+// Free blocks are only returned to the OS if they haven't been reused
+// for this many GCs.
+static const u4 kReleaseAfterGCs = 4;
+
+LC_STATIC_ASSERT(Region::kHugePageSize % Region::kRegionSize == 0);
+
+Region::PageMode Region::pageMode_ = Region::kNormalPages;
+uint8_t *Region::regionTable_[1UL << Region::kRegionTableRootBits];
+Region *Region::freeHugeTLBRegions_ = NULL;
+
+void Region::setPageMode(PageMode mode) {
+#if !defined(MAP_HUGETLB)
+  if (mode == kHugeTLBPages) {
+    fprintf(stderr, "WARNING: Huge TLB pages not supported.\n");
+    mode = kNormalPages;
+  }
+#endif
+#if !defined(MADV_HUGEPAGE)
+  if (mode == kTransparentHugePages) {
+    fprintf(stderr, "WARNING: Transparent huge pages not supported.\n");
+    mode = kNormalPages;
+  }
+#endif
+  pageMode_ = mode;
+}
+
+// Returns a region-sized piece of a huge TLB mapping, or NULL if no
+// huge pages are available.  Each mapping is split into several
+// regions.  Mappings are aligned at the huge page size, hence all the
+// regions are properly aligned.
+char *Region::mapHugeTLBRegion() {
+#if defined(MAP_HUGETLB)
+  static char *spare = NULL;
+  static char *spareEnd = NULL;
+
+  if (freeHugeTLBRegions_ != NULL) {
+    Region *r = freeHugeTLBRegions_;
+    freeHugeTLBRegions_ = r->meta_.region_link_;
+    return (char *)r;
+  }
+
+  if (spare == spareEnd) {
+    char *ptr = static_cast<char *>(mmap(NULL, kHugePageSize, kMMapProtection,
+                                         kMMapFlags | MAP_HUGETLB, -1, 0));
+    if (ptr == MAP_FAILED) {
+      DLOG("mmap(MAP_HUGETLB) failed: %s\n", strerror(errno));
+      return NULL;
+    }
+    LC_ASSERT(isAlignedAtPowerOf2(kRegionSizeLog2, ptr));
+    spare = ptr;
+    spareEnd = ptr + kHugePageSize;
+  }
+
+  char *region = spare;
+  spare += kRegionSize;
+  return region;
+#else
+  return NULL;
+#endif
+}
+
+void Region::setRegionType(Region *region, RegionType type) {
+  Word index = (Word)region >> kRegionSizeLog2;
+  LC_ASSERT((index >> kRegionIndexBits) == 0);
+  uint8_t *&leaf = regionTable_[index >> kRegionTableLeafBits];
+  if (leaf == NULL) {
+    if (type == kNoRegion)
+      return;
+    leaf = static_cast<uint8_t *>(calloc(1UL << kRegionTableLeafBits, 1));
+    if (leaf == NULL) {
+      fprintf(stderr, "FATAL: Could not allocate region table.\n");
+      exit(1);
+    }
+  }
+  leaf[index & ((1UL << kRegionTableLeafBits) - 1)] = (uint8_t)type;
+}
+
 Region *Region::newRegion(RegionType regionType) {
   // TODO: Grab a lock.
   //
@@ -60,6 +141,18 @@ Region *Region::newRegion(RegionType regionType) {
   size_t size = kRegionSize;
   char *ptr;
   uint32_t attempts = 0;
+  bool hugeTLB = false;
+
+  if (pageMode_ == kHugeTLBPages) {
+    ptr = mapHugeTLBRegion();
+    if (ptr != NULL) {
+      hugeTLB = true;
+      goto mapped;
+    }
+    fprintf(stderr, "WARNING: No huge TLB pages available.  "
+            "Using normal pages.\n");
+    pageMode_ = kNormalPages;
+  }
 
   for (;;) {
     DLOG("Trying mmap(%p-%p, %ld, ...)\n", alloc_hint, alloc_hint + size, size);
@@ -114,6 +207,15 @@ Region *Region::newRegion(RegionType regionType) {
     }
   }
 
+#if defined(MADV_HUGEPAGE)
+  if (pageMode_ == kTransparentHugePages) {
+    // Adjacent regions usually end up in the same mapping, so the
+    // kernel can back them with huge pages.
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+
+ mapped:
   DLOG("Allocated region %p-%p\n", ptr, ptr + size);
 
   Region *region = reinterpret_cast<Region *>(ptr);
@@ -122,6 +224,7 @@ Region *Region::newRegion(RegionType regionType) {
   region->meta_.magic_ = REGION_MAGIC;
   region->meta_.region_info_ = regionType;
   region->meta_.region_link_ = NULL;
+  region->meta_.hugeTLB_ = hugeTLB;
 
   switch (regionType) {
   case kSmallObjectRegion: {
@@ -140,6 +243,7 @@ Region *Region::newRegion(RegionType regionType) {
     exit(1);
   }
 
+  setRegionType(region, regionType);
   return region;
 }
 
@@ -157,6 +261,7 @@ void Region::initBlocks(SmallObjectRegionData *r) {
   char *metadata = reinterpret_cast<char *>(r);
   for (Word i = 0; i < first_avail; i++) {
     r->blocks_[i].flags_ = Block::kMetadata;
+    r->blocks_[i].freedAt_ = 0;
     r->blocks_[i].start_ = metadata;
     metadata = alignToBlockBoundary(metadata + 1);
     r->blocks_[i].end_ = metadata;
@@ -165,6 +270,7 @@ void Region::initBlocks(SmallObjectRegionData *r) {
   }
   for (Word i = first_avail; i < kBlocksPerRegion; i++) {
     r->blocks_[i].flags_ = Block::kUninitialized;
+    r->blocks_[i].freedAt_ = 0;
     r->blocks_[i].start_ = ptr;
     r->blocks_[i].free_ = ptr;
     ptr = alignToBlockBoundary(ptr + 1);
@@ -182,7 +288,13 @@ void Region::operator delete(void *) {
 Region::~Region() {
   char *ptr = reinterpret_cast<char *>(this);
   DLOG("Freeing region %p-%p\n", ptr, ptr + kRegionSize);
+  setRegionType(this, kNoRegion);
 
+  if (meta_.hugeTLB_) {
+    meta_.region_link_ = freeHugeTLBRegions_;
+    freeHugeTLBRegions_ = this;
+    return;
+  }
   munmap(ptr, kRegionSize);
 }
 
@@ -203,7 +315,8 @@ Time gc_time = 0;
 
 MemoryManager::MemoryManager()
   : largeObjectRegion_(NULL),
-    free_(NULL), old_heap_(NULL), topOfStackMask_(kNoMask),
+    free_(NULL), old_closures_(NULL), toSpace_(&closures_),
+    old_heap_(NULL), gcPool_(NULL), topOfStackMask_(kNoMask),
     beginAllocInfoTableLevel_(0),
     largeObjects_(NULL),
     evacuatedLargeObjects_(NULL),
@@ -211,7 +324,12 @@ MemoryManager::MemoryManager()
     freeLargeRegions_(NULL),
     minHeapSize_(2), 
     nextGC_(minHeapSize_),
-    allocated_(0), num_gcs_(0)
+    lastGCEnd_(getProcessElapsedTime()),
+    retainedFreeBlocks_(kRetainAll), releasedBytes_(0),
+    heapProfile_(NULL),
+    collectCAFs_(false), staticLock_(0),
+    generational_(false), oldGenBlocks_(0), nextMajorGC_(0),
+    allocated_(0), num_gcs_(0), num_major_gcs_(0)
 {
   region_ = Region::newRegion(Region::kSmallObjectRegion);
   static_closures_ = grabFreeBlock(Block::kStaticClosures);
@@ -224,6 +342,7 @@ MemoryManager::MemoryManager()
 }
 
 MemoryManager::~MemoryManager() {
+  delete gcPool_;
   Region *r = region_;
   while (r != NULL) {
     Region *next = r->meta_.region_link_;
@@ -233,6 +352,29 @@ MemoryManager::~MemoryManager() {
   MiscClosures::reset();
 }
 
+void MemoryManager::setGenerational(bool enable) {
+  LC_ASSERT(num_gcs_ == 0);
+  generational_ = enable;
+  if (enable && old_closures_ == NULL) {
+    old_closures_ = grabFreeBlock(Block::kOldClosures);
+    oldGenBlocks_ = 1;
+    nextMajorGC_ = minHeapSize_;
+  }
+}
+
+void MemoryManager::setGCThreads(u4 nthreads) {
+  LC_ASSERT(!gcInProgress());
+  delete gcPool_;
+  gcPool_ = NULL;
+  if (nthreads > 1) {
+    gcPool_ = new GCWorkerPool(this, nthreads);
+  }
+}
+
+u4 MemoryManager::gcThreads() const {
+  return gcPool_ != NULL ? gcPool_->numThreads() : 1;
+}
+
 Block *MemoryManager::grabFreeBlock(Block::Flags flags) {
   // 1. Try to grab a block from the free block list (very likely).
   Block *b = NULL;
@@ -241,6 +383,7 @@ Block *MemoryManager::grabFreeBlock(Block::Flags flags) {
     free_ = b->link_;
     b->link_ = NULL;
     b->flags_ = static_cast<uint32_t>(flags);
+    clearRememberedSet(b);
     return b;
   }
 
@@ -257,6 +400,7 @@ Block *MemoryManager::grabFreeBlock(Block::Flags flags) {
   }
 
   b->flags_ = static_cast<uint32_t>(flags);
+  clearRememberedSet(b);
   return b;
 }
 
@@ -351,6 +495,24 @@ MemoryManager::bumpAllocatorFullNoGC(char **heap, char **heaplim)
   return 0;
 }
 
+char *
+MemoryManager::bumpAllocNoGC(char **heap, char **heaplim, size_t bytes)
+{
+  // A NULL heap limit is a request to yield, which we must preserve.
+  bool yield = *heaplim == NULL;
+  char *limit = yield ? closures_->end() : *heaplim;
+  if (LC_UNLIKELY(*heap + bytes > limit)) {
+    sync(*heap, *heaplim);
+    blockFull(&closures_);
+    getBumpAllocatorBounds(heap, heaplim);
+    if (yield)
+      *heaplim = NULL;
+  }
+  char *ptr = *heap;
+  *heap += bytes;
+  return ptr;
+}
+
 void MemoryManager::bumpAllocatorFull(char **heap, char **heaplim,
                                       Capability *cap) {
   sync(*heap, *heaplim);
@@ -444,8 +606,8 @@ unsigned int MemoryManager::infoTables() {
 }
 
 bool MemoryManager::looksLikeInfoTable(void *p) {
-  Block *block = Region::blockFromPointer(p);
-  return block->contents() == Block::kInfoTables;
+  Block *block = Region::lookupBlock(p);
+  return block != NULL && block->contents() == Block::kInfoTables;
 }
 
 void MemoryManager::debugPrint() {
@@ -453,13 +615,16 @@ void MemoryManager::debugPrint() {
 }
 
 bool MemoryManager::looksLikeClosure(void *p) {
-  Region *r = Region::regionFromPointer(p);
-  if (r->isLargeObjectRegion())
+  Region::RegionType type = Region::regionType(p);
+  if (type == Region::kLargeObjectRegion)
     return true;
+  if (type != Region::kSmallObjectRegion)
+    return false;
 
   Block *block = Region::blockFromPointer(p);
   if (!(block->contents() == Block::kStaticClosures ||
-        block->contents() == Block::kClosures))
+        block->contents() == Block::kClosures ||
+        block->contents() == Block::kOldClosures))
     return false;
 
   Closure *cl = (Closure *)p;
@@ -513,10 +678,6 @@ std::ostream &operator<<(std::ostream &out, const MemoryManager &mm) {
 
 void MemoryManager::performGC(Capability *cap) {
   Time gc_start = getProcessElapsedTime();
-  Thread *T = cap->currentThread();
-  BcIns *pc = T->pc();
-  Word *base = T->base();
-  Word *top = T->top();
 
   if (DEBUG_COMPONENTS & DEBUG_SANITY_CHECK_GC) {
     cerr << ">>> GC " << num_gcs_ << endl;
@@ -526,99 +687,364 @@ void MemoryManager::performGC(Capability *cap) {
   }
 
   ++num_gcs_;
+  memset(&gcEvent_, 0, sizeof(gcEvent_));
+
+  Time mut_time = gc_start - lastGCEnd_;
+  bool census = heapProfile_ != NULL && heapProfile_->censusDue(gc_start);
+  u4 fullBlocks;
+  if (!generational_) {
+    fullBlocks = collectAllGenerations(cap);
+    // The mutator may fill the rest of the heap target before the
+    // next GC.  The +1 is because nextGC_ is decremented before the
+    // GC check.
+    u4 target = heapTarget(fullBlocks, mut_time,
+                           getProcessElapsedTime() - gc_start);
+    nextGC_ = target - fullBlocks + 1;
+  } else {
+    if (oldGenBlocks_ >= nextMajorGC_ || census) {
+      fullBlocks = collectAllGenerations(cap);
+      // The nursery is part of the heap, too.
+      u4 target = heapTarget(oldGenBlocks_ + minHeapSize_, mut_time,
+                             getProcessElapsedTime() - gc_start);
+      nextMajorGC_ = target - minHeapSize_;
+    } else {
+      fullBlocks = collectNursery(cap);
+    }
+    nextGC_ = minHeapSize_ + 1;
+  }
+
+  if (census)
+    heapCensus(gc_start);
+
+  // TODO: Add sanity check.  Everything reachable from the roots must
+  // be in a k[Static|Old]Closures block now.
+
+  if (DEBUG_COMPONENTS & DEBUG_SANITY_CHECK_GC) {
+    cerr << ">>> GC " << num_gcs_ - 1 << " DONE (full blocks = "
+         << fullBlocks << ")\n";
+    // This ensures that the collector itself hasn't introduced any
+    // corrupt state.
+    sanityCheckHeap(cap);
+  }
+
+  releaseIdleBlocks();
+
+  lastGCEnd_ = getProcessElapsedTime();
+  gc_time += lastGCEnd_ - gc_start;
+  gcEvent_.pause = lastGCEnd_ - gc_start;
+  gcStats_.record(gcEvent_);
+}
+
+u4 MemoryManager::heapTarget(u4 liveBlocks, Time mutTime, Time gcTime) {
+  u4 target = heapPolicy_.heapTarget(liveBlocks, mutTime, gcTime);
+  if (target == 0) {
+    fprintf(stderr, "FATAL: Heap exhausted; maximum heap size is %"
+            FMT_Word64 " bytes.\n",
+            (uint64_t)heapPolicy_.maxHeapBlocks() * Block::kBlockSize);
+    exit(1);
+  }
+  return target;
+}
+
+// Copies all live objects.  Returns the number of blocks occupied by
+// the live data.
+//
+// Without the generational collector all live objects are copied
+// back into the closures_ list.  Otherwise the nursery and the old
+// generation are both evacuated into a fresh old generation and the
+// nursery is left empty.
+u4 MemoryManager::collectAllGenerations(Capability *cap) {
+  Thread *T = cap->currentThread();
 
   LC_ASSERT(old_heap_ == NULL);
   old_heap_ = closures_;
 
-  closures_ = grabFreeBlock(closures_->contents());
+  if (generational_) {
+    // Everything in the old generation is in from-space now.
+    // Relabel the blocks so that evacuate() copies their contents.
+    Block *last = old_closures_;
+    for (;;) {
+      last->flags_ = Block::kClosures;
+      if (last->link_ == NULL) break;
+      last = last->link_;
+    }
+    last->link_ = old_heap_;
+    old_heap_ = old_closures_;
+    ++num_major_gcs_;
+  }
+  gcEvent_.major = true;
+
+  closures_ = grabFreeBlock(Block::kClosures);
   closures_->link_ = NULL;
 
-  // Traverse the roots.
-  // TODO: Traverse updated CAFs
-  scavengeStack(base, top, pc);
-  scavengeStaticRoots(cap->staticRoots());
+  if (generational_) {
+    old_closures_ = grabFreeBlock(Block::kOldClosures);
+    old_closures_->link_ = NULL;
+    toSpace_ = &old_closures_;
+  } else {
+    toSpace_ = &closures_;
+  }
+  Block *scanBlock = *toSpace_;
+  if (gcPool_ != NULL)
+    gcPool_->beginGC(scanBlock);
 
-  // TODO: We need to alternate scavenge a block and scavenging large blocks until both have no more work left.
+  // Updated CAFs are not roots.  Instead we find all static closures
+  // and code reachable from the roots and from live heap objects.
+  collectCAFs_ = true;
+  staticSeen_.clear();
+  memset(staticCache_, 0, sizeof(staticCache_));
 
-  // Scavenging allocates into closures_ and pushes filled blocks onto
-  // the front of the list.  So we repeatedly traverse closures_ until
-  // we reach the end of a list or a block that we've already
-  // processed.
-  for (;;) {
-    Block *block = closures_;
-    if (block == NULL || block->getFlag(Block::kScavenged)) {
-      break;  // we're done
-    } else {
-      // If the block we are evacuating into and the block we're
-      // scavanging is the same then it definitely must be the last
-      // block.  Otherwise, we may finish scavenging the block
-      // and then continue to evacuate into it again.  Those newly
-      // evacuated objects will then never get scavenged.  Ouch!
-      //
-      // To avoid this problem, we only scavenge the first block if
-      // there is no second block.
-      if (block == closures_ && block->link_ &&
-          !block->link_->getFlag(Block::kScavenged))
-        block = block->link_;
-
-      while (block != NULL && !block->getFlag(Block::kScavenged)) {
-        scavengeBlock(block);
-        block = block->link_;
-      }
+  // Traverse the roots.
+  scavengeStack(T->base(), T->top(), T->pc());
+  scavengeTraces(cap);
+
+  // TODO: We need to alternate scavenge a block and scavenging large
+  // blocks until both have no more work left.
+  if (gcPool_ != NULL) {
+    uint64_t copied = gcPool_->finishGC(toSpace_);
+    // Reachable CAFs may keep more heap objects alive, which in turn
+    // may refer to more CAFs.
+    while (!staticTodo_.empty() || !codeTodo_.empty()) {
+      gcPool_->beginGC(*toSpace_);
+      scavengeStaticObjects();
+      copied += gcPool_->finishGC(toSpace_);
     }
+    allocated_ += copied;
+    gcEvent_.bytesCopied += copied;
+  } else {
+    scavengeToSpace(scanBlock, scanBlock->start());
   }
 
-  // Mark blocks as no longer scavenged.
-  // TODO: Would it help much to not do this?
+  revertUnreachableCAFs();
+  collectCAFs_ = false;
+
   u4 fullBlocks = 0;
-  for (Block *block = closures_; block != NULL; block = block->link_) {
-    block->clearFlag(Block::kScavenged);
+  for (Block *block = *toSpace_; block != NULL; block = block->link_) {
     ++fullBlocks;
   }
+  if (generational_) {
+    oldGenBlocks_ = fullBlocks;
+  }
+  gcEvent_.blocksScavenged = fullBlocks;
+  gcEvent_.bytesBefore = usedBytes(old_heap_);
+
+  freeBlocks(old_heap_);
+  old_heap_ = NULL;
+  toSpace_ = &closures_;
+  return fullBlocks;
+}
+
+// Evacuates all live objects from the nursery into the old
+// generation.  Roots are the stack, the static roots and the
+// remembered set.  Returns the number of blocks in the old
+// generation.
+u4 MemoryManager::collectNursery(Capability *cap) {
+  Thread *T = cap->currentThread();
+
+  LC_ASSERT(generational_);
+  LC_ASSERT(old_heap_ == NULL);
+  old_heap_ = closures_;
+  closures_ = grabFreeBlock(Block::kClosures);
+  closures_->link_ = NULL;
+  toSpace_ = &old_closures_;
+
+  // Objects are promoted into the partially filled first block of
+  // the old generation, so scanning starts at its free pointer.
+  Block *scanBlock = old_closures_;
+  char *scan = scanBlock->free();
+  if (gcPool_ != NULL)
+    gcPool_->beginGC(scanBlock);
+
+  // Remembered objects are the roots from the old generation.  This
+  // must happen before any objects get promoted, since we only want
+  // to look at old objects that existed before this GC.
+  for (Block *block = old_closures_; block != NULL; block = block->link_) {
+    scavengeRememberedSet(block);
+  }
+
+  scavengeStack(T->base(), T->top(), T->pc());
+  scavengeCAFs();
+
+  if (gcPool_ != NULL) {
+    uint64_t copied = gcPool_->finishGC(toSpace_);
+    allocated_ += copied;
+    gcEvent_.bytesCopied += copied;
+  } else {
+    scavengeToSpace(scanBlock, scan);
+  }
+
+  u4 oldBlocks = 0;
+  for (Block *block = old_closures_; block != NULL; block = block->link_) {
+    ++oldBlocks;
+  }
+  // The first block of the old generation was partially filled.
+  gcEvent_.blocksScavenged = oldBlocks - oldGenBlocks_ + 1;
+  gcEvent_.bytesBefore = usedBytes(old_heap_);
+  oldGenBlocks_ = oldBlocks;
+
+  freeBlocks(old_heap_);
+  old_heap_ = NULL;
+  toSpace_ = &closures_;
+  return oldBlocks;
+}
+
+// Size of a heap object in bytes.
+static size_t closureSize(Closure *cl) {
+  InfoTable *info = cl->info();
+  if (info->type() == PAP) {
+    return (wordsof(PapClosure) + ((PapClosure *)cl)->info_.nargs_)
+      * sizeof(Word);
+  }
+  return (wordsof(ClosureHeader) + info->size()) * sizeof(Word);
+}
+
+// Classifies all objects that survived the preceding major GC.
+void MemoryManager::heapCensus(Time now) {
+  heapProfile_->beginCensus(now);
+  Block *live = generational_ ? old_closures_ : closures_;
+  for (Block *block = live; block != NULL; block = block->link_) {
+    for (char *p = block->start(); p < block->free(); ) {
+      size_t size = closureSize((Closure *)p);
+      heapProfile_->census((Closure *)p, size);
+      p += size;
+    }
+  }
+  heapProfile_->endCensus();
+}
+
+uint64_t MemoryManager::usedBytes(Block *block) {
+  uint64_t bytes = 0;
+  for ( ; block != NULL; block = block->link_) {
+    bytes += block->free() - block->start();
+  }
+  return bytes;
+}
 
-  // O
-  for (Block *block = old_heap_; block != NULL; ) {
+void MemoryManager::freeBlocks(Block *block) {
+  while (block != NULL) {
     block->markAsFree();
+    block->freedAt_ = num_gcs_;
     Block *next = block->link_;
     block->link_ = free_;
     free_ = block;
     block = next;
   }
-  old_heap_ = NULL;
-
-  // TODO: Add sanity check.  Everything reachable from the roots must
-  // be in a k[Static]Closures block now.
+}
 
-  // TODO: Is this correct?
-  nextGC_ = (fullBlocks > minHeapSize_ ? fullBlocks : minHeapSize_) + 1;
+// Returns the memory of free blocks that have been idle for a while
+// back to the OS.  The most recently freed blocks are at the front of
+// the free list and are reused first, so we keep those.
+void MemoryManager::releaseIdleBlocks() {
+  if (retainedFreeBlocks_ == kRetainAll ||
+      Region::pageMode() == Region::kHugeTLBPages)
+    return;
 
-  if (DEBUG_COMPONENTS & DEBUG_SANITY_CHECK_GC) {
-    cerr << ">>> GC " << num_gcs_ - 1 << " DONE (full blocks = "
-         << fullBlocks << ")\n";
-    // This ensures that the collector itself hasn't introduced any
-    // corrupt state.
-    sanityCheckHeap(cap);
+  u4 n = 0;
+  for (Block *block = free_; block != NULL; block = block->link_) {
+    if (n++ < retainedFreeBlocks_ || block->getFlag(Block::kReleased) ||
+        block->freedAt_ + kReleaseAfterGCs > num_gcs_)
+      continue;
+    if (madvise(block->start(), block->size(), MADV_DONTNEED) == 0) {
+      block->setFlag(Block::kReleased);
+      releasedBytes_ += block->size();
+    }
   }
-
-  gc_time += getProcessElapsedTime() - gc_start;
 }
 
-static inline bool isForwardingPointer(const InfoTable *p) {
-  return (Word)p & 1;
+// Cheney-style scan of the to-space list, starting at the given
+// object.
+//
+// Evacuation allocates into *toSpace_ and pushes filled blocks onto
+// the front of the list, so the blocks that still need scanning are
+// those in front of scanBlock.  We process them oldest first.  The
+// first block of the list may still receive objects while we are
+// scanning it, so we re-check its free pointer until no more
+// objects get added.
+void MemoryManager::scavengeToSpace(Block *scanBlock, char *scan) {
+  std::vector<Block *> pending;
+  for (;;) {
+    while (scan < scanBlock->free()) {
+      scan += scavengeClosure((Closure *)scan);
+    }
+
+    if (scanBlock == *toSpace_) {
+      if (scavengeStaticObjects())
+        continue;  // may have evacuated more objects
+      break;  // we're done
+    }
+
+    // Collect all blocks that were added since we last looked.
+    pending.clear();
+    for (Block *b = *toSpace_; b != scanBlock; b = b->link_) {
+      pending.push_back(b);
+    }
+
+    // All but the first one are full and won't change anymore.
+    for (size_t i = pending.size() - 1; i > 0; --i) {
+      Block *block = pending[i];
+      for (char *p = block->start(); p < block->free(); ) {
+        p += scavengeClosure((Closure *)p);
+      }
+    }
+
+    scanBlock = pending[0];
+    scan = scanBlock->start();
+  }
 }
 
-static inline Closure *getForwardingPointer(const InfoTable *p) {
-  return cast(Closure *, (Word)p ^ 1);
+void MemoryManager::clearRememberedSet(Block *block) {
+  Region *r = Region::regionFromPointer(block->start());
+  Word first = ((Word)block->start() & Region::kRegionMask)
+    >> (LC_ARCH_BYTES_LOG2 + LC_ARCH_BITS_LOG2);
+  Word last = idivCeil((Word)block->end() - (Word)r,
+                       sizeof(Word) * LC_ARCH_BITS);
+  Word *bits = r->smallSelf()->remembered_;
+  memset(&bits[first], 0, (last - first) * sizeof(Word));
 }
 
-static inline InfoTable *makeForwardingPointer(Closure *p) {
-  return cast (InfoTable *, (Word)p | 1);
+// Scavenge all remembered objects in the given block and remove them
+// from the remembered set.  After a minor GC the nursery is empty, so
+// no old object can point into the nursery anymore.
+void MemoryManager::scavengeRememberedSet(Block *block) {
+  Region *r = Region::regionFromPointer(block->start());
+  Word first = ((Word)block->start() & Region::kRegionMask)
+    >> (LC_ARCH_BYTES_LOG2 + LC_ARCH_BITS_LOG2);
+  Word last = idivCeil((Word)block->end() - (Word)r,
+                       sizeof(Word) * LC_ARCH_BITS);
+  Word *bits = r->smallSelf()->remembered_;
+
+  for (Word i = first; i < last; ++i) {
+    Word w = bits[i];
+    if (LC_LIKELY(w == 0))
+      continue;
+    bits[i] = 0;
+    for (int bit = 0; w != 0; ++bit, w >>= 1) {
+      if (!(w & 1))
+        continue;
+      Closure *cl = (Closure *)((char *)r +
+          (i * LC_ARCH_BITS + bit) * sizeof(Word));
+      LC_ASSERT(block->start() <= (char *)cl && (char *)cl < block->free());
+      dout << "MM: Remembered " << cl << ' ' << cl->info()->name() << endl;
+      if (cl->info()->type() == IND) {
+        evacuate((Closure **)&cl->payload_[0]);
+      } else {
+        scavengeClosure(cl);
+      }
+    }
+  }
 }
 
-static inline void copy(MemoryManager *mm, Closure **src,
-                        InfoTable *info, u4 payloadSize) {
+void MemoryManager::copy(Closure **src, InfoTable *info, u4 payloadSize) {
+  GCWorker *worker = GCWorker::current();
+  if (worker != NULL) {
+    worker->copy(src, info, payloadSize);
+    return;
+  }
   Closure *from = *src;
-  Closure *to = mm->allocClosure(info, payloadSize);
+  size_t bytes = (wordsof(ClosureHeader) + payloadSize) * sizeof(Word);
+  Closure *to = reinterpret_cast<Closure*>(allocInto(toSpace_, bytes));
+  gcEvent_.bytesCopied += bytes;
+  Closure::initHeader(to, info);
   *src = to;
   for (u4 i = 0; i < payloadSize; ++i) {
     to->setPayload(i, from->payload(i));
@@ -651,9 +1077,12 @@ loop:
 
   block = Region::blockFromPointer(q);
   if (block->contents() != Block::kClosures) {
-    // TODO: Need to follow indirections from static closures into
-    // dynamic heap.
+    // Static objects and (during a minor GC) objects in the old
+    // generation don't move.  During a major GC static objects are
+    // scavenged once by scavengeStaticObjects.
     dout << " -S-> " COL_YELLOW "static object" COL_RESET << endl;
+    if (collectCAFs_ && block->contents() == Block::kStaticClosures)
+      markStatic(q);
     return;
   }
 
@@ -662,7 +1091,7 @@ loop:
   case THUNK:
   case FUN:
     dout << " -CTF(" << info->size() << ")-> ";
-    copy(this, p, info, info->size());
+    copy(p, info, info->size());
     break;
 
   case IND:
@@ -676,13 +1105,16 @@ loop:
     u4 size = pap->info_.nargs_ + wordsof(PapClosure)
               - wordsof(ClosureHeader);
     dout << " -PAP(" << pap->info_.nargs_ << ")-> " << pap;
-    copy(this, p, info, size);
+    copy(p, info, size);
     break;
   }
 
     // Don't copy large objects.  Just mark them.
   case LARGE: {
-    evacuateLarge(q);
+    if (gcPool_ != NULL)
+      gcPool_->evacuateLarge(q);
+    else
+      evacuateLarge(q);
     break;
   }
 
@@ -692,6 +1124,53 @@ loop:
   }
 }
 
+// Selector thunks whose selectee has already been evaluated are
+// replaced by the selected field.  Otherwise a thunk like (fst p)
+// keeps all of p alive until it is evaluated.
+//
+// This is only done for references from the heap.  A thunk that is
+// referenced from the stack may be under evaluation and its update
+// frame must keep pointing to the thunk itself.
+//
+// We only look at selectees that have not been evacuated yet.  The
+// fields of an evacuated copy may already point into to-space.
+bool MemoryManager::eliminateSelector(Closure **p) {
+  Closure *q = *p;
+  InfoTable *info = q->info();
+  if (isForwardingPointer(info) || info->selectorField() == 0)
+    return false;
+  if (Region::blockFromPointer(q)->contents() != Block::kClosures)
+    return false;
+
+  u4 field = info->selectorField();
+  Closure *selectee = (Closure *)q->payload(0);
+  InfoTable *sinfo = selectee->info();
+  while (!isForwardingPointer(sinfo) && sinfo->type() == IND) {
+    selectee = (Closure *)selectee->payload(0);
+    sinfo = selectee->info();
+  }
+  if (isForwardingPointer(sinfo) || sinfo->type() != CONSTR ||
+      field > sinfo->size() ||
+      !((sinfo->layout().bitmap >> (field - 1)) & 1))
+    return false;
+
+  dout << "MM: Selector " << q << ' ' << info->name() << " -> "
+       << (void *)selectee->payload(field - 1) << endl;
+  *p = (Closure *)selectee->payload(field - 1);
+  if (gcPool_ != NULL)
+    __sync_fetch_and_add(&gcEvent_.selectorsEliminated, 1);
+  else
+    ++gcEvent_.selectorsEliminated;
+  return true;
+}
+
+// Evacuates a pointer stored in a heap object.
+void MemoryManager::evacuateField(Closure **p) {
+  // Bounded, since selector thunks may form a cycle.
+  for (int i = 0; i < 16 && eliminateSelector(p); ++i) { }
+  evacuate(p);
+}
+
 // The "colour" of large objects:
 //
 //  - white: it's in the largeObjects_ list and mark is clear
@@ -847,80 +1326,211 @@ void MemoryManager::scavengeStack(Word *base, Word *top, const BcIns *pc) {
   }
 }
 
-void MemoryManager::scavengeStaticRoots(Closure *cl) {
-  dout << "MM: Scavenging static roots" << endl;
-  while (cl) {
-    evacuate((Closure **)&cl->payload_[0]);
-    cl = (Closure *)cl->payload_[1];
+void MemoryManager::recordCAF(Closure *caf) {
+  LC_ASSERT(caf->info()->type() == CAF);
+  CAFEntry entry = { caf, caf->info(), caf->payload(0) };
+  cafs_.push_back(entry);
+}
+
+// During a minor GC all updated CAFs are roots.
+void MemoryManager::scavengeCAFs() {
+  dout << "MM: Scavenging CAFs" << endl;
+  for (size_t i = 0; i < cafs_.size(); ++i) {
+    evacuate((Closure **)&cafs_[i].caf->payload_[0]);
   }
 }
 
-void MemoryManager::scavengeBlock(Block *block) {
-  dout << "MM: Scavenging block: " << (void *)block->start()
-       << '-' << (void *)block->end() << endl;
+// Closures referenced by compiled traces must stay alive.  So must
+// those of a trace that is still being compiled by the compiler
+// thread.  We wait for it, so that the IR buffer isn't changing.
+void MemoryManager::scavengeTraces(Capability *cap) {
+  std::vector<Closure *> closures;
+  for (u4 i = 0; i < Jit::numFragments(); ++i) {
+    Jit::traceById(i)->closureConstants(&closures);
+  }
+  Jit *jit = cap->jit();
+  jit->waitForCompiler();
+  if (jit->isCompiling())
+    jit->buffer()->closureConstants(&closures);
+  for (size_t i = 0; i < closures.size(); ++i) {
+    Block *block = Region::lookupBlock(closures[i]);
+    if (block != NULL && block->contents() == Block::kStaticClosures)
+      markStatic(closures[i]);
+  }
+}
 
-  char *p = block->start();
+// With the parallel GC, static closures and code are found by all
+// worker threads.  The cache is only a hint and is accessed without
+// holding the lock.
+#define STATIC_LOCK \
+  if (gcPool_ != NULL) { \
+    while (__sync_lock_test_and_set(&staticLock_, 1)) {} }
+#define STATIC_UNLOCK \
+  if (gcPool_ != NULL) { __sync_lock_release(&staticLock_); }
+
+static inline Word staticCacheSlot(const void *p, u4 size) {
+  return ((Word)p >> LC_ARCH_BYTES_LOG2) % size;
+}
 
-  // We might be evacuating into the same block that we're scavenging.
-  // That is `bd->free` might change during the loop, so recheck here.
-  while ((char *)p < block->free()) {
-    Closure *cl = (Closure *)p;
-    InfoTable *info = cl->info();
-    LC_ASSERT(!isForwardingPointer(info));
-    switch (info->type()) {
-    case CONSTR:
-    case THUNK:
-    case FUN: {
-      u4 bitmap = info->layout().bitmap;
-      u4 size = info->size();
-      dout << "MM: * Scav " << (void *)cl
-           << ' ' << info->name() << ' ';
-      IFDBG(InfoTable::printPayload(dout, bitmap, size));
-      dout << endl;
+void MemoryManager::markStatic(Closure *cl) {
+  Word slot = staticCacheSlot(cl, kStaticCacheSize);
+  if (staticCache_[slot] == cl)
+    return;
+  STATIC_LOCK;
+  if (staticSeen_.insert(cl).second)
+    staticTodo_.push_back(cl);
+  STATIC_UNLOCK;
+  staticCache_[slot] = cl;
+}
 
-      LC_ASSERT(bitmap < (1UL << size));
-      for (u4 i = 0; bitmap != 0 && i < size; ++i, bitmap >>= 1) {
-        if (bitmap & 1) {
-          evacuate((Closure **)&cl->payload_[i]);
+void MemoryManager::markCode(const InfoTable *info) {
+  Word slot = staticCacheSlot(info, kStaticCacheSize);
+  if (staticCache_[slot] == info)
+    return;
+  STATIC_LOCK;
+  if (staticSeen_.insert((void *)info).second)
+    codeTodo_.push_back(info);
+  STATIC_UNLOCK;
+  staticCache_[slot] = info;
+}
+
+#undef STATIC_LOCK
+#undef STATIC_UNLOCK
+
+// Follows the references from static closures and from the literals
+// of code that has been found reachable since the last call.  An
+// updated CAF keeps its value alive.  Returns false if there was
+// nothing to do.
+//
+// Only called from one thread.
+bool MemoryManager::scavengeStaticObjects() {
+  if (!collectCAFs_)
+    return false;
+  bool progress = false;
+  for (;;) {
+    if (!codeTodo_.empty()) {
+      const Code *code = ((const CodeInfoTable *)codeTodo_.back())->code();
+      codeTodo_.pop_back();
+      for (u4 i = 0; i < code->sizelits; ++i) {
+        if (code->littypes[i] == LIT_CLOSURE) {
+          Closure *cl = (Closure *)code->lits[i];
+          Block *block = Region::lookupBlock(cl);
+          if (block != NULL && block->contents() == Block::kStaticClosures)
+            markStatic(cl);
+        } else if (code->littypes[i] == LIT_INFO) {
+          InfoTable *info = (InfoTable *)code->lits[i];
+          if (info->hasCode())
+            markCode(info);
         }
       }
-      p += (wordsof(ClosureHeader) + size) * sizeof(Word);
+    } else if (!staticTodo_.empty()) {
+      Closure *cl = staticTodo_.back();
+      staticTodo_.pop_back();
+      InfoTable *info = cl->info();
+      dout << "MM: Static " << (void *)cl << ' ' << info->name() << endl;
+      switch (info->type()) {
+      case IND:
+        evacuate((Closure **)&cl->payload_[0]);
+        break;
+      case CONSTR:
+      case FUN:
+      case THUNK: {
+        u4 bitmap = info->layout().bitmap;
+        for (u4 i = 0; bitmap != 0 && i < info->size(); ++i, bitmap >>= 1) {
+          if (bitmap & 1)
+            evacuate((Closure **)&cl->payload_[i]);
+        }
+        break;
+      }
+      default:
+        break;
+      }
+      if (info->hasCode())
+        markCode(info);
+    } else {
+      return progress;
     }
-    break;
-
-    case PAP: {
-      PapClosure *pap = (PapClosure *)cl;
-      // In principle we could get the bitmap from the function
-      // argument itself.  That would require following a few more
-      // pointers, though, so let's not do that if we can avoid it.
-      u4 bitmap = pap->info_.pointerMask_;
-      u4 size = pap->info_.nargs_;
-      dout << "MM: * Scav " << (void *)cl << " PAP";
-      IFDBG(InfoTable::printPayload(dout, bitmap, size));
-      dout << endl;
+    progress = true;
+  }
+}
 
-      evacuate(&pap->fun_);
+// Reverts all CAFs that have not been found reachable during this
+// GC.  Should they ever be entered again they will simply be
+// re-evaluated.
+void MemoryManager::revertUnreachableCAFs() {
+  size_t live = 0;
+  for (size_t i = 0; i < cafs_.size(); ++i) {
+    CAFEntry &entry = cafs_[i];
+    if (staticSeen_.count(entry.caf)) {
+      cafs_[live++] = entry;
+    } else {
+      dout << "MM: Reverting CAF " << (void *)entry.caf << ' '
+           << entry.info->name() << endl;
+      entry.caf->setInfo(entry.info);
+      entry.caf->setPayload(0, entry.payload);
+      ++gcEvent_.cafsReverted;
+    }
+  }
+  cafs_.resize(live);
+  staticSeen_.clear();
+}
 
-      LC_ASSERT(bitmap < (1UL << size));
-      for (u4 i = 0; bitmap != 0 && i < size; ++i, bitmap >>= 1) {
-        if (bitmap & 1) {
-          evacuate((Closure **)&pap->payload_[i]);
-        }
+// Evacuates all objects referenced from the given object and returns
+// the size of the object in bytes.
+size_t MemoryManager::scavengeClosure(Closure *cl) {
+  InfoTable *info = cl->info();
+  LC_ASSERT(!isForwardingPointer(info));
+  switch (info->type()) {
+  case CONSTR:
+  case THUNK:
+  case FUN: {
+    u4 bitmap = info->layout().bitmap;
+    u4 size = info->size();
+    dout << "MM: * Scav " << (void *)cl
+         << ' ' << info->name() << ' ';
+    IFDBG(InfoTable::printPayload(dout, bitmap, size));
+    dout << endl;
+
+    LC_ASSERT(bitmap < (1UL << size));
+    for (u4 i = 0; bitmap != 0 && i < size; ++i, bitmap >>= 1) {
+      if (bitmap & 1) {
+        evacuateField((Closure **)&cl->payload_[i]);
       }
-      p += (wordsof(PapClosure) + size) * sizeof(Word);
     }
-    break;
+    // The code may refer to CAFs.
+    if (collectCAFs_ && info->type() != CONSTR)
+      markCode(info);
+    return (wordsof(ClosureHeader) + size) * sizeof(Word);
+  }
 
-    default:
-      cerr << "Can't scavenge object type, yet: " << info->type()
-           << " at " << cl << " " << info->name()
-           << endl;
-      exit(43);
+  case PAP: {
+    PapClosure *pap = (PapClosure *)cl;
+    // In principle we could get the bitmap from the function
+    // argument itself.  That would require following a few more
+    // pointers, though, so let's not do that if we can avoid it.
+    u4 bitmap = pap->info_.pointerMask_;
+    u4 size = pap->info_.nargs_;
+    dout << "MM: * Scav " << (void *)cl << " PAP";
+    IFDBG(InfoTable::printPayload(dout, bitmap, size));
+    dout << endl;
+
+    evacuate(&pap->fun_);
+
+    LC_ASSERT(bitmap < (1UL << size));
+    for (u4 i = 0; bitmap != 0 && i < size; ++i, bitmap >>= 1) {
+      if (bitmap & 1) {
+        evacuateField((Closure **)&pap->payload_[i]);
+      }
     }
+    return (wordsof(PapClosure) + size) * sizeof(Word);
+  }
+
+  default:
+    cerr << "Can't scavenge object type, yet: " << info->type()
+         << " at " << cl << " " << info->name()
+         << endl;
+    exit(43);
   }
-  block->setFlag(Block::kScavenged);
-  dout << "MM: DONE Scavenging block: " << (void *)block->start()
-       << '-' << (void *)block->end() << endl;
 }
 
 // --- Sanity Checking ----------------------------------------
@@ -1096,13 +1706,13 @@ bool MemoryManager::sanityCheckStack(SEEN_SET_TYPE &seen, Word *base, Word *top,
   return true;
 }
 
-bool MemoryManager::sanityCheckStaticRoots(SEEN_SET_TYPE &seen, Closure *cl) {
-  while (cl) {
+bool MemoryManager::sanityCheckCAFs(SEEN_SET_TYPE &seen) {
+  for (size_t i = 0; i < cafs_.size(); ++i) {
+    Closure *cl = cafs_[i].caf;
     if (!sanityCheckClosure(seen, (Closure *)cl->payload_[0])) {
-      cerr << ".. static root " << (void *)cl;
+      cerr << ".. CAF " << (void *)cl;
       return false;
     }
-    cl = (Closure *)cl->payload_[1];
   }
   return true;
 }
@@ -1116,28 +1726,8 @@ void MemoryManager::sanityCheckHeap(Capability *cap) {
   Word *top = T->top();
 
   if (!(sanityCheckStack(seen, base, top, pc) &&
-        sanityCheckStaticRoots(seen, cap->staticRoots())))
+        sanityCheckCAFs(seen)))
     exit(42);
 }
 
-bool
-MemoryManager::inRegions(void *p)
-{
-  Region *r = region_;
-  while (r) {
-    if (r->inRegion(p))
-      return true;
-    r = r->meta_.region_link_;
-  }
-
-  r = largeObjectRegion_;
-  while (r) {
-    if (r->inRegion(p))
-      return true;
-    r = r->meta_.region_link_;
-  }
-
-  return false;
-}
-
 _END_LAMBDACHINE_NAMESPACE
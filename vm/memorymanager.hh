@@ -4,8 +4,12 @@
 #include "common.hh"
 #include "utils.hh"
 #include "objects.hh"
+#include "heappolicy.hh"
+#include "gcstats.hh"
+#include "heapprofile.hh"
 #include <iostream>
 #include <string.h>
+#include <vector>
 
 #include HASH_SET_H
 
@@ -13,6 +17,8 @@ _START_LAMBDACHINE_NAMESPACE
 
 class MemoryManager;
 class Capability;
+class GCWorker;
+class GCWorkerPool;
 
 // Only one OS thread should allocate to each block.
 
@@ -50,6 +56,7 @@ public:
 #define DEFINE_CONTENT_TYPE(_) \
   _(Uninitialized,  FREE) \
   _(Closures,       HEAP) \
+  _(OldClosures,    OLDH) \
   _(StaticClosures, STAT) \
   _(InfoTables,     INFO) \
   _(Strings,        STRG) \
@@ -64,6 +71,7 @@ public:
     kContentsMask = 0xff,
     kScavenged = 0x100,
     kFull = 0x200,
+    kReleased = 0x400,  // Free and its memory was returned to the OS.
   } Flags;
 
   inline Flags flags() const {
@@ -81,6 +89,8 @@ public:
 private:
   friend class Region;
   friend class MemoryManager;
+  friend class GCWorker;
+  friend class GCWorkerPool;
   Block() {}; // Hidden
   ~Block() {};
   
@@ -100,15 +110,14 @@ private:
   char *free_;
   Block *link_;
   uint32_t flags_;
-#if LC_ARCH_BITS == 64
-  uint32_t padding;
-#endif
+  uint32_t freedAt_;  // GC number when the block was last freed.
 };
 
 
 class Region {
 public:
   typedef enum {
+    kNoRegion = 0,          // Not part of the heap.
     kSmallObjectRegion = 1, // The region is subdivided into blocks.
     kLargeObjectRegion	// The region contains large objects.
   } RegionType;
@@ -117,6 +126,24 @@ public:
   static const size_t kRegionSize = 1UL << kRegionSizeLog2;
   static const Word kBlocksPerRegion = kRegionSize / Block::kBlockSize;
   static const Word kRegionMask = kRegionSize - 1;
+  static const size_t kHugePageSize = 2UL << 20;
+
+  typedef enum {
+    kNormalPages,
+    kTransparentHugePages,  // madvise(MADV_HUGEPAGE)
+    kHugeTLBPages           // mmap(MAP_HUGETLB)
+  } PageMode;
+
+  // How the memory for new regions is mapped.  Huge pages reduce TLB
+  // misses when scavenging a large heap.  If huge TLB pages cannot be
+  // allocated we fall back to normal pages.
+  static void setPageMode(PageMode mode);
+  static inline PageMode pageMode() { return pageMode_; }
+
+  // Number of words in the remembered set bitmap (one bit per heap
+  // word).
+  static const Word kRememberedSetWords =
+    kRegionSize / sizeof(Word) / LC_ARCH_BITS;
 
   // Allocate a new memory region from the OS.
   static Region *newRegion(RegionType);
@@ -138,6 +165,46 @@ public:
     return reinterpret_cast<Region*>((Word)p & ~kRegionMask);
   }
 
+  // Heap membership is looked up in a two-level table indexed by
+  // region number.  The root table covers the whole user address
+  // space, leaves are allocated when the first region in their range
+  // is mapped.  Each leaf entry holds the RegionType of the region.
+  //
+  // The table is shared by all memory managers.
+#if LC_ARCH_BITS == 64
+  static const int kAddressBits = 48;
+#else
+  static const int kAddressBits = 32;
+#endif
+  static const int kRegionIndexBits = kAddressBits - kRegionSizeLog2;
+  static const int kRegionTableRootBits = kRegionIndexBits / 2;
+  static const int kRegionTableLeafBits =
+    kRegionIndexBits - kRegionTableRootBits;
+
+  // Returns the type of the region containing p, or kNoRegion if p
+  // does not point into the heap.  Works for any pointer.
+  static inline RegionType regionType(const void *p) {
+    Word index = (Word)p >> kRegionSizeLog2;
+    if (LC_UNLIKELY(index >> kRegionIndexBits))
+      return kNoRegion;
+    const uint8_t *leaf = regionTable_[index >> kRegionTableLeafBits];
+    if (leaf == NULL)
+      return kNoRegion;
+    return (RegionType)leaf[index & ((1UL << kRegionTableLeafBits) - 1)];
+  }
+
+  static inline bool isHeapPointer(const void *p) {
+    return regionType(p) != kNoRegion;
+  }
+
+  // Returns the block containing p, or NULL if p does not point into
+  // a small object region.
+  static inline Block *lookupBlock(void *p) {
+    if (regionType(p) != kSmallObjectRegion)
+      return NULL;
+    return blockFromPointer(p);
+  }
+
   static inline Block *blockFromPointer(void *p) {
     Region *r = regionFromPointer(p);
     LC_ASSERT(r->isSmallObjectRegion());
@@ -147,6 +214,31 @@ public:
     return &rd->blocks_[index];
   }
 
+  // The remembered set of a small object region is a bitmap with
+  // one bit for each word in the region.  A set bit marks an object
+  // in the old generation that may point into the nursery.  Bits are
+  // set by the write barrier (see MemoryManager::writeBarrier and
+  // Assembler::insUpdate) and consumed by a minor GC.
+  static inline void remember(void *p) {
+    Region *r = regionFromPointer(p);
+    Word bit = ((Word)p & kRegionMask) >> LC_ARCH_BYTES_LOG2;
+    r->smallSelf()->remembered_[bit >> LC_ARCH_BITS_LOG2] |=
+      (Word)1 << (bit & (LC_ARCH_BITS - 1));
+  }
+
+  static inline bool isRemembered(void *p) {
+    Region *r = regionFromPointer(p);
+    Word bit = ((Word)p & kRegionMask) >> LC_ARCH_BYTES_LOG2;
+    return (r->smallSelf()->remembered_[bit >> LC_ARCH_BITS_LOG2] >>
+            (bit & (LC_ARCH_BITS - 1))) & 1;
+  }
+
+  // Byte offset of the remembered set bitmap from the start of the
+  // region.  Used by the JIT to emit an inline write barrier.
+  static inline int32_t rememberedSetOffset() {
+    return (int32_t)offsetof(SmallObjectRegionData, remembered_);
+  }
+
   // Unlink and return a free block from the region.
   //
   // Returns NULL if this region has no more free blocks.
@@ -171,10 +263,12 @@ private:
     Word magic_;
     Word region_info_;
     Region *region_link_;
+    Word hugeTLB_;  // Non-zero if part of a MAP_HUGETLB mapping.
   } RegionHeader;
 
   typedef struct _SmallObjectRegionData {
     RegionHeader header_;
+    Word remembered_[Region::kRememberedSetWords];
     Block blocks_[Region::kBlocksPerRegion];
     Block *next_free_;
   } SmallObjectRegionData;
@@ -194,6 +288,15 @@ private:
   }
 
   static void initBlocks(SmallObjectRegionData *);
+  static char *mapHugeTLBRegion();
+  static void setRegionType(Region *, RegionType);
+
+  static uint8_t *regionTable_[1UL << kRegionTableRootBits];
+
+  static PageMode pageMode_;
+  // Huge TLB mappings cannot be partially unmapped, so freed regions
+  // from such mappings are kept here for reuse.
+  static Region *freeHugeTLBRegions_;
 
   inline bool inRegion(void *p) {
     return (void *)this <= p &&
@@ -220,6 +323,20 @@ private:
 
 class AllocInfoTableHandle; // forward decl
 
+// During GC the info table pointer of an evacuated object is replaced
+// by a pointer to its new location, tagged in the lowest bit.
+static inline bool isForwardingPointer(const InfoTable *p) {
+  return (Word)p & 1;
+}
+
+static inline Closure *getForwardingPointer(const InfoTable *p) {
+  return cast(Closure *, (Word)p ^ 1);
+}
+
+static inline InfoTable *makeForwardingPointer(Closure *p) {
+  return cast (InfoTable *, (Word)p | 1);
+}
+
 class MemoryManager
 {
   //  void *allocInfoTable(Word nwords);
@@ -252,8 +369,15 @@ public:
     return cl;
   }
 
+  // Allocates from the bump allocator given by `*heap` and
+  // `*heaplim`, moving on to a new block if necessary.  Never
+  // triggers a GC, so this can be used while the stack is not in a
+  // consistent state, e.g., when leaving a trace.
+  char *bumpAllocNoGC(char **heap, char **heaplim, size_t bytes);
+
   bool looksLikeInfoTable(void *p);
   bool looksLikeClosure(void *p);
+  inline bool inRegions(void *p) { return Region::isHeapPointer(p); }
 
   unsigned int infoTables();
 
@@ -262,6 +386,7 @@ public:
 
   inline uint64_t allocated() const { return allocated_; }
   inline uint32_t numGCs() const { return num_gcs_; };
+  inline uint32_t numMajorGCs() const { return num_major_gcs_; };
 
   static const u4 kNoMask = ~0;
 
@@ -282,8 +407,63 @@ public:
   inline void setMinHeapSize(size_t bytes) {
     minHeapSize_ = idivCeil(bytes, Block::kBlockSize);
     if (minHeapSize_ < 2) minHeapSize_ = 2;
+    heapPolicy_.setMinHeapBlocks(minHeapSize_);
+  }
+
+  // Zero means no limit.
+  inline void setMaxHeapSize(size_t bytes) {
+    heapPolicy_.setMaxHeapBlocks(idivCeil(bytes, Block::kBlockSize));
   }
 
+  inline HeapSizingPolicy &heapPolicy() { return heapPolicy_; }
+
+  // Free blocks beyond this many bytes that have not been reused for
+  // a few GCs are returned to the OS (the memory stays reserved).  By
+  // default free blocks are never returned.
+  inline void setRetainedFreeSize(size_t bytes) {
+    retainedFreeBlocks_ = idivCeil(bytes, Block::kBlockSize);
+  }
+  static const u4 kRetainAll = ~0;
+  inline uint64_t releasedBytes() const { return releasedBytes_; }
+
+  // Telemetry about each GC so far.
+  inline const GCStats &gcStats() const { return gcStats_; }
+
+  // Take a heap census after a GC whenever the profile asks for one.
+  // In generational mode this forces a major GC.
+  inline void setHeapProfile(HeapProfile *profile) { heapProfile_ = profile; }
+
+  // Enable the generational collector.  The heap is then split into
+  // a nursery of minHeapSize_ blocks, which is collected by a minor
+  // GC, and an old generation which is only collected by a major GC.
+  // Objects surviving a minor GC are promoted to the old generation.
+  void setGenerational(bool enable);
+  inline bool isGenerational() const { return generational_; }
+
+  // Use the given number of OS threads for evacuating and scavenging
+  // objects during GC.  With one thread (the default) the collector
+  // is purely sequential.
+  void setGCThreads(u4 nthreads);
+  u4 gcThreads() const;
+
+  // Must be called after a pointer has been written into an existing
+  // heap object, e.g., when a thunk is updated with its value.  If
+  // the object is in the old generation it is added to the
+  // remembered set so that the next minor GC treats it as a root.
+  inline void writeBarrier(Closure *cl) {
+    if (Region::blockFromPointer(cl)->contents() == Block::kOldClosures)
+      Region::remember(cl);
+  }
+
+  // Must be called right before a CAF is updated with its value.
+  // The value is kept alive for as long as the CAF is reachable from
+  // the stack, from the literals of code that is reachable from live
+  // objects, or from compiled traces.  If a major GC finds that the
+  // CAF is no longer reachable, the CAF is reverted to its original
+  // state and its value becomes garbage.
+  void recordCAF(Closure *caf);
+  inline size_t numCAFs() const { return cafs_.size(); }
+
 private:
   inline void *allocInto(Block **block, size_t bytes) {
     char *ptr = (*block)->alloc(bytes);
@@ -296,10 +476,13 @@ private:
   }
 
   inline bool isGCd(Block *block) const {
-    return block->contents() == Block::kClosures;
+    return block->contents() == Block::kClosures ||
+      block->contents() == Block::kOldClosures;
   }
 
   friend class Capability;
+  friend class GCWorker;
+  friend class GCWorkerPool;
 
   // There must not be any other allocation occurring to this block.
   inline void getBumpAllocatorBounds(char **heap, char **heaplim) {
@@ -330,15 +513,33 @@ private:
   Block *grabFreeBlock(Block::Flags);
   void blockFull(Block **);
   void performGC(Capability *cap);
+  u4 heapTarget(u4 liveBlocks, Time mutTime, Time gcTime);
+  u4 collectNursery(Capability *cap);
+  u4 collectAllGenerations(Capability *cap);
+  void freeBlocks(Block *);
+  void releaseIdleBlocks();
+  void heapCensus(Time now);
+  static uint64_t usedBytes(Block *);
+  void scavengeToSpace(Block *scanBlock, char *scan);
+  void scavengeRememberedSet(Block *);
+  void clearRememberedSet(Block *);
   void scavengeStack(Word *base, Word *top, const BcIns *pc);
   void scavengeFrame(Word *base, Word *top, const u2 *bitmask);
-  void scavengeBlock(Block *);
-  void scavengeStaticRoots(Closure *);
+  size_t scavengeClosure(Closure *);
+  void scavengeCAFs();
+  void scavengeTraces(Capability *);
+  void markStatic(Closure *);
+  void markCode(const InfoTable *);
+  bool scavengeStaticObjects();
+  void revertUnreachableCAFs();
   void scavengeLarge();
   void sweepLargeObjects();
 
   Closure *allocLarge(Word nbytes);
+  void copy(Closure **src, InfoTable *info, u4 payloadSize);
   void evacuate(Closure **);
+  void evacuateField(Closure **);
+  bool eliminateSelector(Closure **);
   void evacuateLarge(Closure *);
 
 # define SEEN_SET_TYPE HASH_NAMESPACE::HASH_SET_CLASS<void*>
@@ -348,9 +549,8 @@ private:
                         const u2 *bitmask);
   bool sanityCheckStack(SEEN_SET_TYPE &seen, Word *base, Word *top,
                         const BcIns *pc);
-  bool sanityCheckStaticRoots(SEEN_SET_TYPE &seen, Closure *cl);
+  bool sanityCheckCAFs(SEEN_SET_TYPE &seen);
   void sanityCheckHeap(Capability *cap);
-  bool inRegions(void *p);
 
   void beginAllocInfoTable();
   void endAllocInfoTable();
@@ -361,9 +561,12 @@ private:
   Block *info_tables_;
   Block *static_closures_;
   Block *closures_;
+  Block *old_closures_;  // Old generation, only if generational_
+  Block **toSpace_;      // Where evacuate copies to
   Block *strings_;
   Block *bytecode_;
   Block *old_heap_; // Only non-NULL during GC
+  GCWorkerPool *gcPool_;  // Only if using more than one GC thread
   u4 topOfStackMask_;
   int beginAllocInfoTableLevel_;
   LargeObject *largeObjects_;
@@ -373,12 +576,45 @@ private:
 
   uint64_t minHeapSize_;  // in blocks
   u4 nextGC_;  // if zero, a GC gets triggered.
+  HeapSizingPolicy heapPolicy_;
+  Time lastGCEnd_;
+
+  u4 retainedFreeBlocks_;
+  uint64_t releasedBytes_;
+
+  // Telemetry for the current GC.
+  GCStats gcStats_;
+  GCEvent gcEvent_;
+  HeapProfile *heapProfile_;
+
+  // Updated CAFs and their original info tables.
+  typedef struct {
+    Closure *caf;
+    InfoTable *info;
+    Word payload;
+  } CAFEntry;
+  std::vector<CAFEntry> cafs_;
+
+  // Only during a major GC: static closures and code found to be
+  // reachable, and those whose references still need to be followed.
+  static const u4 kStaticCacheSize = 256;
+  bool collectCAFs_;
+  int staticLock_;  // Only used with parallel GC
+  SEEN_SET_TYPE staticSeen_;
+  std::vector<Closure *> staticTodo_;
+  std::vector<const InfoTable *> codeTodo_;
+  const void *staticCache_[kStaticCacheSize];  // Recently marked
+
+  bool generational_;
+  u4 oldGenBlocks_;  // size of the old generation (in blocks)
+  u4 nextMajorGC_;   // major GC once oldGenBlocks_ reaches this
 
   // Assuming an allocation rate of 16GB/s (pretty high), this counter
   // will overflow in 2^30 seconds, or about 34 years.  That appears
   // to be fine for now (it's for statistical purposes only).
   uint64_t allocated_;
   uint64_t num_gcs_;
+  uint64_t num_major_gcs_;
 
   friend class AllocInfoTableHandle;
 };
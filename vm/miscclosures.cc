@@ -28,6 +28,7 @@ void MiscClosures::initStopClosure(MemoryManager &mm) {
   info->type_ = FUN;
   info->size_ = 1;
   info->tagOrBitmap_ = 0;
+  info->selector_ = 0;
   info->layout_.bitmap = 0;
   info->name_ = "stg_STOP";
   info->code_.framesize = 2;
@@ -36,6 +37,9 @@ void MiscClosures::initStopClosure(MemoryManager &mm) {
   info->code_.sizelits = 0;
   info->code_.sizebitmaps = 2;
   info->code_.lits = NULL;
+  info->code_.hotcounts = NULL;
+  info->code_.sizecaches = 0;
+  info->code_.caches = NULL;
   info->code_.littypes = NULL;
   info->code_.code = static_cast<BcIns *>
                      (mm.allocCode(info->code_.sizecode, info->code_.sizebitmaps));
@@ -65,6 +69,7 @@ void MiscClosures::initBlackholeClosure(MemoryManager &mm) {
   info->type_ = BLACKHOLE;
   info->size_ = 1;
   info->tagOrBitmap_ = 0;
+  info->selector_ = 0;
   info->layout_.bitmap = 0;
   info->name_ = "stg_BLACKHOLE";
   info->code_.framesize = 1;
@@ -73,6 +78,9 @@ void MiscClosures::initBlackholeClosure(MemoryManager &mm) {
   info->code_.sizelits = 0;
   info->code_.sizebitmaps = 0;
   info->code_.lits = NULL;
+  info->code_.hotcounts = NULL;
+  info->code_.sizecaches = 0;
+  info->code_.caches = NULL;
   info->code_.littypes = NULL;
   info->code_.code = static_cast<BcIns *>
                      (mm.allocCode(info->code_.sizecode, info->code_.sizebitmaps));
@@ -92,6 +100,7 @@ void MiscClosures::initUpdateClosure(MemoryManager &mm) {
   info->type_ = UPDATE_FRAME;
   info->size_ = 2;
   info->tagOrBitmap_ = 0;
+  info->selector_ = 0;
   info->layout_.bitmap = 0;
   info->name_ = "stg_UPD";
   info->code_.framesize = 2;
@@ -100,6 +109,9 @@ void MiscClosures::initUpdateClosure(MemoryManager &mm) {
   info->code_.sizelits = 0;
   info->code_.sizebitmaps = 2;
   info->code_.lits = NULL;
+  info->code_.hotcounts = NULL;
+  info->code_.sizecaches = 0;
+  info->code_.caches = NULL;
   info->code_.littypes = NULL;
   info->code_.code = static_cast<BcIns *>
                      (mm.allocCode(info->code_.sizecode, info->code_.sizebitmaps));
@@ -137,6 +149,7 @@ void MiscClosures::initByteArrInfo(MemoryManager &mm)
   info->type_ = LARGE;
   info->size_ = 0;
   info->tagOrBitmap_ = 0;
+  info->selector_ = 0;
   info->layout_.bitmap = 0;
   info->name_ = "stg_BYTEARR";
 
@@ -150,6 +163,7 @@ void MiscClosures::initIndirectionItbl(MemoryManager &mm) {
   info->type_ = IND;
   info->size_ = 1;
   info->tagOrBitmap_ = 1;
+  info->selector_ = 0;
   info->layout_.bitmap = 1;
   info->name_ = "stg_IND";
 
@@ -207,6 +221,7 @@ void MiscClosures::buildApCont(MemoryManager *mm, ApContInfo *out,
   info->type_ = AP_CONT;
   info->size_ = 0;
   info->tagOrBitmap_ = 0; // pointerMask;
+  info->selector_ = 0;
   info->layout_.bitmap = 0; // pointerMask;
 
   char buf[50];
@@ -227,6 +242,9 @@ void MiscClosures::buildApCont(MemoryManager *mm, ApContInfo *out,
   info->code_.sizebitmaps = bitmapSize(pointerMask) + bitmapSize(livemask);
 
   info->code_.lits = NULL;
+  info->code_.hotcounts = NULL;
+  info->code_.sizecaches = 0;
+  info->code_.caches = NULL;
   info->code_.littypes = NULL;
   info->code_.code = static_cast<BcIns *>
                      (mm->allocCode(info->code_.sizecode, info->code_.sizebitmaps));
@@ -306,6 +324,7 @@ void MiscClosures::initPapItbl(MemoryManager *mm) {
   info->type_ = PAP;
   info->size_ = 0;  // special layout
   info->tagOrBitmap_ = 0;
+  info->selector_ = 0;
   info->layout_.bitmap = 0;
   info->name_ = "stg_PAP";
 
@@ -315,6 +334,9 @@ void MiscClosures::initPapItbl(MemoryManager *mm) {
   info->code_.sizelits = 0;
   info->code_.sizebitmaps = 0;
   info->code_.lits = NULL;
+  info->code_.hotcounts = NULL;
+  info->code_.sizecaches = 0;
+  info->code_.caches = NULL;
   info->code_.littypes = NULL;
   info->code_.code = static_cast<BcIns *>
                      (mm->allocCode(info->code_.sizecode, info->code_.sizebitmaps));
@@ -334,6 +356,7 @@ InfoTable *MiscClosures::buildApInfo(MemoryManager *mm, u4 nargs, u4 pointerMask
   info->type_ = THUNK;
   info->size_ = 1 + nargs;
   info->tagOrBitmap_ = (pointerMask << 1) | 1u;
+  info->selector_ = 0;
   info->layout_.bitmap = (pointerMask << 1) | 1u;
 
   char buf[50];
@@ -351,6 +374,9 @@ InfoTable *MiscClosures::buildApInfo(MemoryManager *mm, u4 nargs, u4 pointerMask
   info->code_.sizelits = 0;
   info->code_.sizebitmaps = 0;
   info->code_.lits = NULL;
+  info->code_.hotcounts = NULL;
+  info->code_.sizecaches = 0;
+  info->code_.caches = NULL;
   info->code_.littypes = NULL;
   info->code_.code = static_cast<BcIns *>
                      (mm->allocCode(info->code_.sizecode, info->code_.sizebitmaps));
@@ -1,4 +1,5 @@
 #include "objects.hh"
+#include "utils.hh"
 #include <string.h>
 
 _START_LAMBDACHINE_NAMESPACE
@@ -99,6 +100,8 @@ void InfoTable::debugPrint(ostream &out) const {
     break;
   case THUNK:
     out << "Thunk";
+    if (selectorField() != 0)
+      out << ". Selects field " << selectorField();
     break;
   case CAF:
     out << "CAF";
@@ -118,6 +121,97 @@ void InfoTable::debugPrint(ostream &out) const {
   out << endl;
 }
 
+void Code::initInlineCaches() {
+  u4 n = 0;
+  for (BcIns *pc = code; pc < code + sizecode;
+       pc = const_cast<BcIns *>(BcIns::next(pc))) {
+    u4 idx = n < BcIns::kNoInlineCache ? n : BcIns::kNoInlineCache;
+    switch (pc->opcode()) {
+    case BcIns::kEVAL:
+      *pc = BcIns::ad(BcIns::kEVAL, pc->a(), idx);
+      break;
+    case BcIns::kCALL:
+    case BcIns::kCALLT:
+      *pc = BcIns::abc(pc->opcode(), pc->a(), idx, pc->c());
+      break;
+    default:
+      continue;
+    }
+    if (idx != BcIns::kNoInlineCache)
+      ++n;
+  }
+  sizecaches = n;
+  caches = NULL;
+  if (n > 0) {
+    caches = new InlineCache[n];
+    memset(caches, 0, sizeof(InlineCache) * n);
+  }
+}
+
+u2 Code::selectorField() const {
+  // Abstract interpretation of the (straight-line) code, tracking for
+  // each register whether it holds the free variable, its value, the
+  // selected field, or its value.
+  enum { kUnknown, kFreeVar, kSelectee, kField, kFieldValue };
+  u1 kind[256];
+  memset(kind, kUnknown, sizeof(kind));
+  u1 evalResult = kUnknown;
+  u2 field = 0;
+  const BcIns *pc = code;
+  const BcIns *end = code + sizecode;
+
+  for (int steps = 0; pc < end && steps < 32; ++steps) {
+    BcIns ins = *pc++;
+    switch (ins.opcode()) {
+    case BcIns::kFUNC:
+      break;
+    case BcIns::kJMP:
+      if (ins.j() < 0) return 0;
+      pc += ins.j();
+      break;
+    case BcIns::kMOV:
+      if (ins.d() > 0xff) return 0;
+      kind[ins.a()] = kind[ins.d()];
+      break;
+    case BcIns::kLOADFV:
+      kind[ins.a()] = ins.d() == 1 ? kFreeVar : kUnknown;
+      break;
+    case BcIns::kEVAL:
+      ++pc;  // skip live-out info
+      switch (kind[ins.a()]) {
+      case kFreeVar:
+      case kSelectee:
+        evalResult = kSelectee;
+        break;
+      case kField:
+      case kFieldValue:
+        evalResult = kFieldValue;
+        break;
+      default:
+        return 0;
+      }
+      break;
+    case BcIns::kMOV_RES:
+      if (ins.d() != 0) return 0;
+      kind[ins.a()] = evalResult;
+      break;
+    case BcIns::kLOADF:
+      if (kind[ins.b()] != kSelectee || ins.c() == 0 ||
+          (field != 0 && field != ins.c()))
+        return 0;
+      field = ins.c();
+      kind[ins.a()] = kField;
+      break;
+    case BcIns::kRET1:
+      return (kind[ins.a()] == kField || kind[ins.a()] == kFieldValue)
+        ? field : 0;
+    default:
+      return 0;
+    }
+  }
+  return 0;
+}
+
 void Code::printLiteral(std::ostream &out, u4 litid) const {
   if (LC_UNLIKELY(litid >= sizelits))
     return;
@@ -133,6 +227,9 @@ void Code::printLiteral(std::ostream &out, u4 litid) const {
   case LIT_FLOAT:
     out << (float)lit << " (w)";
     break;
+  case LIT_DOUBLE:
+    out << wordToDouble(lit) << " (d)";
+    break;
   case LIT_CHAR:
     if (lit < 256)
       out << "'" << (char)lit << "'";
@@ -8,20 +8,79 @@
 
 _START_LAMBDACHINE_NAMESPACE
 
+class InfoTable;
+struct _Code;
+
+typedef struct {
+  const InfoTable *info;
+  const struct _Code *code;     /* NULL if EVAL found a value. */
+  BcIns *entry;                 /* == code->code */
+  u4    arity;                  /* == code->arity */
+} InlineCacheEntry;
+
+/* Remembers the info tables of the closures evaluated or called by
+   one EVAL, CALL or CALLT instruction, so that the interpreter need
+   not inspect the closure type and arity again.  CALL and CALLT only
+   cache functions applied to exactly their arity.  Once the cache is
+   full, other info tables take the generic path. */
+typedef struct _InlineCache {
+  InlineCacheEntry entries[INLINE_CACHE_ENTRIES];
+  u4 size;
+
+  inline const InlineCacheEntry *lookup(const InfoTable *info) const {
+    for (u4 i = 0; i < size; ++i) {
+      if (entries[i].info == info)
+        return &entries[i];
+    }
+    return NULL;
+  }
+
+  /* Returns NULL if the cache is full. */
+  inline const InlineCacheEntry *add(const InfoTable *info,
+                                     const struct _Code *code);
+} InlineCache;
+
 typedef struct _Code {
   u1   framesize;               /* No. of local variables. */
   u1   arity;                   /* No. of function arguments.  */
   u2   sizecode;                /* No. of instructions in bytecode. */
   u2   sizelits;		/* No. of literals */
   u2   sizebitmaps;             /* No. of bitmaps (in multiples of `u2') */
+  u2   sizecaches;              /* No. of inline caches */
   /* INVARIANT: framesize >= arity */
   Word  *lits;			/* Literals */
   u1    *littypes;              /* Types of literals.  See LitType. */
   BcIns *code;                  /* The bytecode followed by bitsets. */
   /* INVARIANT: code != NULL */
+  u2    *hotcounts;             /* One hot counter per instruction, or NULL. */
+  InlineCache *caches;          /* One per EVAL/CALL/CALLT, or NULL. */
   void printLiteral(std::ostream &out, u4 litid) const;
+
+  // Allocates the inline caches and numbers the call sites.  At
+  // most BcIns::kNoInlineCache sites get a cache.
+  void initInlineCaches();
+
+  // If this is the code of a selector thunk, i.e., it is equivalent
+  // to
+  //
+  //     case fv_1 of C x_1 .. x_n -> x_k
+  //
+  // then returns k, otherwise 0.
+  u2 selectorField() const;
 } Code;
 
+inline const InlineCacheEntry *
+InlineCache::add(const InfoTable *info, const Code *code) {
+  if (size >= INLINE_CACHE_ENTRIES)
+    return NULL;
+  InlineCacheEntry *e = &entries[size++];
+  e->info = info;
+  e->code = code;
+  e->entry = code != NULL ? code->code : NULL;
+  e->arity = code != NULL ? code->arity : 0;
+  return e;
+}
+
 typedef enum {
   LIT_INT,    /* Word-sized integer literal */
   LIT_STRING, /* String literal (utf8-encoded) */
@@ -30,10 +89,10 @@ typedef enum {
   LIT_WORD,   /* Word-sized unsigned integer */
   //  LIT_WORD64, /* Unsigned integer of at least 64 bits */
   LIT_FLOAT,  /* 32 bit floating point number */
-  //  LIT_DOUBLE, /* 64 bit floating point number */
   LIT_CLOSURE, /* Reference to a (static) closure. */
   LIT_INFO,     /* Reference to an info table. */
-  LIT_PC        /* Not actually used by bytecode, only by trace recorder. */
+  LIT_PC,       /* Not actually used by bytecode, only by trace recorder. */
+  LIT_DOUBLE    /* 64 bit floating point number */
 } LitType;
 
 typedef union {
@@ -81,6 +140,8 @@ public:
   inline bool hasCode() const { return (kHasCodeBitmap & (1 << type())) != 0; }
   inline const ClosureInfo layout() const { return layout_; }
   inline u4 size() const { return size_; }
+  // Non-zero for selector thunks (see Code::selectorField).
+  inline u4 selectorField() const { return selector_; }
   void debugPrint(std::ostream&) const;
   static void printPayload(std::ostream&, u4 bitmap, u4 size);
 private:
@@ -93,6 +154,7 @@ private:
   u1 size_;
   u2 tagOrBitmap_; // type == CONSTR_*: constructor tag
                   // type == FUN/THUNK: srt_bitmap
+  u2 selector_;   // selected field; only set by the loader
   const char *name_;
   friend class Loader;
   friend class MiscClosures;
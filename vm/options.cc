@@ -1,6 +1,7 @@
 #include "options.hh"
 #include <getopt.h>
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include <limits.h>
 
@@ -9,12 +10,32 @@ _START_LAMBDACHINE_NAMESPACE
 typedef enum {
   OPT_PRINT_LOADER_STATE = 0x1000,
   OPT_TRACE_INTERPRETER,
-  OPT_PRINT_STATS
+  OPT_PRINT_STATS,
+  OPT_GC_GENERATIONAL,
+  OPT_GC_THREADS,
+  OPT_GC_OVERHEAD,
+  OPT_MAX_HEAP,
+  OPT_STATS,
+  OPT_HUGE_PAGES,
+  OPT_HEAP_RETAIN,
+  OPT_HEAP_PROFILE,
+  OPT_ALLOC_SAMPLE,
+  OPT_MAX_STACK,
+  OPT_JIT_HOTLOOP,
+  OPT_JIT_HOTEXIT,
+  OPT_JIT_MAXMCODE,
+  OPT_JIT_BACKGROUND,
+  OPT_JIT_CACHE,
+  OPT_JIT_PERF,
+  OPT_JIT_PROFILE,
+  OPT_JIT_DUMP
 } OptionFlags;
 
 #define MAX_CLOSURE_NAME_LEN 512
 #define MAX_STACK_SIZE (1024*1024)
 #define MIN_STACK_SIZE (1024*sizeof(Word))
+#define MAX_GC_THREADS 64
+#define MAX_HOT_THRESHOLD 65535
 
 long parseMemorySize(const char *str);
 
@@ -23,8 +44,24 @@ Options::Options()
     printLoaderState_(false),
     traceInterpreter_(false),
     printStats_(false),
+    generationalGC_(false),
+    gcThreads_(1),
+    gcGrowthFactor_(0),
+    gcOverhead_(0),
+    maxHeapSize_(0),
+    hugePages_(0),
+    heapRetain_(-1),
+    heapProfileInterval_(0),
+    allocSampleInterval_(0),
+    hotLoopThreshold_(0),
+    hotExitThreshold_(0),
+    maxMCodeSize_(0),
+    jitBackground_(false),
+    jitProfile_(false),
+    perfMap_(false),
     enableAsm_(1),
-    stackSize_(MIN_STACK_SIZE)
+    stackSize_(MIN_STACK_SIZE),
+    maxStackSize_(0)
 {
 }
 
@@ -48,14 +85,33 @@ Options *OptionParser::parse(int argc, char *argv[]) {
     {"help",               no_argument, 0, 'h'},
     {"step",               required_argument, 0, 'S'},
     {"stack",              required_argument, 0, 's'},
+    {"max-stack",          required_argument, NULL, OPT_MAX_STACK},
     {"trace",              no_argument, NULL, OPT_TRACE_INTERPRETER},
     {"print-stats",        no_argument, NULL, OPT_PRINT_STATS},
+    {"stats",              required_argument, NULL, OPT_STATS},
+    {"gc-generational",    no_argument, NULL, OPT_GC_GENERATIONAL},
+    {"gc-threads",         required_argument, NULL, OPT_GC_THREADS},
+    {"gc-overhead",        required_argument, NULL, OPT_GC_OVERHEAD},
+    {"gc-factor",          required_argument, NULL, 'F'},
+    {"max-heap",           required_argument, NULL, OPT_MAX_HEAP},
+    {"huge-pages",         optional_argument, NULL, OPT_HUGE_PAGES},
+    {"heap-retain",        required_argument, NULL, OPT_HEAP_RETAIN},
+    {"heap-profile",       optional_argument, NULL, OPT_HEAP_PROFILE},
+    {"alloc-sample",       required_argument, NULL, OPT_ALLOC_SAMPLE},
+    {"jit-hotloop",        required_argument, NULL, OPT_JIT_HOTLOOP},
+    {"jit-hotexit",        required_argument, NULL, OPT_JIT_HOTEXIT},
+    {"jit-maxmcode",       required_argument, NULL, OPT_JIT_MAXMCODE},
+    {"jit-background",     no_argument, NULL, OPT_JIT_BACKGROUND},
+    {"jit-cache",          required_argument, NULL, OPT_JIT_CACHE},
+    {"jit-perf",           required_argument, NULL, OPT_JIT_PERF},
+    {"jit-profile",        optional_argument, NULL, OPT_JIT_PROFILE},
+    {"jit-dump",           required_argument, NULL, OPT_JIT_DUMP},
     {0, 0, 0, 0}
   };
 
   while (1) {
     int option_index = 0;
-    c = getopt_long(argc, argv, "he:B:O:", long_options, &option_index);
+    c = getopt_long(argc, argv, "he:B:O:F:", long_options, &option_index);
 
     if (c == -1)
       break;
@@ -75,9 +131,161 @@ Options *OptionParser::parse(int argc, char *argv[]) {
     case OPT_PRINT_STATS:
       opts()->printStats_ = true;
       break;
+    case OPT_STATS:
+      if (strcmp(optarg, "text") == 0) {
+        opts()->printStats_ = true;
+      } else if (strncmp(optarg, "json", 4) == 0 &&
+                 (optarg[4] == '\0' || optarg[4] == ':')) {
+        opts()->statsFile_ =
+          optarg[4] == ':' ? optarg + 5 : "lcvm-stats.json";
+      } else {
+        fprintf(stderr, "Unknown stats format: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
     case OPT_TRACE_INTERPRETER:
       opts()->traceInterpreter_ = true;
       break;
+    case OPT_GC_GENERATIONAL:
+      opts()->generationalGC_ = true;
+      break;
+    case OPT_GC_THREADS: {
+      char *end;
+      long n = strtol(optarg, &end, 10);
+      if (*end != '\0' || n < 1 || n > MAX_GC_THREADS) {
+        fprintf(stderr, "Invalid number of GC threads: %s (must be 1-%d)\n",
+                optarg, MAX_GC_THREADS);
+        res = NULL;
+        goto ret;
+      }
+      opts()->gcThreads_ = (int)n;
+      break;
+    }
+    case 'F': {
+      char *end;
+      double factor = strtod(optarg, &end);
+      if (*end != '\0' || !(factor > 1)) {
+        fprintf(stderr, "Invalid heap growth factor: %s (must be > 1)\n",
+                optarg);
+        res = NULL;
+        goto ret;
+      }
+      opts()->gcGrowthFactor_ = factor;
+      break;
+    }
+    case OPT_GC_OVERHEAD: {
+      char *end;
+      double pct = strtod(optarg, &end);
+      if (*end != '\0' || !(pct > 0 && pct < 100)) {
+        fprintf(stderr, "Invalid GC overhead: %s (must be between 0 and 100)\n",
+                optarg);
+        res = NULL;
+        goto ret;
+      }
+      opts()->gcOverhead_ = pct;
+      break;
+    }
+    case OPT_HUGE_PAGES:
+      if (optarg == NULL || strcmp(optarg, "thp") == 0) {
+        opts()->hugePages_ = 1;
+      } else if (strcmp(optarg, "hugetlb") == 0) {
+        opts()->hugePages_ = 2;
+      } else {
+        fprintf(stderr, "Unknown huge page mode: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
+    case OPT_HEAP_RETAIN:
+      opts()->heapRetain_ = parseMemorySize(optarg);
+      if (opts()->heapRetain_ < 0) {
+        fprintf(stderr, "Could not parse retained heap size: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
+    case OPT_HEAP_PROFILE:
+      if (optarg == NULL) {
+        opts()->heapProfileInterval_ = 0.1;
+      } else {
+        char *end;
+        double interval = strtod(optarg, &end);
+        if (*end != '\0' || !(interval > 0)) {
+          fprintf(stderr, "Invalid heap profile interval: %s\n", optarg);
+          res = NULL;
+          goto ret;
+        }
+        opts()->heapProfileInterval_ = interval;
+      }
+      break;
+    case OPT_ALLOC_SAMPLE:
+      opts()->allocSampleInterval_ = parseMemorySize(optarg);
+      if (opts()->allocSampleInterval_ <= 0 ||
+          opts()->allocSampleInterval_ > UINT_MAX) {
+        fprintf(stderr, "Invalid allocation sample interval: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
+    case OPT_JIT_HOTLOOP:
+    case OPT_JIT_HOTEXIT: {
+      char *end;
+      long n = strtol(optarg, &end, 10);
+      if (*end != '\0' || n < 1 || n > MAX_HOT_THRESHOLD) {
+        fprintf(stderr, "Invalid hotness threshold: %s (must be 1-%d)\n",
+                optarg, MAX_HOT_THRESHOLD);
+        res = NULL;
+        goto ret;
+      }
+      if (c == OPT_JIT_HOTLOOP)
+        opts()->hotLoopThreshold_ = (int)n;
+      else
+        opts()->hotExitThreshold_ = (int)n;
+      break;
+    }
+    case OPT_JIT_MAXMCODE:
+      opts()->maxMCodeSize_ = parseMemorySize(optarg);
+      if (opts()->maxMCodeSize_ <= 0) {
+        fprintf(stderr, "Invalid machine code size: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
+    case OPT_JIT_BACKGROUND:
+      opts()->jitBackground_ = true;
+      break;
+    case OPT_JIT_CACHE:
+      opts()->traceCacheFile_ = optarg;
+      break;
+    case OPT_JIT_PROFILE:
+      opts()->jitProfile_ = true;
+      if (optarg != NULL)
+        opts()->jitProfileFile_ = optarg;
+      break;
+    case OPT_JIT_DUMP:
+      opts()->traceDumpDir_ = optarg;
+      break;
+    case OPT_JIT_PERF:
+      if (strcmp(optarg, "map") == 0) {
+        opts()->perfMap_ = true;
+      } else if (strncmp(optarg, "jitdump", 7) == 0 &&
+                 (optarg[7] == '\0' || optarg[7] == ':')) {
+        opts()->jitDumpDir_ = optarg[7] == ':' ? optarg + 8 : ".";
+      } else {
+        fprintf(stderr, "Unknown perf output format: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
+    case OPT_MAX_HEAP:
+      opts()->maxHeapSize_ = parseMemorySize(optarg);
+      if (opts()->maxHeapSize_ < 0) {
+        fprintf(stderr, "Could not parse maximum heap size: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
     case 'e':
       fprintf(stderr, "entry = %s\n", optarg);
       opts()->entry_ = optarg;
@@ -93,6 +301,14 @@ Options *OptionParser::parse(int argc, char *argv[]) {
         opts()->stackSize_ = MIN_STACK_SIZE;
       }
       break;
+    case OPT_MAX_STACK:
+      opts()->maxStackSize_ = parseMemorySize(optarg);
+      if (opts()->maxStackSize_ <= 0) {
+        fprintf(stderr, "Could not parse maximum stack size: %s\n", optarg);
+        res = NULL;
+        goto ret;
+      }
+      break;
       // case 'S':
       //   opts()->step_opts = optarg;
       //   break;
@@ -115,11 +331,58 @@ Options *OptionParser::parse(int argc, char *argv[]) {
              "                  Print static closures and info tables after loading (to stderr or given file).\n"
              "     --print-stats\n"
              "                  Print performance stats after program finished\n"
+             "     --stats=text|json[:FILE]\n"
+             "                  Print stats (same as --print-stats) or write them as JSON\n"
+             "                  to FILE (default: lcvm-stats.json).\n"
              "     --no-jit     Don't enable JIT.\n"
              "     --asm        Generate native code.\n"
              "  -B --base       Set loader base dir (default: cwd).\n"
              "                  Separate multiple paths with \":\""
-             "     --stack=SIZE Specify the stack size in bytes, valid units are K,M,b,G.\n"
+             "     --stack=SIZE Specify the initial stack size in bytes, valid units are K,M,b,G.\n"
+             "                  The stack grows as needed.\n"
+             "     --max-stack=SIZE\n"
+             "                  Maximum stack size (default: 512M).\n"
+             "     --gc-generational\n"
+             "                  Use a nursery and an old generation for the heap.\n"
+             "     --gc-threads=N\n"
+             "                  Use N threads for garbage collection (default: 1).\n"
+             "  -F --gc-factor=F\n"
+             "                  Let the heap grow to F times the live data (default: 2).\n"
+             "     --gc-overhead=PCT\n"
+             "                  Adapt the heap growth factor to keep GC time below PCT percent.\n"
+             "     --max-heap=SIZE\n"
+             "                  Maximum heap size, valid units are K,M,b,G.\n"
+             "     --huge-pages[=thp|hugetlb]\n"
+             "                  Back the heap with transparent (default) or hugetlbfs huge pages.\n"
+             "     --heap-retain=SIZE\n"
+             "                  Return idle free heap memory beyond SIZE to the OS.\n"
+             "     --heap-profile[=SECONDS]\n"
+             "                  Write a heap census every SECONDS (default: 0.1) to MODULE.hp.\n"
+             "     --alloc-sample=SIZE\n"
+             "                  Sample one allocation every SIZE bytes and write the\n"
+             "                  allocation sites to MODULE.alloc.\n"
+             "     --jit-hotloop=N\n"
+             "                  Record a trace after a loop or function was entered N times.\n"
+             "     --jit-hotexit=N\n"
+             "                  Record a side trace after a side exit was taken N times.\n"
+             "     --jit-maxmcode=SIZE\n"
+             "                  Flush all traces when their machine code exceeds SIZE bytes.\n"
+             "     --jit-background\n"
+             "                  Compile traces on a separate thread.\n"
+             "     --jit-cache=FILE\n"
+             "                  Compile the traces stored in FILE at startup and store\n"
+             "                  the traces of this run in FILE at exit.\n"
+             "     --jit-profile[=FILE]\n"
+             "                  Count completions and exits of each trace and write a\n"
+             "                  report to FILE (default: stderr) at exit.\n"
+             "     --jit-perf=map|jitdump[:DIR]\n"
+             "                  Name compiled code for Linux perf in /tmp/perf-PID.map, or\n"
+             "                  in DIR/jit-PID.dump (default: .) for perf inject --jit.\n"
+             "                  May be given twice.\n"
+             "     --jit-dump=DIR\n"
+             "                  Write each compiled trace (IR, snapshots, registers and\n"
+             "                  machine code) to DIR/trace-N.json and the aborted\n"
+             "                  recordings to DIR/aborts.json.\n"
              "\n",
              argv[0]);
       res = NULL;
@@ -15,9 +15,45 @@ public:
   inline const std::string entry() const { return entry_; }
   inline const std::string basePath() const { return basePath_; }
   inline long stackSize() const { return stackSize_; }
+  // Zero if not set.
+  inline long maxStackSize() const { return maxStackSize_; }
   inline bool printLoaderState() const { return printLoaderState_; }
   inline bool printStats() const { return printStats_; }
+  // Empty if no JSON stats were requested.
+  inline const std::string statsFile() const { return statsFile_; }
   inline bool traceInterpreter() const { return traceInterpreter_; }
+  inline bool generationalGC() const { return generationalGC_; }
+  inline int gcThreads() const { return gcThreads_; }
+  // Zero if not set.
+  inline double gcGrowthFactor() const { return gcGrowthFactor_; }
+  inline double gcOverhead() const { return gcOverhead_; }
+  inline long maxHeapSize() const { return maxHeapSize_; }
+  // 0 = normal pages, 1 = transparent huge pages, 2 = hugetlbfs
+  inline int hugePages() const { return hugePages_; }
+  // Negative if not set.
+  inline long heapRetain() const { return heapRetain_; }
+  // Census interval in seconds, zero if heap profiling is disabled.
+  inline double heapProfileInterval() const { return heapProfileInterval_; }
+  // Zero if allocations are not sampled.
+  inline long allocSampleInterval() const { return allocSampleInterval_; }
+  // Hotness thresholds for root traces and side exits, zero if not set.
+  inline int hotLoopThreshold() const { return hotLoopThreshold_; }
+  inline int hotExitThreshold() const { return hotExitThreshold_; }
+  // Maximum size of compiled trace code in bytes, zero if not set.
+  inline long maxMCodeSize() const { return maxMCodeSize_; }
+  inline bool jitBackground() const { return jitBackground_; }
+  // Empty if no trace cache was requested.
+  inline const std::string traceCacheFile() const { return traceCacheFile_; }
+  // Count trace completions and exits and report them at exit, to
+  // jitProfileFile() or, if that is empty, to stderr.
+  inline bool jitProfile() const { return jitProfile_; }
+  inline const std::string jitProfileFile() const { return jitProfileFile_; }
+  // Write /tmp/perf-<pid>.map for Linux perf.
+  inline bool perfMap() const { return perfMap_; }
+  // Empty if no jitdump file was requested.
+  inline const std::string jitDumpDir() const { return jitDumpDir_; }
+  // Empty if compiled traces should not be written as JSON.
+  inline const std::string traceDumpDir() const { return traceDumpDir_; }
   virtual ~Options();
 
 protected:
@@ -30,9 +66,30 @@ private:
   bool printLoaderState_;
   bool traceInterpreter_;
   bool printStats_;
+  bool generationalGC_;
+  int gcThreads_;
+  double gcGrowthFactor_;
+  double gcOverhead_;
+  long maxHeapSize_;
+  int hugePages_;
+  long heapRetain_;
+  double heapProfileInterval_;
+  long allocSampleInterval_;
+  int hotLoopThreshold_;
+  int hotExitThreshold_;
+  long maxMCodeSize_;
+  bool jitBackground_;
+  bool jitProfile_;
+  bool perfMap_;
   std::string printLoaderStateFile_;
+  std::string statsFile_;
+  std::string traceCacheFile_;
+  std::string jitDumpDir_;
+  std::string traceDumpDir_;
+  std::string jitProfileFile_;
   int enableAsm_;
   long stackSize_;
+  long maxStackSize_;
 
   friend class OptionParser;
 };
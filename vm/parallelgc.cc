@@ -0,0 +1,304 @@
+#include "parallelgc.hh"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+_START_LAMBDACHINE_NAMESPACE
+
+#define DLOG(...) \
+  if (DEBUG_COMPONENTS & DEBUG_MEMORY_MANAGER) { \
+    fprintf(stderr, "PGC: " __VA_ARGS__); }
+
+__thread GCWorker *GCWorker::current_ = NULL;
+
+GCWorker::GCWorker(MemoryManager *mm, GCWorkerPool *pool)
+  : mm_(mm), pool_(pool), alloc_(NULL), allocScan_(NULL),
+    blocks_(NULL), copied_(0) {
+  pthread_mutex_init(&lock_, NULL);
+}
+
+GCWorker::~GCWorker() {
+  pthread_mutex_destroy(&lock_);
+}
+
+void GCWorker::beginGC(Block *toSpace) {
+  LC_ASSERT(todo_.empty());
+  alloc_ = toSpace;
+  allocScan_ = toSpace != NULL ? toSpace->free() : NULL;
+  blocks_ = toSpace;
+  copied_ = 0;
+}
+
+char *GCWorker::alloc(size_t bytes) {
+  char *ptr = alloc_ != NULL ? alloc_->alloc(bytes) : NULL;
+  while (LC_UNLIKELY(ptr == NULL)) {
+    newAllocBlock();
+    ptr = alloc_->alloc(bytes);
+  }
+  return ptr;
+}
+
+// Retire the current allocation block.  Its unscanned objects become
+// a work item that may be stolen by other workers.
+void GCWorker::newAllocBlock() {
+  if (alloc_ != NULL && allocScan_ < alloc_->free()) {
+    push(allocScan_, alloc_->free());
+  }
+  Block *block = pool_->grabFreeBlock();
+  block->link_ = blocks_;
+  blocks_ = block;
+  alloc_ = block;
+  allocScan_ = block->start();
+}
+
+void GCWorker::copy(Closure **src, InfoTable *info, u4 payloadSize) {
+  Closure *from = *src;
+  size_t bytes = (wordsof(ClosureHeader) + payloadSize) * sizeof(Word);
+  Closure *to = reinterpret_cast<Closure *>(alloc(bytes));
+  Closure::initHeader(to, info);
+  for (u4 i = 0; i < payloadSize; ++i) {
+    to->setPayload(i, from->payload(i));
+  }
+  if (LC_LIKELY(__sync_bool_compare_and_swap(&from->header_.info_, info,
+                                             makeForwardingPointer(to)))) {
+    copied_ += bytes;
+    *src = to;
+  } else {
+    // Another worker evacuated the object first.  Nothing else has
+    // been allocated since, so we can simply undo our allocation.
+    LC_ASSERT((char *)to + bytes == alloc_->free());
+    alloc_->free_ -= bytes;
+    *src = getForwardingPointer(from->info());
+  }
+}
+
+void GCWorker::push(char *start, char *end) {
+  ScanItem item = { start, end };
+  pthread_mutex_lock(&lock_);
+  todo_.push_back(item);
+  __sync_fetch_and_add(&pool_->pending_, 1);
+  pthread_mutex_unlock(&lock_);
+}
+
+// Take the most recently pushed item from our own deque.
+bool GCWorker::pop(ScanItem *item) {
+  bool found = false;
+  pthread_mutex_lock(&lock_);
+  if (!todo_.empty()) {
+    *item = todo_.back();
+    todo_.pop_back();
+    __sync_fetch_and_sub(&pool_->pending_, 1);
+    found = true;
+  }
+  pthread_mutex_unlock(&lock_);
+  return found;
+}
+
+// Take the oldest item from another worker's deque.
+bool GCWorker::steal(ScanItem *item) {
+  if (pool_->pending_ <= 0)
+    return false;
+  for (u4 i = 0; i < pool_->nworkers_; ++i) {
+    GCWorker *victim = pool_->workers_[i];
+    if (victim == this)
+      continue;
+    pthread_mutex_lock(&victim->lock_);
+    if (!victim->todo_.empty()) {
+      *item = victim->todo_.front();
+      victim->todo_.pop_front();
+      __sync_fetch_and_sub(&pool_->pending_, 1);
+      pthread_mutex_unlock(&victim->lock_);
+      return true;
+    }
+    pthread_mutex_unlock(&victim->lock_);
+  }
+  return false;
+}
+
+void GCWorker::scanRegion(char *p, char *end) {
+  while (p < end) {
+    p += mm_->scavengeClosure((Closure *)p);
+  }
+}
+
+// Scan until no worker has any work left.
+//
+// A worker only pushes to its own deque and only goes idle once that
+// deque is empty.  Hence, if all workers are idle at the same time
+// there is no more work anywhere.
+void GCWorker::run() {
+  ScanItem item;
+  for (;;) {
+    if (alloc_ != NULL && allocScan_ < alloc_->free()) {
+      char *start = allocScan_;
+      char *end = alloc_->free();
+      allocScan_ = end;
+      if (pool_->idle_ > 0 && (size_t)(end - start) >= kExportBytes) {
+        // Give idle workers a chance to steal it.
+        push(start, end);
+      } else {
+        scanRegion(start, end);
+      }
+      continue;
+    }
+
+    if (pop(&item) || steal(&item)) {
+      scanRegion(item.start, item.end);
+      continue;
+    }
+
+    __sync_fetch_and_add(&pool_->idle_, 1);
+    for (;;) {
+      if (pool_->idle_ == (long)pool_->nworkers_)
+        return;
+      if (pool_->pending_ > 0) {
+        __sync_fetch_and_sub(&pool_->idle_, 1);
+        break;
+      }
+      sched_yield();
+    }
+  }
+}
+
+GCWorkerPool::GCWorkerPool(MemoryManager *mm, u4 nthreads)
+  : mm_(mm), nworkers_(nthreads), contents_(Block::kClosures),
+    epoch_(0), running_(0), shutdown_(false), pending_(0), idle_(0) {
+  LC_ASSERT(nthreads > 0);
+  pthread_mutex_init(&lock_, NULL);
+  pthread_cond_init(&wakeup_, NULL);
+  pthread_cond_init(&finished_, NULL);
+
+  workers_ = new GCWorker*[nworkers_];
+  for (u4 i = 0; i < nworkers_; ++i) {
+    workers_[i] = new GCWorker(mm, this);
+  }
+
+  // Worker 0 is always the thread that triggers the GC.
+  threads_ = new pthread_t[nworkers_];
+  for (u4 i = 1; i < nworkers_; ++i) {
+    if (pthread_create(&threads_[i], NULL, threadMain, workers_[i]) != 0) {
+      fprintf(stderr, "FATAL: Could not create GC thread.\n");
+      exit(1);
+    }
+  }
+  DLOG("Started %u GC threads\n", nworkers_ - 1);
+}
+
+GCWorkerPool::~GCWorkerPool() {
+  pthread_mutex_lock(&lock_);
+  shutdown_ = true;
+  pthread_cond_broadcast(&wakeup_);
+  pthread_mutex_unlock(&lock_);
+
+  for (u4 i = 1; i < nworkers_; ++i) {
+    pthread_join(threads_[i], NULL);
+  }
+  for (u4 i = 0; i < nworkers_; ++i) {
+    delete workers_[i];
+  }
+  delete[] workers_;
+  delete[] threads_;
+
+  pthread_cond_destroy(&finished_);
+  pthread_cond_destroy(&wakeup_);
+  pthread_mutex_destroy(&lock_);
+}
+
+void *GCWorkerPool::threadMain(void *arg) {
+  GCWorker *worker = static_cast<GCWorker *>(arg);
+  worker->pool_->helperLoop(worker);
+  return NULL;
+}
+
+void GCWorkerPool::helperLoop(GCWorker *worker) {
+  GCWorker::current_ = worker;
+  u4 seen = 0;
+  pthread_mutex_lock(&lock_);
+  for (;;) {
+    while (epoch_ == seen && !shutdown_) {
+      pthread_cond_wait(&wakeup_, &lock_);
+    }
+    if (shutdown_)
+      break;
+    seen = epoch_;
+    pthread_mutex_unlock(&lock_);
+
+    worker->run();
+
+    pthread_mutex_lock(&lock_);
+    if (--running_ == 0) {
+      pthread_cond_signal(&finished_);
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void GCWorkerPool::beginGC(Block *toSpace) {
+  contents_ = toSpace->contents();
+  pending_ = 0;
+  idle_ = 0;
+  workers_[0]->beginGC(toSpace);
+  for (u4 i = 1; i < nworkers_; ++i) {
+    workers_[i]->beginGC(NULL);
+  }
+  GCWorker::current_ = workers_[0];
+}
+
+uint64_t GCWorkerPool::finishGC(Block **toSpace) {
+  pthread_mutex_lock(&lock_);
+  running_ = nworkers_ - 1;
+  ++epoch_;
+  pthread_cond_broadcast(&wakeup_);
+  pthread_mutex_unlock(&lock_);
+
+  workers_[0]->run();
+
+  pthread_mutex_lock(&lock_);
+  while (running_ > 0) {
+    pthread_cond_wait(&finished_, &lock_);
+  }
+  pthread_mutex_unlock(&lock_);
+
+  LC_ASSERT(pending_ == 0);
+  GCWorker::current_ = NULL;
+
+  // Worker 0's blocks have been pushed onto the front of the original
+  // to-space list.  Splice in the blocks of all the other workers
+  // right behind its head, so that the head is still the block that
+  // the mutator (or the next GC) continues to allocate into.
+  Block *head = workers_[0]->blocks_;
+  uint64_t copied = workers_[0]->copied_;
+  for (u4 i = 1; i < nworkers_; ++i) {
+    GCWorker *w = workers_[i];
+    copied += w->copied_;
+    if (w->blocks_ == NULL)
+      continue;
+    Block *last = w->blocks_;
+    while (last->link_ != NULL) last = last->link_;
+    last->link_ = head->link_;
+    head->link_ = w->blocks_;
+    w->blocks_ = NULL;
+    w->alloc_ = NULL;
+  }
+  workers_[0]->blocks_ = NULL;
+  workers_[0]->alloc_ = NULL;
+  *toSpace = head;
+  DLOG("Copied %" FMT_Word64 " bytes\n", copied);
+  return copied;
+}
+
+Block *GCWorkerPool::grabFreeBlock() {
+  pthread_mutex_lock(&lock_);
+  Block *block = mm_->grabFreeBlock(contents_);
+  pthread_mutex_unlock(&lock_);
+  return block;
+}
+
+void GCWorkerPool::evacuateLarge(Closure *cl) {
+  pthread_mutex_lock(&lock_);
+  mm_->evacuateLarge(cl);
+  pthread_mutex_unlock(&lock_);
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -0,0 +1,115 @@
+#ifndef _PARALLELGC_H_
+#define _PARALLELGC_H_
+
+#include "common.hh"
+#include "memorymanager.hh"
+
+#include <deque>
+#include <pthread.h>
+
+_START_LAMBDACHINE_NAMESPACE
+
+class GCWorkerPool;
+
+// A GC worker evacuates objects into its own private to-space block
+// and keeps a deque of to-space regions that still need to be
+// scanned.  If it runs out of work it steals regions from other
+// workers.
+//
+// Forwarding pointers are installed with a CAS, so two workers may
+// race to evacuate the same object.  The loser simply rolls back its
+// (private) allocation and uses the winner's copy.
+class GCWorker {
+public:
+  // The worker of the current OS thread, or NULL if the current
+  // thread is not taking part in a parallel GC.
+  static inline GCWorker *current() { return current_; }
+
+  void copy(Closure **src, InfoTable *info, u4 payloadSize);
+
+private:
+  typedef struct {
+    char *start;
+    char *end;
+  } ScanItem;
+
+  // Regions at least this large get shared with idle workers.
+  static const size_t kExportBytes = 1024;
+
+  GCWorker(MemoryManager *mm, GCWorkerPool *pool);
+  ~GCWorker();
+
+  void beginGC(Block *toSpace);
+  void run();
+  char *alloc(size_t bytes);
+  void newAllocBlock();
+  void push(char *start, char *end);
+  bool pop(ScanItem *item);
+  bool steal(ScanItem *item);
+  void scanRegion(char *p, char *end);
+
+  MemoryManager *mm_;
+  GCWorkerPool *pool_;
+  Block *alloc_;       // Private to-space block.
+  char *allocScan_;    // Objects in alloc_ below this have been claimed.
+  Block *blocks_;      // All to-space blocks of this worker (via link_).
+  uint64_t copied_;    // Bytes copied during the current GC.
+  pthread_mutex_t lock_;
+  std::deque<ScanItem> todo_;
+
+  static __thread GCWorker *current_;
+
+  friend class GCWorkerPool;
+};
+
+// A fixed set of OS threads that take part in every GC.  The thread
+// that triggers the GC becomes worker 0 and does all the root
+// scanning.  The other threads wait on a condition variable in
+// between GCs.
+class GCWorkerPool {
+public:
+  GCWorkerPool(MemoryManager *mm, u4 nthreads);
+  ~GCWorkerPool();
+
+  inline u4 numThreads() const { return nworkers_; }
+
+  // Prepare for a parallel GC.  Until the matching finishGC(), objects
+  // evacuated on the current thread are copied into toSpace (and
+  // fresh blocks of the same type).
+  void beginGC(Block *toSpace);
+
+  // Scan all evacuated objects in parallel, then link all new
+  // to-space blocks into *toSpace.  The head of the list remains the
+  // block that received the last objects of worker 0.  Returns the
+  // number of bytes copied.
+  uint64_t finishGC(Block **toSpace);
+
+private:
+  static void *threadMain(void *);
+  void helperLoop(GCWorker *);
+  Block *grabFreeBlock();
+  void evacuateLarge(Closure *);
+
+  MemoryManager *mm_;
+  u4 nworkers_;
+  GCWorker **workers_;
+  pthread_t *threads_;
+  Block::Flags contents_;         // Type of the to-space blocks.
+
+  pthread_mutex_t lock_;          // Protects mm_ and the fields below.
+  pthread_cond_t wakeup_;
+  pthread_cond_t finished_;
+  u4 epoch_;                      // Incremented for each GC.
+  u4 running_;                    // Helpers still working on this GC.
+  bool shutdown_;
+
+  volatile long pending_;         // Number of items in all deques.
+  volatile long idle_;            // Number of workers without work.
+
+  friend class GCWorker;
+  friend class MemoryManager;
+};
+
+_END_LAMBDACHINE_NAMESPACE
+
+#endif /* _PARALLELGC_H_ */
@@ -0,0 +1,149 @@
+#include "perfmap.hh"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+_START_LAMBDACHINE_NAMESPACE
+
+// See tools/perf/Documentation/jitdump-specification.txt in the Linux
+// sources.
+#define JITDUMP_MAGIC    0x4A695444
+#define JITDUMP_VERSION  1
+#define JITDUMP_EM_X86_64 62
+
+typedef enum {
+  JIT_CODE_LOAD = 0,
+  JIT_CODE_CLOSE = 3
+} JitDumpRecordType;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+} JitDumpHeader;
+
+typedef struct {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+} JitDumpRecord;
+
+typedef struct {
+  JitDumpRecord rec;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+  // Followed by the NUL-terminated name and the code.
+} JitDumpCodeLoad;
+
+// perf record -k mono uses the same clock.
+static uint64_t jitDumpTimestamp() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+PerfMap::PerfMap()
+  : map_(NULL), dump_(NULL), dumpMarker_(NULL), codeIndex_(0) {
+}
+
+PerfMap::~PerfMap() {
+  close();
+}
+
+bool PerfMap::openMap() {
+  LC_ASSERT(map_ == NULL);
+  char file[64];
+  snprintf(file, sizeof(file), "/tmp/perf-%d.map", (int)getpid());
+  mapFile_ = file;
+  map_ = fopen(file, "w");
+  return map_ != NULL;
+}
+
+bool PerfMap::openJitDump(const char *dir) {
+  LC_ASSERT(dump_ == NULL);
+  char name[64];
+  snprintf(name, sizeof(name), "/jit-%d.dump", (int)getpid());
+  dumpFile_ = std::string(dir) + name;
+  dump_ = fopen(dumpFile_.c_str(), "w+");
+  if (dump_ == NULL)
+    return false;
+
+  JitDumpHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = JITDUMP_MAGIC;
+  h.version = JITDUMP_VERSION;
+  h.total_size = sizeof(h);
+  h.elf_mach = JITDUMP_EM_X86_64;
+  h.pid = (uint32_t)getpid();
+  h.timestamp = jitDumpTimestamp();
+  fwrite(&h, sizeof(h), 1, dump_);
+  fflush(dump_);
+
+  // perf record notices the file by this executable mapping.
+  dumpMarker_ = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC,
+                     MAP_PRIVATE, fileno(dump_), 0);
+  if (dumpMarker_ == MAP_FAILED) {
+    dumpMarker_ = NULL;
+    fclose(dump_);
+    dump_ = NULL;
+    return false;
+  }
+  return true;
+}
+
+void PerfMap::close() {
+  if (map_ != NULL) {
+    fclose(map_);
+    map_ = NULL;
+  }
+  if (dump_ != NULL) {
+    JitDumpRecord rec;
+    rec.id = JIT_CODE_CLOSE;
+    rec.total_size = sizeof(rec);
+    rec.timestamp = jitDumpTimestamp();
+    fwrite(&rec, sizeof(rec), 1, dump_);
+    munmap(dumpMarker_, sysconf(_SC_PAGESIZE));
+    dumpMarker_ = NULL;
+    fclose(dump_);
+    dump_ = NULL;
+  }
+}
+
+void PerfMap::addCode(const void *start, size_t size, const char *name) {
+  if (map_ != NULL) {
+    fprintf(map_, "%lx %lx %s\n", (unsigned long)start,
+            (unsigned long)size, name);
+    fflush(map_);
+  }
+  if (dump_ != NULL) {
+    size_t namelen = strlen(name) + 1;
+    JitDumpCodeLoad load;
+    load.rec.id = JIT_CODE_LOAD;
+    load.rec.total_size = sizeof(load) + namelen + size;
+    load.rec.timestamp = jitDumpTimestamp();
+    load.pid = (uint32_t)getpid();
+    load.tid = (uint32_t)syscall(SYS_gettid);
+    load.vma = (uint64_t)start;
+    load.code_addr = (uint64_t)start;
+    load.code_size = size;
+    load.code_index = codeIndex_++;
+    fwrite(&load, sizeof(load), 1, dump_);
+    fwrite(name, namelen, 1, dump_);
+    fwrite(start, size, 1, dump_);
+    fflush(dump_);
+  }
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -0,0 +1,58 @@
+#ifndef _PERFMAP_H_
+#define _PERFMAP_H_
+
+#include "common.hh"
+
+#include <stdio.h>
+#include <string>
+
+_START_LAMBDACHINE_NAMESPACE
+
+// Symbols for Linux perf.
+//
+// Without help, perf attributes samples in the machine code area to
+// "[unknown]".  We can describe the generated code in two formats:
+//
+//  - A perf map, /tmp/perf-<pid>.map, is a text file with one line
+//    "START SIZE NAME" per piece of code.  perf report reads it
+//    directly.
+//
+//  - A jitdump file, DIR/jit-<pid>.dump, also contains a copy of the
+//    code and a timestamp for each entry.  It must be merged into the
+//    profile with "perf inject --jit" (after "perf record -k mono"),
+//    but then also annotates the code, and copes with addresses that
+//    are reused after the machine code area was flushed.
+//
+// The JIT names every trace, exit stub group and exit handler that it
+// commits.  Calls must not happen concurrently (the JIT serialises
+// code generation anyway).
+class PerfMap {
+public:
+  PerfMap();
+  ~PerfMap();
+
+  // Each returns false if the file could not be created.
+  bool openMap();
+  bool openJitDump(const char *dir);
+  void close();
+
+  inline bool isEnabled() const { return map_ != NULL || dump_ != NULL; }
+
+  // Describes the code in [start, start + size).
+  void addCode(const void *start, size_t size, const char *name);
+
+  inline const std::string &mapFile() const { return mapFile_; }
+  inline const std::string &dumpFile() const { return dumpFile_; }
+
+private:
+  FILE *map_;
+  FILE *dump_;
+  void *dumpMarker_;
+  uint64_t codeIndex_;
+  std::string mapFile_;
+  std::string dumpFile_;
+};
+
+_END_LAMBDACHINE_NAMESPACE
+
+#endif /* _PERFMAP_H_ */
@@ -4,12 +4,67 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 
 _START_LAMBDACHINE_NAMESPACE
 
+Word Thread::maxStackWords_ = Thread::kDefaultMaxStackWords;
+
+void Thread::setMaxStackSize(Word words) {
+  if (words < kMinStackWords)
+    words = kMinStackWords;
+  maxStackWords_ = words;
+}
+
+// Stacks of threads that have finished and stacks left behind when a
+// stack grows are kept for reuse by other threads.  Stacks only grow
+// by doubling, so threads started with the same stack size request
+// the same sizes.
+static const int kMaxFreeStacks = 8;
+
+typedef struct {
+  Word *stack;
+  Word size;
+} FreeStack;
+
+static FreeStack freeStacks[kMaxFreeStacks];
+static int numFreeStacks = 0;
+
+static Word *allocStack(Word size) {
+  for (int i = 0; i < numFreeStacks; ++i) {
+    if (freeStacks[i].size == size) {
+      Word *stack = freeStacks[i].stack;
+      freeStacks[i] = freeStacks[--numFreeStacks];
+      return stack;
+    }
+  }
+  return new Word[size];
+}
+
+static void freeStack(Word *stack, Word size) {
+  if (numFreeStacks < kMaxFreeStacks) {
+    freeStacks[numFreeStacks].stack = stack;
+    freeStacks[numFreeStacks].size = size;
+    ++numFreeStacks;
+    return;
+  }
+  // Replace the smallest cached stack if this one is bigger.
+  int smallest = 0;
+  for (int i = 1; i < numFreeStacks; ++i) {
+    if (freeStacks[i].size < freeStacks[smallest].size)
+      smallest = i;
+  }
+  if (freeStacks[smallest].size < size) {
+    std::swap(freeStacks[smallest].stack, stack);
+    std::swap(freeStacks[smallest].size, size);
+  }
+  delete[] stack;
+}
+
 void Thread::destroy() {
   if (stack_ != NULL) {
-    delete[] stack_;
+    freeStack(stack_, stackSize_);
   }
   stack_ = NULL;
   base_ = NULL;
@@ -30,7 +85,7 @@ void Thread::initialize(Word stackSizeInWords) {
   }
   pc_ = &stopCode_[0];
   stackSize_ = stackSizeInWords;
-  stack_ = new Word[stackSize_];
+  stack_ = allocStack(stackSize_);
 #ifndef NDEBUG
   // This is mainly to shut up Valgrind
   memset(stack_, 0xf0, stackSize_ * sizeof(Word));
@@ -51,6 +106,46 @@ void Thread::initialize(Word stackSizeInWords) {
   pc_ = &info->code()->code[0];
 }
 
+bool Thread::growStack(Word *limit, Word *base, ptrdiff_t *moved) {
+  Word needed = limit - stack_;
+  if (needed > maxStackWords_)
+    return false;
+  Word newSize = stackSize_ * 2;
+  while (newSize < needed)
+    newSize *= 2;
+  if (newSize > maxStackWords_)
+    newSize = maxStackWords_;
+
+  Word *oldStack = stack_;
+  Word *newStack = allocStack(newSize);
+  memcpy(newStack, oldStack, stackSize_ * sizeof(Word));
+#ifndef NDEBUG
+  memset(newStack + stackSize_, 0xf0, (newSize - stackSize_) * sizeof(Word));
+#endif
+  ptrdiff_t delta = newStack - oldStack;
+
+  // The only pointers into the stack are the saved base pointers of
+  // each frame.  The chain ends with a NULL pointer.
+  Word *frame = base + delta;
+  for (;;) {
+    Word *prev = (Word *)frame[-3];
+    if (!within(oldStack, oldStack + stackSize_, prev))
+      break;
+    frame[-3] = (Word)(prev + delta);
+    frame = prev + delta;
+  }
+  if (within(oldStack, oldStack + stackSize_, base_))
+    base_ += delta;
+  if (within(oldStack, oldStack + stackSize_, top_))
+    top_ += delta;
+
+  freeStack(oldStack, stackSize_);
+  stack_ = newStack;
+  stackSize_ = newSize;
+  *moved = delta;
+  return true;
+}
+
 Thread *Thread::createThread(Capability *cap, Word stackSizeInWords) {
   Thread *T = new Thread;
   T->initialize(stackSizeInWords);
@@ -10,13 +10,19 @@ _START_LAMBDACHINE_NAMESPACE
 struct _Thread {
 public:
   static const Word kMinStackWords = 64;
+  static const Word kDefaultMaxStackWords = (512 * 1024 * 1024) / sizeof(Word);
 
   static Thread *createThread(Capability *, Word stackSizeInWords);
   static Thread *createTestingThread(BcIns *pc, u4 framesize);
+
+  // Stacks grow up to this size.  Applies to all threads.
+  static void setMaxStackSize(Word words);
+  static inline Word maxStackSize() { return maxStackWords_; }
   
   inline BcIns *pc() const { return pc_; }
   inline Word *stackStart() const { return stack_; }
   inline Word *stackLimit() const { return stack_ + stackSize_; }
+  inline Word stackSize() const { return stackSize_; }
   inline Word *top() const { return top_; }
   inline Word *base() const { return base_; }
 
@@ -33,9 +39,19 @@ public:
   inline void setPC(BcIns *pc) { pc_ = pc; }
 
   //  Thread() {}
+  ~_Thread() { destroy(); }
   void initialize(Word stackSizeInWords);
   void destroy();
 
+  // Moves the stack into a larger buffer so that it extends at least
+  // up to (but excluding) `limit`, which points into the current
+  // stack or past its end.  `base` is the current frame, which may
+  // be more recent than base_.  The frame chain, base_ and top_ are
+  // relocated; the caller must add *moved to any other pointers into
+  // the stack.  Returns false if the stack would exceed the maximum
+  // stack size.
+  bool growStack(Word *limit, Word *base, ptrdiff_t *moved);
+
   inline Capability *owner() const { return owner_; }
 
   inline void sync(BcIns *pc, Word *base) {
@@ -43,6 +59,7 @@ public:
   }
 
   static BcIns stopCode_[];
+  static Word maxStackWords_;
 
   friend class Capability;
 
@@ -0,0 +1,741 @@
+#include "jit.hh"
+#include "loader.hh"
+#include "miscclosures.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+_START_LAMBDACHINE_NAMESPACE
+
+using namespace std;
+
+/// Trace Cache
+/// ===========
+///
+/// Short-running programs spend much of their time in the interpreter
+/// before their traces have been recorded.  The trace cache stores
+/// the optimised IR and snapshots of all root traces at the end of a
+/// run, so that the next run can compile them right away.
+///
+/// The machine code itself is not stored, because it contains
+/// absolute addresses (exit stubs, constants, counters) that are
+/// different in each run.  Re-assembling the IR is cheap compared to
+/// profiling and recording.
+///
+/// Pointer constants and bytecode addresses are stored symbolically:
+/// as the name of an info table or static closure, or as the name of
+/// an info table plus an instruction offset into its code.  They are
+/// resolved against the loaded modules when the cache is read.  A
+/// trace that refers to anything without a name (e.g., a dynamically
+/// created info table) is not cached.
+///
+/// The cache is only used if every module it mentions has been loaded
+/// from a file with the same hash.  In addition, the instruction at
+/// the start of each trace must be unchanged.
+///
+/// Side traces are not cached.  They will be recorded again if their
+/// exits become hot.  A root trace that links to a trace that isn't
+/// cached is dropped, too.
+
+static const uint32_t kCacheMagic = 0x4354434c;  // "LCTC"
+static const uint32_t kCacheVersion = 2;  // Bump when IR opcodes change.
+
+class CacheWriter {
+public:
+  inline void u8(uint8_t x) { data_.push_back((char)x); }
+  inline void u16(uint16_t x) { data_.append((const char *)&x, sizeof(x)); }
+  inline void u32(uint32_t x) { data_.append((const char *)&x, sizeof(x)); }
+  inline void u64(uint64_t x) { data_.append((const char *)&x, sizeof(x)); }
+  inline void str(const char *s) {
+    uint32_t len = strlen(s);
+    u32(len);
+    data_.append(s, len);
+  }
+  inline void append(const CacheWriter &other) { data_ += other.data_; }
+  inline const string &data() const { return data_; }
+private:
+  string data_;
+};
+
+class CacheReader {
+public:
+  CacheReader(const string &data)
+    : p_(data.data()), end_(data.data() + data.size()), ok_(true) {}
+  inline uint8_t u8() { uint8_t x = 0; get(&x, sizeof(x)); return x; }
+  inline uint16_t u16() { uint16_t x = 0; get(&x, sizeof(x)); return x; }
+  inline uint32_t u32() { uint32_t x = 0; get(&x, sizeof(x)); return x; }
+  inline uint64_t u64() { uint64_t x = 0; get(&x, sizeof(x)); return x; }
+  inline const char *str(string *buf) {
+    uint32_t len = u32();
+    if (!ok_ || (size_t)(end_ - p_) < len) {
+      ok_ = false;
+      buf->clear();
+    } else {
+      buf->assign(p_, len);
+      p_ += len;
+    }
+    return buf->c_str();
+  }
+  inline bool ok() const { return ok_; }
+  inline bool atEnd() const { return p_ == end_; }
+private:
+  inline void get(void *dest, size_t n) {
+    if ((size_t)(end_ - p_) < n) {
+      ok_ = false;
+      return;
+    }
+    memcpy(dest, p_, n);
+    p_ += n;
+  }
+  const char *p_;
+  const char *end_;
+  bool ok_;
+};
+
+/// Translates addresses of loaded objects to names and back.
+class TraceSymbols {
+public:
+  TraceSymbols(Loader *loader);
+
+  /// Writes a constant of the given type.  Returns false if it is a
+  /// pointer that cannot be named.
+  bool encode(CacheWriter *out, IRType ty, Word value);
+  bool encodePc(CacheWriter *out, const void *pc) {
+    return encode(out, IRT_PC, (Word)pc);
+  }
+
+  /// Reads a constant.  Returns false (after reading the complete
+  /// symbol) if it does not exist in the loaded modules.
+  bool decode(CacheReader *in, Word *value) {
+    SymbolKind kind;
+    return decode(in, value, &kind);
+  }
+
+  /// Reads a bytecode address.  A trace's start must be an
+  /// instruction in loaded code.  Other PCs may also be NULL or the
+  /// update frame's return address.
+  bool decodePc(CacheReader *in, Word *value, bool isStart);
+
+  /// The name of the info table whose code contains pc, or NULL.
+  const char *codeName(const BcIns *pc) const {
+    const CodeRange *r = findCode(pc);
+    return r != NULL ? r->name : NULL;
+  }
+
+private:
+  typedef enum {
+    kRaw, kInfo, kClosure, kPc, kMisc
+  } SymbolKind;
+
+  typedef struct {
+    const char *name;
+    Word value;
+  } MiscSymbol;
+
+  typedef struct {
+    const BcIns *start;
+    const BcIns *end;
+    const char *name;
+  } CodeRange;
+
+  struct CodeRangeLess {
+    bool operator()(const CodeRange &a, const CodeRange &b) const {
+      return a.start < b.start;
+    }
+  };
+
+  typedef HASH_NAMESPACE::HASH_MAP_CLASS<Word, const char *> NAME_MAP;
+
+  const CodeRange *findCode(const BcIns *pc) const;
+  bool decode(CacheReader *in, Word *value, SymbolKind *kind);
+
+  Loader *loader_;
+  NAME_MAP infoNames_;
+  NAME_MAP closureNames_;
+  vector<CodeRange> code_;
+  vector<MiscSymbol> misc_;
+};
+
+TraceSymbols::TraceSymbols(Loader *loader) : loader_(loader) {
+  const STRING_MAP(InfoTable*) &infos = loader->infoTables();
+  for (STRING_MAP(InfoTable*)::const_iterator it = infos.begin();
+       it != infos.end(); ++it) {
+    InfoTable *info = it->second;
+    if (info == NULL)
+      continue;
+    infoNames_[(Word)info] = it->first;
+    if (info->hasCode()) {
+      const Code *code = ((CodeInfoTable *)info)->code();
+      CodeRange r = { code->code, code->code + code->sizecode, it->first };
+      code_.push_back(r);
+    }
+  }
+  sort(code_.begin(), code_.end(), CodeRangeLess());
+
+  const STRING_MAP(Closure*) &closures = loader->closures();
+  for (STRING_MAP(Closure*)::const_iterator it = closures.begin();
+       it != closures.end(); ++it) {
+    if (it->second != NULL)
+      closureNames_[(Word)it->second] = it->first;
+  }
+
+#define MISC(name, value) \
+  { MiscSymbol s = { name, (Word)(value) }; misc_.push_back(s); }
+  MISC("stg_IND_info", MiscClosures::stg_IND_info);
+  MISC("stg_PAP_info", MiscClosures::stg_PAP_info);
+  MISC("stg_BYTEARR_info", MiscClosures::stg_BYTEARR_info);
+  MISC("stg_UPD_closure", MiscClosures::stg_UPD_closure_addr);
+  MISC("stg_UPD_return", MiscClosures::stg_UPD_return_pc);
+  MISC("stg_BLACKHOLE_closure", MiscClosures::stg_BLACKHOLE_closure_addr);
+  MISC("stg_STOP_closure", MiscClosures::stg_STOP_closure_addr);
+#undef MISC
+}
+
+bool TraceSymbols::encode(CacheWriter *out, IRType ty, Word value) {
+  if ((ty != IRT_CLOS && ty != IRT_INFO && ty != IRT_PC && ty != IRT_PTR) ||
+      value == 0) {
+    out->u8(kRaw);
+    out->u64(value);
+    return true;
+  }
+  for (size_t i = 0; i < misc_.size(); ++i) {
+    if (misc_[i].value == value) {
+      out->u8(kMisc);
+      out->str(misc_[i].name);
+      return true;
+    }
+  }
+  NAME_MAP::const_iterator it;
+  switch (ty) {
+  case IRT_INFO:
+    it = infoNames_.find(value);
+    if (it == infoNames_.end())
+      return false;
+    out->u8(kInfo);
+    out->str(it->second);
+    return true;
+  case IRT_CLOS:
+    it = closureNames_.find(value);
+    if (it == closureNames_.end())
+      return false;
+    out->u8(kClosure);
+    out->str(it->second);
+    return true;
+  case IRT_PC: {
+    const CodeRange *r = findCode((const BcIns *)value);
+    if (r == NULL)
+      return false;
+    out->u8(kPc);
+    out->str(r->name);
+    out->u32((const BcIns *)value - r->start);
+    return true;
+  }
+  default:
+    // Strings and other internal pointers.
+    return false;
+  }
+}
+
+const TraceSymbols::CodeRange *
+TraceSymbols::findCode(const BcIns *pc) const {
+  CodeRange key = { pc, NULL, NULL };
+  vector<CodeRange>::const_iterator r =
+    upper_bound(code_.begin(), code_.end(), key, CodeRangeLess());
+  if (r == code_.begin())
+    return NULL;
+  --r;
+  if (pc > r->end)
+    return NULL;
+  return &*r;
+}
+
+bool TraceSymbols::decode(CacheReader *in, Word *value, SymbolKind *kind) {
+  *kind = (SymbolKind)in->u8();
+  if (*kind == kRaw) {
+    *value = in->u64();
+    return true;
+  }
+  string name;
+  in->str(&name);
+  *value = 0;
+  switch (*kind) {
+  case kMisc:
+    for (size_t i = 0; i < misc_.size(); ++i) {
+      if (name == misc_[i].name) {
+        *value = misc_[i].value;
+        return true;
+      }
+    }
+    return false;
+  case kInfo: {
+    STRING_MAP(InfoTable*)::const_iterator it =
+      loader_->infoTables().find(name.c_str());
+    if (it == loader_->infoTables().end() || it->second == NULL)
+      return false;
+    *value = (Word)it->second;
+    return true;
+  }
+  case kClosure: {
+    STRING_MAP(Closure*)::const_iterator it =
+      loader_->closures().find(name.c_str());
+    if (it == loader_->closures().end() || it->second == NULL)
+      return false;
+    *value = (Word)it->second;
+    return true;
+  }
+  case kPc: {
+    uint32_t offset = in->u32();
+    STRING_MAP(InfoTable*)::const_iterator it =
+      loader_->infoTables().find(name.c_str());
+    if (it == loader_->infoTables().end() || it->second == NULL ||
+        !it->second->hasCode())
+      return false;
+    const Code *code = ((CodeInfoTable *)it->second)->code();
+    if (offset > code->sizecode)
+      return false;
+    *value = (Word)(code->code + offset);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool TraceSymbols::decodePc(CacheReader *in, Word *value, bool isStart) {
+  SymbolKind kind;
+  if (!decode(in, value, &kind))
+    return false;
+  switch (kind) {
+  case kPc: {
+    const CodeRange *r = findCode((const BcIns *)*value);
+    return r != NULL && (!isStart || (const BcIns *)*value < r->end);
+  }
+  case kMisc:
+    return !isStart && *value == (Word)MiscClosures::stg_UPD_return_pc;
+  case kRaw:
+    return !isStart && *value == 0;
+  default:
+    return false;
+  }
+}
+
+static void writeModules(CacheWriter *out, Loader *loader) {
+  const STRING_MAP(Module*) &modules = loader->modules();
+  uint32_t n = 0;
+  for (STRING_MAP(Module*)::const_iterator it = modules.begin();
+       it != modules.end(); ++it) {
+    if (it->second != NULL)
+      ++n;
+  }
+  out->u32(n);
+  for (STRING_MAP(Module*)::const_iterator it = modules.begin();
+       it != modules.end(); ++it) {
+    if (it->second != NULL) {
+      out->str(it->first);
+      out->u64(it->second->hash());
+    }
+  }
+}
+
+static bool checkModules(CacheReader *in, Loader *loader) {
+  uint32_t n = in->u32();
+  bool valid = true;
+  string name;
+  for (uint32_t i = 0; i < n && in->ok(); ++i) {
+    in->str(&name);
+    uint64_t hash = in->u64();
+    STRING_MAP(Module*)::const_iterator it =
+      loader->modules().find(name.c_str());
+    if (it == loader->modules().end() || it->second == NULL ||
+        it->second->hash() != hash)
+      valid = false;
+  }
+  return valid && in->ok();
+}
+
+bool Jit::saveTrace(Fragment *F, TraceSymbols *syms,
+                    const std::vector<bool> &cached, CacheWriter *out) {
+  bool patched = F->flags_.get(Fragment::kPatchedStart);
+  out->u32(F->traceId_);
+  out->u8(patched);
+  if (F->startPc_ == NULL || !syms->encodePc(out, F->startPc_))
+    return false;
+  BcIns startIns = patched ? F->startIns_ : *F->startPc_;
+  out->u32(startIns.raw());
+  out->u16(F->frameSize_);
+
+  uint32_t nconsts = 0;
+  for (IRRef ref = F->firstconstant_; ref < REF_BIAS; ++ref) {
+    if (F->ir(ref)->opcode() != IR::kKWORDHI)
+      ++nconsts;
+  }
+  out->u32(nconsts);
+  for (IRRef ref = F->firstconstant_; ref < REF_BIAS; ++ref) {
+    IR *ins = F->ir(ref);
+    switch (ins->opcode()) {
+    case IR::kKWORDHI:
+      continue;
+    case IR::kKBASEO:
+      out->u16(ref);
+      out->u16(ins->ot());
+      out->u32(ins->i32());
+      break;
+    case IR::kKINT:
+    case IR::kKWORD:
+      out->u16(ref);
+      out->u16(ins->ot());
+      if (!syms->encode(out, ins->type(), F->literalValue(ref, NULL)))
+        return false;
+      break;
+    default:
+      return false;
+    }
+  }
+
+  out->u32(F->nextins_ - REF_FIRST);
+  for (IRRef ref = REF_FIRST; ref < F->nextins_; ++ref) {
+    IR *ins = F->ir(ref);
+    out->u16(ins->ot());
+    out->u16(ins->op1());
+    out->u16(ins->op2());
+    if (ins->opcode() == IR::kSAVE && ins->op1() == IR_SAVE_LINK &&
+        !(ins->op2() < cached.size() && cached[ins->op2()]))
+      return false;
+    if (ins->opcode() == IR::kNEW) {
+      AbstractHeapEntry &entry = F->heap_.entry(ins->op2());
+      out->u16(entry.size());
+      for (int i = 0; i < entry.size(); ++i)
+        out->u16(F->heap_.field(ins->op2(), i));
+    }
+  }
+
+  out->u32(F->nsnaps_);
+  for (uint32_t n = 0; n < F->nsnaps_; ++n) {
+    Snapshot &snap = F->snaps_[n];
+    out->u16(snap.ref_);
+    out->u16(snap.relbase_);
+    out->u8(snap.framesize_);
+    out->u16(snap.steps_);
+    out->u16(snap.lastHeapEntry_);
+    if (!syms->encodePc(out, snap.pc_))
+      return false;
+    out->u32(snap.entries_);
+    for (Snapshot::MapRef se = snap.begin(); se < snap.end(); ++se)
+      out->u32(F->snapmap_.data_.at(se));
+  }
+
+  out->u32(F->numTargets_);
+  for (uint32_t i = 0; i < F->numTargets_; ++i) {
+    if (!syms->encodePc(out, F->targets_[i]))
+      return false;
+  }
+  return true;
+}
+
+bool Jit::saveTraceCache(const char *filename, Loader *loader) {
+  TraceSymbols syms(loader);
+  CacheWriter out;
+  out.u32(kCacheMagic);
+  out.u32(kCacheVersion);
+  out.u32(sizeof(Word));
+  writeModules(&out, loader);
+
+  // A trace can only link to traces created before it.
+  std::vector<bool> cached(fragments_.size(), false);
+  CacheWriter traces;
+  uint32_t ntraces = 0;
+  for (size_t i = 0; i < fragments_.size(); ++i) {
+    Fragment *F = fragments_[i];
+    if (F->parent_ != NULL)
+      continue;
+    CacheWriter trace;
+    if (saveTrace(F, &syms, cached, &trace)) {
+      traces.append(trace);
+      cached[i] = true;
+      ++ntraces;
+    }
+  }
+  out.u32(ntraces);
+  out.append(traces);
+
+  FILE *f = fopen(filename, "wb");
+  if (f == NULL)
+    return false;
+  size_t written = fwrite(out.data().data(), 1, out.data().size(), f);
+  return fclose(f) == 0 && written == out.data().size();
+}
+
+// Remaps a reference to a constant of the cached trace.  Returns 0
+// if the constant is unknown.
+static inline IRRef1 remapConst(const std::vector<IRRef1> &consts,
+                                IRRef1 ref) {
+  if (ref == 0 || !irref_islit(ref))
+    return ref;
+  size_t i = REF_BIAS - ref;
+  return i < consts.size() ? consts[i] : 0;
+}
+
+// True if a remapped reference is a known constant or an instruction
+// before lim.
+static inline bool validRef(IRRef1 ref, IRRef lim) {
+  return ref != 0 && (irref_islit(ref) || (ref >= REF_BASE && ref < lim));
+}
+
+// Limits the memory a corrupted cache file can make us allocate.  Real
+// traces are much smaller.
+static const uint32_t kMaxCachedHeapFields = 4096;
+
+// Leaves the recorder as if no trace had been read.
+void Jit::discardLoadedTrace() {
+  buf_.reset(NULL, NULL);
+  resetRecorderState();
+}
+
+// Nothing read from the cache file is trusted: every reference must
+// point to a constant or an earlier instruction, heap checks must
+// match their allocations, and all PCs must be in loaded code.
+// Returns false if the rest of the file cannot be read.  A trace
+// that is merely invalid is skipped.
+bool Jit::loadTrace(CacheReader *in, TraceSymbols *syms,
+                    std::vector<TraceId> *ids) {
+  LC_ASSERT(!isCompiling());
+  TraceId oldId = in->u32();
+  bool patched = in->u8() != 0;
+  Word startPc = 0;
+  bool valid = syms->decodePc(in, &startPc, true);
+  uint32_t startIns = in->u32();
+  uint16_t frameSize = in->u16();
+
+  buf_.reset(NULL, NULL);
+  buf_.disableOptimisation(IRBuffer::kOptSink);
+  buf_.disableOptimisation(IRBuffer::kOptDCE);
+  if (!buf_.slots_.inRange(frameSize))
+    valid = false;
+
+  std::vector<IRRef1> consts;
+  uint32_t nconsts = in->u32();
+  // Each constant takes up at most two literal slots.
+  if (nconsts > (uint32_t)(buf_.bufmin_ - buf_.bufstart_ - 1) / 2) {
+    discardLoadedTrace();
+    return false;
+  }
+  for (uint32_t i = 0; i < nconsts && in->ok(); ++i) {
+    IRRef1 ref = in->u16();
+    uint16_t ot = in->u16();
+    TRef tr;
+    if ((ot >> 8) == IR::kKBASEO) {
+      tr = buf_.baseOffsetLiteral((int32_t)in->u32());
+    } else {
+      Word value;
+      if (!syms->decode(in, &value))
+        valid = false;
+      tr = buf_.literal((IRType)(ot & IRT_TYPE), value);
+    }
+    if (ref >= REF_BIAS || ref < REF_BIAS - 2 * nconsts - 2) {
+      valid = false;
+      continue;
+    }
+    if (consts.size() <= (size_t)(REF_BIAS - ref))
+      consts.resize(REF_BIAS - ref + 1, 0);
+    consts[REF_BIAS - ref] = tr.ref();
+  }
+
+  uint32_t nins = in->u32();
+  if (!in->ok() || nins > (uint32_t)(buf_.bufend_ - buf_.bufmax_)) {
+    discardLoadedTrace();
+    return false;
+  }
+  IRRef insEnd = buf_.bufmax_ + nins;
+  int reserved = 0;  // Heap words reserved and not yet allocated.
+  uint32_t heapFields = 0;
+  for (uint32_t i = 0; i < nins && in->ok(); ++i) {
+    uint16_t ot = in->u16();
+    IRRef1 op1 = in->u16();
+    IRRef1 op2 = in->u16();
+    IR::Opcode op = (IR::Opcode)(ot >> 8);
+    if (op >= IR::k_MAX || op == IR::kBASE ||
+        irmode_left(IR::mode(op)) == IR::IRMcst) {
+      discardLoadedTrace();
+      return false;
+    }
+    IRRef ref = buf_.nextIns();
+    uint8_t mode = IR::mode(op);
+    if (irmode_left(mode) == IR::IRMref) {
+      op1 = remapConst(consts, op1);
+      if (!validRef(op1, ref))
+        valid = false;
+    }
+    if (irmode_right(mode) == IR::IRMref) {
+      op2 = remapConst(consts, op2);
+      if (!validRef(op2, ref))
+        valid = false;
+    }
+    if (op == IR::kSAVE && op1 == IR_SAVE_LINK) {
+      if (op2 < ids->size() && (*ids)[op2] != (TraceId)TRACE_ID_NONE)
+        op2 = (*ids)[op2];
+      else
+        valid = false;
+    }
+
+    IR *ins = buf_.ir(ref);
+    ins->setOt(ot);
+    ins->setOp1(op1);
+    ins->setOp2(op2);
+    ins->setPrev(buf_.chain_[op]);
+    buf_.chain_[op] = (IRRef1)ref;
+
+    if (op == IR::kNEW) {
+      int nfields = in->u16();
+      heapFields += nfields;
+      if (!in->ok() || heapFields > kMaxCachedHeapFields) {
+        discardLoadedTrace();
+        return false;
+      }
+      // The heap check covers only allocations that weren't sunk.
+      // Sunk allocations, and those of an invalid trace, get a
+      // reservation of their own so that newEntry doesn't complain.
+      if (!ins->isSunk() && (reserved -= nfields + 1) < 0)
+        valid = false;
+      if (ins->isSunk() || reserved < 0)
+        buf_.heap_.heapCheck(nfields + 1);
+      IRBuffer::HeapEntry entry = buf_.heap_.newEntry(ref, nfields);
+      ins->setOp2(entry);
+      for (int f = 0; f < nfields; ++f) {
+        // Fields may refer to later allocations (recursive bindings).
+        IRRef1 field = remapConst(consts, in->u16());
+        if (!validRef(field, insEnd))
+          valid = false;
+        buf_.setField(entry, f, field);
+      }
+    } else if (op == IR::kHEAPCHK) {
+      if (reserved != 0)
+        valid = false;
+      reserved = op1;
+      buf_.heap_.heapCheck(op1);
+    } else if (op == IR::kLOOP) {
+      buf_.loop_ = ref;
+    }
+  }
+  if (reserved != 0)
+    valid = false;
+
+  // Every snapshot belongs to a guard.
+  uint32_t nsnaps = in->u32();
+  if (!in->ok() || nsnaps > nins) {
+    discardLoadedTrace();
+    return false;
+  }
+  for (uint32_t n = 0; n < nsnaps && in->ok(); ++n) {
+    Snapshot snap;
+    snap.ref_ = in->u16();
+    snap.relbase_ = (int16_t)in->u16();
+    snap.framesize_ = in->u8();
+    snap.steps_ = in->u16();
+    snap.lastHeapEntry_ = (int16_t)in->u16();
+    if (snap.ref_ < REF_FIRST || snap.ref_ > insEnd ||
+        snap.lastHeapEntry_ < -1 ||
+        snap.lastHeapEntry_ >= (int)buf_.heap_.numEntries())
+      valid = false;
+    Word pc = 0;
+    if (!syms->decodePc(in, &pc, false))
+      valid = false;
+    snap.pc_ = (void *)pc;
+    snap.mcode_ = NULL;
+    uint32_t entries = in->u32();
+    if (!in->ok() || entries > AbstractStack::kSlots) {
+      discardLoadedTrace();
+      return false;
+    }
+    snap.mapofs_ = buf_.snapmap_.data_.size();
+    snap.entries_ = entries;
+    for (uint32_t e = 0; e < entries && in->ok(); ++e) {
+      uint32_t data = in->u32();
+      IRRef1 ref = remapConst(consts, (IRRef1)data);
+      if (!validRef(ref, insEnd))
+        valid = false;
+      buf_.snapmap_.data_.push_back((data & 0xffff0000) | ref);
+    }
+    buf_.snaps_.push_back(snap);
+  }
+  buf_.snapmap_.index_ = buf_.snapmap_.data_.size();
+
+  targets_.clear();
+  uint32_t ntargets = in->u32();
+  for (uint32_t i = 0; i < ntargets && in->ok(); ++i) {
+    Word target = 0;
+    if (!syms->decodePc(in, &target, false))
+      valid = false;
+    targets_.push_back((BcIns *)target);
+  }
+
+  if (!in->ok()) {
+    discardLoadedTrace();
+    return false;
+  }
+
+  if (ids->size() <= oldId)
+    ids->resize(oldId + 1, TRACE_ID_NONE);
+
+  BcIns *pc = (BcIns *)startPc;
+  if (!valid || pc->raw() != startIns || traceAt(pc) != NULL) {
+    discardLoadedTrace();
+    return true;
+  }
+
+  // Pretend we have just recorded the trace.
+  startPc_ = pc;
+  startName_ = syms->codeName(pc);
+  parent_ = NULL;
+  parentExitNo_ = 0;
+  traceType_ = TT_ROOT;
+  jobCap_ = NULL;
+  flags_.set(kIsReturnTrace, !patched);
+  buf_.slots_.set(frameSize, TRef());
+  try {
+    compileTrace();
+  } catch (int err) {
+    if (err != IROPTERR_MCODE_FULL)
+      throw err;
+    mcode_.abort();
+    discardLoadedTrace();
+    return false;
+  }
+  installTrace();
+  Fragment *F = fragments_.back();
+  F->frameSize_ = frameSize;
+  (*ids)[oldId] = F->traceId();
+  ++traces_from_cache;
+  return true;
+}
+
+int Jit::loadTraceCache(const char *filename, Loader *loader) {
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL)
+    return -1;
+  string data;
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    data.append(chunk, n);
+  fclose(f);
+
+  CacheReader in(data);
+  if (in.u32() != kCacheMagic || in.u32() != kCacheVersion ||
+      in.u32() != sizeof(Word) || !checkModules(&in, loader))
+    return -1;
+
+  TraceSymbols syms(loader);
+  std::vector<TraceId> ids;
+  uint64_t before = traces_from_cache;
+  uint32_t ntraces = in.u32();
+  for (uint32_t i = 0; i < ntraces && in.ok(); ++i) {
+    if (!loadTrace(&in, &syms, &ids))
+      break;
+  }
+  return (int)(traces_from_cache - before);
+}
+
+_END_LAMBDACHINE_NAMESPACE
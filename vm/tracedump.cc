@@ -0,0 +1,201 @@
+#include "tracedump.hh"
+#include "jit.hh"
+#include "ir-inl.hh"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+_START_LAMBDACHINE_NAMESPACE
+
+// Writes s as a JSON string, or null if s is NULL.
+static void writeString(FILE *out, const char *s) {
+  if (s == NULL) {
+    fputs("null", out);
+    return;
+  }
+  fputc('"', out);
+  for ( ; *s != '\0'; ++s) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+static void writeArg(FILE *out, uint8_t mode, IRRef1 op) {
+  switch ((IR::Mode)mode) {
+  case IR::IRMref:
+    fprintf(out, "{ \"ref\": %d }", (int)op - REF_BIAS);
+    break;
+  case IR::IRMlit:
+    fprintf(out, "{ \"lit\": %u }", (unsigned)op);
+    break;
+  default:
+    fputs("null", out);
+    break;
+  }
+}
+
+TraceDump::TraceDump() : tracesWritten_(0) {
+}
+
+TraceDump::~TraceDump() {
+  close();
+}
+
+bool TraceDump::open(const char *dir) {
+  LC_ASSERT(!isOpen());
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    return false;
+  struct stat st;
+  if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+    return false;
+  dir_ = dir;
+  tracesWritten_ = 0;
+  aborts_.clear();
+  return true;
+}
+
+void TraceDump::close() {
+  if (!isOpen())
+    return;
+  std::string file = dir_ + "/aborts.json";
+  FILE *out = fopen(file.c_str(), "w");
+  if (out != NULL) {
+    fprintf(out, "{\n  \"traces\": %u,\n  \"aborts\": [", tracesWritten_);
+    for (size_t i = 0; i < aborts_.size(); ++i) {
+      const Abort &a = aborts_[i];
+      fprintf(out, "%s\n    { \"start_pc\": \"%p\", \"function\": ",
+              i == 0 ? "" : ",", a.startPc);
+      writeString(out, a.fnName);
+      fputs(", \"reason\": ", out);
+      writeString(out, a.reason);
+      if (a.parent != (TraceId)TRACE_ID_NONE)
+        fprintf(out, ", \"parent\": %u, \"parent_exit\": %u }",
+                a.parent, a.exitno);
+      else
+        fputs(", \"parent\": null, \"parent_exit\": null }", out);
+    }
+    fprintf(out, "%s]\n}\n", aborts_.empty() ? "" : "\n  ");
+    fclose(out);
+  } else {
+    fprintf(stderr, "Could not write trace dump: %s\n", file.c_str());
+  }
+  dir_.clear();
+}
+
+void TraceDump::abortedRecording(const BcIns *startPc, const char *fnName,
+                                 const char *reason, TraceId parent,
+                                 ExitNo exitno) {
+  Abort a = { startPc, fnName, reason, parent, exitno };
+  aborts_.push_back(a);
+}
+
+bool TraceDump::writeTrace(Fragment *F, const char *fnName, size_t codeSize,
+                           uint64_t generation) {
+  LC_ASSERT(isOpen());
+  char name[32];
+  snprintf(name, sizeof(name), "/trace-%06u.json", tracesWritten_);
+  std::string file = dir_ + name;
+  FILE *out = fopen(file.c_str(), "w");
+  if (out == NULL)
+    return false;
+  ++tracesWritten_;
+
+  fprintf(out, "{\n  \"trace_id\": %u,\n  \"generation\": %" FMT_Word64
+          ",\n  \"start_pc\": \"%p\",\n  \"function\": ",
+          F->traceId(), generation, F->startPc());
+  writeString(out, fnName);
+  if (F->parent() != NULL)
+    fprintf(out, ",\n  \"parent\": %u,\n  \"parent_exit\": %u",
+            F->parent()->traceId(), F->parentExit());
+  else
+    fputs(",\n  \"parent\": null,\n  \"parent_exit\": null", out);
+  fprintf(out, ",\n  \"frame_size\": %u,\n", F->frameSize());
+
+  fputs("  \"ir\": [", out);
+  bool first = true;
+  for (IRRef ref = F->firstconstant_; ref < F->nextins_; ++ref) {
+    IR *ins = F->ir(ref);
+    IR::Opcode op = ins->opcode();
+    if (op == IR::kKWORDHI)
+      continue;
+    fprintf(out, "%s\n    { \"ref\": %d, \"op\": \"%s\", \"type\": \"%s\"",
+            first ? "" : ",", (int)ref - REF_BIAS, IR::name(op),
+            IR::typeName(ins->t()));
+    first = false;
+    if (ins->isGuard())
+      fputs(", \"guard\": true", out);
+    if (op == IR::kNEW && ins->isSunk())
+      fputs(", \"sunk\": true", out);
+    uint8_t mode = IR::mode(op);
+    if (irmode_left(mode) != IR::IRMcst) {
+      fputs(", \"args\": [", out);
+      writeArg(out, irmode_left(mode), ins->op1());
+      fputs(", ", out);
+      writeArg(out, irmode_right(mode), ins->op2());
+      fputs("]", out);
+    }
+    if (op == IR::kKINT) {
+      fprintf(out, ", \"value\": %d", ins->i32());
+    } else if (op == IR::kKWORD) {
+      fprintf(out, ", \"value\": \"0x%" FMT_Word64X "\"",
+              F->literalValue(ref, NULL));
+    } else if (op == IR::kKBASEO) {
+      fprintf(out, ", \"base_offset\": %d", ins->i32());
+    } else if (op == IR::kNEW) {
+      AbstractHeapEntry &entry = F->heap_.entry(ins->op2());
+      fputs(", \"fields\": [", out);
+      for (int i = 0; i < entry.size(); ++i) {
+        fprintf(out, "%s%d", i == 0 ? "" : ", ",
+                (int)F->heap_.field(ins->op2(), i) - REF_BIAS);
+      }
+      fputs("]", out);
+    }
+    if (ref >= REF_BIAS) {
+      if (isReg(ins->reg()))
+        fprintf(out, ", \"reg\": \"%s\"",
+                IR::regName(ins->reg(), ins->type()));
+      if (ins->spill() != 0)
+        fprintf(out, ", \"spill\": %u", ins->spill());
+    }
+    fputs(" }", out);
+  }
+  fputs("\n  ],\n", out);
+
+  MCode *entry = F->entry();
+  fputs("  \"snapshots\": [", out);
+  for (ExitNo e = 0; e < F->numExits(); ++e) {
+    Snapshot &snap = F->snap(e);
+    fprintf(out, "%s\n    { \"exit\": %u, \"ref\": %d, \"pc\": \"%p\""
+            ", \"relbase\": %d, \"framesize\": %d, \"mcode_offset\": ",
+            e == 0 ? "" : ",", e, (int)snap.ref() - REF_BIAS, snap.pc(),
+            snap.relbase(), snap.framesize());
+    if (snap.mcode_ != NULL && entry != NULL)
+      fprintf(out, "%ld", (long)(snap.mcode_ - entry));
+    else
+      fputs("null", out);
+    fputs(", \"slots\": [", out);
+    for (SnapmapRef i = snap.begin(); i < snap.end(); ++i) {
+      fprintf(out, "%s[%d, %d]", i == snap.begin() ? "" : ", ",
+              F->snapmap_.slotId(i), (int)F->snapmap_.slotRef(i) - REF_BIAS);
+    }
+    fputs("] }", out);
+  }
+  fputs("\n  ],\n", out);
+
+  fprintf(out, "  \"mcode\": { \"address\": \"%p\", \"size\": %lu"
+          ", \"bytes\": \"", entry, (unsigned long)codeSize);
+  for (size_t i = 0; entry != NULL && i < codeSize; ++i)
+    fprintf(out, "%02x", (uint8_t)entry[i]);
+  fputs("\" }\n}\n", out);
+  fclose(out);
+  return true;
+}
+
+_END_LAMBDACHINE_NAMESPACE
@@ -0,0 +1,70 @@
+#ifndef _TRACEDUMP_H_
+#define _TRACEDUMP_H_
+
+#include "common.hh"
+#include "vm.hh"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+_START_LAMBDACHINE_NAMESPACE
+
+class Fragment;
+
+// Writes compiled traces as JSON documents for offline analysis.
+//
+// Each installed trace is written to DIR/trace-NNNNNN.json, numbered
+// in the order the traces were compiled.  (Trace IDs start again at
+// zero after the machine code area has been flushed, so they are not
+// unique within a run.)  A document contains:
+//
+//  - the trace ID, its start PC and the function containing it, and
+//    the parent trace and exit for side traces,
+//  - the IR, including register and spill slot assignments,
+//  - the snapshots with their PCs, slots and the offset of their
+//    guard in the machine code,
+//  - the machine code bytes.
+//
+// Aborted recordings are collected and written to DIR/aborts.json by
+// close().
+class TraceDump {
+public:
+  TraceDump();
+  ~TraceDump();
+
+  // Creates dir if necessary.  Returns false if it cannot be used.
+  bool open(const char *dir);
+  void close();
+
+  inline bool isOpen() const { return !dir_.empty(); }
+  inline const std::string &dir() const { return dir_; }
+  inline uint32_t tracesWritten() const { return tracesWritten_; }
+
+  // The trace's code is [F->entry(), F->entry() + codeSize).  The
+  // generation is the number of machine code flushes so far.
+  bool writeTrace(Fragment *F, const char *fnName, size_t codeSize,
+                  uint64_t generation);
+
+  // Remembers an aborted recording.  For side traces, parent is the
+  // parent's trace ID, otherwise TRACE_ID_NONE.
+  void abortedRecording(const BcIns *startPc, const char *fnName,
+                        const char *reason, TraceId parent, ExitNo exitno);
+
+private:
+  typedef struct {
+    const BcIns *startPc;
+    const char *fnName;
+    const char *reason;
+    TraceId parent;
+    ExitNo exitno;
+  } Abort;
+
+  std::string dir_;
+  uint32_t tracesWritten_;
+  std::vector<Abort> aborts_;
+};
+
+_END_LAMBDACHINE_NAMESPACE
+
+#endif /* _TRACEDUMP_H_ */
@@ -8,10 +8,15 @@
 #include "miscclosures.hh"
 #include "jit.hh"
 #include "time.hh"
+#include "utils.hh"
+#include "perfmap.hh"
+#include "tracedump.hh"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <unistd.h>
+#include <math.h>
 
 using namespace std;
 _USE_LAMBDACHINE_NAMESPACE
@@ -25,6 +30,42 @@ TEST(ThreadTest, StartStop) {
   delete T;
 }
 
+TEST(ThreadTest, GrowStack) {
+  MemoryManager m;
+  Loader l(&m, NULL);
+  Thread *T = Thread::createThread(NULL, Thread::kMinStackWords);
+  Word *stack = T->stackStart();
+  Word *base = T->base();
+  // Push two frames.
+  Word *base1 = base + 4;
+  base1[-3] = (Word)base;
+  Word *base2 = base1 + 4;
+  base2[-3] = (Word)base1;
+  base2[0] = 42;
+
+  ptrdiff_t moved;
+  ASSERT_TRUE(T->growStack(T->stackLimit() + 1, base2, &moved));
+  EXPECT_EQ(Thread::kMinStackWords * 2, T->stackSize());
+  base2 += moved;
+  EXPECT_EQ((Word)42, base2[0]);
+  Word *newBase1 = (Word *)base2[-3];
+  EXPECT_EQ(base1 + moved, newBase1);
+  EXPECT_EQ(base + moved, (Word *)newBase1[-3]);
+  EXPECT_EQ(base + moved, T->base());
+  EXPECT_TRUE(T->isValid());
+
+  // The old stack is reused by the next thread.
+  Thread *T2 = Thread::createThread(NULL, Thread::kMinStackWords);
+  EXPECT_EQ(stack, T2->stackStart());
+  delete T2;
+
+  Word oldMax = Thread::maxStackSize();
+  Thread::setMaxStackSize(T->stackSize());
+  EXPECT_FALSE(T->growStack(T->stackLimit() + 1, base2, &moved));
+  Thread::setMaxStackSize(oldMax);
+  delete T;
+}
+
 TEST(MMTest, AllocRegion) {
   Region *region = Region::newRegion(Region::kSmallObjectRegion);
   ASSERT_TRUE(region != NULL);
@@ -51,6 +92,257 @@ TEST(MMTest, AllocBasic2) {
   ASSERT_GT(m.infoTables(), sizeof(Word));
 }
 
+TEST(MMTest, RememberedSet) {
+  Region *region = Region::newRegion(Region::kSmallObjectRegion);
+  char *block = (char *)region + Block::kBlockSize;
+  void *p = block + 5 * sizeof(Word);
+  void *q = block + 6 * sizeof(Word);
+  ASSERT_FALSE(Region::isRemembered(p));
+  Region::remember(p);
+  ASSERT_TRUE(Region::isRemembered(p));
+  ASSERT_FALSE(Region::isRemembered(q));
+  delete region;
+}
+
+TEST(MMTest, WriteBarrierOnlyOldGen) {
+  MemoryManager m;
+  m.setGenerational(true);
+  Closure *young = m.allocClosure(MiscClosures::stg_IND_info, 1);
+  m.writeBarrier(young);
+  ASSERT_FALSE(Region::isRemembered(young));
+}
+
+TEST(MMTest, RegionTable) {
+  Region *region = Region::newRegion(Region::kSmallObjectRegion);
+  char *block = (char *)region + Block::kBlockSize;
+  ASSERT_EQ(Region::kSmallObjectRegion, Region::regionType(block));
+  ASSERT_TRUE(Region::isHeapPointer((char *)region + Region::kRegionMask));
+  ASSERT_FALSE(Region::isHeapPointer((char *)region + Region::kRegionSize));
+  ASSERT_FALSE(Region::isHeapPointer(&region));
+  ASSERT_FALSE(Region::isHeapPointer((void *)~(Word)0));
+  ASSERT_EQ(Region::blockFromPointer(block), Region::lookupBlock(block));
+  ASSERT_TRUE(Region::lookupBlock(&region) == NULL);
+  delete region;
+  ASSERT_FALSE(Region::isHeapPointer(block));
+
+  MemoryManager m;
+  Closure *cl = m.allocClosure(MiscClosures::stg_IND_info, 1);
+  ASSERT_TRUE(m.inRegions(cl));
+  ASSERT_EQ(Block::kClosures, Region::lookupBlock(cl)->contents());
+  ASSERT_FALSE(m.inRegions(&cl));
+  ASSERT_FALSE(m.looksLikeClosure(&cl));
+}
+
+TEST(MMTest, GCThreads) {
+  MemoryManager m;
+  ASSERT_EQ(1U, m.gcThreads());
+  m.setGCThreads(4);
+  ASSERT_EQ(4U, m.gcThreads());
+  m.setGCThreads(1);
+  ASSERT_EQ(1U, m.gcThreads());
+  m.setGCThreads(2);  // Helper threads are joined by the destructor.
+}
+
+TEST(MMTest, HugePages) {
+  Region::setPageMode(Region::kTransparentHugePages);
+  {
+    MemoryManager m;
+    Closure *cl = m.allocClosure(MiscClosures::stg_IND_info, 1);
+    cl->setPayload(0, 42);
+    ASSERT_EQ((Word)42, cl->payload(0));
+  }
+  // Falls back to normal pages if no huge pages are configured.
+  Region::setPageMode(Region::kHugeTLBPages);
+  {
+    MemoryManager m;
+    Closure *cl = m.allocClosure(MiscClosures::stg_IND_info, 1);
+    cl->setPayload(0, 42);
+    ASSERT_EQ((Word)42, cl->payload(0));
+  }
+  Region::setPageMode(Region::kNormalPages);
+}
+
+TEST(HeapPolicyTest, GrowthFactor) {
+  HeapSizingPolicy p;
+  p.setMinHeapBlocks(8);
+  ASSERT_EQ(8U, p.heapTarget(1, 0, 0));
+  ASSERT_EQ(20U, p.heapTarget(10, 0, 0));
+  p.setGrowthFactor(3);
+  ASSERT_EQ(30U, p.heapTarget(10, 0, 0));
+}
+
+TEST(HeapPolicyTest, MaxHeap) {
+  HeapSizingPolicy p;
+  p.setMaxHeapBlocks(15);
+  ASSERT_EQ(15U, p.heapTarget(10, 0, 0));
+  ASSERT_EQ(0U, p.heapTarget(15, 0, 0));
+}
+
+TEST(HeapPolicyTest, OverheadTarget) {
+  HeapSizingPolicy p;
+  p.setOverheadTarget(10);
+  // 50% of the time spent in GC: the heap must grow faster.
+  p.heapTarget(10, 100, 100);
+  ASSERT_GT(p.growthFactor(), HeapSizingPolicy::kDefaultGrowthFactor);
+  // Negligible GC time: shrink back to the initial factor.
+  for (int i = 0; i < 20; ++i)
+    p.heapTarget(10, 1000000, 1);
+  ASSERT_EQ(HeapSizingPolicy::kDefaultGrowthFactor, p.growthFactor());
+}
+
+TEST(GCStatsTest, Percentiles) {
+  GCStats stats;
+  ASSERT_EQ((Time)0, stats.pausePercentile(50));
+  for (int i = 1; i <= 100; ++i) {
+    GCEvent ev = { USToTime(i), 1000, 250, 1, false };
+    stats.record(ev);
+  }
+  ASSERT_EQ(USToTime(50), stats.pausePercentile(50));
+  ASSERT_EQ(USToTime(99), stats.pausePercentile(99));
+  ASSERT_EQ(USToTime(100), stats.pausePercentile(100));
+  ASSERT_EQ(25000U, stats.totalCopied());
+  ASSERT_DOUBLE_EQ(0.25, stats.survivalRate(stats.event(0)));
+}
+
+TEST(GCStatsTest, Histogram) {
+  GCStats stats;
+  GCEvent ev = { NSToTime(500), 0, 0, 0, true };
+  stats.record(ev);
+  ev.pause = USToTime(20);
+  stats.record(ev);
+  ev.pause = SecondsToTime(1);
+  stats.record(ev);
+  u4 buckets[GCStats::kHistogramBuckets];
+  stats.pauseHistogram(buckets);
+  ASSERT_EQ(1U, buckets[0]);
+  ASSERT_EQ(0U, buckets[1]);
+  ASSERT_EQ(1U, buckets[2]);
+  ASSERT_EQ(1U, buckets[GCStats::kHistogramBuckets - 1]);
+}
+
+TEST(GCStatsTest, CAFsReverted) {
+  GCStats stats;
+  GCEvent ev = { USToTime(1), 0, 0, 0, true, 0, 3 };
+  stats.record(ev);
+  ev.major = false;
+  ev.cafsReverted = 0;
+  stats.record(ev);
+  ASSERT_EQ(3U, stats.totalCAFsReverted());
+}
+
+TEST(HeapProfileTest, Census) {
+  MemoryManager mm;
+  Loader l(&mm, NULL);
+  Closure *cl = mm.allocClosure(MiscClosures::stg_IND_info, 1);
+  char file[] = "/tmp/lcvm-hp-XXXXXX";
+  int fd = mkstemp(file);
+  ASSERT_TRUE(fd >= 0);
+  close(fd);
+
+  HeapProfile prof;
+  ASSERT_TRUE(prof.open(file, "test", SecondsToTime(1)));
+  ASSERT_FALSE(prof.censusDue(getProcessElapsedTime()));
+  prof.beginCensus(getProcessElapsedTime());
+  prof.census(cl, 16);
+  prof.census(cl, 16);
+  prof.endCensus();
+  prof.close(getProcessElapsedTime());
+  ASSERT_EQ(1U, prof.numCensuses());
+
+  FILE *in = fopen(file, "r");
+  ASSERT_TRUE(in != NULL);
+  char line[256];
+  string contents;
+  while (fgets(line, sizeof(line), in) != NULL)
+    contents += line;
+  fclose(in);
+  unlink(file);
+  string band = string(MiscClosures::stg_IND_info->name()) + "/IND\t32\n";
+  ASSERT_NE(string::npos, contents.find(band));
+  ASSERT_EQ(0U, contents.find("JOB \"test\"\n"));
+}
+
+TEST(HeapProfileTest, SampleAllocations) {
+  MemoryManager mm;
+  Loader l(&mm, NULL);
+  Closure *node = mm.allocClosure(MiscClosures::stg_IND_info, 1);
+  BcIns code[2];
+  HeapProfile prof;
+  prof.setSampleInterval(64);
+  for (int i = 0; i < 10; ++i)
+    prof.allocated(&code[0], node, MiscClosures::stg_IND_info, 16);
+  prof.allocated(&code[1], node, MiscClosures::stg_IND_info, 200);
+  ASSERT_EQ(128U, prof.sampledBytes(&code[0]));
+  ASSERT_EQ(192U, prof.sampledBytes(&code[1]));
+}
+
+TEST(PerfMapTest, MapAndJitDump) {
+  char dir[] = "/tmp/lcvm-perf-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  static const uint8_t code[] = { 0x90, 0xc3 };
+
+  PerfMap perf;
+  EXPECT_FALSE(perf.isEnabled());
+  ASSERT_TRUE(perf.openMap());
+  ASSERT_TRUE(perf.openJitDump(dir));
+  EXPECT_TRUE(perf.isEnabled());
+  perf.addCode(code, sizeof(code), "lc_trace_0 Main.f_info");
+  perf.close();
+
+  ifstream map(perf.mapFile().c_str());
+  string line;
+  ASSERT_TRUE(getline(map, line).good());
+  stringstream expected;
+  expected << hex << (Word)code << " 2 lc_trace_0 Main.f_info";
+  EXPECT_EQ(expected.str(), line);
+  map.close();
+  unlink(perf.mapFile().c_str());
+
+  FILE *in = fopen(perf.dumpFile().c_str(), "rb");
+  ASSERT_TRUE(in != NULL);
+  uint32_t header[10];
+  ASSERT_EQ(1U, fread(header, sizeof(header), 1, in));
+  EXPECT_EQ(0x4A695444U, header[0]);  // magic
+  EXPECT_EQ(40U, header[2]);          // header size
+  uint32_t rec[4];
+  ASSERT_EQ(1U, fread(rec, sizeof(rec), 1, in));
+  EXPECT_EQ(0U, rec[0]);  // JIT_CODE_LOAD
+  // Record header, 40 bytes of fields, name and code.
+  EXPECT_EQ(16U + 40U + 23U + 2U, rec[1]);
+  fclose(in);
+  unlink(perf.dumpFile().c_str());
+  rmdir(dir);
+}
+
+TEST(SelectorTest, RecogniseSelectorThunk) {
+  // case fv_1 of (_, x) -> x
+  BcIns code[] = {
+    BcIns::ad(BcIns::kFUNC, 2, 0),
+    BcIns::ad(BcIns::kLOADFV, 0, 1),
+    BcIns::ad(BcIns::kEVAL, 0, 0),
+    BcIns::bitmapOffset(0),
+    BcIns::ad(BcIns::kMOV_RES, 0, 0),
+    BcIns::abc(BcIns::kLOADF, 1, 0, 2),
+    BcIns::ad(BcIns::kEVAL, 1, 0),
+    BcIns::bitmapOffset(0),
+    BcIns::ad(BcIns::kMOV_RES, 1, 0),
+    BcIns::ad(BcIns::kRET1, 1, 0)
+  };
+  Code c;
+  c.code = code;
+  c.sizecode = countof(code);
+  ASSERT_EQ(2, c.selectorField());
+
+  // Selecting from something other than the evaluated free variable.
+  code[5] = BcIns::abc(BcIns::kLOADF, 1, 1, 2);
+  ASSERT_EQ(0, c.selectorField());
+
+  // Returning something else.
+  code[5] = BcIns::abc(BcIns::kLOADF, 1, 0, 2);
+  code[9] = BcIns::ad(BcIns::kRET1, 0, 0);
+  ASSERT_EQ(0, c.selectorField());
+}
+
 TEST(LoaderTest, Simple) {
   MemoryManager mm;
   Loader l(&mm, "/usr/bin");
@@ -297,6 +589,27 @@ TEST_F(AsmTest, MoveHiReg) {
   EXPECT_EQ(1234, cast(anon_fn_1, code)(1234));
 }
 
+TEST_F(AsmTest, WriteBarrier) {
+  Region *region = Region::newRegion(Region::kSmallObjectRegion);
+  void *obj = (char *)region + Block::kBlockSize + 7 * sizeof(Word);
+  as->setupRegAlloc();
+  // Don't clobber callee-save registers.
+  as->useReg(RID_EBX);
+  as->useReg(RID_R13D);
+  as->useReg(RID_R14D);
+  as->useReg(RID_R15D);
+  as->ret();
+  as->move(RID_EAX, RID_EDI);
+  as->writeBarrier(RID_EDI);
+
+  MCode *code = as->finish();
+  EXPECT_FALSE(Region::isRemembered(obj));
+  EXPECT_EQ((Word)obj, cast(anon_fn_1, code)((Word)obj));
+  EXPECT_TRUE(Region::isRemembered(obj));
+  EXPECT_FALSE(Region::isRemembered((char *)obj + sizeof(Word)));
+  delete region;
+}
+
 TEST_F(AsmTest, LoadImmU32Pos) {
   as->ret();
   as->loadi_u32(RID_EAX, 6789);
@@ -635,6 +948,37 @@ TEST_F(IRTestFold, FoldSub) {
   buf->debugPrint(cerr, 1);
 }
 
+TEST_F(IRTestFold, FoldLoad) {
+  MemoryManager mm;
+  Loader l(&mm, NULL);
+  TRef pap = buf->slot(0);
+  TRef thunk = buf->slot(1);
+  TRef other = buf->slot(2);
+  TRef papinfo = buf->literal(IRT_INFO, (Word)MiscClosures::stg_PAP_info);
+  buf->emit(IR::kEQINFO, IRT_VOID|IRT_GUARD, pap, papinfo);
+
+  TRef fref1 = buf->emit(IR::kFREF, IRT_PTR, pap, 1);
+  TRef x1 = buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref1, 0);
+  TRef fref2 = buf->emit(IR::kFREF, IRT_PTR, thunk, 2);
+  TRef y1 = buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref2, 0);
+  EXPECT_EQ(x1, buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref1, 0));
+  EXPECT_EQ(y1, buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref2, 0));
+
+  // The update may change the thunk but not the PAP.
+  buf->emit(IR::kUPDATE, IRT_VOID, other, x1);
+  EXPECT_EQ(x1, buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref1, 0));
+  TRef y2 = buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref2, 0);
+  EXPECT_NE(y1, y2);
+  EXPECT_EQ(y2, buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref2, 0));
+
+  // The payload of an updated object is the indirectee.
+  buf->emit(IR::kUPDATE, IRT_VOID, thunk, y2);
+  TRef fref3 = buf->emit(IR::kFREF, IRT_PTR, thunk, 1);
+  EXPECT_EQ(y2, buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref3, 0));
+
+  buf->debugPrint(cerr, 1);
+}
+
 class CodeTest : public ::testing::Test {
 protected:
   virtual void SetUp() {
@@ -842,6 +1186,44 @@ TEST_F(ArithTest, BranchNotEq) {
   ASSERT_TRUE(branchTest(BcIns::kISNE, -4, -5));
 }
 
+#define D(x)  doubleToWord(x)
+
+TEST_F(ArithTest, Double) {
+  ASSERT_EQ(D(3.75), arithABC(BcIns::abc(BcIns::kADDD, 0, 1, 2),
+                              D(1.5), D(2.25)));
+  ASSERT_EQ(D(-0.75), arithABC(BcIns::abc(BcIns::kSUBD, 0, 1, 2),
+                               D(1.5), D(2.25)));
+  ASSERT_EQ(D(-3.375), arithABC(BcIns::abc(BcIns::kMULD, 0, 1, 2),
+                                D(-1.5), D(2.25)));
+  ASSERT_EQ(D(0.25), arithABC(BcIns::abc(BcIns::kDIVD, 0, 1, 2),
+                              D(1.0), D(4.0)));
+  ASSERT_EQ(D(-2.5), arithAD(BcIns::ad(BcIns::kNEGD, 0, 1), D(2.5)));
+  ASSERT_EQ(D(1.5), arithAD(BcIns::ad(BcIns::kSQRTD, 0, 1), D(2.25)));
+  ASSERT_EQ(D(-42.0), arithAD(BcIns::ad(BcIns::kI2D, 0, 1), (Word)-42));
+  ASSERT_EQ((Word)-3, arithAD(BcIns::ad(BcIns::kD2I, 0, 1), D(-3.9)));
+  ASSERT_EQ(1, arithABC(BcIns::abc(BcIns::kCMPLTD, 0, 1, 2),
+                        D(-1.0), D(0.5)));
+  ASSERT_EQ(0, arithABC(BcIns::abc(BcIns::kCMPEQD, 0, 1, 2),
+                        D(NAN), D(NAN)));
+}
+
+TEST_F(ArithTest, BranchDouble) {
+  ASSERT_TRUE(branchTest(BcIns::kISLTD, D(-1.5), D(0.0)));
+  ASSERT_FALSE(branchTest(BcIns::kISLTD, D(0.0), D(-0.0)));
+  ASSERT_TRUE(branchTest(BcIns::kISGED, D(0.0), D(-0.0)));
+  ASSERT_TRUE(branchTest(BcIns::kISLED, D(2.0), D(2.0)));
+  ASSERT_FALSE(branchTest(BcIns::kISGTD, D(2.0), D(2.0)));
+  ASSERT_TRUE(branchTest(BcIns::kISEQD, D(0.0), D(-0.0)));
+  ASSERT_FALSE(branchTest(BcIns::kISNED, D(0.0), D(-0.0)));
+  // Comparisons with NaN are false, except for /=.
+  ASSERT_FALSE(branchTest(BcIns::kISLTD, D(NAN), D(1.0)));
+  ASSERT_FALSE(branchTest(BcIns::kISGED, D(NAN), D(1.0)));
+  ASSERT_FALSE(branchTest(BcIns::kISEQD, D(NAN), D(NAN)));
+  ASSERT_TRUE(branchTest(BcIns::kISNED, D(NAN), D(NAN)));
+}
+
+#undef D
+
 TEST_F(ArithTest, Alloc1) {
   uint64_t alloc_before = mm.allocated();
   T->setPC(&code_[0]);
@@ -1181,6 +1563,97 @@ TEST(HotCounters, Simple) {
   EXPECT_TRUE(counters.tick(pc));
 }
 
+TEST(HotCounters, PerCode) {
+  HotCounters counters(3);
+  BcIns pc[] = { BcIns::ad(BcIns::kFUNC, 3, 0),
+                 BcIns::ad(BcIns::kJMP, 0, 0) };
+  u2 hotcounts[2] = { 0, 0 };
+  Code code;
+  memset(&code, 0, sizeof(code));
+  code.sizecode = 2;
+  code.code = pc;
+  code.hotcounts = hotcounts;
+
+  EXPECT_FALSE(counters.tick(&pc[0], &code));
+  EXPECT_FALSE(counters.tick(&pc[0], &code));
+  EXPECT_FALSE(counters.tick(&pc[1], &code));
+  EXPECT_TRUE(counters.tick(&pc[0], &code));
+  EXPECT_EQ(0, hotcounts[0]);
+  EXPECT_EQ(1, hotcounts[1]);
+  counters.reset(&pc[1], &code);
+  EXPECT_EQ(0, hotcounts[1]);
+
+  // Instructions outside of the code use the hashed counters.
+  BcIns other[] = { BcIns::ad(BcIns::kFUNC, 3, 0) };
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_FALSE(counters.tick(other, &code));
+  }
+  EXPECT_TRUE(counters.tick(other, &code));
+  EXPECT_EQ(0, hotcounts[0]);
+}
+
+TEST(InlineCacheTest, NumberCallSites) {
+  BcIns pc[] = {
+    BcIns::ad(BcIns::kFUNC, 3, 0),
+    BcIns::ad(BcIns::kEVAL, 0, 0),
+    BcIns::bitmapOffset(0),
+    // A case table whose payload looks like an EVAL.
+    BcIns::ad(BcIns::kCASE, 0, 2),
+    BcIns::ad(BcIns::kEVAL, 1, 0),
+    BcIns::abc(BcIns::kCALL, 0, BcIns::kNoInlineCache, 1),
+    BcIns::pointerInfo(1),
+    BcIns::args(1, 0, 0, 0),
+    BcIns::bitmapOffset(0),
+    BcIns::abc(BcIns::kCALLT, 0, BcIns::kNoInlineCache, 2),
+    BcIns::pointerInfo(3)
+  };
+  Code code;
+  memset(&code, 0, sizeof(code));
+  code.sizecode = countof(pc);
+  code.code = pc;
+  code.initInlineCaches();
+
+  ASSERT_EQ(3, code.sizecaches);
+  EXPECT_EQ(0, pc[1].d());
+  EXPECT_EQ(BcIns::ad(BcIns::kEVAL, 1, 0).raw(), pc[4].raw());
+  EXPECT_EQ(1, pc[5].b());
+  EXPECT_EQ(1, pc[5].c());
+  EXPECT_EQ(2, pc[9].b());
+  EXPECT_EQ(2, pc[9].c());
+  EXPECT_EQ(0U, code.caches[2].size);
+  delete[] code.caches;
+}
+
+TEST(InlineCacheTest, AddAndLookup) {
+  InfoTable *infos[INLINE_CACHE_ENTRIES + 1];
+  Code codes[INLINE_CACHE_ENTRIES + 1];
+  BcIns entry = BcIns::ad(BcIns::kFUNC, 1, 0);
+  for (int i = 0; i <= INLINE_CACHE_ENTRIES; ++i) {
+    infos[i] = (InfoTable *)&codes[i];  // Only compared.
+    memset(&codes[i], 0, sizeof(Code));
+    codes[i].arity = i;
+    codes[i].code = &entry;
+  }
+  InlineCache cache;
+  memset(&cache, 0, sizeof(cache));
+  EXPECT_TRUE(cache.lookup(infos[0]) == NULL);
+
+  for (int i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+    const InlineCacheEntry *e = cache.add(infos[i], &codes[i]);
+    ASSERT_TRUE(e != NULL);
+    EXPECT_EQ((u4)i, e->arity);
+    EXPECT_EQ(&entry, e->entry);
+  }
+  // Full.  Further info tables are not cached.
+  EXPECT_TRUE(cache.add(infos[INLINE_CACHE_ENTRIES], NULL) == NULL);
+  EXPECT_TRUE(cache.lookup(infos[INLINE_CACHE_ENTRIES]) == NULL);
+  for (int i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+    const InlineCacheEntry *e = cache.lookup(infos[i]);
+    ASSERT_TRUE(e != NULL);
+    EXPECT_EQ(&codes[i], e->code);
+  }
+}
+
 class RegAlloc : public ::testing::Test {
 protected:
   IRBuffer *buf;
@@ -1888,9 +2361,337 @@ TEST_P(ParallelAssignRandomTest, Random) {
 INSTANTIATE_TEST_CASE_P(Random, ParallelAssignRandomTest,
                         ::testing::Range(1,51));
 
+// Writes a bytecode file for a module that contains only the function
+// `<module>.f` with the given code.
+class ModuleWriter {
+public:
+  ModuleWriter(const char *file) : f_(fopen(file, "wb")) {}
+  ~ModuleWriter() { if (f_) fclose(f_); }
+
+  bool writeFunction(const char *module, const BcIns *code, u2 sizecode,
+                     u1 framesize, u1 arity, ClosureType type = FUN) {
+    if (!f_) return false;
+    const char *names[] = { "f" };
+    header(module, names, 1);
+    fputs("ITBL", f_);
+    varuint(2); varuint(0); varuint(1);
+    varuint(type);
+    varuint(0);              // no free variables
+    varuint(2); varuint(0); varuint(1);
+    varuint(framesize);
+    varuint(arity);
+    varuint(0);              // no literals
+    u2(sizecode);
+    u2(1);                   // pointer bitmap
+    for (int i = 0; i < sizecode; ++i)
+      u4(code[i].raw());
+    u2(0);
+    return fclose(f_) == 0 && (f_ = NULL, true);
+  }
+
+  // Constructor i is called <module>.<names[i]>, has tag i + 1 and
+  // sizes[i] fields.  Bit n of bitmaps[i] is set if field n is a
+  // pointer.
+  bool writeConstructors(const char *module, const char **names, uint32_t n,
+                         const u1 *sizes, const uint32_t *bitmaps) {
+    if (!f_) return false;
+    header(module, names, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      fputs("ITBL", f_);
+      varuint(2); varuint(0); varuint(i + 1);
+      varuint(CONSTR);
+      varuint(i + 1);        // tag
+      varuint(sizes[i]);
+      if (sizes[i] > 0)
+        u4(bitmaps[i]);
+      varuint(2); varuint(0); varuint(i + 1);
+    }
+    return fclose(f_) == 0 && (f_ = NULL, true);
+  }
+
+private:
+  // Writes everything up to the first info table.  The string table
+  // is the module name followed by names.
+  void header(const char *module, const char **names, uint32_t ninfos) {
+    fputs("KHCB", f_);
+    u2(0); u2(1);            // version
+    u4(0);                   // flags
+    u4(ninfos + 1); u4(ninfos); u4(0); u4(0);  // strings, info tables,
+                                               // closures, imports
+    u4(STR_SEC_HDR_MAGIC);
+    str(module);
+    for (uint32_t i = 0; i < ninfos; ++i)
+      str(names[i]);
+    varuint(1); varuint(0);  // module name
+    fputs("BCCL", f_);
+  }
+
+  void u2(uint16_t x) { fputc(x >> 8, f_); fputc(x & 0xff, f_); }
+  void u4(uint32_t x) { u2(x >> 16); u2(x & 0xffff); }
+  void varuint(Word x) {
+    do {
+      uint8_t b = x & 0x7f;
+      x >>= 7;
+      fputc(x != 0 ? (b | 0x80) : b, f_);
+    } while (x != 0);
+  }
+  void str(const char *s) {
+    varuint(strlen(s));
+    fputs(s, f_);
+  }
+  FILE *f_;
+};
+
+// Runs an ALLOC1 with a full heap block, which triggers a GC.  Slot 0
+// of T is the only root.  info must be a constructor with a single
+// non-pointer field.
+static bool collectFromSlot0(MemoryManager *mm, Capability *cap, Thread *T,
+                             InfoTable *info) {
+  for (;;) {
+    Block *block = Region::lookupBlock(mm->allocClosure(info, 1));
+    if (block->end() - block->free() < (ptrdiff_t)(2 * sizeof(Word)))
+      break;
+  }
+  BcIns code[] = { BcIns::abc(BcIns::kALLOC1, 1, 2, 3),
+                   BcIns::bitmapOffset(0),
+                   BcIns::ad(BcIns::kSTOP, 0, 0) };
+  T->setSlot(2, (Word)info);
+  T->setSlot(3, 0);
+  T->setPC(&code[0]);
+  mm->setNextGC(1);
+  mm->setTopOfStackMask(1);
+  bool ok = cap->run(T);
+  mm->setTopOfStackMask(MemoryManager::kNoMask);
+  return ok;
+}
+
+// Builds a graph with lots of sharing, so that GC workers race to
+// evacuate the same objects, and collects it twice.
+TEST(ParallelGCTest, SharedGraph) {
+  char dir[] = "/tmp/lcvm-pgc-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  MemoryManager mm;
+  Loader loader(&mm, dir);
+  Capability cap(&mm);
+  mm.setGCThreads(4);
+
+  const char *module = "TestParallelGC";
+  string modfile = string(dir) + "/TestParallelGC.lcbc";
+  const char *names[] = { "Pair", "Leaf" };
+  const u1 sizes[] = { 2, 1 };
+  const uint32_t bitmaps[] = { 3, 0 };
+  ASSERT_TRUE(ModuleWriter(modfile.c_str())
+              .writeConstructors(module, names, 2, sizes, bitmaps));
+  bool loaded = loader.loadModule(module);
+  remove(modfile.c_str());
+  rmdir(dir);
+  ASSERT_TRUE(loaded);
+  InfoTable *pairInfo = loader.infoTables().find("TestParallelGC.Pair")->second;
+  InfoTable *leafInfo = loader.infoTables().find("TestParallelGC.Leaf")->second;
+
+  // node[i] = Pair(node[i-1], odd i ? node[i/2] : leaf[i % kLeaves])
+  const u4 kNodes = 20000;
+  const u4 kLeaves = 61;  // Odd, so that even nodes use all leaves.
+  std::vector<Closure *> leaf(kLeaves);
+  for (u4 i = 0; i < kLeaves; ++i) {
+    leaf[i] = mm.allocClosure(leafInfo, 1);
+    leaf[i]->setPayload(0, i);
+  }
+  std::vector<Closure *> node(kNodes);
+  for (u4 i = 0; i < kNodes; ++i) {
+    node[i] = mm.allocClosure(pairInfo, 2);
+    node[i]->setPayload(0, (Word)(i > 0 ? node[i - 1] : leaf[0]));
+    node[i]->setPayload(1, (Word)(i % 2 == 1 ? node[i / 2]
+                                             : leaf[i % kLeaves]));
+  }
+  const uint64_t liveBytes = kNodes * 3 * sizeof(Word) +
+                             kLeaves * 2 * sizeof(Word);
+
+  Thread *T = Thread::createThread(&cap, 1000);
+  T->setSlot(0, (Word)node[kNodes - 1]);
+
+  for (u4 gc = 0; gc < 2; ++gc) {
+    ASSERT_TRUE(collectFromSlot0(&mm, &cap, T, leafInfo));
+    ASSERT_EQ(gc + 1, mm.numGCs());
+    // Objects copied twice would be counted twice.
+    EXPECT_EQ(liveBytes, mm.gcStats().event(gc).bytesCopied);
+
+    std::vector<Closure *> copy(kNodes);
+    Closure *cl = (Closure *)T->slot(0);
+    for (u4 i = kNodes; i > 0; --i) {
+      ASSERT_EQ(pairInfo, cl->info());
+      ASSERT_EQ(Block::kClosures, Region::lookupBlock(cl)->contents());
+      copy[i - 1] = cl;
+      cl = (Closure *)cl->payload(0);
+    }
+    std::vector<Closure *> leafCopy(kLeaves, (Closure *)NULL);
+    leafCopy[0] = cl;
+    for (u4 i = 0; i < kNodes; ++i) {
+      EXPECT_NE(node[i], copy[i]);
+      Closure *right = (Closure *)copy[i]->payload(1);
+      if (i % 2 == 1) {
+        EXPECT_EQ(copy[i / 2], right);
+      } else {
+        if (leafCopy[i % kLeaves] == NULL)
+          leafCopy[i % kLeaves] = right;
+        EXPECT_EQ(leafCopy[i % kLeaves], right);
+      }
+    }
+    for (u4 i = 0; i < kLeaves; ++i) {
+      ASSERT_EQ(leafInfo, leafCopy[i]->info());
+      EXPECT_EQ((Word)i, leafCopy[i]->payload(0));
+    }
+    node = copy;
+  }
+  delete T;
+}
+
+// A CAF whose value was recorded is reverted by a major GC unless it
+// is reachable from a live closure or from a compiled trace.
+TEST(CAFTest, RevertUnreachable) {
+  char dir[] = "/tmp/lcvm-caf-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  string consfile = string(dir) + "/TestCAFCons.lcbc";
+  string caffile = string(dir) + "/TestCAF.lcbc";
+  MemoryManager mm;
+  Loader loader(&mm, dir);
+  Capability cap(&mm);
+
+  const char *names[] = { "Box", "Leaf" };
+  const u1 sizes[] = { 1, 1 };
+  const uint32_t bitmaps[] = { 1, 0 };
+  ASSERT_TRUE(ModuleWriter(consfile.c_str())
+              .writeConstructors("TestCAFCons", names, 2, sizes, bitmaps));
+  BcIns code[] = { BcIns::ad(BcIns::kFUNC, 0, 0),
+                   BcIns::ad(BcIns::kRET1, 0, 0) };
+  ASSERT_TRUE(ModuleWriter(caffile.c_str())
+              .writeFunction("TestCAF", code, 2, 1, 0, CAF));
+  bool loaded = loader.loadModule("TestCAFCons") &&
+                loader.loadModule("TestCAF");
+  remove(consfile.c_str());
+  remove(caffile.c_str());
+  rmdir(dir);
+  ASSERT_TRUE(loaded);
+  InfoTable *boxInfo = loader.infoTables().find("TestCAFCons.Box")->second;
+  InfoTable *leafInfo = loader.infoTables().find("TestCAFCons.Leaf")->second;
+  InfoTable *cafInfo = loader.infoTables().find("TestCAF.f")->second;
+  ASSERT_EQ(CAF, cafInfo->type());
+
+  // Evaluates three CAFs, as UPDATE does.
+  Closure *caf[3];
+  for (int i = 0; i < 3; ++i) {
+    caf[i] = mm.allocStaticClosure(2);
+    Closure::initHeader(caf[i], cafInfo);
+    caf[i]->setPayload(0, 0);
+    caf[i]->setPayload(1, 0);
+    Closure *value = mm.allocClosure(leafInfo, 1);
+    value->setPayload(0, 100 + i);
+    mm.recordCAF(caf[i]);
+    caf[i]->setInfo(MiscClosures::stg_IND_info);
+    caf[i]->setPayload(0, (Word)value);
+  }
+  ASSERT_EQ(3U, mm.numCAFs());
+
+  // caf[1] is referenced by a live closure, caf[2] by a trace.
+  Closure *box = mm.allocClosure(boxInfo, 1);
+  box->setPayload(0, (Word)caf[1]);
+  Jit *jit = cap.jit();
+  Word stack[20];
+  IRBuffer *buf = jit->buffer();
+  buf->reset(&stack[10], &stack[18]);
+  buf->setSlot(0, buf->literal(IRT_CLOS, (Word)caf[2]));
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  jit->assembler()->assemble(buf, jit->mcode());
+  Jit::registerFragment(NULL, jit->saveFragment(), false);
+
+  Thread *T = Thread::createThread(&cap, 1000);
+  T->setSlot(0, (Word)box);
+  ASSERT_TRUE(collectFromSlot0(&mm, &cap, T, leafInfo));
+  ASSERT_EQ(1U, mm.numGCs());
+  EXPECT_EQ(1U, mm.gcStats().event(0).cafsReverted);
+  EXPECT_EQ(2U, mm.numCAFs());
+
+  EXPECT_EQ(cafInfo, caf[0]->info());
+  EXPECT_EQ((Word)0, caf[0]->payload(0));
+  box = (Closure *)T->slot(0);
+  EXPECT_EQ((Word)caf[1], box->payload(0));
+  for (int i = 1; i < 3; ++i) {
+    ASSERT_EQ(MiscClosures::stg_IND_info, caf[i]->info());
+    Closure *value = (Closure *)caf[i]->payload(0);
+    ASSERT_EQ(leafInfo, value->info());
+    EXPECT_EQ(Block::kClosures, Region::lookupBlock(value)->contents());
+    EXPECT_EQ((Word)(100 + i), value->payload(0));
+  }
+
+  // Once the trace is gone, caf[2] is reverted, too.
+  Jit::resetFragments();
+  ASSERT_TRUE(collectFromSlot0(&mm, &cap, T, leafInfo));
+  EXPECT_EQ(1U, mm.gcStats().event(1).cafsReverted);
+  EXPECT_EQ(cafInfo, caf[2]->info());
+  EXPECT_EQ(MiscClosures::stg_IND_info, caf[1]->info());
+  delete T;
+}
+
+// An Ap thunk has the same layout as a selector thunk, but must not
+// be short-cut by the GC.
+TEST(SelectorTest, KeepApThunk) {
+  char dir[] = "/tmp/lcvm-sel-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  string modfile = string(dir) + "/TestApThunk.lcbc";
+  MemoryManager mm;
+  Loader loader(&mm, dir);
+  Capability cap(&mm);
+
+  const char *names[] = { "Box", "Leaf" };
+  const u1 sizes[] = { 1, 1 };
+  const uint32_t bitmaps[] = { 1, 0 };
+  ASSERT_TRUE(ModuleWriter(modfile.c_str())
+              .writeConstructors("TestApThunk", names, 2, sizes, bitmaps));
+  bool loaded = loader.loadModule("TestApThunk");
+  remove(modfile.c_str());
+  rmdir(dir);
+  ASSERT_TRUE(loaded);
+  InfoTable *boxInfo = loader.infoTables().find("TestApThunk.Box")->second;
+  InfoTable *leafInfo = loader.infoTables().find("TestApThunk.Leaf")->second;
+
+  // box (ap1 (Box leaf) 42)
+  InfoTable *apInfo = MiscClosures::getApInfo(1, 0);
+  EXPECT_EQ(0U, apInfo->selectorField());
+  Closure *leaf = mm.allocClosure(leafInfo, 1);
+  leaf->setPayload(0, 7);
+  Closure *fun = mm.allocClosure(boxInfo, 1);
+  fun->setPayload(0, (Word)leaf);
+  Closure *thunk = mm.allocClosure(apInfo, 2);
+  thunk->setPayload(0, (Word)fun);
+  thunk->setPayload(1, 42);
+  Closure *box = mm.allocClosure(boxInfo, 1);
+  box->setPayload(0, (Word)thunk);
+
+  Thread *T = Thread::createThread(&cap, 1000);
+  T->setSlot(0, (Word)box);
+  ASSERT_TRUE(collectFromSlot0(&mm, &cap, T, leafInfo));
+  ASSERT_EQ(1U, mm.numGCs());
+  EXPECT_EQ(0U, mm.gcStats().event(0).selectorsEliminated);
+  box = (Closure *)T->slot(0);
+  thunk = (Closure *)box->payload(0);
+  ASSERT_EQ(apInfo, thunk->info());
+  EXPECT_EQ((Word)42, thunk->payload(1));
+  fun = (Closure *)thunk->payload(0);
+  ASSERT_EQ(boxInfo, fun->info());
+  EXPECT_EQ((Word)7, ((Closure *)fun->payload(0))->payload(0));
+  delete T;
+}
+
+// Creates a fresh temporary directory named after tmpl.
+static const char *makeTempDir(char *dir, const char *tmpl) {
+  strcpy(dir, tmpl);
+  return mkdtemp(dir);
+}
+
 class TestFragment : public ::testing::Test {
 protected:
   MemoryManager mm;
+  char dir[32];  // For generated files.  The loader looks here.
   Loader loader;
   Capability cap;
   Thread *T;
@@ -1900,10 +2701,14 @@ protected:
   Fragment *F;
 
 public:
-  TestFragment() : mm(), loader(&mm, "tests"), cap(&mm),
-                   T(NULL), jit(), buf(NULL), F(NULL) {
+  TestFragment()
+    : mm(), loader(&mm, makeTempDir(dir, "/tmp/lcvm-frag-XXXXXX")),
+      cap(&mm), T(NULL), jit(), buf(NULL), F(NULL) {
   }
-  ~TestFragment() { TearDown(); }
+  ~TestFragment() { TearDown(); rmdir(dir); }
+
+  // The path of a generated file called name.
+  string tempFile(const char *name) { return string(dir) + "/" + name; }
   virtual void SetUp() {
     T = Thread::createThread(&cap, 1000);
     buf = jit.buffer();
@@ -1983,6 +2788,78 @@ TEST_F(TestFragment, Test1) {
   EXPECT_EQ((Word)(base + 2), base[1]);
 }
 
+TEST_F(TestFragment, Profile) {
+  jit.setOption(Jit::kOptProfile, true);
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kLT, IRT_VOID|IRT_GUARD, tr1, tr2);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  Assemble();
+  ASSERT_TRUE(F->hasStats());
+
+  Word *base = T->base();
+  for (int i = 0; i < 3; ++i) {
+    base[0] = 10;  // Exits at the guard.
+    Run();
+  }
+  base[0] = 1;
+  Run();
+  EXPECT_EQ(3U, F->traceExitsAt(0));
+  EXPECT_EQ(4U, F->traceCompletions() + F->traceExits());
+}
+
+TEST_F(TestFragment, TraceDump) {
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kLT, IRT_VOID|IRT_GUARD, tr1, tr2);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  Assemble();
+
+  char dir[] = "/tmp/lcvm-dump-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  TraceDump dump;
+  ASSERT_TRUE(dump.open(dir));
+  ASSERT_TRUE(dump.writeTrace(F, "Main.\"f\"_info", 4, 0));
+  dump.abortedRecording(NULL, "Main.g_info", "trace_too_long",
+                        F->traceId(), 1);
+  dump.close();
+
+  string file = string(dir) + "/trace-000000.json";
+  ifstream in(file.c_str());
+  stringstream json;
+  json << in.rdbuf();
+  string s = json.str();
+  EXPECT_NE(string::npos, s.find("\"function\": \"Main.\\\"f\\\"_info\""));
+  EXPECT_NE(string::npos, s.find("\"parent\": null"));
+  EXPECT_NE(string::npos, s.find("\"op\": \"ADD\", \"type\": \"I64\""));
+  EXPECT_NE(string::npos, s.find("\"op\": \"LT\", \"type\": \"VOID\", "
+                                 "\"guard\": true"));
+  EXPECT_NE(string::npos, s.find("\"value\": 5"));
+  EXPECT_NE(string::npos, s.find("\"reg\": "));
+  EXPECT_NE(string::npos, s.find("\"exit\": 1"));
+  size_t bytes = s.find("\"size\": 4, \"bytes\": \"");
+  ASSERT_NE(string::npos, bytes);
+  bytes += 21;
+  EXPECT_EQ(bytes + 8, s.find('"', bytes));  // Two hex digits per byte.
+  unlink(file.c_str());
+
+  file = string(dir) + "/aborts.json";
+  ifstream aborts(file.c_str());
+  stringstream json2;
+  json2 << aborts.rdbuf();
+  s = json2.str();
+  EXPECT_NE(string::npos, s.find("\"traces\": 1"));
+  EXPECT_NE(string::npos, s.find("\"reason\": \"trace_too_long\", "
+                                 "\"parent\": 0, \"parent_exit\": 1"));
+  unlink(file.c_str());
+  rmdir(dir);
+}
+
 TEST_F(TestFragment, Test2) {
   // Program:
   //   f(x, y): if (y <= 0) return x; else f(x + 5, y - 1);
@@ -2010,6 +2887,118 @@ TEST_F(TestFragment, Test2) {
   EXPECT_EQ(0, base[1]);
 }
 
+TEST_F(TestFragment, LoopInvariant) {
+  // Program:
+  //   f(x, y, z): if (y <= 0 || z <= 0) return x; else f(x + z, y - 1, z);
+
+  TRef x = buf->slot(0);
+  TRef y = buf->slot(1);
+  TRef z = buf->slot(2);
+  TRef one = buf->literal(IRT_I64, 1);
+  TRef zero = buf->literal(IRT_I64, 0);
+  buf->emit(IR::kGT, IRT_VOID|IRT_GUARD, y, zero);
+  buf->emit(IR::kGT, IRT_VOID|IRT_GUARD, z, zero);
+  TRef x1 = buf->emit(IR::kADD, IRT_I64, x, z);
+  buf->setSlot(0, x1);
+  TRef y1 = buf->emit(IR::kSUB, IRT_I64, y, one);
+  buf->setSlot(1, y1);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, IR_SAVE_LOOP, 0);  // loop
+  EXPECT_TRUE(buf->optLoop());
+
+  // The guard on z must have been hoisted out of the loop.
+  int guards = 0;
+  for (IRRef ref = buf->loopRef() + 1;
+       buf->ir(ref)->opcode() != IR::kSAVE; ++ref) {
+    if (buf->ir(ref)->opcode() == IR::kGT)
+      ++guards;
+  }
+  EXPECT_EQ(1, guards);
+
+  Assemble();
+
+  Word *base = T->base();
+  base[0] = 0;
+  base[1] = 5;
+  base[2] = 7;
+  Run();
+  EXPECT_EQ(5 * 7, base[0]);
+  EXPECT_EQ(0, base[1]);
+  EXPECT_EQ(7, base[2]);
+}
+
+TEST_F(TestFragment, LoopSwap) {
+  // Program:
+  //   f(x, y, n): if (n <= 0) return (x, y); else f(y, x, n - 1);
+  //
+  // The PHIs for x and y form a cycle.
+
+  TRef x = buf->slot(0);
+  TRef y = buf->slot(1);
+  TRef n = buf->slot(2);
+  TRef one = buf->literal(IRT_I64, 1);
+  TRef zero = buf->literal(IRT_I64, 0);
+  buf->emit(IR::kGT, IRT_VOID|IRT_GUARD, n, zero);
+  buf->setSlot(0, y);
+  buf->setSlot(1, x);
+  TRef n1 = buf->emit(IR::kSUB, IRT_I64, n, one);
+  buf->setSlot(2, n1);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, IR_SAVE_LOOP, 0);  // loop
+  EXPECT_TRUE(buf->optLoop());
+
+  Assemble();
+
+  Word *base = T->base();
+  base[0] = 3;
+  base[1] = 4;
+  base[2] = 5;
+  Run();
+  EXPECT_EQ(4, base[0]);
+  EXPECT_EQ(3, base[1]);
+  EXPECT_EQ(0, base[2]);
+
+  base[2] = 4;
+  Run();
+  EXPECT_EQ(4, base[0]);
+  EXPECT_EQ(3, base[1]);
+  EXPECT_EQ(0, base[2]);
+}
+
+TEST_F(TestFragment, LoopUpdateGuard) {
+  // Program:
+  //   f(x, n): if (n <= 0) return x; else { update x (x.1); f(x, n - 1) }
+  //
+  // After the preamble has updated x its info table is no longer
+  // that of a thunk, so the loop body must not reuse the guard.
+
+  TRef x = buf->slot(0);
+  TRef n = buf->slot(1);
+  TRef one = buf->literal(IRT_I64, 1);
+  TRef zero = buf->literal(IRT_I64, 0);
+  InfoTable *apinfo = MiscClosures::getApInfo(1, 1);
+  TRef itbl = buf->literal(IRT_INFO, (Word)apinfo);
+  buf->emit(IR::kGT, IRT_VOID|IRT_GUARD, n, zero);
+  buf->emit(IR::kEQINFO, IRT_VOID|IRT_GUARD, x, itbl);
+  TRef fref = buf->emit(IR::kFREF, IRT_PTR, x, 1);
+  TRef fv = buf->emit(IR::kFLOAD, IRT_UNKNOWN, fref, 0);
+  buf->emit(IR::kUPDATE, IRT_VOID, x, fv);
+  TRef n1 = buf->emit(IR::kSUB, IRT_I64, n, one);
+  buf->setSlot(1, n1);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, IR_SAVE_LOOP, 0);  // loop
+  EXPECT_TRUE(buf->optLoop());
+  buf->debugPrint(cerr, 1);
+
+  int guards = 0;
+  for (IRRef ref = buf->loopRef() + 1;
+       buf->ir(ref)->opcode() != IR::kSAVE; ++ref) {
+    IR *ins = buf->ir(ref);
+    if (ins->opcode() == IR::kEQINFO) {
+      EXPECT_EQ((IRRef1)x, ins->op1());
+      ++guards;
+    }
+  }
+  EXPECT_EQ(1, guards);
+}
+
 TEST_F(TestFragment, RestoreSnapSpill) {
   buf->disableOptimisation(IRBuffer::kOptFold);
   TRef s[5];
@@ -2145,6 +3134,348 @@ TEST_F(TestFragment, LoadField) {
   EXPECT_EQ((Word)500000001234, base[0]);
 }
 
+TEST_F(TestFragment, DeadCode) {
+  TRef x = buf->slot(0);
+  TRef clos = buf->slot(1);
+  TRef lit1 = buf->literal(IRT_I64, 5);
+  TRef dead1 = buf->emit(IR::kADD, IRT_I64, x, lit1);
+  TRef dead2 = buf->emit(IR::kMUL, IRT_I64, dead1, x);
+  TRef ref = buf->emit(IR::kFREF, IRT_PTR, clos, 1);
+  TRef dead3 = buf->emit(IR::kFLOAD, IRT_UNKNOWN, ref, 0);
+  TRef y = buf->emit(IR::kSUB, IRT_I64, x, lit1);
+  buf->setSlot(0, y);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  EXPECT_EQ(5, buf->optDCE());
+  EXPECT_EQ(IR::kNOP, buf->ir(clos)->opcode());
+  EXPECT_EQ(IR::kNOP, buf->ir(dead1)->opcode());
+  EXPECT_EQ(IR::kNOP, buf->ir(dead2)->opcode());
+  EXPECT_EQ(IR::kNOP, buf->ir(ref)->opcode());
+  EXPECT_EQ(IR::kNOP, buf->ir(dead3)->opcode());
+  EXPECT_NE(IR::kNOP, buf->ir(y)->opcode());
+  EXPECT_EQ(0, buf->optDCE());
+
+  Assemble();
+
+  Word *base = T->base();
+  base[0] = 12;
+  base[1] = 0;
+  Run();
+  EXPECT_EQ(7, base[0]);
+}
+
+TEST_F(TestFragment, FlushMCode) {
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  Assemble();
+  EXPECT_EQ(1U, Jit::numFragments());
+  EXPECT_LT(jit.mcode()->start(), jit.mcode()->end());
+
+  jit.flush();
+  EXPECT_EQ(0U, Jit::numFragments());
+  EXPECT_EQ(jit.mcode()->start(), jit.mcode()->end());
+
+  // A trace that exceeds the limit is rejected.
+  jit.mcode()->setMaxSize(4);
+  EXPECT_THROW(jit.assembler()->assemble(buf, jit.mcode()), int);
+  jit.mcode()->abort();
+  jit.mcode()->setMaxSize(0);
+  EXPECT_EQ(jit.mcode()->start(), jit.mcode()->end());
+}
+
+TEST_F(TestFragment, CompilerThread) {
+  jit.startCompilerThread();
+  EXPECT_FALSE(jit.isCompiling());
+
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  // Code generation leaves the area executable.
+  Assemble();
+  Word *base = T->base();
+  base[0] = 2;
+  Run();
+  EXPECT_EQ(7, base[0]);
+  jit.pollCompiler();
+  EXPECT_EQ(1U, Jit::numFragments());
+}
+
+// True if any page in [from, to) is mapped writable and executable.
+static bool hasWritableCode(MCode *from, MCode *to) {
+  FILE *maps = fopen("/proc/self/maps", "r");
+  if (maps == NULL)
+    return false;
+  bool found = false;
+  char line[512];
+  while (fgets(line, sizeof(line), maps) != NULL) {
+    unsigned long lo, hi;
+    char perms[5];
+    if (sscanf(line, "%lx-%lx %4s", &lo, &hi, perms) == 3 &&
+        lo < (unsigned long)to && (unsigned long)from < hi &&
+        perms[1] == 'w' && perms[2] == 'x')
+      found = true;
+  }
+  fclose(maps);
+  return found;
+}
+
+TEST_F(TestFragment, CompilerThreadInstall) {
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  Assemble();
+  Fragment *F0 = F;
+  MCode *top = jit.mcode()->start();
+
+  BcIns code[] = { BcIns::ad(BcIns::kFUNC, 1, 0),
+                   BcIns::ad(BcIns::kRET1, 0, 0) };
+  jit.startCompilerThread();
+  buf->reset(&stack[10], &stack[18]);
+  jit.setStartPc(code);
+  tr1 = buf->slot(0);
+  tr2 = buf->literal(IRT_I64, 7);
+  tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  jit.finishRecording();
+  EXPECT_TRUE(jit.isCompiling());
+
+  // The first trace may run while the second one is compiled.
+  Word *base = T->base();
+  base[0] = 2;
+  Run();
+  EXPECT_EQ(7, base[0]);
+
+  jit.waitForCompiler();
+  EXPECT_TRUE(jit.isCompiling());
+  EXPECT_EQ(1U, Jit::numFragments());
+  EXPECT_FALSE(hasWritableCode(jit.mcode()->stubStart(), jit.mcode()->end()));
+
+  jit.pollCompiler();
+  EXPECT_FALSE(jit.isCompiling());
+  ASSERT_EQ(2U, Jit::numFragments());
+  EXPECT_EQ(BcIns::kJFUNC, code[0].opcode());
+  F = Jit::traceById(1);
+  EXPECT_EQ(F, jit.lookupFragment(code));
+  // The new code starts on a page that the first trace doesn't use.
+  EXPECT_LE((uintptr_t)F->entry(),
+            (uintptr_t)top & ~(uintptr_t)(LC_PAGESIZE - 1));
+  base[0] = 2;
+  Run();
+  EXPECT_EQ(9, base[0]);
+  F = F0;
+  Run();
+  EXPECT_EQ(14, base[0]);
+
+  // While the compiler thread writes code, only unused pages are
+  // writable.
+  MachineCode *mcode = jit.mcode();
+  MCode *limit;
+  mcode->setConcurrentExecution(true);
+  EXPECT_LE(mcode->reserve(&limit), mcode->start());
+  EXPECT_FALSE(hasWritableCode(mcode->stubStart(), mcode->end()));
+  mcode->abort();
+  mcode->setConcurrentExecution(false);
+}
+
+// Starts a recording at pc and aborts it straight away.
+static void abortRecording(Jit *jit, Capability *cap, BcIns *pc,
+                           Word *base,
+                           AbortReason reason = AR_INTERPRETER_REQUEST) {
+  jit->beginRecording(cap, pc, base, false);
+  jit->requestAbort(reason);
+  EXPECT_TRUE(jit->recordIns(pc, base, NULL));
+  EXPECT_FALSE(jit->isRecording());
+}
+
+TEST_F(TestFragment, RecordingPenalty) {
+  BcIns code[] = { BcIns::ad(BcIns::kFUNC, 1, 0),
+                   BcIns::ad(BcIns::kRET1, 0, 0) };
+  BcIns *pc = &code[0];
+  BcIns other = BcIns::ad(BcIns::kFUNC, 1, 0);
+  // Running the thread makes it current.
+  BcIns stop[] = { BcIns::ad(BcIns::kSTOP, 0, 0) };
+  T->setPC(&stop[0]);
+  ASSERT_TRUE(cap.run(T));
+  Word *base = T->base();
+  EXPECT_TRUE(jit.shouldRecord(pc));
+  EXPECT_TRUE(jit.penalty(pc) == NULL);
+
+  // Growing the stack is not the trace's fault.
+  abortRecording(&jit, &cap, pc, base, AR_STACK_GROWN);
+  EXPECT_TRUE(jit.penalty(pc) == NULL);
+  EXPECT_TRUE(jit.shouldRecord(pc));
+
+  // Each abort doubles the number of ignored hot events.
+  for (u4 n = 1; n < TRACE_MAX_ABORTS; ++n) {
+    abortRecording(&jit, &cap, pc, base);
+    const TracePenalty *p = jit.penalty(pc);
+    ASSERT_TRUE(p != NULL);
+    EXPECT_EQ(n, p->aborts);
+    EXPECT_EQ(1u << n, p->skip);
+    for (u4 i = 0; i < (1u << n); ++i)
+      EXPECT_FALSE(jit.shouldRecord(pc));
+    EXPECT_TRUE(jit.shouldRecord(pc));
+    EXPECT_TRUE(jit.shouldRecord(&other));
+    EXPECT_EQ(BcIns::kFUNC, pc->opcode());
+    EXPECT_TRUE(jit.blacklisted().empty());
+  }
+
+  // The last abort blacklists the FUNC for good.
+  abortRecording(&jit, &cap, pc, base);
+  EXPECT_EQ((u4)TRACE_MAX_ABORTS, jit.penalty(pc)->aborts);
+  EXPECT_EQ(BcIns::kIFUNC, pc->opcode());
+  EXPECT_EQ(1, pc->a());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_FALSE(jit.shouldRecord(pc));
+  EXPECT_TRUE(jit.shouldRecord(&other));
+  ASSERT_EQ(1U, jit.blacklisted().size());
+  EXPECT_EQ(pc, jit.blacklisted()[0]);
+
+  FILE *out = tmpfile();
+  ASSERT_TRUE(out != NULL);
+  jit.printBlacklisted(out);
+  rewind(out);
+  char line[256];
+  string stats;
+  while (fgets(line, sizeof(line), out) != NULL)
+    stats += line;
+  fclose(out);
+  char entry[256];
+  snprintf(entry, sizeof(entry), "    %p  %-6s %s\n", (void *)pc, "IFUNC",
+           jit.penalty(pc)->name);
+  EXPECT_EQ(string("  Blacklisted Trace Starts            1\n") + entry,
+            stats);
+}
+
+TEST_F(TestFragment, TraceCache) {
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  Assemble();
+
+  // The trace has no start PC, so it cannot be cached.
+  string path = tempFile("TraceCache.lctc");
+  const char *file = path.c_str();
+  ASSERT_TRUE(jit.saveTraceCache(file, &loader));
+  EXPECT_EQ(0, jit.loadTraceCache(file, &loader));
+  EXPECT_EQ(1U, Jit::numFragments());
+
+  FILE *f = fopen(file, "wb");
+  fputs("junk", f);
+  fclose(f);
+  EXPECT_EQ(-1, jit.loadTraceCache(file, &loader));
+  remove(file);
+  EXPECT_EQ(-1, jit.loadTraceCache(file, &loader));
+}
+
+TEST_F(TestFragment, TraceCacheRoundTrip) {
+  int emptySize = buf->size();
+  BcIns code[] = { BcIns::ad(BcIns::kFUNC, 1, 0),
+                   BcIns::ad(BcIns::kRET1, 0, 0) };
+  const char *module = "TestFragmentTraceCache";
+  string modfile = tempFile("TestFragmentTraceCache.lcbc");
+  ASSERT_TRUE(ModuleWriter(modfile.c_str())
+              .writeFunction(module, code, 2, 1, 1));
+  bool loaded = loader.loadModule(module);
+  remove(modfile.c_str());
+  ASSERT_TRUE(loaded);
+  InfoTable *info = loader.infoTables().find("TestFragmentTraceCache.f")->second;
+  BcIns *pc = ((CodeInfoTable *)info)->code()->code;
+
+  TRef tr1 = buf->slot(0);
+  TRef tr2 = buf->literal(IRT_I64, 5);
+  TRef tr3 = buf->emit(IR::kADD, IRT_I64, tr1, tr2);
+  buf->setSlot(0, tr3);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  jit.setStartPc(pc);
+  Assemble();
+
+  string path = tempFile("TraceCacheRoundTrip.lctc");
+  const char *file = path.c_str();
+  ASSERT_TRUE(jit.saveTraceCache(file, &loader));
+  string data;
+  {
+    ifstream in(file, ios::binary);
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  }
+  Jit::resetFragments();
+
+  // Save -> load -> assemble -> run.
+  EXPECT_EQ(1, jit.loadTraceCache(file, &loader));
+  ASSERT_EQ(1U, Jit::numFragments());
+  F = Jit::traceById(0);
+  EXPECT_EQ(F, jit.traceAt(pc));
+  EXPECT_EQ(pc, F->startPc());
+  Word *base = T->base();
+  base[0] = 12;
+  Run();
+  EXPECT_EQ(17, base[0]);
+  F = NULL;
+  Jit::resetFragments();
+
+  // A truncated file must not install anything nor leave a half-read
+  // trace in the recorder.
+  for (size_t len = 0; len < data.size(); ++len) {
+    buf->reset(&stack[10], &stack[18]);
+    {
+      ofstream out(file, ios::binary);
+      out.write(data.data(), len);
+    }
+    EXPECT_GE(0, jit.loadTraceCache(file, &loader)) << "length " << len;
+    EXPECT_EQ(0U, Jit::numFragments());
+    EXPECT_EQ(0U, buf->numSnapshots());
+    EXPECT_EQ(emptySize, buf->size());
+  }
+
+  // The start PC is a raw address instead of an instruction.
+  string corrupt = data;
+  size_t startPcOfs = 4 * 3 + 4 + (4 + strlen(module) + 8) + 4 + 4 + 1;
+  ASSERT_EQ(3, corrupt[startPcOfs]);  // kPc
+  corrupt[startPcOfs] = 0;  // kRaw
+  {
+    ofstream out(file, ios::binary);
+    out.write(corrupt.data(), corrupt.size());
+  }
+  EXPECT_EQ(0, jit.loadTraceCache(file, &loader));
+  EXPECT_EQ(0U, Jit::numFragments());
+
+  // The ADD refers to an instruction after itself.
+  corrupt = data;
+  uint16_t addOt = IRT(IR::kADD, IRT_I64);
+  size_t addOfs = corrupt.find(string((const char *)&addOt, 2));
+  ASSERT_NE(string::npos, addOfs);
+  uint16_t badRef = REF_BIAS + 100;
+  memcpy(&corrupt[addOfs + 2], &badRef, 2);
+  {
+    ofstream out(file, ios::binary);
+    out.write(corrupt.data(), corrupt.size());
+  }
+  EXPECT_EQ(0, jit.loadTraceCache(file, &loader));
+  EXPECT_EQ(0U, Jit::numFragments());
+  EXPECT_EQ(0U, buf->numSnapshots());
+  EXPECT_EQ(emptySize, buf->size());
+
+  // Still good.
+  {
+    ofstream out(file, ios::binary);
+    out.write(data.data(), data.size());
+  }
+  EXPECT_EQ(1, jit.loadTraceCache(file, &loader));
+  remove(file);
+}
+
 TEST_F(TestFragment, DivMod) {
   TRef inp1 = buf->slot(0);
   TRef inp2 = buf->slot(1);
@@ -2239,6 +3570,107 @@ TEST_F(TestFragment, Mul) {
   EXPECT_EQ(0, base[5]);
 }
 
+TEST_F(TestFragment, Double) {
+  TRef x = buf->doubleSlot(0);
+  TRef y = buf->doubleSlot(1);
+  TRef n = buf->slot(2);
+  TRef s = buf->emit(IR::kFADD, IRT_F64, x, y);
+  buf->setSlot(0, s);
+  buf->emit(IR::kFLT, IRT_VOID|IRT_GUARD, x, y);
+  buf->emit(IR::kFNE, IRT_VOID|IRT_GUARD, x, y);
+  TRef p = buf->emit(IR::kFMUL, IRT_F64, s, x);
+  TRef q = buf->emit(IR::kFDIV, IRT_F64, p, y);
+  TRef r = buf->emit(IR::kFSQRT, IRT_F64, q, TRef());
+  TRef nd = buf->emit(IR::kCONV, IRT_F64, n, IRT_I64);
+  TRef t = buf->emit(IR::kFSUB, IRT_F64, r, nd);
+  TRef ti = buf->emit(IR::kCONV, IRT_I64, t, IRT_F64);
+  TRef half = buf->toFloatReg(buf->literal(IRT_F64, doubleToWord(0.5)));
+  TRef u = buf->emit(IR::kFMUL, IRT_F64, t, half);
+  buf->setSlot(0, u);
+  buf->setSlot(1, ti);
+  buf->setSlot(2, nd);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  Assemble();
+
+  Word *base = T->base();
+  base[0] = doubleToWord(1.0);
+  base[1] = doubleToWord(3.0);
+  base[2] = 2;
+  Run();
+  double t_expected = sqrt(4.0 * 1.0 / 3.0) - 2.0;
+  EXPECT_EQ(t_expected * 0.5, wordToDouble(base[0]));
+  EXPECT_EQ((Word)(WordInt)t_expected, base[1]);
+  EXPECT_EQ(2.0, wordToDouble(base[2]));
+
+  // Exits at the first guard, the sum is restored from an XMM
+  // register.
+  base[0] = doubleToWord(5.0);
+  base[1] = doubleToWord(3.0);
+  base[2] = 2;
+  Run();
+  EXPECT_EQ(8.0, wordToDouble(base[0]));
+  EXPECT_EQ(3.0, wordToDouble(base[1]));
+  EXPECT_EQ((Word)2, base[2]);
+
+  base[0] = doubleToWord(NAN);
+  base[1] = doubleToWord(3.0);
+  Run();
+  EXPECT_TRUE(isnan(wordToDouble(base[0])));
+}
+
+TEST_F(TestFragment, ExitHandler) {
+  // Exit handlers are compiled by the JIT of the exiting thread's
+  // capability.  Keep the exit from becoming hot.
+  Jit *capjit = cap.jit();
+  capjit->setOption(Jit::kOptCompiledExits, true);
+  Snapshot::setHotExitThreshold(1000);
+  IRBuffer *b = capjit->buffer();
+  b->reset(&stack[10], &stack[18]);
+  TRef x = b->slot(0);
+  TRef d = b->doubleSlot(1);
+  TRef k5 = b->literal(IRT_I64, 5);
+  TRef big = b->literal(IRT_I64, 0x123456789LL);
+  TRef y = b->emit(IR::kADD, IRT_I64, x, k5);
+  TRef e = b->emit(IR::kFADD, IRT_F64, d, d);
+  b->setSlot(0, y);
+  b->setSlot(1, e);
+  b->setSlot(2, k5);
+  b->setSlot(3, big);
+  b->emit(IR::kLT, IRT_VOID|IRT_GUARD, x, k5);
+  b->setSlot(0, b->emit(IR::kADD, IRT_I64, y, k5));
+  b->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+  capjit->assembler()->assemble(b, capjit->mcode());
+  F = capjit->saveFragment();
+  Jit::registerFragment(NULL, F, false);
+  Snapshot::setHotExitThreshold(HOT_SIDE_EXIT_THRESHOLD);
+
+  uint64_t handlers = exit_handlers;
+  Word *base = T->base();
+  Word heap[4];
+  for (int i = 0; i < EXIT_HANDLER_THRESHOLD + 3; ++i) {
+    base[0] = 10 + i;
+    base[1] = doubleToWord(1.5);
+    base[2] = base[3] = 0;
+    asmEnter(F->traceId(), T, &heap[1], &heap[4], T->stackLimit(),
+             F->entry());
+    EXPECT_EQ((Word)(15 + i), base[0]);
+    EXPECT_EQ(3.0, wordToDouble(base[1]));
+    EXPECT_EQ((Word)5, base[2]);
+    EXPECT_EQ((Word)0x123456789LL, base[3]);
+    EXPECT_EQ(base, T->base());
+    EXPECT_EQ(base + F->snap(0).framesize(), T->top());
+    EXPECT_EQ(&heap[1], cap.traceExitHp());
+  }
+  EXPECT_EQ(handlers + 1, exit_handlers);
+
+  // The trace itself is unchanged.
+  base[0] = 1;
+  asmEnter(F->traceId(), T, &heap[1], &heap[4], T->stackLimit(),
+           F->entry());
+  EXPECT_EQ((Word)11, base[0]);
+}
+
 TEST_F(TestFragment, Alloc1) {
   TRef itbl = buf->literal(IRT_INFO, 0x123456783);
   TRef lit1 = buf->literal(IRT_I64, 5);
@@ -2383,6 +3815,116 @@ TEST_F(TestFragment, Alloc3) {
   EXPECT_EQ(37 + 7, heap[5]);
 }
 
+TEST_F(TestFragment, SinkAlloc) {
+  TRef itbl = buf->literal(IRT_INFO, 0x123456783);
+  TRef one = buf->literal(IRT_I64, 1);
+  TRef zero = buf->literal(IRT_I64, 0);
+  TRef x = buf->slot(0);
+  TRef y = buf->slot(1);
+  buf->emitHeapCheck(7);
+  IRBuffer::HeapEntry he = 0;
+  TRef box = buf->emitNEW(itbl, 1, &he);
+  buf->setField(he, 0, x);
+  TRef pair = buf->emitNEW(itbl, 2, &he);
+  buf->setField(he, 0, box);
+  buf->setField(he, 1, y);
+  TRef x1 = buf->emit(IR::kADD, IRT_I64, x, one);
+  buf->setSlot(0, x1);
+  buf->setSlot(2, pair);
+  buf->emit(IR::kGT, IRT_VOID|IRT_GUARD, y, zero);
+  // Only `kept` escapes.
+  TRef kept = buf->emitNEW(itbl, 1, &he);
+  buf->setField(he, 0, x1);
+  buf->setSlot(2, zero);
+  buf->setSlot(3, kept);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  EXPECT_EQ(2, buf->optSink());
+  EXPECT_TRUE(buf->ir(box)->isSunk());
+  EXPECT_TRUE(buf->ir(pair)->isSunk());
+  EXPECT_FALSE(buf->ir(kept)->isSunk());
+
+  Assemble();
+
+  Word heap[10];
+
+  // Run 1: Only `kept` is allocated.
+  memset(heap, 0, sizeof(heap));
+  Word *base = T->base();
+  base[0] = 3;
+  base[1] = 1;
+  RunWithHeap(&heap[0], &heap[10]);
+  EXPECT_EQ(&heap[2], cap.traceExitHp());
+  EXPECT_EQ(4, base[0]);
+  EXPECT_EQ(0, base[2]);
+  EXPECT_EQ((Word)&heap[0], base[3]);
+  EXPECT_EQ(0x123456783, heap[0]);
+  EXPECT_EQ(4, heap[1]);
+  EXPECT_EQ(0, heap[2]);
+
+  // Run 2: The guard fails and the exit handler constructs the sunk
+  // objects after the space reserved by the trace.
+  memset(heap, 0, sizeof(heap));
+  base = T->base();
+  base[0] = 3;
+  base[1] = 0;
+  base[3] = 0;
+  RunWithHeap(&heap[0], &heap[10]);
+  EXPECT_EQ(&heap[7], cap.traceExitHp());
+  EXPECT_EQ(4, base[0]);
+  EXPECT_EQ((Word)&heap[2], base[2]);
+  EXPECT_EQ(0, base[3]);
+  EXPECT_EQ(0x123456783, heap[2]);
+  EXPECT_EQ((Word)&heap[5], heap[3]);
+  EXPECT_EQ(0, heap[4]);
+  EXPECT_EQ(0x123456783, heap[5]);
+  EXPECT_EQ(3, heap[6]);
+}
+
+TEST_F(TestFragment, SinkAllocDeadCode) {
+  TRef itbl = buf->literal(IRT_INFO, 0x123456783);
+  TRef one = buf->literal(IRT_I64, 1);
+  TRef x = buf->slot(0);
+  buf->emitHeapCheck(6);
+  IRBuffer::HeapEntry he = 0;
+  TRef kept1 = buf->emitNEW(itbl, 1, &he);
+  buf->setField(he, 0, x);
+  // Boxed and immediately unboxed again.  Not mentioned by any
+  // snapshot, so it is sunk and then dead.
+  TRef box = buf->emitNEW(itbl, 1, &he);
+  buf->setField(he, 0, x);
+  TRef ref = buf->emit(IR::kFREF, IRT_PTR, box, 1);
+  TRef unboxed = buf->emit(IR::kFLOAD, IRT_I64, ref, 0);
+  TRef y = buf->emit(IR::kADD, IRT_I64, unboxed, one);
+  TRef kept2 = buf->emitNEW(itbl, 1, &he);
+  buf->setField(he, 0, y);
+  buf->setSlot(0, kept1);
+  buf->setSlot(1, kept2);
+  buf->emit(IR::kSAVE, IRT_VOID|IRT_GUARD, 0, 0);
+
+  EXPECT_EQ(1, buf->optSink());
+  EXPECT_TRUE(buf->ir(box)->isSunk());
+  buf->optDCE();
+  EXPECT_EQ(IR::kNEW, buf->ir(box)->opcode());
+  EXPECT_TRUE(buf->ir(box)->isSunk());
+
+  Assemble();
+
+  Word heap[8];
+  memset(heap, 0, sizeof(heap));
+  Word *base = T->base();
+  base[0] = 3;
+  RunWithHeap(&heap[0], &heap[8]);
+  EXPECT_EQ(&heap[4], cap.traceExitHp());
+  EXPECT_EQ((Word)&heap[0], base[0]);
+  EXPECT_EQ((Word)&heap[2], base[1]);
+  EXPECT_EQ(0x123456783, heap[0]);
+  EXPECT_EQ(3, heap[1]);
+  EXPECT_EQ(0x123456783, heap[2]);
+  EXPECT_EQ(4, heap[3]);
+  EXPECT_EQ(0, heap[4]);
+}
+
 TEST(CallStackTest, Simple1) {
   CallStack cs;
   cs.reset();
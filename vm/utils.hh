@@ -3,6 +3,8 @@
 
 #include "common.hh"
 
+#include <string.h>
+
 _START_LAMBDACHINE_NAMESPACE
 
 template <typename A> inline bool within(A low, A high, A value) {
@@ -43,6 +45,23 @@ inline bool isWordAligned(char *ptr) {
   return isAlignedAtPowerOf2(LC_ARCH_BYTES_LOG2, ptr);
 }
 
+/**
+ * A Double# is stored in a stack slot or object field as its bit
+ * pattern.  These convert between the two representations.
+ */
+inline double wordToDouble(Word w) {
+  LC_STATIC_ASSERT(sizeof(double) == sizeof(Word));
+  double d;
+  memcpy(&d, &w, sizeof(d));
+  return d;
+}
+
+inline Word doubleToWord(double d) {
+  Word w;
+  memcpy(&w, &d, sizeof(w));
+  return w;
+}
+
 _END_LAMBDACHINE_NAMESPACE
 
 #endif /* _UTILS_H_ */